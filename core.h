@@ -13,6 +13,13 @@
 #include <string.h>
 #include <math.h>
 
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+
 #ifdef SDL_IMPLEMENTATION
     #include <SDL3/SDL.h>
     #ifdef IMGUI_IMPLEMENTATION
@@ -28,6 +35,14 @@
     #include <X11/Xlib.h>
     #include <X11/Xutil.h>
     #include <unistd.h>
+    #include <pthread.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
 #endif
 
 #define PI 3.14159265358979323846f
@@ -43,6 +58,13 @@ extern "C" {
 #endif
 #define LOG(x) do { fprintf(stderr, "%s\n", x); } while(0)
 
+// Filter used when the buffer is presented at a different size than the window
+typedef enum {
+    SCALE_NEAREST = 0,
+    SCALE_BILINEAR,
+    SCALE_SHARP_BILINEAR,   // Integer nearest upscale, then bilinear for the fractional rest
+} ScaleMode;
+
 typedef struct WindowHandle {
 #ifdef SDL_IMPLEMENTATION
     SDL_Window   *window;
@@ -53,6 +75,10 @@ typedef struct WindowHandle {
     XImage  *image;
     int      screen;
     GC       gc;
+    XImage  *present_image; // Window-sized surface when the buffer is scaled
+    uint32_t *present;
+    int      pWidth, pHeight;
+    size_t   present_capacity;
 #endif
 
     int width;
@@ -68,9 +94,19 @@ typedef struct WindowHandle {
 
     bool buffer_valid;
     size_t buffer_size;
+    size_t buffer_capacity; // Allocated bytes (>= buffer_size, see bufferReserve)
     bool resized;
+    double resize_debounce; // Seconds a new window size must hold before buffers follow it
+    bool resize_pending;
+    struct timespec resize_time;
     bool vsync;
     bool skip_renderer;
+    float render_scale;     // > 0: buffer = window size * scale (see setRenderScale), 0: set bWidth/bHeight yourself
+    ScaleMode scale_mode;
+
+    // Called by updateFramebuffer with the finished frame (e.g. video recording)
+    void (*on_present)(const struct WindowHandle *w, void *user);
+    void *present_user;
 } Window_t;
 
 typedef struct Camera Camera;
@@ -126,6 +162,69 @@ void drawPixel(const Window_t *w, int x, int y, uint32_t color);
  */
 void setVSync(Window_t *w, bool enable);
 
+// Render at a fraction of the window size; updateFramebuffer scales up with w->scale_mode
+/*  -> Example:
+ *  win.scale_mode = SCALE_SHARP_BILINEAR;
+ *  setRenderScale(&win, 0.5f); // 4x fewer pixels to shade
+ */
+void setRenderScale(Window_t *w, float scale);
+
+// Resample a 0xAARRGGBB buffer (pitches in pixels), multithreaded on the job pool
+/*  -> Example:
+ *  scaleBuffer(win.buffer, win.bWidth, win.bHeight, win.bWidth, out, 1920, 1080, 1920, SCALE_BILINEAR);
+ */
+void scaleBuffer(const uint32_t *src, int sw, int sh, int spitch,
+                 uint32_t *dst, int dw, int dh, int dpitch, ScaleMode mode);
+
+// SIMD code path used by the CPU drawing/rasterization helpers
+typedef enum {
+    CPU_SIMD_SCALAR = 0,
+    CPU_SIMD_SSE,
+    CPU_SIMD_AVX2,
+    CPU_SIMD_COUNT
+} CpuSimdLevel;
+
+// Select SIMD path for CPU rendering (clamped to what the build was compiled with)
+/*  -> Example:
+ *  cpuSetSimdLevel(CPU_SIMD_SCALAR); // force reference path
+ */
+void cpuSetSimdLevel(CpuSimdLevel level);
+
+// Get active SIMD path
+/*  -> Example:
+ *  if (cpuGetSimdLevel() >= CPU_SIMD_AVX2) { ... }
+ */
+CpuSimdLevel cpuGetSimdLevel(void);
+
+// Set worker thread count for parallel CPU paths (0 = one per core, 1 = single threaded)
+/*  -> Example:
+ *  cpuSetThreadCount(1);
+ */
+void cpuSetThreadCount(int count);
+
+// Get resolved worker thread count (always >= 1)
+/*  -> Example:
+ *  int threads = cpuGetThreadCount();
+ */
+int cpuGetThreadCount(void);
+
+// Job callback, called once per index by jobParallelFor
+typedef void (*JobFn)(void *user, int index);
+
+// Run fn(user, 0..count-1) on the worker pool and wait for completion.
+// The calling thread helps; nested calls from inside a job run serially.
+// Drive it from one thread (usually the render loop).
+/*  -> Example:
+ *  jobParallelFor(num_bands, shade_band, &ctx);
+ */
+void jobParallelFor(int count, JobFn fn, void *user);
+
+// Stop and join pool worker threads (they are restarted on demand)
+/*  -> Example:
+ *  jobShutdown();
+ */
+void jobShutdown(void);
+
 #ifdef SDL_IMPLEMENTATION
 typedef struct {
     SDL_GPUDevice *device;
@@ -344,6 +443,24 @@ bool resizeBuffer(Window_t *w);
  */
 void freeBuffer(Window_t *w);
 
+// Reserve buffer memory for up to max_w x max_h so later resizeBuffer calls within it don't reallocate
+/*  -> Example:
+ *  bufferReserve(&win, win.width, win.height);
+ */
+bool bufferReserve(Window_t *w, int max_w, int max_h);
+
+// Match the scaled present surface to the window size (X11; called by resizeBuffer and pollEvents)
+/*  -> Example:
+ *  resizePresent(&win);
+ */
+void resizePresent(Window_t *w);
+
+// Record the window size; once it has held for resize_debounce, follow it and set w->resized (called by pollEvents)
+/*  -> Example:
+ *  bufferTrackResize(&win, new_width, new_height);
+ */
+void bufferTrackResize(Window_t *w, int width, int height);
+
 #ifdef SDL_IMPLEMENTATION
 // Update framebuffer texture from buffer
 /*  -> Example:
@@ -368,6 +485,84 @@ bool updateFramebuffer(const Window_t *w);
 
 #ifdef CORE_IMPLEMENTATION
 
+// Allocation size for a request: 25% headroom, whole pages, so drags and small growth reuse memory
+static inline size_t _coreGrowCapacity(const size_t size)
+{
+    return (size + size / 4 + 4095) & ~(size_t)4095;
+}
+
+#ifndef SDL_IMPLEMENTATION
+// Point an XImage at data; when the memory is unchanged only the header is updated
+static inline bool _coreFitImage(const Window_t *w, XImage **img, uint32_t *data, const int width, const int height)
+{
+    if (*img && (*img)->data == (char*)data) {
+        (*img)->width = width;
+        (*img)->height = height;
+        (*img)->bytes_per_line = width * ((*img)->bits_per_pixel / 8);
+        return true;
+    }
+    if (*img) {
+        (*img)->data = NULL; // pixels are owned by Window_t, not the XImage
+        XDestroyImage(*img);
+        *img = NULL;
+    }
+    if (!w->display) return true;
+
+    *img = XCreateImage(
+        w->display,
+        DefaultVisual(w->display, w->screen),
+        DefaultDepth(w->display, w->screen),
+        ZPixmap, 0, (char*)data,
+        width, height, 32, 0
+    );
+    return *img != NULL;
+}
+
+static inline void _coreFreePresent(Window_t *w)
+{
+    if (w->present_image) {
+        w->present_image->data = NULL;
+        XDestroyImage(w->present_image);
+        w->present_image = NULL;
+    }
+    free(w->present);
+    w->present = NULL;
+    w->pWidth  = 0;
+    w->pHeight = 0;
+    w->present_capacity = 0;
+}
+
+inline void resizePresent(Window_t *w)
+{
+    if (!w->display || !w->buffer_valid || w->width <= 0 || w->height <= 0 ||
+        (w->width == w->bWidth && w->height == w->bHeight)) {
+        _coreFreePresent(w);
+        return;
+    }
+    if (w->present_image && w->pWidth == w->width && w->pHeight == w->height) return;
+
+    const size_t sz = (size_t)w->width * w->height * sizeof(uint32_t);
+    if (sz > w->present_capacity) {
+        _coreFreePresent(w);
+        const size_t cap = _coreGrowCapacity(sz);
+        w->present = (uint32_t*)malloc(cap);
+        if (!w->present) return;
+        w->present_capacity = cap;
+    }
+    if (!_coreFitImage(w, &w->present_image, w->present, w->width, w->height)) {
+        _coreFreePresent(w);
+        return;
+    }
+    w->pWidth  = w->width;
+    w->pHeight = w->height;
+}
+#else
+inline void resizePresent(Window_t *w)
+{
+    (void)w; // SDL_RenderTexture scales to the window
+}
+#endif
+
 inline void freeBuffer(Window_t *w)
 {
     if (w->buffer) {
@@ -376,17 +571,25 @@ inline void freeBuffer(Window_t *w)
     }
     w->buffer_valid = false;
     w->buffer_size = 0;
+    w->buffer_capacity = 0;
 }
 
 inline bool resizeBuffer(Window_t *w)
 {
-    if (w->buffer_valid) freeBuffer(w);
-
-    const size_t sz = w->bWidth * w->bHeight * sizeof(uint32_t);
-    w->buffer = (uint32_t*)calloc(1, sz);
-    if (!w->buffer) {
-        fprintf(stderr, "Failed to allocate framebuffer (%dx%d)\n", w->bWidth, w->bHeight);
-        return false;
+    const size_t sz = (size_t)w->bWidth * w->bHeight * sizeof(uint32_t);
+    if (w->buffer && sz <= w->buffer_capacity) {
+        // Fits the reservation: same memory, just cleared
+        memset(w->buffer, 0, sz);
+    }
+    else {
+        if (w->buffer_valid || w->buffer) freeBuffer(w);
+        const size_t cap = _coreGrowCapacity(sz);
+        w->buffer = (uint32_t*)calloc(1, cap);
+        if (!w->buffer) {
+            fprintf(stderr, "Failed to allocate framebuffer (%dx%d)\n", w->bWidth, w->bHeight);
+            return false;
+        }
+        w->buffer_capacity = cap;
     }
 
     w->buffer_size = sz;
@@ -395,20 +598,9 @@ inline bool resizeBuffer(Window_t *w)
 #ifdef SDL_IMPLEMENTATION
     // Texture handled in updateFramebuffer
 #else
-    if (w->image) {
-        XDestroyImage(w->image);
-        w->image = NULL;
-    }
-
-    w->image = XCreateImage(
-        w->display,
-        DefaultVisual(w->display, w->screen),
-        DefaultDepth(w->display, w->screen),
-        ZPixmap, 0, (char*)w->buffer,
-        w->bWidth, w->bHeight, 32, 0
-    );
-
-    if (!w->image) {
+    // Headless (no display connection): buffer only, nothing to present
+    resizePresent(w);
+    if (!_coreFitImage(w, &w->image, w->buffer, w->bWidth, w->bHeight)) {
         fprintf(stderr, "Failed to create XImage\n");
         freeBuffer(w);
         return false;
@@ -418,6 +610,45 @@ inline bool resizeBuffer(Window_t *w)
     return true;
 }
 
+inline bool bufferReserve(Window_t *w, const int max_w, const int max_h)
+{
+    const size_t sz = (size_t)max_w * max_h * sizeof(uint32_t);
+    if (max_w <= 0 || max_h <= 0 || sz <= w->buffer_capacity) return true;
+
+    uint32_t *grown = (uint32_t*)calloc(1, sz);
+    if (!grown) {
+        fprintf(stderr, "Failed to reserve framebuffer (%dx%d)\n", max_w, max_h);
+        return false;
+    }
+    free(w->buffer); // the XImage header is rebuilt by resizeBuffer
+    w->buffer = grown;
+    w->buffer_capacity = sz;
+    return w->buffer_valid ? resizeBuffer(w) : true;
+}
+
+inline void bufferTrackResize(Window_t *w, const int width, const int height)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (width != w->width || height != w->height) {
+        w->width  = width;
+        w->height = height;
+        w->resize_pending = true;
+        w->resize_time = now;
+    }
+    if (!w->resize_pending) return;
+
+    // Wait for the drag to settle instead of reallocating on every intermediate size
+    const double held = (now.tv_sec - w->resize_time.tv_sec) + (now.tv_nsec - w->resize_time.tv_nsec) / 1e9;
+    if (held < w->resize_debounce) return;
+
+    w->resize_pending = false;
+    if (w->render_scale > 0.0f) setRenderScale(w, w->render_scale); // resizes buffer and present surface
+    else resizePresent(w);
+    w->resized = true;
+}
+
 inline void windowInit(Window_t *w)
 {
 #ifdef SDL_IMPLEMENTATION
@@ -429,6 +660,11 @@ inline void windowInit(Window_t *w)
     w->window  = 0;
     w->gc      = 0;
     w->image   = NULL;
+    w->present_image = NULL;
+    w->present = NULL;
+    w->pWidth  = 0;
+    w->pHeight = 0;
+    w->present_capacity = 0;
 #endif
 
     w->width  = 800;
@@ -443,9 +679,16 @@ inline void windowInit(Window_t *w)
     w->deltat = 0.0;
     w->buffer_valid = false;
     w->buffer_size = 0;
+    w->buffer_capacity = 0;
     w->resized = false;
+    w->resize_debounce = 0.05;
+    w->resize_pending = false;
     w->vsync = false;
     w->skip_renderer = false;
+    w->render_scale = 0.0f;
+    w->scale_mode = SCALE_NEAREST;
+    w->on_present = NULL;
+    w->present_user = NULL;
     clock_gettime(CLOCK_MONOTONIC, &w->lastt);
 }
 
@@ -486,6 +729,7 @@ inline bool createWindow(Window_t *w)
         w->renderer = NULL;
     }
 
+    setRenderScale(w, w->render_scale);
     if (!resizeBuffer(w)) {
         SDL_DestroyRenderer(w->renderer);
         SDL_DestroyWindow(w->window);
@@ -535,6 +779,7 @@ inline bool createWindow(Window_t *w)
 
     w->gc = DefaultGC(w->display, w->screen);
 
+    setRenderScale(w, w->render_scale);
     if (!resizeBuffer(w)) {
         XDestroyWindow(w->display, w->window);
         XCloseDisplay(w->display);
@@ -567,8 +812,9 @@ inline void destroyWindow(Window_t *w)
         SDL_QuitSubSystem(SDL_INIT_VIDEO);
     }
 #else
-    if (!w->display) return;
+    if (!w->display) { freeBuffer(w); return; }
 
+    _coreFreePresent(w);
     if (w->image) {
         XDestroyImage(w->image);
         w->image  = NULL;
@@ -696,6 +942,7 @@ inline void updateFrame(Window_t *w)
 inline bool updateFramebuffer(const Window_t *w, SDL_Texture *texture)
 {
     if (!w->renderer || !w->buffer_valid || !texture) return false;
+    if (w->on_present) w->on_present(w, w->present_user);
 
     void* pixels; int pitch;
     if (!SDL_LockTexture(texture, NULL, &pixels, &pitch)) {
@@ -710,6 +957,8 @@ inline bool updateFramebuffer(const Window_t *w, SDL_Texture *texture)
 
     memcpy(pixels, w->buffer, w->buffer_size);
     SDL_UnlockTexture(texture);
+    // The renderer stretches the texture to the window; sharp bilinear falls back to linear here
+    SDL_SetTextureScaleMode(texture, w->scale_mode == SCALE_NEAREST ? SDL_SCALEMODE_NEAREST : SDL_SCALEMODE_LINEAR);
     SDL_RenderClear(w->renderer);
     SDL_RenderTexture(w->renderer, texture, NULL, NULL);
     return true;
@@ -717,10 +966,20 @@ inline bool updateFramebuffer(const Window_t *w, SDL_Texture *texture)
 #else
 inline bool updateFramebuffer(const Window_t *w)
 {
-    if (!w->buffer_valid || !w->image) return false;
-
-    XPutImage(w->display, w->window, w->gc, w->image,
-              0, 0, 0, 0, w->bWidth, w->bHeight);
+    if (!w->buffer_valid) return false;
+    if (w->on_present) w->on_present(w, w->present_user);
+    if (!w->image) return false;
+
+    if (w->present_image) {
+        scaleBuffer(w->buffer, w->bWidth, w->bHeight, w->bWidth,
+                    w->present, w->pWidth, w->pHeight, w->pWidth, w->scale_mode);
+        XPutImage(w->display, w->window, w->gc, w->present_image,
+                  0, 0, 0, 0, w->pWidth, w->pHeight);
+    }
+    else {
+        XPutImage(w->display, w->window, w->gc, w->image,
+                  0, 0, 0, 0, w->bWidth, w->bHeight);
+    }
     XFlush(w->display);
     return true;
 }
@@ -758,6 +1017,378 @@ inline void setVSync(Window_t *w, bool enable)
 #endif
 }
 
+#if defined(__AVX2__)
+    #define _CPU_SIMD_MAX CPU_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64)
+    #define _CPU_SIMD_MAX CPU_SIMD_SSE
+#else
+    #define _CPU_SIMD_MAX CPU_SIMD_SCALAR
+#endif
+
+static CpuSimdLevel _cpu_simd_level   = _CPU_SIMD_MAX;
+static int          _cpu_thread_count = 0;
+
+inline void cpuSetSimdLevel(CpuSimdLevel level)
+{
+    if (level < CPU_SIMD_SCALAR) level = CPU_SIMD_SCALAR;
+    if (level > _CPU_SIMD_MAX)   level = _CPU_SIMD_MAX;
+    _cpu_simd_level = level;
+}
+
+inline CpuSimdLevel cpuGetSimdLevel(void)
+{
+    return _cpu_simd_level;
+}
+
+inline void cpuSetThreadCount(int count)
+{
+    _cpu_thread_count = count < 0 ? 0 : count;
+}
+
+inline int cpuGetThreadCount(void)
+{
+    if (_cpu_thread_count > 0) return _cpu_thread_count;
+#ifdef SDL_IMPLEMENTATION
+    const int n = SDL_GetNumLogicalCPUCores();
+#else
+    const int n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return n > 0 ? n : 1;
+}
+
+// Minimal thread/mutex/condition wrappers over SDL or pthreads
+#ifdef SDL_IMPLEMENTATION
+typedef SDL_Thread    *_CoreThread;
+typedef SDL_Mutex     *_CoreMutex;
+typedef SDL_Condition *_CoreCond;
+#define _CORE_THREAD_RET    int
+#define _CORE_THREAD_RETURN 0
+
+static inline void _coreMutexInit(_CoreMutex *m)   { *m = SDL_CreateMutex(); }
+static inline void _coreMutexFree(_CoreMutex *m)   { SDL_DestroyMutex(*m); }
+static inline void _coreLock(_CoreMutex *m)        { SDL_LockMutex(*m); }
+static inline void _coreUnlock(_CoreMutex *m)      { SDL_UnlockMutex(*m); }
+static inline void _coreCondInit(_CoreCond *c)     { *c = SDL_CreateCondition(); }
+static inline void _coreCondFree(_CoreCond *c)     { SDL_DestroyCondition(*c); }
+static inline void _coreCondWait(_CoreCond *c, _CoreMutex *m) { SDL_WaitCondition(*c, *m); }
+static inline void _coreCondSignal(_CoreCond *c)   { SDL_SignalCondition(*c); }
+static inline void _coreCondBroadcast(_CoreCond *c){ SDL_BroadcastCondition(*c); }
+static inline bool _coreThreadStart(_CoreThread *t, _CORE_THREAD_RET (*fn)(void*), void *arg)
+{
+    *t = SDL_CreateThread(fn, "wrapper_worker", arg);
+    return *t != NULL;
+}
+static inline void _coreThreadJoin(_CoreThread *t) { SDL_WaitThread(*t, NULL); }
+#else
+typedef pthread_t       _CoreThread;
+typedef pthread_mutex_t _CoreMutex;
+typedef pthread_cond_t  _CoreCond;
+#define _CORE_THREAD_RET    void*
+#define _CORE_THREAD_RETURN NULL
+
+static inline void _coreMutexInit(_CoreMutex *m)   { pthread_mutex_init(m, NULL); }
+static inline void _coreMutexFree(_CoreMutex *m)   { pthread_mutex_destroy(m); }
+static inline void _coreLock(_CoreMutex *m)        { pthread_mutex_lock(m); }
+static inline void _coreUnlock(_CoreMutex *m)      { pthread_mutex_unlock(m); }
+static inline void _coreCondInit(_CoreCond *c)     { pthread_cond_init(c, NULL); }
+static inline void _coreCondFree(_CoreCond *c)     { pthread_cond_destroy(c); }
+static inline void _coreCondWait(_CoreCond *c, _CoreMutex *m) { pthread_cond_wait(c, m); }
+static inline void _coreCondSignal(_CoreCond *c)   { pthread_cond_signal(c); }
+static inline void _coreCondBroadcast(_CoreCond *c){ pthread_cond_broadcast(c); }
+static inline bool _coreThreadStart(_CoreThread *t, _CORE_THREAD_RET (*fn)(void*), void *arg)
+{
+    return pthread_create(t, NULL, fn, arg) == 0;
+}
+static inline void _coreThreadJoin(_CoreThread *t) { pthread_join(*t, NULL); }
+#endif
+
+#define _JOB_MAX_THREADS 64
+
+static struct {
+    _CoreMutex  lock;
+    _CoreCond   wake;
+    _CoreCond   done;
+    _CoreThread threads[_JOB_MAX_THREADS];
+    int         nthreads;
+    int         requested;
+    bool        ready;
+    bool        quit;
+    bool        busy;
+    unsigned    generation;
+    JobFn       fn;
+    void       *user;
+    int         count, next, finished;
+} _job_pool;
+
+// Take and run indices until none are left (called with the lock held, returns with it held)
+static inline void _jobDrain(void)
+{
+    while (_job_pool.next < _job_pool.count) {
+        const int i = _job_pool.next++;
+        JobFn fn = _job_pool.fn;
+        void *user = _job_pool.user;
+        _coreUnlock(&_job_pool.lock);
+        fn(user, i);
+        _coreLock(&_job_pool.lock);
+        if (++_job_pool.finished == _job_pool.count) _coreCondSignal(&_job_pool.done);
+    }
+}
+
+static inline _CORE_THREAD_RET _jobWorker(void *arg)
+{
+    (void)arg;
+    unsigned seen = 0;
+    _coreLock(&_job_pool.lock);
+    for (;;) {
+        while (!_job_pool.quit && _job_pool.generation == seen)
+            _coreCondWait(&_job_pool.wake, &_job_pool.lock);
+        if (_job_pool.quit) break;
+        seen = _job_pool.generation;
+        _jobDrain();
+    }
+    _coreUnlock(&_job_pool.lock);
+    return _CORE_THREAD_RETURN;
+}
+
+inline void jobShutdown(void)
+{
+    if (!_job_pool.ready) return;
+    _coreLock(&_job_pool.lock);
+    _job_pool.quit = true;
+    _coreCondBroadcast(&_job_pool.wake);
+    _coreUnlock(&_job_pool.lock);
+
+    for (int i = 0; i < _job_pool.nthreads; i++) _coreThreadJoin(&_job_pool.threads[i]);
+    _job_pool.nthreads = 0;
+
+    _coreCondFree(&_job_pool.done);
+    _coreCondFree(&_job_pool.wake);
+    _coreMutexFree(&_job_pool.lock);
+    _job_pool.ready = false;
+}
+
+static inline void _jobEnsure(int workers)
+{
+    if (workers > _JOB_MAX_THREADS) workers = _JOB_MAX_THREADS;
+    if (_job_pool.ready && _job_pool.requested == workers) return;
+    jobShutdown();
+
+    _coreMutexInit(&_job_pool.lock);
+    _coreCondInit(&_job_pool.wake);
+    _coreCondInit(&_job_pool.done);
+    _job_pool.quit       = false;
+    _job_pool.busy       = false;
+    _job_pool.generation = 0;
+    _job_pool.count      = 0;
+    _job_pool.next       = 0;
+    _job_pool.finished   = 0;
+    _job_pool.nthreads   = 0;
+    _job_pool.requested  = workers;
+    _job_pool.ready      = true;
+
+    for (int i = 0; i < workers; i++) {
+        if (!_coreThreadStart(&_job_pool.threads[i], _jobWorker, NULL)) {
+            fprintf(stderr, "Failed to start worker thread %d\n", i);
+            break;
+        }
+        _job_pool.nthreads++;
+    }
+}
+
+inline void jobParallelFor(const int count, JobFn fn, void *user)
+{
+    if (count <= 0 || !fn) return;
+
+    const int threads = cpuGetThreadCount();
+    if (threads <= 1 || count == 1 || (_job_pool.ready && _job_pool.busy)) {
+        for (int i = 0; i < count; i++) fn(user, i);
+        return;
+    }
+
+    _jobEnsure(threads - 1);
+
+    _coreLock(&_job_pool.lock);
+    if (_job_pool.busy) {
+        // Another thread (or a job) is using the pool
+        _coreUnlock(&_job_pool.lock);
+        for (int i = 0; i < count; i++) fn(user, i);
+        return;
+    }
+    _job_pool.busy     = true;
+    _job_pool.fn       = fn;
+    _job_pool.user     = user;
+    _job_pool.count    = count;
+    _job_pool.next     = 0;
+    _job_pool.finished = 0;
+    _job_pool.generation++;
+    _coreCondBroadcast(&_job_pool.wake);
+
+    _jobDrain();
+    while (_job_pool.finished < _job_pool.count)
+        _coreCondWait(&_job_pool.done, &_job_pool.lock);
+
+    _job_pool.busy = false;
+    _coreUnlock(&_job_pool.lock);
+}
+
+// Scaled presentation: tap tables shared by every mode (nearest has zero weights)
+#define _SCALE_BAND 32
+
+typedef struct {
+    const uint32_t *src;
+    int sw, sh, spitch;
+    uint32_t *dst;
+    int dw, dh, dpitch;
+    const int32_t *x0, *x1;
+    const uint8_t *xw;
+    const int32_t *y0, *y1;
+    const uint8_t *yw;
+    uint32_t *rows;         // Two scaled source rows per band
+} _ScaleJob;
+
+// Source taps and 8-bit weight per destination pixel. k > 1 is sharp bilinear:
+// bilinear from a virtual k-times nearest-upscaled source, so only texel edges blend
+static inline void _scaleTaps(const int dn, const int sn, const ScaleMode mode, const int k,
+                              int32_t *i0, int32_t *i1, uint8_t *w)
+{
+    const int64_t n = (int64_t)sn * k;
+    for (int d = 0; d < dn; d++) {
+        if (mode == SCALE_NEAREST) {
+            i0[d] = i1[d] = (int32_t)(((int64_t)(2 * d + 1) * sn) / (2 * dn));
+            w[d] = 0;
+            continue;
+        }
+        int64_t u = (int64_t)(2 * d + 1) * n * 256 / (2 * dn) - 128; // sample center, 8 fraction bits
+        if (u < 0) u = 0;
+        const int64_t a = u >> 8, b = a + 1 < n ? a + 1 : n - 1;
+        i0[d] = (int32_t)(a / k);
+        i1[d] = (int32_t)(b / k);
+        w[d]  = i0[d] == i1[d] ? 0 : (uint8_t)(u & 255);
+    }
+}
+
+// Two channels per multiply: (a * (256 - w) + b * w) >> 8 for each byte
+static inline uint32_t _scaleLerp(const uint32_t a, const uint32_t b, const uint32_t w)
+{
+    const uint32_t iw = 256 - w;
+    const uint32_t rb = (((a & 0x00FF00FFu) * iw + (b & 0x00FF00FFu) * w) >> 8) & 0x00FF00FFu;
+    const uint32_t ag = (((a >> 8) & 0x00FF00FFu) * iw + ((b >> 8) & 0x00FF00FFu) * w) & 0xFF00FF00u;
+    return rb | ag;
+}
+
+static inline void _scaleRow(const _ScaleJob *j, const int sy, uint32_t *out)
+{
+    const uint32_t *row = j->src + (size_t)sy * j->spitch;
+    for (int x = 0; x < j->dw; x++)
+        out[x] = j->xw[x] ? _scaleLerp(row[j->x0[x]], row[j->x1[x]], j->xw[x]) : row[j->x0[x]];
+}
+
+static inline void _scaleBlendRows(uint32_t *out, const uint32_t *a, const uint32_t *b, const int n, const uint32_t w)
+{
+    int x = 0;
+#if defined(__AVX2__)
+    if (cpuGetSimdLevel() >= CPU_SIMD_AVX2) {
+        const __m256i z = _mm256_setzero_si256();
+        const __m256i wa = _mm256_set1_epi16((short)(256 - w)), wb = _mm256_set1_epi16((short)w);
+        for (; x + 8 <= n; x += 8) {
+            const __m256i va = _mm256_loadu_si256((const __m256i*)(a + x));
+            const __m256i vb = _mm256_loadu_si256((const __m256i*)(b + x));
+            const __m256i lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(va, z), wa),
+                                                                  _mm256_mullo_epi16(_mm256_unpacklo_epi8(vb, z), wb)), 8);
+            const __m256i hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(va, z), wa),
+                                                                  _mm256_mullo_epi16(_mm256_unpackhi_epi8(vb, z), wb)), 8);
+            _mm256_storeu_si256((__m256i*)(out + x), _mm256_packus_epi16(lo, hi));
+        }
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    if (cpuGetSimdLevel() >= CPU_SIMD_SSE) {
+        const __m128i z = _mm_setzero_si128();
+        const __m128i wa = _mm_set1_epi16((short)(256 - w)), wb = _mm_set1_epi16((short)w);
+        for (; x + 4 <= n; x += 4) {
+            const __m128i va = _mm_loadu_si128((const __m128i*)(a + x));
+            const __m128i vb = _mm_loadu_si128((const __m128i*)(b + x));
+            const __m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, z), wa),
+                                                            _mm_mullo_epi16(_mm_unpacklo_epi8(vb, z), wb)), 8);
+            const __m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, z), wa),
+                                                            _mm_mullo_epi16(_mm_unpackhi_epi8(vb, z), wb)), 8);
+            _mm_storeu_si128((__m128i*)(out + x), _mm_packus_epi16(lo, hi));
+        }
+    }
+#endif
+    for (; x < n; x++) out[x] = _scaleLerp(a[x], b[x], w);
+}
+
+static void _scaleBand(void *user, const int band)
+{
+    const _ScaleJob *j = (const _ScaleJob*)user;
+    const int y_end = (band + 1) * _SCALE_BAND < j->dh ? (band + 1) * _SCALE_BAND : j->dh;
+
+    // Horizontally scaled source rows, reused while consecutive output rows share them
+    uint32_t *r0 = j->rows + (size_t)band * 2 * j->dw, *r1 = r0 + j->dw;
+    int c0 = -1, c1 = -1;
+
+    for (int y = band * _SCALE_BAND; y < y_end; y++) {
+        const int sy0 = j->y0[y], sy1 = j->y1[y];
+        if (c0 != sy0) {
+            if (c1 == sy0) {
+                uint32_t *t = r0; r0 = r1; r1 = t;
+                c1 = c0;
+            }
+            else _scaleRow(j, sy0, r0);
+            c0 = sy0;
+        }
+
+        uint32_t *out = j->dst + (size_t)y * j->dpitch;
+        if (j->yw[y] == 0) {
+            memcpy(out, r0, (size_t)j->dw * sizeof(uint32_t));
+            continue;
+        }
+        if (c1 != sy1) {
+            _scaleRow(j, sy1, r1);
+            c1 = sy1;
+        }
+        _scaleBlendRows(out, r0, r1, j->dw, j->yw[y]);
+    }
+}
+
+inline void scaleBuffer(const uint32_t *src, const int sw, const int sh, const int spitch,
+                        uint32_t *dst, const int dw, const int dh, const int dpitch, const ScaleMode mode)
+{
+    if (!src || !dst || sw <= 0 || sh <= 0 || dw <= 0 || dh <= 0) return;
+
+    int k = 1;
+    if (mode == SCALE_SHARP_BILINEAR) {
+        k = dw / sw < dh / sh ? dw / sw : dh / sh;
+        if (k < 1) k = 1;
+    }
+
+    // One allocation per call: band row scratch, then the tap tables
+    const int bands = (dh + _SCALE_BAND - 1) / _SCALE_BAND;
+    uint32_t *rows = (uint32_t*)malloc((size_t)bands * 2 * dw * sizeof(uint32_t) + ((size_t)dw + dh) * (2 * sizeof(int32_t) + 1));
+    if (!rows) return;
+    int32_t *x0 = (int32_t*)(rows + (size_t)bands * 2 * dw), *x1 = x0 + dw, *y0 = x1 + dw, *y1 = y0 + dh;
+    uint8_t *xw = (uint8_t*)(y1 + dh), *yw = xw + dw;
+    _scaleTaps(dw, sw, mode, k, x0, x1, xw);
+    _scaleTaps(dh, sh, mode, k, y0, y1, yw);
+
+    const _ScaleJob job = { src, sw, sh, spitch, dst, dw, dh, dpitch, x0, x1, xw, y0, y1, yw, rows };
+    jobParallelFor(bands, _scaleBand, (void*)&job);
+    free(rows);
+}
+
+inline void setRenderScale(Window_t *w, const float scale)
+{
+    w->render_scale = scale > 0.0f ? scale : 0.0f;
+    if (w->render_scale <= 0.0f) return;
+
+    const int bw = (int)ceilf((float)w->width  * w->render_scale);
+    const int bh = (int)ceilf((float)w->height * w->render_scale);
+    w->bWidth  = bw > 0 ? bw : 1;
+    w->bHeight = bh > 0 ? bh : 1;
+    if (w->buffer_valid) resizeBuffer(w);
+}
+
 #ifdef SDL_IMPLEMENTATION
 typedef struct {
     Uint8 *code;
@@ -1260,1363 +1891,7892 @@ inline bool gpuRenderFrame(Gpu *gpu, GpuRenderCallback scene_callback, GpuRender
 
 
 // ============================================================================
-// Keyboard and Mouse Input (X11 or SDL3 backend)
+// Images in framebuffer pixel format (0xAARRGGBB)
 // ============================================================================
-#ifndef WRAPPER_KEYS_H
-#define WRAPPER_KEYS_H
+#ifndef WRAPPER_IMAGE_H
+#define WRAPPER_IMAGE_H
+
+#define IMAGE_ALIGNMENT 64
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-typedef enum {
-    KEY_UNKNOWN = 0,
+// Pixel buffer using the same layout as Window_t::buffer
+typedef struct {
+    uint32_t *pixels;   // 0xAARRGGBB
+    int width;
+    int height;
+    int pitch;          // Row stride in pixels (>= width)
+    bool owned;         // false if pixels belong to someone else (see imageWrap)
+} Image;
 
-    KEY_ESCAPE, KEY_SPACE,
-    KEY_ENTER,  KEY_TAB, KEY_BACKSPACE,
+// Allocate a zeroed image with rows aligned to IMAGE_ALIGNMENT bytes
+/*  -> Example:
+ *  Image img;
+ *  ASSERT(imageCreate(&img, 256, 256));
+ */
+bool imageCreate(Image *img, int width, int height);
 
-    KEY_LEFT, KEY_RIGHT,
-    KEY_UP,   KEY_DOWN,
+// Wrap existing pixels without taking ownership (e.g. the window buffer)
+/*  -> Example:
+ *  Image fb;
+ *  imageWrap(&fb, win.buffer, win.bWidth, win.bHeight, win.bWidth);
+ */
+void imageWrap(Image *img, uint32_t *pixels, int width, int height, int pitch);
 
-    KEY_A, KEY_B, KEY_C,
-    KEY_D, KEY_E, KEY_F,
-    KEY_G, KEY_H, KEY_I,
-    KEY_J, KEY_K, KEY_L,
-    KEY_M, KEY_N, KEY_O,
-    KEY_P, KEY_Q, KEY_R,
-    KEY_S, KEY_T, KEY_U,
-    KEY_V, KEY_W, KEY_X,
-    KEY_Y, KEY_Z,
+// Free image pixels (no-op for wrapped images)
+/*  -> Example:
+ *  imageFree(&img);
+ */
+void imageFree(Image *img);
 
-    KEY_NUM0, KEY_NUM1, KEY_NUM2,
-    KEY_NUM3, KEY_NUM4, KEY_NUM5,
-    KEY_NUM6, KEY_NUM7, KEY_NUM8,
-    KEY_NUM9,
+// Decode an in-memory QOI or binary PNM (P5/P6/P7 PAM) image, detected by its magic bytes
+/*  -> Example:
+ *  Image img;
+ *  if (!imageDecode(&img, embedded_qoi, sizeof(embedded_qoi))) { ... }
+ */
+bool imageDecode(Image *img, const void *data, size_t size);
 
-    KEY_LSHIFT, KEY_RSHIFT,
-    KEY_LCTRL,  KEY_RCTRL,
-    KEY_LALT,   KEY_RALT,
+// Load a QOI or binary PNM file (memory-mapped where the platform supports it)
+/*  -> Example:
+ *  Image sheet;
+ *  ASSERT(imageLoad(&sheet, "res/sprites.qoi"));
+ */
+bool imageLoad(Image *img, const char *path);
 
-    KEY_F1, KEY_F2,
-    KEY_F3, KEY_F4,
+// Load binary PNM (P5/P6/P7) file
+/*  -> Example:
+ *  Image img;
+ *  if (!imageLoadPPM(&img, "res/reference.ppm")) { ... }
+ */
+bool imageLoadPPM(Image *img, const char *path);
 
-    KEY_COUNT
-} Key;
+// Save image as binary PPM (P6), alpha is dropped
+/*  -> Example:
+ *  imageSavePPM(&img, "out.ppm");
+ */
+bool imageSavePPM(const Image *img, const char *path);
 
-typedef enum {
-    MOUSE_LEFT = 0,
-    MOUSE_MIDDLE,
-    MOUSE_RIGHT,
-    MOUSE_COUNT
-} MouseButton;
+// Save image as QOI (lossless, keeps alpha)
+/*  -> Example:
+ *  imageSaveQOI(&img, "shot.qoi");
+ */
+bool imageSaveQOI(const Image *img, const char *path);
 
-typedef struct InputState {
-    bool key_curr[KEY_COUNT];
-    bool key_prev[KEY_COUNT];
-    bool mouse_curr[MOUSE_COUNT];
-    bool mouse_prev[MOUSE_COUNT];
-    int mouse_x, mouse_y;
-    int mouse_dx, mouse_dy;
-    int last_x, last_y;
-    bool mouse_grabbed;
-#ifdef SDL_IMPLEMENTATION
-    void *grab_window;
-#else
-    Window grab_window;
+// Save image as PNG; compression 0 (stored) .. 9, alpha is kept unless every pixel is opaque
+/*  -> Example:
+ *  imageSavePNG(&img, "shot.png", 6);
+ */
+bool imageSavePNG(const Image *img, const char *path, int compression);
+
+// Convert straight alpha to premultiplied alpha in place (for blended drawing)
+/*  -> Example:
+ *  imagePremultiply(&sprite_sheet);
+ */
+void imagePremultiply(Image *img);
+
+#ifdef __cplusplus
+}
 #endif
-    int center_x, center_y;
-} Input;
 
-// Initialize input state - call once at startup
-void inputInit(Input *input);
+#ifdef IMAGE_IMPLEMENTATION
 
-// Poll events and update input state - call once per frame BEFORE processing input
-// Returns true if window should close
-// NOTE: This automatically calls updateInput() at the end, so you don't need to call it manually
+static inline void *_imageAlloc(size_t size)
+{
 #ifdef SDL_IMPLEMENTATION
-bool pollEvents(Window_t *win, Input *input);
+    return SDL_aligned_alloc(IMAGE_ALIGNMENT, size);
 #else
-bool pollEvents(Window_t *win, Input *input);
+    void *p = NULL;
+    return posix_memalign(&p, IMAGE_ALIGNMENT, size) == 0 ? p : NULL;
 #endif
+}
 
-// Copy current to previous - ONLY call manually if not using pollEvents
-void updateInput(Input *input);
-
-// This is just the same for everything
-/*
- * if (isKeyDown(&state.input, KEY_W)) cameraMove(&state.cam, state.cam.front, state.move_speed);
- */
-bool isKeyDown(const Input *input, Key key);
-bool isKeyPressed(const Input *input, Key key);
-bool isKeyReleased(const Input *input, Key key);
-bool isMouseDown(const Input *input, MouseButton btn);
-bool isMousePressed(const Input *input, MouseButton btn);
-bool isMouseReleased(const Input *input, MouseButton btn);
-void getMousePosition(const Input *input, int *x, int *y);
-void getMouseDelta(const Input *input, int *dx, int *dy);
-bool isMouseGrabbed(const Input *input);
-
+static inline void _imageDealloc(void *p)
+{
 #ifdef SDL_IMPLEMENTATION
-void grabMouse(SDL_Window *window, int width, int height, Input *input);
-void releaseMouse(SDL_Window *window, Input *input);
+    SDL_aligned_free(p);
 #else
-void grabMouse(Display *display, Window window, int width, int height, Input *input);
-void releaseMouse(Display *display, Window window, Input *input);
+    free(p);
 #endif
-
-#ifdef __cplusplus
 }
-#endif
 
-#ifdef KEYS_IMPLEMENTATION
+inline bool imageCreate(Image *img, const int width, const int height)
+{
+    img->pixels = NULL;
+    img->width  = 0;
+    img->height = 0;
+    img->pitch  = 0;
+    img->owned  = false;
+    if (width <= 0 || height <= 0) return false;
+
+    const int per_line = IMAGE_ALIGNMENT / (int)sizeof(uint32_t);
+    const int pitch = (width + per_line - 1) / per_line * per_line;
+    const size_t sz = (size_t)pitch * (size_t)height * sizeof(uint32_t);
+
+    img->pixels = (uint32_t*)_imageAlloc(sz);
+    if (!img->pixels) {
+        fprintf(stderr, "Failed to allocate image (%dx%d)\n", width, height);
+        return false;
+    }
+    memset(img->pixels, 0, sz);
 
-static void setKey(Input *input, const Key key, const bool down)
+    img->width  = width;
+    img->height = height;
+    img->pitch  = pitch;
+    img->owned  = true;
+    return true;
+}
+
+inline void imageWrap(Image *img, uint32_t *pixels, const int width, const int height, const int pitch)
 {
-    if (key < KEY_COUNT) input->key_curr[key] = down;
+    img->pixels = pixels;
+    img->width  = width;
+    img->height = height;
+    img->pitch  = pitch;
+    img->owned  = false;
 }
 
-static void setMouse(Input *input, const MouseButton btn, const bool down)
+inline void imageFree(Image *img)
 {
-    if (btn < MOUSE_COUNT) input->mouse_curr[btn] = down;
+    if (img->pixels && img->owned) _imageDealloc(img->pixels);
+    img->pixels = NULL;
+    img->width  = 0;
+    img->height = 0;
+    img->pitch  = 0;
+    img->owned  = false;
 }
 
-inline void inputInit(Input *input)
+// Read a file into memory: mmap where available (pages stream in as the decoder walks them), fread otherwise
+static inline const uint8_t *_imageMapFile(const char *path, size_t *size, bool *mapped)
 {
-    for (int i = 0; i < KEY_COUNT; i++) {
-        input->key_curr[i] = false;
-        input->key_prev[i] = false;
+    *size = 0;
+    *mapped = false;
+#if defined(__unix__) || defined(__APPLE__)
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+            close(fd);
+            *size = (size_t)st.st_size;
+            *mapped = true;
+            return (const uint8_t*)p;
+        }
     }
-    for (int i = 0; i < MOUSE_COUNT; i++) {
-        input->mouse_curr[i] = false;
-        input->mouse_prev[i] = false;
+    close(fd);
+#endif
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    const long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = len > 0 ? (uint8_t*)malloc((size_t)len) : NULL;
+    if (data && fread(data, 1, (size_t)len, f) != (size_t)len) {
+        free(data);
+        data = NULL;
     }
-    input->mouse_x = 0;
-    input->mouse_y = 0;
-    input->mouse_dx = 0;
-    input->mouse_dy = 0;
-    input->last_x = 0;
-    input->last_y = 0;
-    input->mouse_grabbed = false;
-    input->grab_window = 0;
-    input->center_x = 400;
-    input->center_y = 300;
+    fclose(f);
+    if (data) *size = (size_t)len;
+    return data;
 }
 
-#ifdef SDL_IMPLEMENTATION
+static inline void _imageUnmapFile(const uint8_t *data, const size_t size, const bool mapped)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    if (mapped) { munmap((void*)data, size); return; }
+#endif
+    (void)size; (void)mapped;
+    free((void*)data);
+}
 
-inline bool pollEvents(Window_t *win, Input *input)
+// Read next PNM header integer, skipping whitespace and '#' comments
+static inline bool _imagePnmInt(const uint8_t **p, const uint8_t *end, int *out)
 {
-    bool shouldClose = false;
+    const uint8_t *s = *p;
+    while (s < end) {
+        if (*s == '#') { while (s < end && *s != '\n') s++; }
+        else if (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') s++;
+        else break;
+    }
+    if (s >= end || *s < '0' || *s > '9') return false;
 
-    input->mouse_dx = 0;
-    input->mouse_dy = 0;
+    int v = 0;
+    while (s < end && *s >= '0' && *s <= '9' && v < 1 << 24) v = v * 10 + (*s++ - '0');
+    if (s >= end) return false;
+    *p = s + 1; // the single whitespace after the value is consumed
+    *out = v;
+    return true;
+}
 
-    // Handle window resize
-    if (win) {
-        int nw, nh;
-        SDL_GetWindowSize(win->window, &nw, &nh);
-        if (nw != win->width || nh != win->height) {
-            win->width = nw;
-            win->height = nh;
-            // Note: bWidth/bHeight should be updated in main.cpp based on RENDER_SCALE
-            win->resized = true;
+// RGB byte triplets -> 0xFFRRGGBB
+static inline void _imageRgbRow(uint32_t *dst, const uint8_t *src, const int n)
+{
+    int x = 0;
+#if defined(__AVX2__)
+    if (cpuGetSimdLevel() >= CPU_SIMD_AVX2) {
+        const __m256i shuf = _mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+                                              2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+        const __m256i alpha = _mm256_set1_epi32((int)0xFF000000u);
+        // Each 16-byte load covers 4 pixels (12 bytes); stop early so the last load stays in bounds
+        for (; x + 11 <= n; x += 8) {
+            const __m256i v = _mm256_setr_m128i(_mm_loadu_si128((const __m128i*)(src + x * 3)),
+                                                _mm_loadu_si128((const __m128i*)(src + x * 3 + 12)));
+            _mm256_storeu_si256((__m256i*)(dst + x), _mm256_or_si256(_mm256_shuffle_epi8(v, shuf), alpha));
         }
     }
-
-    SDL_Event event;
-    while (SDL_PollEvent(&event)) {
-#ifdef IMGUI_IMPLEMENTATION
-        ImGui_ImplSDL3_ProcessEvent(&event);
 #endif
-        switch (event.type) {
-            case SDL_EVENT_QUIT:
-            case SDL_EVENT_WINDOW_CLOSE_REQUESTED:
-                shouldClose = true;
-                break;
+    for (; x < n; x++)
+        dst[x] = 0xFF000000u | ((uint32_t)src[x*3] << 16) | ((uint32_t)src[x*3+1] << 8) | src[x*3+2];
+}
 
-            case SDL_EVENT_MOUSE_MOTION:
-                if (input->mouse_grabbed) {
-                    input->mouse_dx += (int)event.motion.xrel;
-                    input->mouse_dy += (int)event.motion.yrel;
-                }
-                input->mouse_x = (int)event.motion.x;
-                input->mouse_y = (int)event.motion.y;
-                input->last_x  = input->mouse_x;
-                input->last_y  = input->mouse_y;
-                break;
+// P5 (gray), P6 (RGB) and P7 (PAM: GRAYSCALE, GRAYSCALE_ALPHA, RGB, RGB_ALPHA), 8-bit samples
+static inline bool _imageDecodePNM(Image *img, const uint8_t *data, const size_t size)
+{
+    const uint8_t *p = data + 2, *end = data + size;
+    int w = 0, h = 0, depth = 0, maxval = 0;
 
-            case SDL_EVENT_MOUSE_BUTTON_DOWN:
-            case SDL_EVENT_MOUSE_BUTTON_UP: {
-                const bool down = (event.type == SDL_EVENT_MOUSE_BUTTON_DOWN);
-                switch (event.button.button) {
-                    case SDL_BUTTON_LEFT:   setMouse(input, MOUSE_LEFT,   down); break;
-                    case SDL_BUTTON_MIDDLE: setMouse(input, MOUSE_MIDDLE, down); break;
-                    case SDL_BUTTON_RIGHT:  setMouse(input, MOUSE_RIGHT,  down); break;
-                    default: break;
-                }
+    if (data[1] == '5' || data[1] == '6') {
+        depth = data[1] == '5' ? 1 : 3;
+        if (!_imagePnmInt(&p, end, &w) || !_imagePnmInt(&p, end, &h) || !_imagePnmInt(&p, end, &maxval)) return false;
+    }
+    else if (data[1] == '7') {
+        // Header is "KEY value" lines up to ENDHDR; TUPLTYPE is implied by DEPTH
+        while (p < end) {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+            const uint8_t *key = p;
+            while (p < end && *p != ' ' && *p != '\t' && *p != '\n') p++;
+            const size_t len = (size_t)(p - key);
+            if (len == 6 && memcmp(key, "ENDHDR", 6) == 0) {
+                while (p < end && *p != '\n') p++;
+                p++;
                 break;
             }
+            if      (len == 5 && memcmp(key, "WIDTH", 5) == 0)  { if (!_imagePnmInt(&p, end, &w)) return false; }
+            else if (len == 6 && memcmp(key, "HEIGHT", 6) == 0) { if (!_imagePnmInt(&p, end, &h)) return false; }
+            else if (len == 5 && memcmp(key, "DEPTH", 5) == 0)  { if (!_imagePnmInt(&p, end, &depth)) return false; }
+            else if (len == 6 && memcmp(key, "MAXVAL", 6) == 0) { if (!_imagePnmInt(&p, end, &maxval)) return false; }
+            else while (p < end && *p != '\n') p++; // TUPLTYPE, comments
+        }
+    }
+    else return false;
+
+    if (maxval != 255 || depth < 1 || depth > 4 || p > end) return false;
+    if ((size_t)(end - p) / (size_t)depth / (size_t)(w > 0 ? w : 1) < (size_t)h) return false; // truncated
+    if (!imageCreate(img, w, h)) return false;
+
+    const size_t stride = (size_t)w * depth;
+    for (int y = 0; y < h; y++, p += stride) {
+        uint32_t *dst = img->pixels + (size_t)y * img->pitch;
+        switch (depth) {
+            case 3: _imageRgbRow(dst, p, w); break;
+            case 4:
+                for (int x = 0; x < w; x++)
+                    dst[x] = ((uint32_t)p[x*4+3] << 24) | ((uint32_t)p[x*4] << 16) | ((uint32_t)p[x*4+1] << 8) | p[x*4+2];
+                break;
+            case 2:
+                for (int x = 0; x < w; x++)
+                    dst[x] = ((uint32_t)p[x*2+1] << 24) | (p[x*2] * 0x010101u);
+                break;
+            default:
+                for (int x = 0; x < w; x++) dst[x] = 0xFF000000u | (p[x] * 0x010101u);
+                break;
+        }
+    }
+    return true;
+}
 
-            case SDL_EVENT_KEY_DOWN:
-            case SDL_EVENT_KEY_UP: {
-                const bool down = (event.type == SDL_EVENT_KEY_DOWN);
-                const SDL_Keycode sym = event.key.key;
-                Key k = KEY_UNKNOWN;
+static inline uint32_t _imageBE32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
 
-                switch (sym) {
-                    case SDLK_ESCAPE:  k = KEY_ESCAPE; break;
-                    case SDLK_SPACE:   k = KEY_SPACE; break;
-                    case SDLK_RETURN:  k = KEY_ENTER; break;
-                    case SDLK_TAB:     k = KEY_TAB; break;
-                    case SDLK_BACKSPACE: k = KEY_BACKSPACE; break;
+// QOI (https://qoiformat.org), decoded straight into 0xAARRGGBB rows
+static inline bool _imageDecodeQOI(Image *img, const uint8_t *data, const size_t size)
+{
+    if (size < 14 + 8) return false;
+    const uint32_t w = _imageBE32(data + 4), h = _imageBE32(data + 8);
+    if (w == 0 || h == 0 || (uint64_t)w * h > 400000000u || (data[12] != 3 && data[12] != 4)) return false; // spec pixel limit
+    if (!imageCreate(img, (int)w, (int)h)) return false;
+
+    uint32_t index[64] = {0};
+    uint32_t px = 0xFF000000u;
+    int run = 0;
+    const uint8_t *p = data + 14, *end = data + size - 8; // 8 bytes of end padding
+
+    for (uint32_t y = 0; y < h; y++) {
+        uint32_t *dst = img->pixels + (size_t)y * img->pitch;
+        for (uint32_t x = 0; x < w; x++) {
+            if (run > 0) { run--; dst[x] = px; continue; }
+            if (p >= end) { imageFree(img); return false; }
+
+            const uint8_t b1 = *p++;
+            if (b1 == 0xFE) {        // QOI_OP_RGB
+                if (end - p < 3) { imageFree(img); return false; }
+                px = (px & 0xFF000000u) | ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+                p += 3;
+            }
+            else if (b1 == 0xFF) {   // QOI_OP_RGBA
+                if (end - p < 4) { imageFree(img); return false; }
+                px = ((uint32_t)p[3] << 24) | ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+                p += 4;
+            }
+            else switch (b1 >> 6) {
+                case 0:              // QOI_OP_INDEX
+                    px = index[b1];
+                    dst[x] = px;
+                    continue;        // already hashed into this slot
+                case 1: {            // QOI_OP_DIFF
+                    const uint32_t r = ((px >> 16) + ((b1 >> 4) & 3) - 2) & 0xFF;
+                    const uint32_t g = ((px >> 8)  + ((b1 >> 2) & 3) - 2) & 0xFF;
+                    const uint32_t b = ( px        + ( b1       & 3) - 2) & 0xFF;
+                    px = (px & 0xFF000000u) | (r << 16) | (g << 8) | b;
+                    break;
+                }
+                case 2: {            // QOI_OP_LUMA
+                    if (p >= end) { imageFree(img); return false; }
+                    const uint8_t b2 = *p++;
+                    const int vg = (b1 & 0x3F) - 32;
+                    const uint32_t r = ((px >> 16) + vg - 8 + ((b2 >> 4) & 0x0F)) & 0xFF;
+                    const uint32_t g = ((px >> 8)  + vg) & 0xFF;
+                    const uint32_t b = ( px        + vg - 8 + ( b2       & 0x0F)) & 0xFF;
+                    px = (px & 0xFF000000u) | (r << 16) | (g << 8) | b;
+                    break;
+                }
+                default:             // QOI_OP_RUN
+                    run = b1 & 0x3F;
+                    dst[x] = px;
+                    continue;        // px is unchanged, so is its index slot
+            }
 
-                    case SDLK_LEFT:  k = KEY_LEFT; break;
-                    case SDLK_RIGHT: k = KEY_RIGHT; break;
-                    case SDLK_UP:    k = KEY_UP; break;
-                    case SDLK_DOWN:  k = KEY_DOWN; break;
+            const uint32_t r = (px >> 16) & 0xFF, g = (px >> 8) & 0xFF, b = px & 0xFF, a = px >> 24;
+            index[(r * 3 + g * 5 + b * 7 + a * 11) & 63] = px;
+            dst[x] = px;
+        }
+    }
+    return true;
+}
 
-                    case SDLK_A: k = KEY_A; break;
-                    case SDLK_B: k = KEY_B; break;
-                    case SDLK_C: k = KEY_C; break;
-                    case SDLK_D: k = KEY_D; break;
-                    case SDLK_E: k = KEY_E; break;
-                    case SDLK_F: k = KEY_F; break;
-                    case SDLK_G: k = KEY_G; break;
-                    case SDLK_H: k = KEY_H; break;
-                    case SDLK_I: k = KEY_I; break;
-                    case SDLK_J: k = KEY_J; break;
-                    case SDLK_K: k = KEY_K; break;
-                    case SDLK_L: k = KEY_L; break;
-                    case SDLK_M: k = KEY_M; break;
-                    case SDLK_N: k = KEY_N; break;
-                    case SDLK_O: k = KEY_O; break;
-                    case SDLK_P: k = KEY_P; break;
-                    case SDLK_Q: k = KEY_Q; break;
-                    case SDLK_R: k = KEY_R; break;
-                    case SDLK_S: k = KEY_S; break;
-                    case SDLK_T: k = KEY_T; break;
-                    case SDLK_U: k = KEY_U; break;
-                    case SDLK_V: k = KEY_V; break;
-                    case SDLK_W: k = KEY_W; break;
-                    case SDLK_X: k = KEY_X; break;
-                    case SDLK_Y: k = KEY_Y; break;
-                    case SDLK_Z: k = KEY_Z; break;
+inline bool imageDecode(Image *img, const void *data, const size_t size)
+{
+    const uint8_t *d = (const uint8_t*)data;
+    memset(img, 0, sizeof(*img));
+    if (!d || size < 4) return false;
+    if (memcmp(d, "qoif", 4) == 0) return _imageDecodeQOI(img, d, size);
+    if (d[0] == 'P' && d[1] >= '5' && d[1] <= '7') return _imageDecodePNM(img, d, size);
+    return false;
+}
 
-                    case SDLK_0: k = KEY_NUM0; break;
-                    case SDLK_1: k = KEY_NUM1; break;
-                    case SDLK_2: k = KEY_NUM2; break;
-                    case SDLK_3: k = KEY_NUM3; break;
-                    case SDLK_4: k = KEY_NUM4; break;
-                    case SDLK_5: k = KEY_NUM5; break;
-                    case SDLK_6: k = KEY_NUM6; break;
-                    case SDLK_7: k = KEY_NUM7; break;
-                    case SDLK_8: k = KEY_NUM8; break;
-                    case SDLK_9: k = KEY_NUM9; break;
+inline bool imageLoad(Image *img, const char *path)
+{
+    size_t size;
+    bool mapped;
+    const uint8_t *data = _imageMapFile(path, &size, &mapped);
+    memset(img, 0, sizeof(*img));
+    if (!data) {
+        fprintf(stderr, "Failed to open image: %s\n", path);
+        return false;
+    }
 
-                    case SDLK_LSHIFT: k = KEY_LSHIFT; break;
-                    case SDLK_RSHIFT: k = KEY_RSHIFT; break;
-                    case SDLK_LCTRL:  k = KEY_LCTRL; break;
-                    case SDLK_RCTRL:  k = KEY_RCTRL; break;
-                    case SDLK_LALT:   k = KEY_LALT; break;
-                    case SDLK_RALT:   k = KEY_RALT; break;
+    const bool ok = imageDecode(img, data, size);
+    _imageUnmapFile(data, size, mapped);
+    if (!ok) fprintf(stderr, "Unsupported or corrupt image: %s\n", path);
+    return ok;
+}
 
-                    case SDLK_F1: k = KEY_F1; break;
-                    case SDLK_F2: k = KEY_F2; break;
-                    case SDLK_F3: k = KEY_F3; break;
-                    case SDLK_F4: k = KEY_F4; break;
+inline bool imageLoadPPM(Image *img, const char *path)
+{
+    size_t size;
+    bool mapped;
+    const uint8_t *data = _imageMapFile(path, &size, &mapped);
+    memset(img, 0, sizeof(*img));
+    if (!data) return false;
+
+    const bool ok = size >= 2 && data[0] == 'P' && _imageDecodePNM(img, data, size);
+    _imageUnmapFile(data, size, mapped);
+    if (!ok) fprintf(stderr, "Unsupported PPM file: %s\n", path);
+    return ok;
+}
 
-                    default: break;
-                }
+inline bool imageSavePPM(const Image *img, const char *path)
+{
+    if (!img->pixels) return false;
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "Failed to open %s for writing\n", path);
+        return false;
+    }
 
-                if (k != KEY_UNKNOWN) setKey(input, k, down);
-                break;
-            }
+    fprintf(f, "P6\n%d %d\n255\n", img->width, img->height);
 
-            default:
-                break;
+    uint8_t *row = (uint8_t*)malloc((size_t)img->width * 3);
+    assert(row && "Failed to allocate PPM row buffer");
+
+    bool ok = true;
+    for (int y = 0; y < img->height && ok; y++) {
+        const uint32_t *src = img->pixels + (size_t)y * img->pitch;
+        for (int x = 0; x < img->width; x++) {
+            row[x*3+0] = (uint8_t)(src[x] >> 16);
+            row[x*3+1] = (uint8_t)(src[x] >> 8);
+            row[x*3+2] = (uint8_t)(src[x]);
         }
+        ok = fwrite(row, 3, (size_t)img->width, f) == (size_t)img->width;
     }
 
-    updateInput(input);
-    return shouldClose;
+    free(row);
+    fclose(f);
+    return ok;
 }
 
-#else // X11 backend
+// Growable byte buffer used by the encoders
+typedef struct {
+    uint8_t *data;
+    size_t size, capacity;
+    uint64_t bits;          // Pending deflate bits (LSB first)
+    int nbits;
+} _ImageBytes;
 
-inline bool pollEvents(Window_t *win, Input *input)
+static inline void _imageBytesReserve(_ImageBytes *b, const size_t extra)
 {
-    const Atom wmDeleteMessage = XInternAtom(win->display, "WM_DELETE_WINDOW", False);
-    bool shouldClose = false;
+    if (b->size + extra <= b->capacity) return;
+    size_t cap = b->capacity ? b->capacity : 4096;
+    while (cap < b->size + extra) cap *= 2;
+    b->data = (uint8_t*)realloc(b->data, cap);
+    assert(b->data && "Failed to grow encoder buffer");
+    b->capacity = cap;
+}
 
-    input->mouse_dx = 0;
-    input->mouse_dy = 0;
+static inline void _imageBytesPut(_ImageBytes *b, const void *src, const size_t n)
+{
+    _imageBytesReserve(b, n);
+    memcpy(b->data + b->size, src, n);
+    b->size += n;
+}
 
-    // Handle window resize
-    if (win) {
-        XEvent ev;
-        while (XCheckTypedWindowEvent(win->display, win->window, ConfigureNotify, &ev)) {
-            if (ev.xconfigure.width != win->width || ev.xconfigure.height != win->height) {
-                win->width = ev.xconfigure.width;
-                win->height = ev.xconfigure.height;
-                // Note: bWidth/bHeight should be updated in main.cpp based on RENDER_SCALE
-                win->resized = true;
-            }
-        }
-        XFlush(win->display);
-    }
+static inline void _imageBytesBE32(_ImageBytes *b, const uint32_t v)
+{
+    const uint8_t be[4] = { (uint8_t)(v >> 24), (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v };
+    _imageBytesPut(b, be, 4);
+}
 
-    while (XPending(win->display) > 0)
-    {
-        XEvent event;
-        XNextEvent(win->display, &event);
+static inline bool _imageWriteFile(const char *path, const _ImageBytes *b)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "Failed to open %s for writing\n", path);
+        return false;
+    }
+    const bool ok = fwrite(b->data, 1, b->size, f) == b->size;
+    return fclose(f) == 0 && ok;
+}
 
-        switch (event.type)
-        {
-            case ClientMessage:
-                if ((Atom)event.xclient.data.l[0] == wmDeleteMessage)
-                    shouldClose = true;
-                break;
+inline bool imageSaveQOI(const Image *img, const char *path)
+{
+    if (!img->pixels) return false;
+
+    _ImageBytes out = {NULL, 0, 0, 0, 0};
+    _imageBytesReserve(&out, 14 + (size_t)img->width * img->height * 5 + 8); // worst case, no regrowth
+    _imageBytesPut(&out, "qoif", 4);
+    _imageBytesBE32(&out, (uint32_t)img->width);
+    _imageBytesBE32(&out, (uint32_t)img->height);
+    out.data[out.size++] = 4;   // RGBA
+    out.data[out.size++] = 0;   // sRGB
+
+    uint32_t index[64] = {0};
+    uint32_t prev = 0xFF000000u;
+    int run = 0;
+    uint8_t *o = out.data + out.size;
+
+    for (int y = 0; y < img->height; y++) {
+        const uint32_t *row = img->pixels + (size_t)y * img->pitch;
+        for (int x = 0; x < img->width; x++) {
+            const uint32_t px = row[x];
+            if (px == prev) {
+                if (++run == 62) { *o++ = (uint8_t)(0xC0 | (run - 1)); run = 0; }
+                continue;
+            }
+            if (run > 0) { *o++ = (uint8_t)(0xC0 | (run - 1)); run = 0; }
 
-            case MotionNotify:
-                if (input->mouse_grabbed) {
-                    input->mouse_dx += event.xmotion.x - input->last_x;
-                    input->mouse_dy += event.xmotion.y - input->last_y;
+            const uint32_t r = (px >> 16) & 0xFF, g = (px >> 8) & 0xFF, b = px & 0xFF, a = px >> 24;
+            const uint32_t h = (r * 3 + g * 5 + b * 7 + a * 11) & 63;
+            if (index[h] == px) {
+                *o++ = (uint8_t)h;
+            }
+            else {
+                index[h] = px;
+                if ((px >> 24) == (prev >> 24)) {
+                    const int vr = (int8_t)(r - ((prev >> 16) & 0xFF));
+                    const int vg = (int8_t)(g - ((prev >> 8) & 0xFF));
+                    const int vb = (int8_t)(b - (prev & 0xFF));
+                    const int vg_r = vr - vg, vg_b = vb - vg;
+                    if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                        *o++ = (uint8_t)(0x40 | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+                    }
+                    else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+                        *o++ = (uint8_t)(0x80 | (vg + 32));
+                        *o++ = (uint8_t)((vg_r + 8) << 4 | (vg_b + 8));
+                    }
+                    else {
+                        *o++ = 0xFE; *o++ = (uint8_t)r; *o++ = (uint8_t)g; *o++ = (uint8_t)b;
+                    }
                 }
-                input->mouse_x = event.xmotion.x;
-                input->mouse_y = event.xmotion.y;
-                input->last_x = input->mouse_x;
-                input->last_y = input->mouse_y;
-                break;
-
-            case ButtonPress:
-            case ButtonRelease:
-            {
-                const bool down = (event.type == ButtonPress);
-                switch (event.xbutton.button)
-                {
-                    case Button1: setMouse(input, MOUSE_LEFT, down); break;
-                    case Button2: setMouse(input, MOUSE_MIDDLE, down); break;
-                    case Button3: setMouse(input, MOUSE_RIGHT, down); break;
-                    default: break;
+                else {
+                    *o++ = 0xFF; *o++ = (uint8_t)r; *o++ = (uint8_t)g; *o++ = (uint8_t)b; *o++ = (uint8_t)a;
                 }
-                break;
             }
+            prev = px;
+        }
+    }
+    if (run > 0) *o++ = (uint8_t)(0xC0 | (run - 1));
+    static const uint8_t padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+    memcpy(o, padding, 8);
+    out.size = (size_t)(o + 8 - out.data);
+
+    const bool ok = _imageWriteFile(path, &out);
+    free(out.data);
+    return ok;
+}
 
-            case KeyPress:
-            case KeyRelease:
-            {
-                const bool down = (event.type == KeyPress);
-                const KeySym sym = XLookupKeysym(&event.xkey, 0);
-                Key k = KEY_UNKNOWN;
-
-                switch (sym)
-                {
-                    case XK_Escape: k = KEY_ESCAPE; break;
-                    case XK_space: k = KEY_SPACE; break;
-                    case XK_Return: k = KEY_ENTER; break;
-                    case XK_Tab: k = KEY_TAB; break;
-                    case XK_BackSpace: k = KEY_BACKSPACE; break;
-
-                    case XK_Left: k = KEY_LEFT; break;
-                    case XK_Right: k = KEY_RIGHT; break;
-                    case XK_Up: k = KEY_UP; break;
-                    case XK_Down: k = KEY_DOWN; break;
+// Append bits LSB first (deflate bit order)
+static inline void _imageBits(_ImageBytes *b, const uint32_t value, const int count)
+{
+    b->bits |= (uint64_t)value << b->nbits;
+    b->nbits += count;
+    if (b->nbits >= 32) {
+        _imageBytesReserve(b, 4);
+        for (int i = 0; i < 4; i++) b->data[b->size++] = (uint8_t)(b->bits >> (8 * i));
+        b->bits >>= 32;
+        b->nbits -= 32;
+    }
+}
 
-                    case XK_a: case XK_A: k = KEY_A; break;
-                    case XK_b: case XK_B: k = KEY_B; break;
-                    case XK_c: case XK_C: k = KEY_C; break;
-                    case XK_d: case XK_D: k = KEY_D; break;
-                    case XK_e: case XK_E: k = KEY_E; break;
-                    case XK_f: case XK_F: k = KEY_F; break;
-                    case XK_g: case XK_G: k = KEY_G; break;
-                    case XK_h: case XK_H: k = KEY_H; break;
-                    case XK_i: case XK_I: k = KEY_I; break;
-                    case XK_j: case XK_J: k = KEY_J; break;
-                    case XK_k: case XK_K: k = KEY_K; break;
-                    case XK_l: case XK_L: k = KEY_L; break;
-                    case XK_m: case XK_M: k = KEY_M; break;
-                    case XK_n: case XK_N: k = KEY_N; break;
-                    case XK_o: case XK_O: k = KEY_O; break;
-                    case XK_p: case XK_P: k = KEY_P; break;
-                    case XK_q: case XK_Q: k = KEY_Q; break;
-                    case XK_r: case XK_R: k = KEY_R; break;
-                    case XK_s: case XK_S: k = KEY_S; break;
-                    case XK_t: case XK_T: k = KEY_T; break;
-                    case XK_u: case XK_U: k = KEY_U; break;
-                    case XK_v: case XK_V: k = KEY_V; break;
-                    case XK_w: case XK_W: k = KEY_W; break;
-                    case XK_x: case XK_X: k = KEY_X; break;
-                    case XK_y: case XK_Y: k = KEY_Y; break;
-                    case XK_z: case XK_Z: k = KEY_Z; break;
+// Huffman codes are stored MSB first
+static inline void _imageBitsRev(_ImageBytes *b, const uint32_t code, const int count)
+{
+    uint32_t r = 0;
+    for (int i = 0; i < count; i++) r |= ((code >> i) & 1) << (count - 1 - i);
+    _imageBits(b, r, count);
+}
 
-                    case XK_0: k = KEY_NUM0; break;
-                    case XK_1: k = KEY_NUM1; break;
-                    case XK_2: k = KEY_NUM2; break;
-                    case XK_3: k = KEY_NUM3; break;
-                    case XK_4: k = KEY_NUM4; break;
-                    case XK_5: k = KEY_NUM5; break;
-                    case XK_6: k = KEY_NUM6; break;
-                    case XK_7: k = KEY_NUM7; break;
-                    case XK_8: k = KEY_NUM8; break;
-                    case XK_9: k = KEY_NUM9; break;
+static inline void _imageBitsFlush(_ImageBytes *b)
+{
+    while (b->nbits > 0) {
+        _imageBytesReserve(b, 1);
+        b->data[b->size++] = (uint8_t)b->bits;
+        b->bits >>= 8;
+        b->nbits -= 8;
+    }
+    b->bits = 0;
+    b->nbits = 0;
+}
 
-                    case XK_Shift_L: k = KEY_LSHIFT; break;
-                    case XK_Shift_R: k = KEY_RSHIFT; break;
-                    case XK_Control_L: k = KEY_LCTRL; break;
-                    case XK_Control_R: k = KEY_RCTRL; break;
-                    case XK_Alt_L: k = KEY_LALT; break;
-                    case XK_Alt_R: k = KEY_RALT; break;
+static inline void _imageFixedLiteral(_ImageBytes *b, const int v)
+{
+    if      (v < 144) _imageBitsRev(b, 0x30 + v, 8);
+    else if (v < 256) _imageBitsRev(b, 0x190 + v - 144, 9);
+    else if (v < 280) _imageBitsRev(b, v - 256, 7);
+    else              _imageBitsRev(b, 0xC0 + v - 280, 8);
+}
 
-                    case XK_F1: k = KEY_F1; break;
-                    case XK_F2: k = KEY_F2; break;
-                    case XK_F3: k = KEY_F3; break;
-                    case XK_F4: k = KEY_F4; break;
+static inline void _imageFixedMatch(_ImageBytes *b, const int len, const int dist)
+{
+    static const uint16_t len_base[29]  = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258};
+    static const uint8_t  len_extra[29] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+    static const uint16_t dist_base[30] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,
+                                           1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+    static const uint8_t  dist_extra[30]= {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+
+    int lc = 28;
+    while (len_base[lc] > len) lc--;
+    _imageFixedLiteral(b, 257 + lc);
+    if (len_extra[lc]) _imageBits(b, (uint32_t)(len - len_base[lc]), len_extra[lc]);
+
+    int dc = 29;
+    while (dist_base[dc] > dist) dc--;
+    _imageBitsRev(b, (uint32_t)dc, 5);
+    if (dist_extra[dc]) _imageBits(b, (uint32_t)(dist - dist_base[dc]), dist_extra[dc]);
+}
 
-                    default: break;
+// zlib stream: stored blocks at level 0, otherwise greedy LZ77 (hash chains) with fixed Huffman codes
+static inline void _imageDeflate(_ImageBytes *out, const uint8_t *src, const size_t n, const int level)
+{
+    const uint8_t header[2] = {0x78, 0x01};
+    _imageBytesPut(out, header, 2);
+
+    if (level <= 0) {
+        size_t pos = 0;
+        do {
+            const size_t len = n - pos > 65535 ? 65535 : n - pos;
+            const uint8_t hdr[5] = { (uint8_t)(pos + len == n), (uint8_t)len, (uint8_t)(len >> 8),
+                                     (uint8_t)~len, (uint8_t)(~len >> 8) };
+            _imageBytesPut(out, hdr, 5);
+            _imageBytesPut(out, src + pos, len);
+            pos += len;
+        } while (pos < n);
+    }
+    else {
+        enum { WINDOW = 32768, HASH_BITS = 15 };
+        const int max_chain = level >= 9 ? 256 : 1 << (level - 1 < 7 ? level - 1 : 7);
+        int *head = (int*)malloc(sizeof(int) << HASH_BITS);
+        int *prev = (int*)malloc(sizeof(int) * WINDOW);
+        assert(head && prev && "Failed to allocate deflate tables");
+        memset(head, 0xFF, sizeof(int) << HASH_BITS);
+
+        _imageBits(out, 1, 1);  // BFINAL
+        _imageBits(out, 1, 2);  // fixed Huffman
+        size_t i = 0;
+        while (i < n) {
+            int best_len = 0, best_dist = 0;
+            if (i + 3 <= n) {
+                const uint32_t h = ((uint32_t)src[i] << 16 | (uint32_t)src[i+1] << 8 | src[i+2]) * 2654435761u >> (32 - HASH_BITS);
+                const size_t max_len = n - i < 258 ? n - i : 258;
+                int cand = head[h], chain = max_chain;
+                while (cand >= 0 && i - (size_t)cand <= WINDOW && chain-- > 0) {
+                    if (src[cand + best_len] == src[i + best_len]) {
+                        size_t l = 0;
+                        while (l < max_len && src[cand + l] == src[i + l]) l++;
+                        if ((int)l > best_len) {
+                            best_len = (int)l;
+                            best_dist = (int)(i - (size_t)cand);
+                            if (l == max_len) break;
+                        }
+                    }
+                    cand = prev[cand & (WINDOW - 1)];
                 }
-
-                if (k != KEY_UNKNOWN) setKey(input, k, down);
-                break;
+                prev[i & (WINDOW - 1)] = head[h];
+                head[h] = (int)i;
             }
 
-            default: break;
+            if (best_len >= 3) {
+                _imageFixedMatch(out, best_len, best_dist);
+                // Insert the covered positions so later matches can reference them
+                for (size_t k = i + 1; k < i + (size_t)best_len && k + 3 <= n; k++) {
+                    const uint32_t h = ((uint32_t)src[k] << 16 | (uint32_t)src[k+1] << 8 | src[k+2]) * 2654435761u >> (32 - HASH_BITS);
+                    prev[k & (WINDOW - 1)] = head[h];
+                    head[h] = (int)k;
+                }
+                i += (size_t)best_len;
+            }
+            else {
+                _imageFixedLiteral(out, src[i]);
+                i++;
+            }
         }
+        _imageFixedLiteral(out, 256);
+        _imageBitsFlush(out);
+        free(head);
+        free(prev);
     }
 
-    if (input->mouse_grabbed && (input->mouse_dx != 0 || input->mouse_dy != 0))
-    {
-        XWarpPointer(win->display, None, input->grab_window, 0, 0, 0, 0, input->center_x, input->center_y);
-        XFlush(win->display);
-        input->last_x = input->center_x;
-        input->last_y = input->center_y;
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < n; ) {
+        const size_t end = i + 5552 < n ? i + 5552 : n; // largest run without 32-bit overflow
+        for (; i < end; i++) { a += src[i]; b += a; }
+        a %= 65521;
+        b %= 65521;
     }
+    _imageBytesBE32(out, b << 16 | a);
+}
 
-    updateInput(input);
-    return shouldClose;
+static inline void _imagePngChunk(_ImageBytes *out, const uint32_t *crc_table, const char *type, const uint8_t *data, const size_t n)
+{
+    _imageBytesBE32(out, (uint32_t)n);
+    const size_t start = out->size;
+    _imageBytesPut(out, type, 4);
+    if (n) _imageBytesPut(out, data, n);
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = start; i < out->size; i++) crc = crc_table[(crc ^ out->data[i]) & 0xFF] ^ (crc >> 8);
+    _imageBytesBE32(out, crc ^ 0xFFFFFFFFu);
 }
 
-#endif
+static inline int _imagePaeth(const int a, const int b, const int c)
+{
+    const int p = a + b - c;
+    const int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
 
-inline void updateInput(Input *input)
+inline bool imageSavePNG(const Image *img, const char *path, const int compression)
 {
-    for (int i = 0; i < KEY_COUNT; i++)
-        input->key_prev[i] = input->key_curr[i];
-    for (int i = 0; i < MOUSE_COUNT; i++)
-        input->mouse_prev[i] = input->mouse_curr[i];
+    if (!img->pixels) return false;
+    const int level = compression < 0 ? 0 : compression > 9 ? 9 : compression;
+
+    bool opaque = true;
+    for (int y = 0; y < img->height && opaque; y++) {
+        const uint32_t *row = img->pixels + (size_t)y * img->pitch;
+        for (int x = 0; x < img->width; x++) if ((row[x] >> 24) != 0xFF) { opaque = false; break; }
+    }
+    const int bpp = opaque ? 3 : 4;
+    const size_t stride = (size_t)img->width * bpp;
+
+    // Filtered scanlines; with compression on, pick the filter with the smallest absolute sum per row
+    uint8_t *raw = (uint8_t*)malloc((stride + 1) * img->height + stride * 2 + stride);
+    assert(raw && "Failed to allocate PNG scanlines");
+    uint8_t *cur = raw + (stride + 1) * img->height, *up = cur + stride, *trial = up + stride;
+    memset(up, 0, stride);
+
+    for (int y = 0; y < img->height; y++) {
+        const uint32_t *row = img->pixels + (size_t)y * img->pitch;
+        for (int x = 0; x < img->width; x++) {
+            uint8_t *p = cur + (size_t)x * bpp;
+            p[0] = (uint8_t)(row[x] >> 16);
+            p[1] = (uint8_t)(row[x] >> 8);
+            p[2] = (uint8_t)row[x];
+            if (bpp == 4) p[3] = (uint8_t)(row[x] >> 24);
+        }
+
+        uint8_t *line = raw + (size_t)y * (stride + 1);
+        line[0] = 0;
+        memcpy(line + 1, cur, stride);
+        if (level > 0) {
+            uint32_t best = 0;
+            for (size_t i = 0; i < stride; i++) best += cur[i] < 128 ? cur[i] : 256 - cur[i];
+            for (int f = 1; f <= 4; f++) {
+                uint32_t sum = 0;
+                for (size_t i = 0; i < stride; i++) {
+                    const int a = i >= (size_t)bpp ? cur[i - bpp] : 0, b = up[i], c = i >= (size_t)bpp ? up[i - bpp] : 0;
+                    const int pred = f == 1 ? a : f == 2 ? b : f == 3 ? (a + b) >> 1 : _imagePaeth(a, b, c);
+                    trial[i] = (uint8_t)(cur[i] - pred);
+                    sum += trial[i] < 128 ? trial[i] : 256 - trial[i];
+                }
+                if (sum < best) {
+                    best = sum;
+                    line[0] = (uint8_t)f;
+                    memcpy(line + 1, trial, stride);
+                }
+            }
+        }
+        uint8_t *t = up; up = cur; cur = t;
+    }
+
+    uint32_t crc_table[256];
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+
+    _ImageBytes out = {NULL, 0, 0, 0, 0}, z = {NULL, 0, 0, 0, 0};
+    _imageDeflate(&z, raw, (stride + 1) * img->height, level);
+    free(raw);
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    _imageBytesPut(&out, signature, 8);
+    const uint8_t ihdr[13] = {
+        (uint8_t)(img->width >> 24), (uint8_t)(img->width >> 16), (uint8_t)(img->width >> 8), (uint8_t)img->width,
+        (uint8_t)(img->height >> 24), (uint8_t)(img->height >> 16), (uint8_t)(img->height >> 8), (uint8_t)img->height,
+        8, (uint8_t)(opaque ? 2 : 6), 0, 0, 0,
+    };
+    _imagePngChunk(&out, crc_table, "IHDR", ihdr, sizeof(ihdr));
+    _imagePngChunk(&out, crc_table, "IDAT", z.data, z.size);
+    _imagePngChunk(&out, crc_table, "IEND", NULL, 0);
+    free(z.data);
+
+    const bool ok = _imageWriteFile(path, &out);
+    free(out.data);
+    return ok;
 }
 
-inline bool isKeyDown(const Input *input, const Key key)
+inline void imagePremultiply(Image *img)
 {
-    return key < KEY_COUNT ? input->key_curr[key] : false;
+    for (int y = 0; y < img->height; y++) {
+        uint32_t *p = img->pixels + (size_t)y * img->pitch;
+        for (int x = 0; x < img->width; x++) {
+            const uint32_t a = p[x] >> 24;
+            if (a == 255) continue;
+            const uint32_t r = (((p[x] >> 16) & 0xFF) * a + 127) / 255;
+            const uint32_t g = (((p[x] >> 8)  & 0xFF) * a + 127) / 255;
+            const uint32_t b = (( p[x]        & 0xFF) * a + 127) / 255;
+            p[x] = (a << 24) | (r << 16) | (g << 8) | b;
+        }
+    }
 }
 
-inline bool isKeyPressed(const Input *input, const Key key)
+#endif // IMAGE_IMPLEMENTATION
+#endif // WRAPPER_IMAGE_H
+
+
+// ============================================================================
+// 2D drawing primitives (clipped, written directly into Window_t::buffer)
+// ============================================================================
+#ifndef WRAPPER_DRAW2D_H
+#define WRAPPER_DRAW2D_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Fill rectangle (clipped to buffer)
+/*  -> Example:
+ *  drawRect(&win, 10, 10, 200, 50, 0xFF202020);
+ */
+void drawRect(const Window_t *w, int x, int y, int width, int height, uint32_t color);
+
+// Horizontal span from x0 to x1 inclusive
+/*  -> Example:
+ *  drawHLine(&win, 0, win.bWidth - 1, 100, 0xFFFF0000);
+ */
+void drawHLine(const Window_t *w, int x0, int x1, int y, uint32_t color);
+
+// Vertical span from y0 to y1 inclusive
+/*  -> Example:
+ *  drawVLine(&win, 100, 0, win.bHeight - 1, 0xFF00FF00);
+ */
+void drawVLine(const Window_t *w, int x, int y0, int y1, uint32_t color);
+
+// Line between two points (clipped, endpoints inclusive)
+/*  -> Example:
+ *  drawLine(&win, 0, 0, mouse_x, mouse_y, 0xFFFFFFFF);
+ */
+void drawLine(const Window_t *w, int x0, int y0, int x1, int y1, uint32_t color);
+
+// Circle outline
+/*  -> Example:
+ *  drawCircle(&win, 160, 120, 40, 0xFFFFFF00);
+ */
+void drawCircle(const Window_t *w, int cx, int cy, int radius, uint32_t color);
+
+// Filled circle
+/*  -> Example:
+ *  drawCircleFilled(&win, 160, 120, 40, 0xFF00FFFF);
+ */
+void drawCircleFilled(const Window_t *w, int cx, int cy, int radius, uint32_t color);
+
+// Copy region (sx, sy, sw, sh) of src to (dx, dy) in the buffer
+/*  -> Example:
+ *  drawBlit(&win, &sheet, 0, 0, 32, 32, player_x, player_y);
+ */
+void drawBlit(const Window_t *w, const Image *src, int sx, int sy, int sw, int sh, int dx, int dy);
+
+// Like drawBlit but skips source pixels whose RGB equals key (alpha ignored)
+/*  -> Example:
+ *  drawBlitKeyed(&win, &sheet, 32, 0, 32, 32, x, y, 0xFFFF00FF);
+ */
+void drawBlitKeyed(const Window_t *w, const Image *src, int sx, int sy, int sw, int sh, int dx, int dy, uint32_t key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef DRAW2D_IMPLEMENTATION
+
+static inline void _draw2d_fill_span(uint32_t *dst, const int n, const uint32_t color)
 {
-    return key < KEY_COUNT ? (input->key_curr[key] && !input->key_prev[key]) : false;
+    int i = 0;
+#if defined(__AVX2__)
+    if (cpuGetSimdLevel() >= CPU_SIMD_AVX2) {
+        const __m256i c = _mm256_set1_epi32((int)color);
+        for (; i + 8 <= n; i += 8) _mm256_storeu_si256((__m256i*)(dst + i), c);
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    if (cpuGetSimdLevel() >= CPU_SIMD_SSE) {
+        const __m128i c = _mm_set1_epi32((int)color);
+        for (; i + 4 <= n; i += 4) _mm_storeu_si128((__m128i*)(dst + i), c);
+    }
+#endif
+    for (; i < n; i++) dst[i] = color;
 }
 
-inline bool isKeyReleased(const Input *input, const Key key)
+static inline void _draw2d_key_span(uint32_t *dst, const uint32_t *src, const int n, const uint32_t key)
 {
-    return key < KEY_COUNT ? (!input->key_curr[key] && input->key_prev[key]) : false;
+    const uint32_t k = key & 0x00FFFFFFu;
+    int i = 0;
+#if defined(__AVX2__)
+    if (cpuGetSimdLevel() >= CPU_SIMD_AVX2) {
+        const __m256i vk = _mm256_set1_epi32((int)k);
+        const __m256i rgb = _mm256_set1_epi32(0x00FFFFFF);
+        for (; i + 8 <= n; i += 8) {
+            const __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+            const __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+            const __m256i m = _mm256_cmpeq_epi32(_mm256_and_si256(s, rgb), vk);
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_blendv_epi8(s, d, m));
+        }
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    if (cpuGetSimdLevel() >= CPU_SIMD_SSE) {
+        const __m128i vk = _mm_set1_epi32((int)k);
+        const __m128i rgb = _mm_set1_epi32(0x00FFFFFF);
+        for (; i + 4 <= n; i += 4) {
+            const __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+            const __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+            const __m128i m = _mm_cmpeq_epi32(_mm_and_si128(s, rgb), vk);
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_and_si128(m, d), _mm_andnot_si128(m, s)));
+        }
+    }
+#endif
+    for (; i < n; i++)
+        if ((src[i] & 0x00FFFFFFu) != k) dst[i] = src[i];
 }
 
-inline bool isMouseDown(const Input *input, const MouseButton btn)
+// x*y/255 with exact rounding, same formula in every code path
+static inline uint32_t _draw2d_mul255(const uint32_t a, const uint32_t b)
 {
-    return btn < MOUSE_COUNT ? input->mouse_curr[btn] : false;
+    const uint32_t t = a * b + 128;
+    return (t + (t >> 8)) >> 8;
 }
 
-inline bool isMousePressed(const Input *input, const MouseButton btn)
+// Premultiplied "over" of one pixel given as separate channels (saturating like packus)
+static inline uint32_t _draw2d_over_px(const uint32_t d, const uint32_t sb, const uint32_t sg, const uint32_t sr, const uint32_t sa)
 {
-    return btn < MOUSE_COUNT ? (input->mouse_curr[btn] && !input->mouse_prev[btn]) : false;
+    const uint32_t ia = 255 - sa;
+    uint32_t ob = sb + _draw2d_mul255(d & 0xFF, ia);
+    uint32_t og = sg + _draw2d_mul255((d >> 8) & 0xFF, ia);
+    uint32_t orr = sr + _draw2d_mul255((d >> 16) & 0xFF, ia);
+    uint32_t oa = sa + _draw2d_mul255(d >> 24, ia);
+    if (ob > 255) ob = 255;
+    if (og > 255) og = 255;
+    if (orr > 255) orr = 255;
+    if (oa > 255) oa = 255;
+    return (oa << 24) | (orr << 16) | (og << 8) | ob;
 }
 
-inline bool isMouseReleased(const Input *input, const MouseButton btn)
+// Scale source by f (B, G, R, A multipliers, 0..255), optionally premultiplying first, and blend over d
+static inline uint32_t _draw2d_blend_px(const uint32_t d, const uint32_t s, const uint16_t f[4], const bool premul)
 {
-    return btn < MOUSE_COUNT ? (!input->mouse_curr[btn] && input->mouse_prev[btn]) : false;
+    uint32_t sb = s & 0xFF, sg = (s >> 8) & 0xFF, sr = (s >> 16) & 0xFF, sa = s >> 24;
+    if (!premul) { sb = _draw2d_mul255(sb, sa); sg = _draw2d_mul255(sg, sa); sr = _draw2d_mul255(sr, sa); }
+    return _draw2d_over_px(d, _draw2d_mul255(sb, f[0]), _draw2d_mul255(sg, f[1]),
+                              _draw2d_mul255(sr, f[2]), _draw2d_mul255(sa, f[3]));
 }
 
-inline void getMousePosition(const Input *input, int *x, int *y)
+#if defined(__SSE2__) || defined(_M_X64)
+static inline __m128i _draw2d_mul255_sse(const __m128i a, const __m128i b)
 {
-    if (x) *x = input->mouse_x;
-    if (y) *y = input->mouse_y;
+    const __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
 }
 
-inline void getMouseDelta(const Input *input, int *dx, int *dy)
+// Premultiplied "over": s + d * (255 - s.alpha), two pixels unpacked to 16-bit lanes
+static inline __m128i _draw2d_over_sse(const __m128i d, const __m128i s)
 {
-    if (dx) *dx = input->mouse_dx;
-    if (dy) *dy = input->mouse_dy;
+    const __m128i ia = _mm_sub_epi16(_mm_set1_epi16(255), _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF));
+    return _mm_add_epi16(s, _draw2d_mul255_sse(d, ia));
 }
 
-#ifdef SDL_IMPLEMENTATION
+// Scale source by f (optionally premultiplying first) and blend over d, two pixels in 16-bit lanes
+static inline __m128i _draw2d_blend2_sse(const __m128i d, __m128i s, const __m128i f, const bool premul)
+{
+    const __m128i alpha_lanes = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+    if (!premul) {
+        const __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+        s = _draw2d_mul255_sse(s, _mm_or_si128(_mm_andnot_si128(alpha_lanes, a), _mm_and_si128(alpha_lanes, _mm_set1_epi16(255))));
+    }
+    return _draw2d_over_sse(d, _draw2d_mul255_sse(s, f));
+}
 
-inline void grabMouse(SDL_Window *window, const int width, const int height, Input *input)
+static inline __m128i _draw2d_blend4_sse(const __m128i d, const __m128i s, const __m128i f, const bool premul)
 {
-    if (input->mouse_grabbed) return;
+    const __m128i z = _mm_setzero_si128();
+    const __m128i lo = _draw2d_blend2_sse(_mm_unpacklo_epi8(d, z), _mm_unpacklo_epi8(s, z), f, premul);
+    const __m128i hi = _draw2d_blend2_sse(_mm_unpackhi_epi8(d, z), _mm_unpackhi_epi8(s, z), f, premul);
+    return _mm_packus_epi16(lo, hi);
+}
+#endif
 
-    input->center_x = width / 2;
-    input->center_y = height / 2;
-    input->grab_window = (void*)window;
+#if defined(__AVX2__)
+static inline __m256i _draw2d_mul255_avx2(const __m256i a, const __m256i b)
+{
+    const __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(a, b), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
 
-    SDL_SetWindowRelativeMouseMode(window, true);
+static inline __m256i _draw2d_over_avx2(const __m256i d, const __m256i s)
+{
+    const __m256i ia = _mm256_sub_epi16(_mm256_set1_epi16(255), _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF));
+    return _mm256_add_epi16(s, _draw2d_mul255_avx2(d, ia));
+}
 
-    input->mouse_grabbed = true;
-    input->mouse_dx = 0;
-    input->mouse_dy = 0;
+static inline __m256i _draw2d_blend4_avx2(const __m256i d, __m256i s, const __m256i f, const bool premul)
+{
+    const __m256i alpha_lanes = _mm256_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1);
+    if (!premul) {
+        const __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF);
+        s = _draw2d_mul255_avx2(s, _mm256_or_si256(_mm256_andnot_si256(alpha_lanes, a), _mm256_and_si256(alpha_lanes, _mm256_set1_epi16(255))));
+    }
+    return _draw2d_over_avx2(d, _draw2d_mul255_avx2(s, f));
 }
 
-inline void releaseMouse(SDL_Window *window, Input *input)
+static inline __m256i _draw2d_blend8_avx2(const __m256i d, const __m256i s, const __m256i f, const bool premul)
 {
-    if (!input->mouse_grabbed) return;
-
-    SDL_SetWindowRelativeMouseMode(window, false);
-
-    input->mouse_grabbed = false;
-    input->mouse_dx = 0;
-    input->mouse_dy = 0;
+    const __m256i z = _mm256_setzero_si256();
+    const __m256i lo = _draw2d_blend4_avx2(_mm256_unpacklo_epi8(d, z), _mm256_unpacklo_epi8(s, z), f, premul);
+    const __m256i hi = _draw2d_blend4_avx2(_mm256_unpackhi_epi8(d, z), _mm256_unpackhi_epi8(s, z), f, premul);
+    return _mm256_packus_epi16(lo, hi);
 }
+#endif
 
-#else
+// Clip a rectangle to the buffer; returns false if nothing is left
+static inline bool _draw2d_clip(const Window_t *w, int *x, int *y, int *width, int *height)
+{
+    if (!w->buffer_valid) return false;
+    if (*x < 0) { *width  += *x; *x = 0; }
+    if (*y < 0) { *height += *y; *y = 0; }
+    if (*x + *width  > w->bWidth)  *width  = w->bWidth  - *x;
+    if (*y + *height > w->bHeight) *height = w->bHeight - *y;
+    return *width > 0 && *height > 0;
+}
 
-inline void grabMouse(Display *display, const Window window,
-                      const int width, const int height, Input *input)
+inline void drawRect(const Window_t *w, int x, int y, int width, int height, const uint32_t color)
 {
-    if (input->mouse_grabbed) return;
+    if (!_draw2d_clip(w, &x, &y, &width, &height)) return;
+    uint32_t *row = w->buffer + (size_t)y * w->bWidth + x;
+    for (int j = 0; j < height; j++, row += w->bWidth)
+        _draw2d_fill_span(row, width, color);
+}
 
-    input->center_x = width / 2;
-    input->center_y = height / 2;
-    input->grab_window = window;
+inline void drawHLine(const Window_t *w, int x0, int x1, const int y, const uint32_t color)
+{
+    if (x0 > x1) { const int t = x0; x0 = x1; x1 = t; }
+    drawRect(w, x0, y, x1 - x0 + 1, 1, color);
+}
 
-    XColor dummy;
-    const char data[1] = {0};
-    const Pixmap blank = XCreateBitmapFromData(display, window, data, 1, 1);
-    const Cursor cursor = XCreatePixmapCursor(display, blank, blank,
-                                              &dummy, &dummy, 0, 0);
-    XFreePixmap(display, blank);
+inline void drawVLine(const Window_t *w, const int x, int y0, int y1, const uint32_t color)
+{
+    if (y0 > y1) { const int t = y0; y0 = y1; y1 = t; }
+    int cx = x, cy = y0, cw = 1, ch = y1 - y0 + 1;
+    if (!_draw2d_clip(w, &cx, &cy, &cw, &ch)) return;
+    uint32_t *p = w->buffer + (size_t)cy * w->bWidth + cx;
+    for (int j = 0; j < ch; j++, p += w->bWidth) *p = color;
+}
 
-    XDefineCursor(display, window, cursor);
-    XGrabPointer(display, window, True,
-                 PointerMotionMask | ButtonPressMask | ButtonReleaseMask,
-                 GrabModeAsync, GrabModeAsync, window, None, CurrentTime);
+inline void drawLine(const Window_t *w, int x0, int y0, int x1, int y1, const uint32_t color)
+{
+    if (!w->buffer_valid) return;
+    if (y0 == y1) { drawHLine(w, x0, x1, y0, color); return; }
+    if (x0 == x1) { drawVLine(w, x0, y0, y1, color); return; }
+
+    // 16.16 DDA along the major axis; the major range is clipped up front,
+    // the minor axis is monotonic so out-of-range pixels only occur at the ends
+    const bool steep = abs(y1 - y0) > abs(x1 - x0);
+    if (steep) { int t = x0; x0 = y0; y0 = t; t = x1; x1 = y1; y1 = t; }
+    if (x0 > x1) { int t = x0; x0 = x1; x1 = t; t = y0; y0 = y1; y1 = t; }
+
+    const int major_max = steep ? w->bHeight : w->bWidth;
+    const int minor_max = steep ? w->bWidth  : w->bHeight;
+    const int64_t step  = ((int64_t)(y1 - y0) << 16) / (x1 - x0);
+
+    int start = x0 < 0 ? 0 : x0;
+    const int end = x1 >= major_max ? major_max - 1 : x1;
+    int64_t fy = ((int64_t)y0 << 16) + 0x8000 + step * (start - x0);
+
+    const ptrdiff_t major_stride = steep ? w->bWidth : 1;
+    const ptrdiff_t minor_stride = steep ? 1 : w->bWidth;
+
+    bool entered = false;
+    for (int x = start; x <= end; x++, fy += step) {
+        const int y = (int)(fy >> 16);
+        if (y < 0 || y >= minor_max) {
+            if (entered) break;
+            continue;
+        }
+        entered = true;
+        w->buffer[x * major_stride + y * minor_stride] = color;
+    }
+}
 
-    XWarpPointer(display, None, window, 0, 0, 0, 0,
-                 input->center_x, input->center_y);
-    XFlush(display);
+// Plot with bounds check (circle outline touches few pixels)
+static inline void _draw2d_plot(const Window_t *w, const int x, const int y, const uint32_t color)
+{
+    if ((unsigned)x < (unsigned)w->bWidth && (unsigned)y < (unsigned)w->bHeight)
+        w->buffer[(size_t)y * w->bWidth + x] = color;
+}
 
-    input->last_x = input->center_x;
-    input->last_y = input->center_y;
-    input->mouse_grabbed = true;
-    input->mouse_dx = 0;
-    input->mouse_dy = 0;
+inline void drawCircle(const Window_t *w, const int cx, const int cy, const int radius, const uint32_t color)
+{
+    if (!w->buffer_valid || radius < 0) return;
+    if (cx + radius < 0 || cy + radius < 0 || cx - radius >= w->bWidth || cy - radius >= w->bHeight) return;
+
+    int x = radius, y = 0, err = 1 - radius;
+    while (x >= y) {
+        _draw2d_plot(w, cx + x, cy + y, color); _draw2d_plot(w, cx - x, cy + y, color);
+        _draw2d_plot(w, cx + x, cy - y, color); _draw2d_plot(w, cx - x, cy - y, color);
+        _draw2d_plot(w, cx + y, cy + x, color); _draw2d_plot(w, cx - y, cy + x, color);
+        _draw2d_plot(w, cx + y, cy - x, color); _draw2d_plot(w, cx - y, cy - x, color);
+        y++;
+        if (err < 0) err += 2 * y + 1;
+        else { x--; err += 2 * (y - x) + 1; }
+    }
 }
 
-inline void releaseMouse(Display *display, const Window window, Input *input)
+inline void drawCircleFilled(const Window_t *w, const int cx, const int cy, const int radius, const uint32_t color)
 {
-    if (!input->mouse_grabbed) return;
+    if (!w->buffer_valid || radius < 0) return;
+
+    // Same midpoint walk as drawCircle, emitting one span per row
+    int x = radius, y = 0, err = 1 - radius;
+    while (x >= y) {
+        drawHLine(w, cx - x, cx + x, cy + y, color);
+        if (y) drawHLine(w, cx - x, cx + x, cy - y, color);
+        if (err >= 0 && x != y) {
+            drawHLine(w, cx - y, cx + y, cy + x, color);
+            drawHLine(w, cx - y, cx + y, cy - x, color);
+        }
+        y++;
+        if (err < 0) err += 2 * y + 1;
+        else { x--; err += 2 * (y - x) + 1; }
+    }
+}
 
-    XUngrabPointer(display, CurrentTime);
-    XDefineCursor(display, window, None);
-    input->mouse_grabbed = false;
-    input->mouse_dx = 0;
-    input->mouse_dy = 0;
+// Clip source and destination rectangles together; returns false if empty
+static inline bool _draw2d_clip_blit(const Window_t *w, const Image *src,
+    int *sx, int *sy, int *sw, int *sh, int *dx, int *dy)
+{
+    if (!src->pixels) return false;
+    if (*sx < 0) { *sw += *sx; *dx -= *sx; *sx = 0; }
+    if (*sy < 0) { *sh += *sy; *dy -= *sy; *sy = 0; }
+    if (*sx + *sw > src->width)  *sw = src->width  - *sx;
+    if (*sy + *sh > src->height) *sh = src->height - *sy;
+
+    const int ox = *dx, oy = *dy;
+    if (!_draw2d_clip(w, dx, dy, sw, sh)) return false;
+    *sx += *dx - ox;
+    *sy += *dy - oy;
+    return true;
 }
 
-#endif
+inline void drawBlit(const Window_t *w, const Image *src, int sx, int sy, int sw, int sh, int dx, int dy)
+{
+    if (!_draw2d_clip_blit(w, src, &sx, &sy, &sw, &sh, &dx, &dy)) return;
+    const uint32_t *s = src->pixels + (size_t)sy * src->pitch + sx;
+    uint32_t *d = w->buffer + (size_t)dy * w->bWidth + dx;
+    for (int j = 0; j < sh; j++, s += src->pitch, d += w->bWidth)
+        memcpy(d, s, (size_t)sw * sizeof(uint32_t));
+}
 
-inline bool isMouseGrabbed(const Input *input)
+inline void drawBlitKeyed(const Window_t *w, const Image *src, int sx, int sy, int sw, int sh, int dx, int dy, const uint32_t key)
 {
-    return input->mouse_grabbed;
+    if (!_draw2d_clip_blit(w, src, &sx, &sy, &sw, &sh, &dx, &dy)) return;
+    const uint32_t *s = src->pixels + (size_t)sy * src->pitch + sx;
+    uint32_t *d = w->buffer + (size_t)dy * w->bWidth + dx;
+    for (int j = 0; j < sh; j++, s += src->pitch, d += w->bWidth)
+        _draw2d_key_span(d, s, sw, key);
 }
 
-#endif // KEYS_IMPLEMENTATION
-#endif // WRAPPER_KEYS_H
+#endif // DRAW2D_IMPLEMENTATION
+#endif // WRAPPER_DRAW2D_H
 
 
 // ============================================================================
-// Vector math
+// Sprite batching with premultiplied-alpha blending into Window_t::buffer
+// The implementation shares the blend helpers of DRAW2D_IMPLEMENTATION, which must be defined too
 // ============================================================================
-#ifndef WRAPPER_MATH_H
-#define WRAPPER_MATH_H
-
-#include <math.h>
+#ifndef WRAPPER_SPRITE_H
+#define WRAPPER_SPRITE_H
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
+#ifdef __cplusplus
+extern "C" {
 #endif
 
+// Queued sprite
 typedef struct {
-    float x, y, z;
-} Vec3;
-
+    const Image *image;
+    int sx, sy, sw, sh;     // Source rectangle in image
+    int dx, dy, dw, dh;     // Destination rectangle (nearest-scaled if size differs)
+    uint32_t tint;          // 0xAARRGGBB multiplier, 0xFFFFFFFF = unchanged
+    float alpha;            // Extra opacity 0..1
+    float depth;            // Layer, lower values are drawn first (further back)
+    uint32_t order;         // Submission index (set by spriteBatchAdd, keeps sorting stable)
+} Sprite;
+
+// Sprite queue, composited in screen bands on the job pool
 typedef struct {
-    Vec3 origin, direction;
-} Ray;
-
-/*  -> Example:
- *  Vec3 v = vec3(1.0f, 2.0f, 3.0f);
- */
-Vec3  vec3(float x, float y, float z);
-
-/*  -> Example:
- *  Vec3 c = add(a, b);
- */
-Vec3  add(Vec3 a, Vec3 b);
-
-/*  -> Example:
- *  Vec3 c = sub(a, b);
- */
-Vec3  sub(Vec3 a, Vec3 b);
-
-/*  -> Example:
- *  Vec3 v = mul(a, 2.0f);
- */
-Vec3  mul(Vec3 v, float t);
-
-/*  -> Example:
- *  Vec3 c = vmul(a, b);
- */
-Vec3  vmul(Vec3 a, Vec3 b);
-
-/*  -> Example:
- *  Vec3 v = vdiv(a, 2.0f);
- */
-Vec3  vdiv(Vec3 v, float t);
-
+    Sprite *sprites;
+    int count;
+    int capacity;
+    int band_height;        // Rows per parallel job
+    bool premultiplied;     // Source images are premultiplied (see imagePremultiply)
+} SpriteBatch;
+
+// Initialize empty batch
 /*  -> Example:
- *  float d = dot(a, b);
+ *  SpriteBatch batch;
+ *  spriteBatchInit(&batch);
  */
-float dot(Vec3 a, Vec3 b);
+void spriteBatchInit(SpriteBatch *b);
 
+// Free batch memory
 /*  -> Example:
- *  Vec3 n = cross(a, b);
+ *  spriteBatchFree(&batch);
  */
-Vec3  cross(Vec3 a, Vec3 b);
+void spriteBatchFree(SpriteBatch *b);
 
+// Queue a sprite (returns false if the source rectangle is outside the image)
 /*  -> Example:
- *  float length = len(v);
+ *  spriteBatchAdd(&batch, &sheet, 0, 0, 16, 16, x, y, 32, 32, 0xFFFFFFFF, 1.0f, 0.0f);
  */
-float len(Vec3 v);
+bool spriteBatchAdd(SpriteBatch *b, const Image *img,
+                    int sx, int sy, int sw, int sh,
+                    int dx, int dy, int dw, int dh,
+                    uint32_t tint, float alpha, float depth);
 
+// Sort queued sprites by layer then image, composite them and clear the queue.
+// Sprites sharing a depth are grouped by image, so give overlapping sprites distinct depths.
 /*  -> Example:
- *  Vec3 unit = norm(v);
+ *  spriteBatchFlush(&batch, &win);
+ *  updateFramebuffer(&win);
  */
-Vec3  norm(Vec3 v);
+void spriteBatchFlush(SpriteBatch *b, const Window_t *w);
 
-/*  -> Example:
- *  Vec3 reflected = reflect(incident, normal);
- */
-Vec3  reflect(Vec3 v, Vec3 n);
+#ifdef __cplusplus
+}
+#endif
 
-#ifdef MATH_IMPLEMENTATION
+#ifdef SPRITE_IMPLEMENTATION
 
-inline Vec3 vec3(const float x, const float y, const float z)
-{
-    return (Vec3) {x, y, z};
-}
+#ifndef DRAW2D_IMPLEMENTATION
+#error "SPRITE_IMPLEMENTATION needs DRAW2D_IMPLEMENTATION (shared blend helpers)"
+#endif
 
-inline Vec3 add(const Vec3 a, const Vec3 b)
+inline void spriteBatchInit(SpriteBatch *b)
 {
-    return (Vec3) {
-        a.x + b.x,
-        a.y + b.y,
-        a.z + b.z,
-    };
+    b->sprites       = NULL;
+    b->count         = 0;
+    b->capacity      = 0;
+    b->band_height   = 32;
+    b->premultiplied = false;
 }
 
-inline Vec3 sub(const Vec3 a, const Vec3 b)
+inline void spriteBatchFree(SpriteBatch *b)
 {
-    return (Vec3) {
-        a.x - b.x,
-        a.y - b.y,
-        a.z - b.z,
-    };
+    if (b->sprites) {
+        free(b->sprites);
+        b->sprites = NULL;
+    }
+    b->count    = 0;
+    b->capacity = 0;
 }
 
-inline Vec3 mul(const Vec3 v, const float t)
+inline bool spriteBatchAdd(SpriteBatch *b, const Image *img,
+                           const int sx, const int sy, const int sw, const int sh,
+                           const int dx, const int dy, const int dw, const int dh,
+                           const uint32_t tint, const float alpha, const float depth)
 {
-    return (Vec3) {
-        v.x * t,
-        v.y * t,
-        v.z * t,
-    };
-}
+    if (!img || !img->pixels || sw <= 0 || sh <= 0 || dw <= 0 || dh <= 0) return false;
+    if (sx < 0 || sy < 0 || sx + sw > img->width || sy + sh > img->height) return false;
 
-inline Vec3 vmul(const Vec3 a, const Vec3 b)
-{
-    return (Vec3) {
-        a.x * b.x,
-        a.y * b.y,
-        a.z * b.z,
-    };
-}
+    if (b->count >= b->capacity) {
+        b->capacity = b->capacity ? b->capacity * 2 : 256;
+        b->sprites = (Sprite*)realloc(b->sprites, b->capacity * sizeof(Sprite));
+        assert(b->sprites && "Failed to grow sprite batch");
+    }
 
-inline Vec3 vdiv(const Vec3 v, const float t)
-{
-    const float inv = 1.0f / t;
-    return (Vec3) {
-        v.x * inv,
-        v.y * inv,
-        v.z * inv,
-    };
+    Sprite *s = &b->sprites[b->count];
+    s->image = img;
+    s->sx = sx; s->sy = sy; s->sw = sw; s->sh = sh;
+    s->dx = dx; s->dy = dy; s->dw = dw; s->dh = dh;
+    s->tint  = tint;
+    s->alpha = alpha;
+    s->depth = depth;
+    s->order = (uint32_t)b->count++;
+    return true;
 }
 
-inline float dot(const Vec3 a, const Vec3 b)
+static inline int _sprite_compare(const void *pa, const void *pb)
 {
-    return (a.x * b.x) + (a.y * b.y) + (a.z * b.z);
+    const Sprite *a = (const Sprite*)pa, *b = (const Sprite*)pb;
+    if (a->depth != b->depth) return a->depth < b->depth ? -1 : 1;
+    if (a->image != b->image) return (uintptr_t)a->image < (uintptr_t)b->image ? -1 : 1;
+    return a->order < b->order ? -1 : (a->order > b->order);
 }
 
-inline Vec3 cross(const Vec3 a, const Vec3 b)
+// Blend n pixels; source texel for pixel i is src[(u + i*du) >> 16]
+static inline void _sprite_span(uint32_t *dst, const uint32_t *src, const int n,
+                                uint32_t u, const uint32_t du, const uint16_t f[4], const bool premul)
 {
-    return (Vec3) {
-        (a.y * b.z) - (a.z * b.y),
-        (a.z * b.x) - (a.x * b.z),
-        (a.x * b.y) - (a.y * b.x),
-    };
+    const bool contiguous = du == 0x10000;
+    int i = 0;
+#if defined(__AVX2__)
+    if (cpuGetSimdLevel() >= CPU_SIMD_AVX2) {
+        const __m256i vf = _mm256_setr_epi16(f[0], f[1], f[2], f[3], f[0], f[1], f[2], f[3],
+                                             f[0], f[1], f[2], f[3], f[0], f[1], f[2], f[3]);
+        uint32_t tmp[8];
+        for (; i + 8 <= n; i += 8) {
+            __m256i s;
+            if (contiguous) {
+                s = _mm256_loadu_si256((const __m256i*)(src + (u >> 16)));
+                u += 8 << 16;
+            } else {
+                for (int k = 0; k < 8; k++, u += du) tmp[k] = src[u >> 16];
+                s = _mm256_loadu_si256((const __m256i*)tmp);
+            }
+            const __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+            _mm256_storeu_si256((__m256i*)(dst + i), _draw2d_blend8_avx2(d, s, vf, premul));
+        }
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    if (cpuGetSimdLevel() >= CPU_SIMD_SSE) {
+        const __m128i vf = _mm_setr_epi16(f[0], f[1], f[2], f[3], f[0], f[1], f[2], f[3]);
+        uint32_t tmp[4];
+        for (; i + 4 <= n; i += 4) {
+            __m128i s;
+            if (contiguous) {
+                s = _mm_loadu_si128((const __m128i*)(src + (u >> 16)));
+                u += 4 << 16;
+            } else {
+                for (int k = 0; k < 4; k++, u += du) tmp[k] = src[u >> 16];
+                s = _mm_loadu_si128((const __m128i*)tmp);
+            }
+            const __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+            _mm_storeu_si128((__m128i*)(dst + i), _draw2d_blend4_sse(d, s, vf, premul));
+        }
+    }
+#endif
+    for (; i < n; i++, u += du) dst[i] = _draw2d_blend_px(dst[i], src[u >> 16], f, premul);
 }
 
-inline float len(const Vec3 v)
-{
-    return sqrtf(dot(v,v));
-}
+typedef struct {
+    const SpriteBatch *batch;
+    const Window_t    *window;
+    int                band_height;
+} _SpriteJob;
 
-inline Vec3 norm(const Vec3 v)
+static inline void _sprite_band(void *user, const int band)
 {
-    const float l2 = dot(v,v);
-    if (l2 > 0.0f)
-    {
-        const float inv = 1.0f / sqrtf(l2);
-        return (Vec3) {
-            v.x * inv,
-            v.y * inv,
-            v.z * inv,
+    const _SpriteJob *job = (const _SpriteJob*)user;
+    const Window_t *w = job->window;
+    const int band_y0 = band * job->band_height;
+    const int band_y1 = band_y0 + job->band_height < w->bHeight ? band_y0 + job->band_height : w->bHeight;
+
+    for (int i = 0; i < job->batch->count; i++) {
+        const Sprite *s = &job->batch->sprites[i];
+
+        int x0 = s->dx < 0 ? 0 : s->dx;
+        int x1 = s->dx + s->dw < w->bWidth ? s->dx + s->dw : w->bWidth;
+        int y0 = s->dy < band_y0 ? band_y0 : s->dy;
+        int y1 = s->dy + s->dh < band_y1 ? s->dy + s->dh : band_y1;
+        if (x0 >= x1 || y0 >= y1) continue;
+
+        // Combined tint * alpha multipliers (premultiplied: color scales with alpha too)
+        float a = s->alpha < 0.0f ? 0.0f : (s->alpha > 1.0f ? 1.0f : s->alpha);
+        const uint32_t fa = _draw2d_mul255(s->tint >> 24, (uint32_t)(a * 255.0f + 0.5f));
+        if (fa == 0) continue;
+        const uint16_t f[4] = {
+            (uint16_t)_draw2d_mul255(s->tint & 0xFF, fa),
+            (uint16_t)_draw2d_mul255((s->tint >> 8) & 0xFF, fa),
+            (uint16_t)_draw2d_mul255((s->tint >> 16) & 0xFF, fa),
+            (uint16_t)fa,
         };
+
+        const uint32_t du = (uint32_t)(((uint64_t)s->sw << 16) / (uint32_t)s->dw);
+        const uint32_t dv = (uint32_t)(((uint64_t)s->sh << 16) / (uint32_t)s->dh);
+        const uint32_t u0 = ((uint32_t)s->sx << 16) + (uint32_t)(x0 - s->dx) * du + du / 2;
+
+        for (int y = y0; y < y1; y++) {
+            const uint32_t v = ((uint32_t)s->sy << 16) + (uint32_t)(y - s->dy) * dv + dv / 2;
+            const uint32_t *src = s->image->pixels + (size_t)(v >> 16) * s->image->pitch;
+            _sprite_span(w->buffer + (size_t)y * w->bWidth + x0, src, x1 - x0, u0, du, f, job->batch->premultiplied);
+        }
     }
-    return v;
 }
 
-inline Vec3 reflect(const Vec3 v, const Vec3 n)
+inline void spriteBatchFlush(SpriteBatch *b, const Window_t *w)
 {
-    const float d = 2.0f * dot(v,n);
-    return (Vec3) {
-        v.x - (d * n.x),
-        v.y - (d * n.y),
-        v.z - (d * n.z),
-    };
+    if (!w->buffer_valid || b->count == 0) { b->count = 0; return; }
+
+    qsort(b->sprites, (size_t)b->count, sizeof(Sprite), _sprite_compare);
+
+    _SpriteJob job;
+    job.batch       = b;
+    job.window      = w;
+    job.band_height = b->band_height > 0 ? b->band_height : 32;
+    jobParallelFor((w->bHeight + job.band_height - 1) / job.band_height, _sprite_band, &job);
+
+    b->count = 0;
 }
 
-#endif // MATH_IMPLEMENTATION
-#endif // WRAPPER_MATH_H
+#endif // SPRITE_IMPLEMENTATION
+#endif // WRAPPER_SPRITE_H
 
+// ============================================================================
+// Bitmap font text rendering (BDF or grid atlas) with cached glyph runs
+// The implementation shares the blend helpers of DRAW2D_IMPLEMENTATION, which must be defined too
+// ============================================================================
+#ifndef WRAPPER_TEXT_H
+#define WRAPPER_TEXT_H
 
-#ifndef WRAPPER_CAMERA_H
-#define WRAPPER_CAMERA_H
+#define FONT_MAX_GLYPHS 256     // Byte-encoded text (ASCII / Latin-1)
+#define FONT_RUN_CACHE  64      // Rasterized text runs kept per font
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-typedef struct Camera {
-    Vec3 position;
-    float yaw;      // Rotation in degrees
-    float pitch;    // Rotation in degrees
-    float fov;      // Field of view in degrees
-    Vec3 front;     // Forward direction vector
-    Vec3 right;     // Right direction vector
-    Vec3 up;        // Up direction vector
-} Camera;
+// Glyph metrics, offsets relative to the top-left of the line
+typedef struct {
+    int x_off, y_off;
+    int width, height;
+    int advance;
+    size_t offset;          // Start of the glyph bitmap in BitmapFont::coverage
+} Glyph;
 
-// Initialize camera with default position and orientation
+// Cached rasterized line of text (8-bit coverage)
+typedef struct {
+    uint64_t hash;
+    char *text;
+    int length;
+    int width, height;
+    int origin;             // Run x relative to the pen start (negative for left-hanging glyphs)
+    uint8_t *coverage;
+    uint32_t last_used;
+} FontRun;
+
+typedef struct {
+    Glyph glyphs[FONT_MAX_GLYPHS];
+    uint8_t *coverage;      // All glyph bitmaps, one byte per pixel
+    size_t coverage_size;
+    int line_height;
+    int ascent;
+    FontRun runs[FONT_RUN_CACHE];
+    uint32_t tick;
+    int cache_hits;         // Run cache statistics
+    int cache_misses;
+} BitmapFont;
+
+// Load a BDF bitmap font
 /*  -> Example:
- *  Camera camera;
- *  cameraInit(&camera);
- *  camera.position = vec3(0.0f, 1.0f, 5.0f);
+ *  BitmapFont font;
+ *  ASSERT(fontLoadBDF(&font, "res/fonts/6x13.bdf"));
  */
-void cameraInit(Camera *cam);
+bool fontLoadBDF(BitmapFont *f, const char *path);
 
-// Update camera vectors based on yaw/pitch (automatically clamps pitch)
+// Build a monospace font from a grid atlas (glyph coverage = brightness * alpha)
 /*  -> Example:
- *  camera.yaw += 10.0f;
- *  cameraUpdate(&camera);
+ *  Image atlas;
+ *  imageLoadPPM(&atlas, "res/font_8x8.ppm");
+ *  fontFromAtlas(&font, &atlas, 8, 8, 32); // cells start at ' '
  */
-void cameraUpdate(Camera *cam);
+bool fontFromAtlas(BitmapFont *f, const Image *atlas, int cell_w, int cell_h, int first_char);
 
-// Move camera in given direction by speed amount
+// Free font and cached runs
 /*  -> Example:
- *  if (isKeyDown(&input, KEY_W)) cameraMove(&camera, camera.front, 0.1f);
+ *  fontFree(&font);
  */
-void cameraMove(Camera *cam, Vec3 direction, float speed);
+void fontFree(BitmapFont *f);
 
-// Rotate camera by delta angles in degrees
+// Size of text in pixels ('\n' starts a new line)
 /*  -> Example:
- *  cameraRotate(&camera, mouse_dx * sensitivity, -mouse_dy * sensitivity);
+ *  int tw, th;
+ *  fontMeasure(&font, "FPS: 60", &tw, &th);
  */
-void cameraRotate(Camera *cam, float dyaw, float dpitch);
+void fontMeasure(const BitmapFont *f, const char *text, int *width, int *height);
 
-// Generate ray from camera with pre-scaled viewport offsets
+// Draw text with its top-left corner at (x, y); color alpha scales opacity
 /*  -> Example:
- *  float* u_offsets = (float*)malloc(win.width * sizeof(float));
-    float* v_offsets = (float*)malloc(win.height * sizeof(float));
-    assert(u_offsets && v_offsets && "Failed to allocate viewport offset buffers");
+ *  drawText(&win, &font, 8, 8, "Hello", 0xFFFFFFFF);
+ */
+void drawText(const Window_t *w, BitmapFont *f, int x, int y, const char *text, uint32_t color);
 
-    for (int x = 0; x < win.width; x++)  u_offsets[x] = ((float)x / (float)(win.width - 1) - 0.5f) * viewport_width;
-    for (int y = 0; y < win.height; y++) v_offsets[y] = ((float)(win.height - 1 - y) / (float)(win.height - 1) - 0.5f) * viewport_height;
+#ifdef __cplusplus
+}
+#endif
 
-    while (1) {
-        ...
-        #pragma omp parallel for schedule(dynamic) default(none) shared(win, camera, u_offsets, v_offsets)
-        for (int y = 0; y < win.height; y++) {
-            for (int x = 0; x < win.width; x++) {
-                const Ray ray = cameraGetRay(&camera, u_offsets[x], v_offsets[y]);
-                const Vec3 color = calculate_ray_color(ray, MAX_BOUNCES);
-                win.buffer[y * win.width + x] = uint32(color);
-        }
+#ifdef TEXT_IMPLEMENTATION
+
+#ifndef DRAW2D_IMPLEMENTATION
+#error "TEXT_IMPLEMENTATION needs DRAW2D_IMPLEMENTATION (shared blend helpers)"
+#endif
+
+static inline void _fontReset(BitmapFont *f)
+{
+    memset(f, 0, sizeof(*f));
+}
+
+static inline size_t _fontAllocGlyph(BitmapFont *f, const size_t size, size_t *capacity)
+{
+    if (f->coverage_size + size > *capacity) {
+        while (f->coverage_size + size > *capacity) *capacity = *capacity ? *capacity * 2 : 4096;
+        f->coverage = (uint8_t*)realloc(f->coverage, *capacity);
+        assert(f->coverage && "Failed to grow font glyph storage");
     }
-}*/
-Ray cameraGetRay(const Camera* cam, float u_scaled, float v_scaled);
+    const size_t off = f->coverage_size;
+    memset(f->coverage + off, 0, size);
+    f->coverage_size += size;
+    return off;
+}
 
-#ifdef __cplusplus
+static inline int _fontHexNibble(const char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
 }
-#endif
 
-#ifdef CAMERA_IMPLEMENTATION
+inline bool fontLoadBDF(BitmapFont *f, const char *path)
+{
+    _fontReset(f);
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "Failed to open BDF font: %s\n", path);
+        return false;
+    }
 
-inline void cameraInit(Camera *cam)
+    char line[1024];
+    size_t capacity = 0;
+    int ascent = -1, descent = -1, box_h = 0, box_y = 0;
+    int encoding = -1, dwidth = 0, bw = 0, bh = 0, bx = 0, by = 0;
+    int row = -1;
+    size_t glyph_off = 0;
+    int glyphs = 0;
+
+    // Bitmaps are stored relative to the baseline until the ascent is known
+    typedef struct { int encoding, x, y, w, h, adv; size_t off; } _BdfGlyph;
+    _BdfGlyph *pending = (_BdfGlyph*)malloc(FONT_MAX_GLYPHS * sizeof(_BdfGlyph));
+    assert(pending && "Failed to allocate BDF glyph table");
+
+    while (fgets(line, sizeof(line), fp)) {
+        if (row >= 0) {
+            if (strncmp(line, "ENDCHAR", 7) == 0) {
+                if (encoding >= 0 && encoding < FONT_MAX_GLYPHS && glyphs < FONT_MAX_GLYPHS) {
+                    _BdfGlyph *p = &pending[glyphs++];
+                    p->encoding = encoding;
+                    p->x = bx; p->y = by; p->w = bw; p->h = bh;
+                    p->adv = dwidth;
+                    p->off = glyph_off;
+                }
+                row = -1;
+                continue;
+            }
+            if (row < bh && encoding >= 0 && encoding < FONT_MAX_GLYPHS) {
+                uint8_t *dst = f->coverage + glyph_off + (size_t)row * bw;
+                for (int x = 0; x < bw; x++) {
+                    const int nib = _fontHexNibble(line[x / 4]);
+                    if (nib < 0) break;
+                    dst[x] = ((nib >> (3 - (x & 3))) & 1) ? 255 : 0;
+                }
+            }
+            row++;
+        }
+        else if (sscanf(line, "FONTBOUNDINGBOX %*d %d %*d %d", &box_h, &box_y) == 2) {}
+        else if (sscanf(line, "FONT_ASCENT %d", &ascent) == 1) {}
+        else if (sscanf(line, "FONT_DESCENT %d", &descent) == 1) {}
+        else if (strncmp(line, "STARTCHAR", 9) == 0) { encoding = -1; dwidth = 0; bw = bh = bx = by = 0; }
+        else if (sscanf(line, "ENCODING %d", &encoding) == 1) {}
+        else if (sscanf(line, "DWIDTH %d", &dwidth) == 1) {}
+        else if (sscanf(line, "BBX %d %d %d %d", &bw, &bh, &bx, &by) == 4) {}
+        else if (strncmp(line, "BITMAP", 6) == 0) {
+            row = 0;
+            glyph_off = 0;
+            if (encoding >= 0 && encoding < FONT_MAX_GLYPHS && bw > 0 && bh > 0)
+                glyph_off = _fontAllocGlyph(f, (size_t)bw * bh, &capacity);
+            else
+                bw = bh = 0;
+        }
+    }
+    fclose(fp);
+
+    if (ascent < 0)  ascent  = box_h + box_y;
+    if (descent < 0) descent = -box_y;
+    f->ascent      = ascent;
+    f->line_height = ascent + descent;
+
+    for (int i = 0; i < glyphs; i++) {
+        Glyph *g = &f->glyphs[pending[i].encoding];
+        g->x_off   = pending[i].x;
+        g->y_off   = ascent - pending[i].y - pending[i].h;
+        g->width   = pending[i].w;
+        g->height  = pending[i].h;
+        g->advance = pending[i].adv;
+        g->offset  = pending[i].off;
+    }
+    free(pending);
+
+    if (glyphs == 0 || f->line_height <= 0) {
+        fprintf(stderr, "No usable glyphs in BDF font: %s\n", path);
+        fontFree(f);
+        return false;
+    }
+    return true;
+}
+
+inline bool fontFromAtlas(BitmapFont *f, const Image *atlas, const int cell_w, const int cell_h, const int first_char)
 {
-    cam->position = vec3(0.0f, 0.0f, 0.0f);
-    cam->yaw = 0.0f;
-    cam->pitch = 0.0f;
-    cam->fov = 60.0f;
-    cameraUpdate(cam);
+    _fontReset(f);
+    if (!atlas->pixels || cell_w <= 0 || cell_h <= 0) return false;
+
+    const int cols = atlas->width / cell_w, rows = atlas->height / cell_h;
+    size_t capacity = 0;
+
+    for (int c = 0; c < cols * rows && first_char + c < FONT_MAX_GLYPHS; c++) {
+        Glyph *g = &f->glyphs[first_char + c];
+        g->width   = cell_w;
+        g->height  = cell_h;
+        g->advance = cell_w;
+        g->offset  = _fontAllocGlyph(f, (size_t)cell_w * cell_h, &capacity);
+
+        const int ox = (c % cols) * cell_w, oy = (c / cols) * cell_h;
+        for (int y = 0; y < cell_h; y++) {
+            const uint32_t *src = atlas->pixels + (size_t)(oy + y) * atlas->pitch + ox;
+            uint8_t *dst = f->coverage + g->offset + (size_t)y * cell_w;
+            for (int x = 0; x < cell_w; x++) {
+                const uint32_t p = src[x];
+                uint32_t lum = (p >> 16) & 0xFF;
+                if (((p >> 8) & 0xFF) > lum) lum = (p >> 8) & 0xFF;
+                if ((p & 0xFF) > lum)        lum = p & 0xFF;
+                dst[x] = (uint8_t)_draw2d_mul255(lum, p >> 24);
+            }
+        }
+    }
+
+    f->ascent      = cell_h;
+    f->line_height = cell_h;
+    return true;
 }
 
-inline void cameraUpdate(Camera *cam)
+inline void fontFree(BitmapFont *f)
 {
-    // Clamp pitch to avoid gimbal lock
-    if (cam->pitch > 89.0f) cam->pitch = 89.0f;
-    if (cam->pitch < -89.0f) cam->pitch = -89.0f;
+    for (int i = 0; i < FONT_RUN_CACHE; i++) {
+        free(f->runs[i].text);
+        free(f->runs[i].coverage);
+    }
+    free(f->coverage);
+    _fontReset(f);
+}
 
-    const float yaw_rad = cam->yaw * M_PI / 180.0f;
-    const float pitch_rad = cam->pitch * M_PI / 180.0f;
+static inline int _fontLineWidth(const BitmapFont *f, const char *text, const int len)
+{
+    int w = 0;
+    for (int i = 0; i < len; i++) w += f->glyphs[(uint8_t)text[i]].advance;
+    return w;
+}
 
-    cam->front = vec3(
-        cosf(yaw_rad) * cosf(pitch_rad),
-        sinf(pitch_rad),
-        sinf(yaw_rad) * cosf(pitch_rad)
-    );
+inline void fontMeasure(const BitmapFont *f, const char *text, int *width, int *height)
+{
+    int w = 0, lines = 0;
+    while (text) {
+        const char *nl = strchr(text, '\n');
+        const int len = nl ? (int)(nl - text) : (int)strlen(text);
+        const int lw = _fontLineWidth(f, text, len);
+        if (lw > w) w = lw;
+        lines++;
+        text = nl ? nl + 1 : NULL;
+    }
+    if (width)  *width  = w;
+    if (height) *height = lines * f->line_height;
+}
 
-    cam->front = norm(cam->front);
-    cam->right = norm(cross(cam->front, vec3(0, 1, 0)));
-    cam->up    = cross(cam->right, cam->front);
+// FNV-1a
+static inline uint64_t _fontHash(const char *text, const int len)
+{
+    uint64_t h = 1469598103934665603ull;
+    for (int i = 0; i < len; i++) h = (h ^ (uint8_t)text[i]) * 1099511628211ull;
+    return h;
 }
 
-inline void cameraMove(Camera *cam, const Vec3 direction, const float speed)
+// Find or rasterize the coverage run for one line of text
+static inline const FontRun *_fontGetRun(BitmapFont *f, const char *text, const int len)
 {
-    cam->position = add(cam->position, mul(direction, speed));
+    const uint64_t h = _fontHash(text, len);
+    f->tick++;
+
+    FontRun *victim = &f->runs[0];
+    for (int i = 0; i < FONT_RUN_CACHE; i++) {
+        FontRun *r = &f->runs[i];
+        if (r->text && r->hash == h && r->length == len && memcmp(r->text, text, (size_t)len) == 0) {
+            r->last_used = f->tick;
+            f->cache_hits++;
+            return r;
+        }
+        if (!r->text || (victim->text && r->last_used < victim->last_used)) victim = r;
+    }
+
+    f->cache_misses++;
+    free(victim->text);
+    free(victim->coverage);
+
+    int min_x = 0, max_x = 0, pen = 0;
+    for (int i = 0; i < len; i++) {
+        const Glyph *g = &f->glyphs[(uint8_t)text[i]];
+        if (pen + g->x_off < min_x) min_x = pen + g->x_off;
+        if (pen + g->x_off + g->width > max_x) max_x = pen + g->x_off + g->width;
+        pen += g->advance;
+    }
+    if (pen > max_x) max_x = pen;
+
+    victim->hash      = h;
+    victim->length    = len;
+    victim->width     = max_x - min_x;
+    victim->height    = f->line_height;
+    victim->origin    = min_x;
+    victim->last_used = f->tick;
+    victim->text      = (char*)malloc((size_t)len + 1);
+    victim->coverage  = (uint8_t*)calloc(1, (size_t)victim->width * victim->height + 1);
+    assert(victim->text && victim->coverage && "Failed to allocate text run");
+    memcpy(victim->text, text, (size_t)len);
+    victim->text[len] = '\0';
+
+    pen = -min_x;
+    for (int i = 0; i < len; i++) {
+        const Glyph *g = &f->glyphs[(uint8_t)text[i]];
+        for (int y = 0; y < g->height; y++) {
+            const int ry = g->y_off + y;
+            if (ry < 0 || ry >= victim->height) continue;
+            const uint8_t *src = f->coverage + g->offset + (size_t)y * g->width;
+            uint8_t *dst = victim->coverage + (size_t)ry * victim->width + pen + g->x_off;
+            for (int x = 0; x < g->width; x++)
+                if (src[x] > dst[x]) dst[x] = src[x];
+        }
+        pen += g->advance;
+    }
+
+    return victim;
 }
 
-inline void cameraRotate(Camera *cam, const float dyaw, const float dpitch)
+// Blend premultiplied color pc (B, G, R, A) scaled by per-pixel coverage
+static inline void _font_span(uint32_t *dst, const uint8_t *cov, const int n, const uint32_t pc[4])
 {
-    cam->yaw += dyaw;
-    cam->pitch += dpitch;
-    cameraUpdate(cam);
+    int i = 0;
+#if defined(__AVX2__)
+    if (cpuGetSimdLevel() >= CPU_SIMD_AVX2) {
+        const __m256i color = _mm256_setr_epi16((short)pc[0], (short)pc[1], (short)pc[2], (short)pc[3],
+                                                (short)pc[0], (short)pc[1], (short)pc[2], (short)pc[3],
+                                                (short)pc[0], (short)pc[1], (short)pc[2], (short)pc[3],
+                                                (short)pc[0], (short)pc[1], (short)pc[2], (short)pc[3]);
+        const __m256i z = _mm256_setzero_si256();
+        for (; i + 8 <= n; i += 8) {
+            uint64_t c8;
+            memcpy(&c8, cov + i, 8);
+            if (!c8) continue;
+            // Coverage bytes -> one 16-bit coverage value per channel lane
+            const __m128i c16 = _mm_unpacklo_epi8(_mm_cvtsi64_si128((long long)c8), _mm_setzero_si128());
+            const __m128i c32lo = _mm_unpacklo_epi16(c16, c16), c32hi = _mm_unpackhi_epi16(c16, c16);
+            // Match the in-lane pixel order of unpacklo/hi_epi8 on 256-bit registers
+            const __m256i cov_lo = _mm256_setr_m128i(_mm_unpacklo_epi32(c32lo, c32lo), _mm_unpacklo_epi32(c32hi, c32hi));
+            const __m256i cov_hi = _mm256_setr_m128i(_mm_unpackhi_epi32(c32lo, c32lo), _mm_unpackhi_epi32(c32hi, c32hi));
+            const __m256i d  = _mm256_loadu_si256((const __m256i*)(dst + i));
+            const __m256i lo = _draw2d_over_avx2(_mm256_unpacklo_epi8(d, z), _draw2d_mul255_avx2(color, cov_lo));
+            const __m256i hi = _draw2d_over_avx2(_mm256_unpackhi_epi8(d, z), _draw2d_mul255_avx2(color, cov_hi));
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(lo, hi));
+        }
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    if (cpuGetSimdLevel() >= CPU_SIMD_SSE) {
+        const __m128i color = _mm_setr_epi16((short)pc[0], (short)pc[1], (short)pc[2], (short)pc[3],
+                                             (short)pc[0], (short)pc[1], (short)pc[2], (short)pc[3]);
+        const __m128i z = _mm_setzero_si128();
+        for (; i + 4 <= n; i += 4) {
+            int c4;
+            memcpy(&c4, cov + i, 4);
+            if (!c4) continue;
+            const __m128i c16 = _mm_unpacklo_epi8(_mm_cvtsi32_si128(c4), z);
+            const __m128i c32 = _mm_unpacklo_epi16(c16, c16);
+            const __m128i d  = _mm_loadu_si128((const __m128i*)(dst + i));
+            const __m128i lo = _draw2d_over_sse(_mm_unpacklo_epi8(d, z), _draw2d_mul255_sse(color, _mm_unpacklo_epi32(c32, c32)));
+            const __m128i hi = _draw2d_over_sse(_mm_unpackhi_epi8(d, z), _draw2d_mul255_sse(color, _mm_unpackhi_epi32(c32, c32)));
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        const uint32_t c = cov[i];
+        if (!c) continue;
+        dst[i] = _draw2d_over_px(dst[i], _draw2d_mul255(pc[0], c), _draw2d_mul255(pc[1], c),
+                                         _draw2d_mul255(pc[2], c), _draw2d_mul255(pc[3], c));
+    }
 }
 
-inline Ray cameraGetRay(const Camera* cam, const float u_scaled, const float v_scaled)
+inline void drawText(const Window_t *w, BitmapFont *f, const int x, int y, const char *text, const uint32_t color)
 {
-    Vec3 rd = add(cam->front, add(mul(cam->up, v_scaled), mul(cam->right, u_scaled)));
-    rd = norm(rd);
-    return (Ray){cam->position, rd};
+    if (!w->buffer_valid || !text || f->line_height <= 0) return;
+
+    const uint32_t a = color >> 24;
+    if (a == 0) return;
+    const uint32_t pc[4] = {
+        _draw2d_mul255(color & 0xFF, a),
+        _draw2d_mul255((color >> 8) & 0xFF, a),
+        _draw2d_mul255((color >> 16) & 0xFF, a),
+        a,
+    };
+
+    while (text) {
+        const char *nl = strchr(text, '\n');
+        const int len = nl ? (int)(nl - text) : (int)strlen(text);
+
+        if (len > 0 && y + f->line_height > 0 && y < w->bHeight) {
+            const FontRun *run = _fontGetRun(f, text, len);
+            int rx = x + run->origin, ry = y, rw = run->width, rh = run->height;
+            const int ox = rx, oy = ry;
+            if (_draw2d_clip(w, &rx, &ry, &rw, &rh)) {
+                for (int j = 0; j < rh; j++) {
+                    const uint8_t *cov = run->coverage + (size_t)(ry - oy + j) * run->width + (rx - ox);
+                    _font_span(w->buffer + (size_t)(ry + j) * w->bWidth + rx, cov, rw, pc);
+                }
+            }
+        }
+
+        y += f->line_height;
+        text = nl ? nl + 1 : NULL;
+    }
 }
 
-#endif // CAMERA_IMPLEMENTATION
-#endif // WRAPPER_CAMERA_H
+#endif // TEXT_IMPLEMENTATION
+#endif // WRAPPER_TEXT_H
 
 // ============================================================================
-// 3D model with materials and transforms
+// Asynchronous framebuffer capture (screenshots / frame dumps)
+// The encoders come from IMAGE_IMPLEMENTATION, which must be defined with CAPTURE_IMPLEMENTATION
 // ============================================================================
-#ifndef WRAPPER_MODEL_H
-#define WRAPPER_MODEL_H
-
-#define INITIAL_VERTEX_CAPACITY 1024
-#define INITIAL_TRIANGLE_CAPACITY 2048
+#ifndef WRAPPER_CAPTURE_H
+#define WRAPPER_CAPTURE_H
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// Material properties for rendering
+typedef enum {
+    CAPTURE_QOI,
+    CAPTURE_PNG,
+    CAPTURE_PPM,
+} CaptureFormat;
+
+// What happens when every pooled buffer is still waiting to be encoded
+typedef enum {
+    CAPTURE_DROP_NEWEST,    // Reject the new frame
+    CAPTURE_DROP_OLDEST,    // Replace the oldest frame that has not started encoding
+} CaptureDropPolicy;
+
 typedef struct {
-    Vec3 color;
-    float reflectivity;  // 0.0 = matte, 1.0 = mirror
-	float specular;
-} Material;
+    CaptureFormat format;
+    int compression;        // PNG only: 0 (stored, fastest) .. 9 (smallest)
+    int queue_size;         // Pooled frame buffers (>= 1)
+    CaptureDropPolicy drop;
+    bool keep_alpha;        // false: force opaque output (framebuffer alpha is usually junk)
+} CaptureOptions;
 
-// Triangle primitive for meshes
 typedef struct {
-    Vec3 v0, v1, v2;
-    Vec3 color;
-} Triangle;
+    int queued;             // Frames accepted by captureFrame
+    int written;
+    int dropped;
+    int failed;             // Encoder or file errors
+} CaptureStats;
 
-// 3D model with transform and material
 typedef struct {
-    Triangle* triangles;              // Original mesh triangles
-    Triangle* transformed_triangles;  // World-space transformed triangles
-    int num_triangles;
-    int capacity;                      // Allocated triangle capacity
-    Vec3 position;
-    float rot_x, rot_y, rot_z;         // Euler angles in radians
-    Vec3 scale;
-    Material mat;
-} Model;
+    CaptureOptions options;
+    struct _CaptureQueue *queue;
+} Capture;
 
-// Create new model in storage array (returns NULL if array is full)
+// Defaults: QOI, PNG level 1, 4 buffers, drop newest, opaque
 /*  -> Example:
- *  Model* cube = modelCreate(scene_models, &num_models, MAX_MODELS, vec3(1,0,0), 0.5f);
+ *  CaptureOptions o;
+ *  captureOptionsInit(&o);
+ *  o.format = CAPTURE_PNG;
  */
-Model* modelCreate(Model* storage, int* count, int max, Vec3 color, float refl, float spec);
+void captureOptionsInit(CaptureOptions *o);
 
-// Load OBJ file into model (dynamically allocates triangles)
+// Start the encoder thread
 /*  -> Example:
- *  modelLoad(cube, "res/cube.obj");
+ *  Capture cap;
+ *  ASSERT(captureInit(&cap, &o));
  */
-void modelLoad(Model* m, const char* path);
+bool captureInit(Capture *c, const CaptureOptions *o);
 
-// Free model triangle data
+// Copy the framebuffer into a pooled buffer and queue it for encoding; false if the frame was dropped.
+// path may contain one integer conversion (%d, %04d, %x, ...) that receives the running frame number and
+// "%%" for a literal '%'; any other '%' sequence fails the frame (counted in CaptureStats::failed)
 /*  -> Example:
- *  modelFree(cube);
+ *  if (isKeyPressed(&win, KEY_P)) captureFrame(&cap, &win, "shot_%04d.qoi");
  */
-void modelFree(Model* m);
+bool captureFrame(Capture *c, const Window_t *w, const char *path);
 
-// Set model transform (position, rotation in radians, scale)
+// Block until every queued frame is written
 /*  -> Example:
- *  modelTransform(cube, vec3(0,0,0), vec3(0, M_PI/4, 0), vec3(1,1,1));
+ *  captureFlush(&cap);
  */
-void modelTransform(Model* m, Vec3 pos, Vec3 rot, Vec3 scale);
+void captureFlush(Capture *c);
 
-// Apply transforms to all models in array (call after changing transforms)
+// Read counters
 /*  -> Example:
- *  modelUpdate(scene_models, num_models);
+ *  CaptureStats s;
+ *  captureGetStats(&cap, &s);
+ *  printf("dropped %d\n", s.dropped);
  */
-void modelUpdate(const Model* models, int count);
+void captureGetStats(Capture *c, CaptureStats *s);
+
+// Finish pending frames, stop the thread and free the pool
+/*  -> Example:
+ *  captureShutdown(&cap);
+ */
+void captureShutdown(Capture *c);
 
 #ifdef __cplusplus
 }
 #endif
 
-#ifdef MODEL_IMPLEMENTATION
+#ifdef CAPTURE_IMPLEMENTATION
 
-#include <stdlib.h>
-#include <string.h>
+#ifndef IMAGE_IMPLEMENTATION
+#error "CAPTURE_IMPLEMENTATION needs IMAGE_IMPLEMENTATION (PNG/QOI/PPM encoders)"
+#endif
 
-// Rotation helpers
-static inline Vec3 rotate_x(const Vec3 v, const float a)
+#define _CAPTURE_MAX_QUEUE 64
+
+typedef struct {
+    uint32_t *pixels;
+    size_t capacity;        // In pixels
+    int width, height;
+    char path[512];
+} _CaptureSlot;
+
+struct _CaptureQueue;
+typedef bool (*_CaptureEncodeFn)(struct _CaptureQueue *q, const _CaptureSlot *slot);
+
+// Pooled frame buffers drained in order by one worker thread (shared with the video recorder)
+struct _CaptureQueue {
+    _CoreMutex   lock;
+    _CoreCond    wake;      // Worker: frame queued or quit
+    _CoreCond    idle;      // Flush: a frame finished
+    _CoreThread  thread;
+    _CaptureSlot slots[_CAPTURE_MAX_QUEUE];
+    int          order[_CAPTURE_MAX_QUEUE]; // FIFO of queued slot indices
+    int          head, count;
+    bool         in_use[_CAPTURE_MAX_QUEUE];
+    bool         busy;      // Worker is encoding
+    bool         quit;
+    int          frame;
+    CaptureOptions options; // Worker's copy, so the owner may move
+    _CaptureEncodeFn encode;
+    void        *user;
+    CaptureStats stats;
+};
+
+inline void captureOptionsInit(CaptureOptions *o)
 {
-    const float c = cosf(a), s = sinf(a);
-    return vec3(v.x, v.y * c - v.z * s, v.y * s + v.z * c);
+    o->format      = CAPTURE_QOI;
+    o->compression = 1;
+    o->queue_size  = 4;
+    o->drop        = CAPTURE_DROP_NEWEST;
+    o->keep_alpha  = false;
 }
 
-static inline Vec3 rotate_y(const Vec3 v, const float a)
+static _CORE_THREAD_RET _captureWorker(void *arg)
 {
-    const float c = cosf(a), s = sinf(a);
-    return vec3(v.x * c - v.z * s, v.y, v.x * s + v.z * c);
+    struct _CaptureQueue *q = (struct _CaptureQueue*)arg;
+
+    _coreLock(&q->lock);
+    for (;;) {
+        while (q->count == 0 && !q->quit) _coreCondWait(&q->wake, &q->lock);
+        if (q->count == 0) break;
+
+        const int s = q->order[q->head];
+        q->head = (q->head + 1) % _CAPTURE_MAX_QUEUE;
+        q->count--;
+        q->busy = true;
+        _coreUnlock(&q->lock);
+
+        const bool ok = q->encode(q, &q->slots[s]);
+
+        _coreLock(&q->lock);
+        q->in_use[s] = false;
+        q->busy = false;
+        if (ok) q->stats.written++;
+        else    q->stats.failed++;
+        _coreCondBroadcast(&q->idle);
+    }
+    _coreUnlock(&q->lock);
+    return _CORE_THREAD_RETURN;
 }
 
-static inline Vec3 rotate_z(const Vec3 v, const float a)
+static inline struct _CaptureQueue *_captureQueueCreate(const CaptureOptions *o, const _CaptureEncodeFn encode, void *user)
 {
-    const float c = cosf(a), s = sinf(a);
-    return vec3(v.x * c - v.y * s, v.x * s + v.y * c, v.z);
+    struct _CaptureQueue *q = (struct _CaptureQueue*)calloc(1, sizeof(struct _CaptureQueue));
+    if (!q) return NULL;
+    q->options = *o;
+    if (q->options.queue_size < 1) q->options.queue_size = 1;
+    if (q->options.queue_size > _CAPTURE_MAX_QUEUE) q->options.queue_size = _CAPTURE_MAX_QUEUE;
+    q->encode = encode;
+    q->user   = user;
+    _coreMutexInit(&q->lock);
+    _coreCondInit(&q->wake);
+    _coreCondInit(&q->idle);
+
+    if (!_coreThreadStart(&q->thread, _captureWorker, q)) {
+        fprintf(stderr, "Failed to start capture thread\n");
+        _coreCondFree(&q->idle);
+        _coreCondFree(&q->wake);
+        _coreMutexFree(&q->lock);
+        free(q);
+        return NULL;
+    }
+    return q;
 }
 
-static inline Vec3 transform_vertex(Vec3 v, const Model* m)
+// Row copy; optionally forces alpha to 0xFF on the way
+static inline void _captureCopyRow(uint32_t *dst, const uint32_t *src, const int n, const bool keep_alpha)
 {
-    v = vmul(v, m->scale);
-    if (m->rot_z) v = rotate_z(v, m->rot_z);
-    if (m->rot_x) v = rotate_x(v, m->rot_x);
-    if (m->rot_y) v = rotate_y(v, m->rot_y);
-    return add(v, m->position);
+    if (keep_alpha) { memcpy(dst, src, (size_t)n * sizeof(uint32_t)); return; }
+    int i = 0;
+#if defined(__AVX2__)
+    if (cpuGetSimdLevel() >= CPU_SIMD_AVX2) {
+        const __m256i a = _mm256_set1_epi32((int)0xFF000000u);
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(src + i)), a));
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    if (cpuGetSimdLevel() >= CPU_SIMD_SSE) {
+        const __m128i a = _mm_set1_epi32((int)0xFF000000u);
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_loadu_si128((const __m128i*)(src + i)), a));
+    }
+#endif
+    for (; i < n; i++) dst[i] = src[i] | 0xFF000000u;
 }
 
-inline Model* modelCreate(Model* storage, int* count, const int max, const Vec3 color, const float refl, const float spec)
+// Expand a capture path pattern: "%%" and at most one integer conversion ("%d", "%05u", "%x", ...) that receives
+// frame. Anything else after a '%' makes the pattern invalid. out may be NULL to only validate.
+static inline bool _captureFormatPath(char *out, const size_t size, const char *pattern, const int frame)
 {
-    if (*count >= max) return NULL;
-    Model* m = &storage[(*count)++];
-    m->triangles = NULL;
-    m->transformed_triangles = NULL;
-    m->num_triangles = 0;
-    m->capacity = 0;
-    m->position = (Vec3){0, 0, 0};
-    m->scale = (Vec3){1.0f, 1.0f, 1.0f};
-    m->rot_x = 0; m->rot_y = 0; m->rot_z = 0;
-    m->mat = (Material){color, refl, spec};
-    return m;
+    size_t n = 0;
+    bool converted = false;
+    for (const char *p = pattern; *p; ) {
+        char piece[64];
+        int len = 1;
+        if (*p != '%') {
+            piece[0] = *p++;
+        } else if (p[1] == '%') {
+            piece[0] = '%';
+            p += 2;
+        } else {
+            // %[flags][width][.precision]conversion, width and precision up to two digits
+            char spec[16];
+            int k = 0, digits = 0;
+            spec[k++] = *p++;
+            while (*p && strchr("-+ 0#", *p) && k < 6) spec[k++] = *p++;
+            for (digits = 0; *p >= '0' && *p <= '9' && digits < 2; digits++) spec[k++] = *p++;
+            if (*p == '.') {
+                spec[k++] = *p++;
+                for (digits = 0; *p >= '0' && *p <= '9' && digits < 2; digits++) spec[k++] = *p++;
+            }
+            if (converted || !*p || !strchr("diuxXo", *p)) return false;
+            spec[k++] = *p++;
+            spec[k] = '\0';
+            converted = true;
+            len = snprintf(piece, sizeof(piece), spec, frame);
+            if (len < 0 || len >= (int)sizeof(piece)) return false;
+        }
+        if (out) {
+            if (n + (size_t)len >= size) return false;
+            memcpy(out + n, piece, (size_t)len);
+        }
+        n += (size_t)len;
+    }
+    if (out) out[n] = '\0';
+    return true;
 }
 
-inline void modelFree(Model* m)
+// Snapshot w->buffer into a free slot and queue it; false if the frame was dropped
+static inline bool _captureQueuePush(struct _CaptureQueue *q, const Window_t *w, const char *path)
 {
-    if (m->triangles)
-    {
-        free(m->triangles);
-        m->triangles = NULL;
+    if (!q || !w->buffer_valid) return false;
+    if (path && !_captureFormatPath(NULL, 0, path, 0)) {
+        _coreLock(&q->lock);
+        q->stats.failed++;
+        _coreUnlock(&q->lock);
+        return false;
     }
 
-    if (m->transformed_triangles)
-    {
-        free(m->transformed_triangles);
-        m->transformed_triangles = NULL;
+    _coreLock(&q->lock);
+    int s = -1;
+    for (int i = 0; i < q->options.queue_size; i++)
+        if (!q->in_use[i]) { s = i; break; }
+
+    if (s < 0 && q->options.drop == CAPTURE_DROP_OLDEST && q->count > 0) {
+        s = q->order[q->head];
+        q->head = (q->head + 1) % _CAPTURE_MAX_QUEUE;
+        q->count--;
+        q->stats.dropped++;
+    }
+    if (s < 0) {
+        q->stats.dropped++;
+        _coreUnlock(&q->lock);
+        return false;
+    }
+    q->in_use[s] = true;
+    const int frame = q->frame++;
+    _coreUnlock(&q->lock);
+
+    // The slot is ours now; copy without holding the lock
+    _CaptureSlot *slot = &q->slots[s];
+    const size_t n = (size_t)w->bWidth * w->bHeight;
+    if (slot->capacity < n) {
+        free(slot->pixels);
+        slot->pixels = (uint32_t*)malloc(n * sizeof(uint32_t));
+        slot->capacity = slot->pixels ? n : 0;
+    }
+    if (!slot->pixels) {
+        _coreLock(&q->lock);
+        q->in_use[s] = false;
+        q->stats.failed++;
+        _coreUnlock(&q->lock);
+        return false;
     }
 
-    m->num_triangles = 0;
-    m->capacity = 0;
+    for (int y = 0; y < w->bHeight; y++)
+        _captureCopyRow(slot->pixels + (size_t)y * w->bWidth, w->buffer + (size_t)y * w->bWidth, w->bWidth, q->options.keep_alpha);
+    slot->width  = w->bWidth;
+    slot->height = w->bHeight;
+    if (!path || !_captureFormatPath(slot->path, sizeof(slot->path), path, frame)) slot->path[0] = '\0';
+
+    _coreLock(&q->lock);
+    q->order[(q->head + q->count) % _CAPTURE_MAX_QUEUE] = s;
+    q->count++;
+    q->stats.queued++;
+    _coreCondSignal(&q->wake);
+    _coreUnlock(&q->lock);
+    return true;
 }
 
-inline void modelTransform(Model* m, const Vec3 pos, const Vec3 rot, const Vec3 scale)
+static inline void _captureQueueFlush(struct _CaptureQueue *q)
 {
-    m->position = pos;
-    m->rot_x = rot.x;
-    m->rot_y = rot.y;
-    m->rot_z = rot.z;
-    m->scale = scale;
+    if (!q) return;
+    _coreLock(&q->lock);
+    for (;;) {
+        bool pending = q->count > 0 || q->busy;
+        for (int i = 0; i < q->options.queue_size && !pending; i++) pending = q->in_use[i];
+        if (!pending) break;
+        _coreCondWait(&q->idle, &q->lock);
+    }
+    _coreUnlock(&q->lock);
 }
 
-inline void modelUpdate(const Model* models, const int count)
+static inline CaptureStats _captureQueueStats(struct _CaptureQueue *q)
 {
-    for (int i = 0; i < count; i++)
-    {
-        const Model* m = &models[i];
-        for (int j = 0; j < m->num_triangles; j++)
-        {
-            m->transformed_triangles[j].v0    = transform_vertex(m->triangles[j].v0, m);
-            m->transformed_triangles[j].v1    = transform_vertex(m->triangles[j].v1, m);
-            m->transformed_triangles[j].v2    = transform_vertex(m->triangles[j].v2, m);
-            m->transformed_triangles[j].color = m->triangles[j].color;
-        }
+    CaptureStats s;
+    memset(&s, 0, sizeof(s));
+    if (!q) return s;
+    _coreLock(&q->lock);
+    s = q->stats;
+    _coreUnlock(&q->lock);
+    return s;
+}
+
+// Drains pending frames, then stops the worker
+static inline void _captureQueueDestroy(struct _CaptureQueue *q)
+{
+    if (!q) return;
+    _coreLock(&q->lock);
+    q->quit = true;
+    _coreCondSignal(&q->wake);
+    _coreUnlock(&q->lock);
+    _coreThreadJoin(&q->thread);
+
+    for (int i = 0; i < _CAPTURE_MAX_QUEUE; i++) free(q->slots[i].pixels);
+    _coreCondFree(&q->idle);
+    _coreCondFree(&q->wake);
+    _coreMutexFree(&q->lock);
+    free(q);
+}
+
+static bool _captureEncodeImage(struct _CaptureQueue *q, const _CaptureSlot *slot)
+{
+    Image img;
+    imageWrap(&img, slot->pixels, slot->width, slot->height, slot->width);
+    switch (q->options.format) {
+        case CAPTURE_QOI: return imageSaveQOI(&img, slot->path);
+        case CAPTURE_PNG: return imageSavePNG(&img, slot->path, q->options.compression);
+        case CAPTURE_PPM: return imageSavePPM(&img, slot->path);
     }
+    return false;
 }
 
-// Helper to open file with fallback paths
-static inline FILE* _modelOpenFileWithFallback(const char* path)
+inline bool captureInit(Capture *c, const CaptureOptions *o)
 {
-    FILE* f = fopen(path, "r");
-    if (f) return f;
+    if (o) c->options = *o;
+    else   captureOptionsInit(&c->options);
+    c->queue = _captureQueueCreate(&c->options, _captureEncodeImage, NULL);
+    if (c->queue) c->options = c->queue->options;
+    return c->queue != NULL;
+}
 
-    char buf[1024];
+inline bool captureFrame(Capture *c, const Window_t *w, const char *path)
+{
+    return _captureQueuePush(c->queue, w, path);
+}
 
-#ifdef SDL_IMPLEMENTATION
-    const char* base = SDL_GetBasePath();
-    if (base) {
-        SDL_snprintf(buf, sizeof(buf), "%s%s", base, path);
-        f = fopen(buf, "r");
-        if (!f) {
-            SDL_snprintf(buf, sizeof(buf), "%s../%s", base, path);
-            f = fopen(buf, "r");
-        }
-        if (!f) {
-            SDL_snprintf(buf, sizeof(buf), "%s../../%s", base, path);
-            f = fopen(buf, "r");
-        }
-        SDL_free((void*)base);
-        if (f) return f;
-    }
-#endif
-
-    // Generic fallbacks (up to 2 levels)
-    snprintf(buf, sizeof(buf), "../%s", path);
-    f = fopen(buf, "r");
-    if (f) return f;
-
-    snprintf(buf, sizeof(buf), "../../%s", path);
-    f = fopen(buf, "r");
-    if (f) return f;
-
-    return NULL;
+inline void captureFlush(Capture *c)
+{
+    _captureQueueFlush(c->queue);
 }
 
-inline void modelLoad(Model* m, const char* path)
+inline void captureGetStats(Capture *c, CaptureStats *s)
 {
-    FILE* f = _modelOpenFileWithFallback(path);
-    if (!f) {
-        fprintf(stderr, "Failed to open OBJ file: %s\n", path);
-        return;
-    }
-
-    // Dynamic arrays for vertices and triangles
-    int vert_capacity = INITIAL_VERTEX_CAPACITY;
-    int tri_capacity  = INITIAL_TRIANGLE_CAPACITY;
-
-    Vec3* verts     = (Vec3*)malloc(vert_capacity * sizeof(Vec3));
-    Triangle* tris = (Triangle*)malloc(tri_capacity * sizeof(Triangle));
-    assert(verts && tris && "Failed to allocate OBJ parsing buffers");
-
-    int nv = 0, nt = 0;
-    char buf[256];
-
-    while (fgets(buf, sizeof(buf), f))
-    {
-        if (buf[0] == 'v' && buf[1] == ' ')
-        {
-            // Vertex line
-            if (nv >= vert_capacity)
-            {
-                vert_capacity *= 2;
-                verts = (Vec3*)realloc(verts, vert_capacity * sizeof(Vec3));
-                assert(verts && "Failed to reallocate vertex buffer");
-            }
-
-            float x, y, z;
-            sscanf(buf + 2, "%f %f %f", &x, &y, &z);
-            verts[nv++] = vec3(x, y, z);
-        }
-        else if (buf[0] == 'f')
-        {
-            // Face line (only supports triangulated meshes)
-            if (nt >= tri_capacity)
-            {
-                tri_capacity *= 2;
-                tris = (Triangle*)realloc(tris, tri_capacity * sizeof(Triangle));
-                assert(tris && "Failed to reallocate triangle buffer");
-            }
-
-            int a, b, c;
-            if (sscanf(buf + 2, "%d %d %d", &a, &b, &c) == 3)
-            {
-                // OBJ indices are 1-based
-                if (a > 0 && a <= nv && b > 0 && b <= nv && c > 0 && c <= nv)
-                {
-                    tris[nt++] = (Triangle){verts[a-1], verts[b-1], verts[c-1], m->mat.color};
-                }
-            }
-        }
-    }
-    fclose(f);
-
-    // Allocate exact size for model
-    m->triangles             = (Triangle*)malloc(nt * sizeof(Triangle));
-    m->transformed_triangles = (Triangle*)malloc(nt * sizeof(Triangle));
-    assert(m->triangles && m->transformed_triangles && "Failed to allocate model triangles");
-
-    memcpy(m->triangles, tris, nt * sizeof(Triangle));
-    m->num_triangles = nt;
-    m->capacity = nt;
-
-    // Free temporary buffers
-    free(verts);
-    free(tris);
-
-    printf("Loaded %s: %d vertices, %d triangles\n", path, nv, nt);
+    *s = _captureQueueStats(c->queue);
 }
 
-#endif // MODEL_IMPLEMENTATION
-#endif // WRAPPER_MODEL_H
+inline void captureShutdown(Capture *c)
+{
+    _captureQueueDestroy(c->queue);
+    c->queue = NULL;
+}
 
+#endif // CAPTURE_IMPLEMENTATION
+#endif // WRAPPER_CAPTURE_H
 
 // ============================================================================
-// 3D Rasterization Renderer
+// Raw video recording (Y4M / I420) of presented frames
+// The implementation runs on the capture queue, so CAPTURE_IMPLEMENTATION (and with it IMAGE_IMPLEMENTATION)
+// must be defined too
 // ============================================================================
-#ifndef WRAPPER_RENDER3D_H
-#define WRAPPER_RENDER3D_H
+#ifndef WRAPPER_VIDEO_H
+#define WRAPPER_VIDEO_H
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// Depth buffer for 3D rendering
 typedef struct {
-    float* depths;
-    int width;
-    int height;
-    bool valid;
-} DepthBuffer;
+    int fps_num, fps_den;   // Frame rate written to the Y4M header
+    int queue_size;         // Frames buffered for the converter thread
+} VideoOptions;
 
-// Rendering context combining window, camera, and depth buffer
 typedef struct {
-    Window_t* window;
-    Camera* camera;
-    DepthBuffer depth;
-    bool wireframe;
-    bool backface_culling;
-    bool light;
-    Vec3 light_dir;
-#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
-    // GPU-accelerated rendering state (populated by renderInit when Gpu* != NULL)
-    Gpu*                    gpu;
-    SDL_GPUGraphicsPipeline *pipeline;
-    SDL_GPUTexture          *depth_tex;
-    Uint32                   depth_tex_w, depth_tex_h;
-    bool                     gpu_ready;
-#endif
-} Renderer;
+    int submitted;          // Frames presented while recording
+    int written;
+    int dropped;            // Queue full (converter or sink too slow)
+    int mismatched;         // Buffer size differed from the stream size
+    int failed;             // Write errors (e.g. the pipe closed)
+    bool pipe_closed;       // The "|command" reader exited (EPIPE); later frames fail without writing
+} VideoStats;
 
-// Initialize 3D renderer.
-// Pass a valid Gpu* to enable GPU-accelerated rendering; NULL for CPU rasterization.
-/*  -> Example (CPU):
- *  renderInit(&renderer, &window, &camera, NULL);
- *
- *  -> Example (GPU):
- *  renderInit(&renderer, &window, &camera, &gpu);
+typedef struct {
+    VideoOptions options;
+    int width, height;
+    FILE *out;
+    bool is_pipe;
+    uint8_t *planes;        // I420 scratch, used by the worker only
+    int mismatched;
+    bool pipe_closed;       // Set by the worker under the queue lock
+    struct _CaptureQueue *queue;
+    Window_t *window;       // Set while attached
+} VideoRecorder;
+
+// Defaults: 60 fps, 4 queued frames
+/*  -> Example:
+ *  VideoOptions vo;
+ *  videoOptionsInit(&vo);
+ *  vo.fps_num = 30;
  */
-#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
-inline void renderInit(Renderer* r, Window_t* win, Camera* cam, Gpu* gpu);
-#else
-inline void renderInit(Renderer* r, Window_t* win, Camera* cam);
-#endif
+void videoOptionsInit(VideoOptions *o);
 
-// Free 3D renderer resources
-void renderFree(Renderer* r);
+// Open a Y4M stream: a file path, or "|command" to pipe into an external encoder
+/*  -> Example:
+ *  VideoRecorder rec;
+ *  videoRecorderOpen(&rec, "session.y4m", win.bWidth, win.bHeight, NULL);
+ *  videoRecorderOpen(&rec, "|ffmpeg -y -i - -c:v libx264 out.mp4", win.bWidth, win.bHeight, &vo);
+ */
+bool videoRecorderOpen(VideoRecorder *r, const char *target, int width, int height, const VideoOptions *o);
 
-// Clear depth buffer
-void renderClear(Renderer* r);
+// Record every frame passed to updateFramebuffer
+/*  -> Example:
+ *  videoRecorderAttach(&rec, &win);
+ */
+void videoRecorderAttach(VideoRecorder *r, Window_t *w);
 
-// Render a single model
+// Queue the current framebuffer manually (without attaching); false if dropped
 /*  -> Example:
- *  renderModel(&renderer, &cube_model);
+ *  videoRecordFrame(&rec, &win);
  */
-void renderModel(Renderer* r, const Model* m);
+bool videoRecordFrame(VideoRecorder *r, const Window_t *w);
 
-// Render array of models
+// Read counters
 /*  -> Example:
- *  renderScene(&renderer, scene_models, num_models);
+ *  VideoStats s;
+ *  videoRecorderGetStats(&rec, &s);
+ *  printf("%d/%d frames dropped\n", s.dropped, s.submitted);
  */
-void renderScene(Renderer* r, const Model* models, int count);
+void videoRecorderGetStats(VideoRecorder *r, VideoStats *s);
+
+// Detach, write pending frames and close the stream
+/*  -> Example:
+ *  videoRecorderClose(&rec);
+ */
+void videoRecorderClose(VideoRecorder *r);
+
+// Convert 0xAARRGGBB to I420 (BT.601 limited range, 2x2 averaged chroma)
+/*  -> Example:
+ *  videoConvertI420(img.pixels, img.pitch, img.width, img.height, y, u, v);
+ */
+void videoConvertI420(const uint32_t *src, int pitch, int width, int height, uint8_t *y, uint8_t *u, uint8_t *v);
 
 #ifdef __cplusplus
 }
 #endif
 
-#ifdef RENDER3D_IMPLEMENTATION
+#ifdef VIDEO_IMPLEMENTATION
 
-#include <float.h>
+#ifndef CAPTURE_IMPLEMENTATION
+#error "VIDEO_IMPLEMENTATION needs CAPTURE_IMPLEMENTATION (frame queue and worker)"
+#endif
 
-typedef struct { float m[16]; } Mat4;
+#include <errno.h>
 
-static inline Mat4 _perspective(float fov, float aspect, float near, float far)
+#ifdef _WIN32
+    #define _video_popen  _popen
+    #define _video_pclose _pclose
+typedef int _VideoPipeGuard;
+static inline void _video_pipe_enter(_VideoPipeGuard *g) { *g = 0; }
+static inline void _video_pipe_leave(const _VideoPipeGuard *g) { (void)g; }
+#else
+    #include <signal.h>
+    #include <pthread.h>
+    #define _video_popen  popen
+    #define _video_pclose pclose
+
+// Writing to a pipe whose reader exited raises SIGPIPE, which terminates the process by default. It is blocked in
+// the writing thread around pipe writes so they fail with EPIPE, and one raised meanwhile is consumed before the
+// old mask comes back (unless the caller had it blocked already).
+typedef sigset_t _VideoPipeGuard;
+static inline void _video_pipe_enter(_VideoPipeGuard *g)
 {
-    Mat4 mat = {0};
-    const float tan_half_fov = tanf(fov * 0.5f * M_PI / 180.0f);
-    mat.m[0]  = 1.0f / (aspect * tan_half_fov);
-    mat.m[5]  = 1.0f / tan_half_fov;
-    mat.m[10] = -(far + near) / (far - near);
-    mat.m[11] = -1.0f;
-    mat.m[14] = -(2.0f * far * near) / (far - near);
-    return mat;
+    sigset_t s;
+    sigemptyset(&s);
+    sigaddset(&s, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &s, g);
 }
-
-static inline Mat4 _lookAt(Vec3 eye, Vec3 target, Vec3 up)
+static inline void _video_pipe_leave(const _VideoPipeGuard *g)
 {
-    Mat4 mat = {0};
-    const Vec3 f = norm(sub(target, eye));
-    const Vec3 r = norm(cross(f, up));
-    const Vec3 u = cross(r, f);
-    mat.m[0] = r.x; mat.m[4] = r.y; mat.m[8]  = r.z;  mat.m[12] = -dot(r, eye);
-    mat.m[1] = u.x; mat.m[5] = u.y; mat.m[9]  = u.z;  mat.m[13] = -dot(u, eye);
-    mat.m[2] =-f.x; mat.m[6] =-f.y; mat.m[10] =-f.z;  mat.m[14] =  dot(f, eye);
-    mat.m[15] = 1.0f;
-    return mat;
+    sigset_t s, pending;
+    sigemptyset(&s);
+    sigaddset(&s, SIGPIPE);
+    if (!sigismember(g, SIGPIPE) && sigpending(&pending) == 0 && sigismember(&pending, SIGPIPE)) {
+        int sig;
+        sigwait(&s, &sig);
+    }
+    pthread_sigmask(SIG_SETMASK, g, NULL);
 }
+#endif
 
-static inline Vec3 _mat4_mul_vec3(const Mat4* m, Vec3 v, float* w_out)
+inline void videoOptionsInit(VideoOptions *o)
 {
-    const float x = m->m[0]*v.x + m->m[4]*v.y + m->m[8]*v.z  + m->m[12];
-    const float y = m->m[1]*v.x + m->m[5]*v.y + m->m[9]*v.z  + m->m[13];
-    const float z = m->m[2]*v.x + m->m[6]*v.y + m->m[10]*v.z + m->m[14];
-    const float w = m->m[3]*v.x + m->m[7]*v.y + m->m[11]*v.z + m->m[15];
-    if (w_out) *w_out = w;
-    return vec3(x, y, z);
+    o->fps_num    = 60;
+    o->fps_den    = 1;
+    o->queue_size = 4;
 }
 
-static inline Mat4 _mat4_mul(const Mat4* a, const Mat4* b)
+static inline int _video_y(const uint32_t p)
 {
-    Mat4 r = {0};
-    for (int i = 0; i < 4; i++)
-        for (int j = 0; j < 4; j++)
-            r.m[i + j*4] = a->m[i+0*4]*b->m[0+j*4] + a->m[i+1*4]*b->m[1+j*4]
-                         + a->m[i+2*4]*b->m[2+j*4] + a->m[i+3*4]*b->m[3+j*4];
-    return r;
+    const int r = (p >> 16) & 0xFF, g = (p >> 8) & 0xFF, b = p & 0xFF;
+    return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
 }
 
-static inline void _to_screen(Vec3* v, int width, int height)
+// Chroma from the rounded average of a 2x2 block
+static inline void _video_uv(const uint32_t p0, const uint32_t p1, const uint32_t p2, const uint32_t p3, uint8_t *u, uint8_t *v)
 {
-    v->x = (v->x + 1.0f) * 0.5f * width;
-    v->y = (1.0f - v->y) * 0.5f * height;
+    const int r = (int)((((p0 >> 16) & 0xFF) + ((p1 >> 16) & 0xFF) + ((p2 >> 16) & 0xFF) + ((p3 >> 16) & 0xFF) + 2) >> 2);
+    const int g = (int)((((p0 >> 8) & 0xFF) + ((p1 >> 8) & 0xFF) + ((p2 >> 8) & 0xFF) + ((p3 >> 8) & 0xFF) + 2) >> 2);
+    const int b = (int)(((p0 & 0xFF) + (p1 & 0xFF) + (p2 & 0xFF) + (p3 & 0xFF) + 2) >> 2);
+    *u = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    *v = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
 }
 
-static inline float _calculate_lighting(Vec3 normal, Vec3 light_dir)
+#if defined(__SSE2__) || defined(_M_X64)
+// Dot products of 4 pixels (B, G, R, A in 16-bit lanes) with coef, as 4 int32
+static inline __m128i _video_dot4_sse(const __m128i lo, const __m128i hi, const __m128i coef)
 {
-    return fminf(1.0f, fmaxf(0.0f, -dot(normal, light_dir)));
+    __m128i a = _mm_madd_epi16(lo, coef), b = _mm_madd_epi16(hi, coef);
+    a = _mm_add_epi32(a, _mm_srli_epi64(a, 32));
+    b = _mm_add_epi32(b, _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi64(_mm_shuffle_epi32(a, _MM_SHUFFLE(3, 3, 2, 0)), _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 3, 2, 0)));
 }
+#endif
 
-static inline uint32_t _vec3_to_color(Vec3 c, float brightness)
+#if defined(__AVX2__)
+static inline __m256i _video_dot8_avx2(const __m256i lo, const __m256i hi, const __m256i coef)
 {
-    const int r = (int)(fminf(1.0f, c.x * brightness) * 255.0f);
-    const int g = (int)(fminf(1.0f, c.y * brightness) * 255.0f);
-    const int b = (int)(fminf(1.0f, c.z * brightness) * 255.0f);
-    return 0xFF000000 | (r << 16) | (g << 8) | b;
+    __m256i a = _mm256_madd_epi16(lo, coef), b = _mm256_madd_epi16(hi, coef);
+    a = _mm256_add_epi32(a, _mm256_srli_epi64(a, 32));
+    b = _mm256_add_epi32(b, _mm256_srli_epi64(b, 32));
+    return _mm256_unpacklo_epi64(_mm256_shuffle_epi32(a, _MM_SHUFFLE(3, 3, 2, 0)), _mm256_shuffle_epi32(b, _MM_SHUFFLE(3, 3, 2, 0)));
 }
+#endif
 
-static inline void _draw_line(Window_t* w, int x0, int y0, int x1, int y1, uint32_t color)
+static inline void _video_luma_row(const uint32_t *src, uint8_t *dst, const int n)
 {
-    const int dx = abs(x1-x0), dy = abs(y1-y0);
-    const int sx = x0<x1?1:-1, sy = y0<y1?1:-1;
-    int err = dx - dy;
-    while (1) {
-        drawPixel(w, x0, y0, color);
-        if (x0==x1 && y0==y1) break;
-        const int e2 = 2*err;
-        if (e2 > -dy) { err -= dy; x0 += sx; }
-        if (e2 <  dx) { err += dx; y0 += sy; }
+    int x = 0;
+#if defined(__AVX2__)
+    if (cpuGetSimdLevel() >= CPU_SIMD_AVX2) {
+        const __m256i coef = _mm256_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0, 25, 129, 66, 0, 25, 129, 66, 0);
+        const __m256i z = _mm256_setzero_si256(), bias = _mm256_set1_epi32(128), off = _mm256_set1_epi32(16);
+        for (; x + 16 <= n; x += 16) {
+            const __m256i d0 = _mm256_loadu_si256((const __m256i*)(src + x));
+            const __m256i d1 = _mm256_loadu_si256((const __m256i*)(src + x + 8));
+            __m256i y0 = _video_dot8_avx2(_mm256_unpacklo_epi8(d0, z), _mm256_unpackhi_epi8(d0, z), coef);
+            __m256i y1 = _video_dot8_avx2(_mm256_unpacklo_epi8(d1, z), _mm256_unpackhi_epi8(d1, z), coef);
+            y0 = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(y0, bias), 8), off);
+            y1 = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(y1, bias), 8), off);
+            // packs interleave 128-bit lanes; permute restores pixel order
+            const __m256i w16 = _mm256_permute4x64_epi64(_mm256_packs_epi32(y0, y1), _MM_SHUFFLE(3, 1, 2, 0));
+            const __m128i b8 = _mm_packus_epi16(_mm256_castsi256_si128(w16), _mm256_extracti128_si256(w16, 1));
+            _mm_storeu_si128((__m128i*)(dst + x), b8);
+        }
     }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    if (cpuGetSimdLevel() >= CPU_SIMD_SSE) {
+        const __m128i coef = _mm_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0);
+        const __m128i z = _mm_setzero_si128(), bias = _mm_set1_epi32(128), off = _mm_set1_epi32(16);
+        for (; x + 8 <= n; x += 8) {
+            const __m128i d0 = _mm_loadu_si128((const __m128i*)(src + x));
+            const __m128i d1 = _mm_loadu_si128((const __m128i*)(src + x + 4));
+            __m128i y0 = _video_dot4_sse(_mm_unpacklo_epi8(d0, z), _mm_unpackhi_epi8(d0, z), coef);
+            __m128i y1 = _video_dot4_sse(_mm_unpacklo_epi8(d1, z), _mm_unpackhi_epi8(d1, z), coef);
+            y0 = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(y0, bias), 8), off);
+            y1 = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(y1, bias), 8), off);
+            _mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(_mm_packs_epi32(y0, y1), z));
+        }
+    }
+#endif
+    for (; x < n; x++) dst[x] = (uint8_t)_video_y(src[x]);
 }
 
-static inline void _fill_triangle(Window_t* w, DepthBuffer* db,
-    Vec3 v0, Vec3 v1, Vec3 v2, float z0, float z1, float z2, uint32_t color)
+// One chroma row from two source rows (a, b), n source pixels
+static inline void _video_chroma_row(const uint32_t *a, const uint32_t *b, uint8_t *u, uint8_t *v, const int n)
 {
-    if (v0.y > v1.y) { Vec3 t=v0;v0=v1;v1=t; float tz=z0;z0=z1;z1=tz; }
-    if (v1.y > v2.y) { Vec3 t=v1;v1=v2;v2=t; float tz=z1;z1=z2;z2=tz; }
-    if (v0.y > v1.y) { Vec3 t=v0;v0=v1;v1=t; float tz=z0;z0=z1;z1=tz; }
-    const int y0=(int)v0.y, y1=(int)v1.y, y2=(int)v2.y;
-    for (int y=y0; y<=y2; y++) {
-        if (y<0||y>=w->bHeight) continue;
-        float x_s, x_e, z_s, z_e;
-        if (y < y1) {
-            if (y1==y0) continue;
-            const float t1=(float)(y-y0)/(float)(y1-y0);
-            const float t2=(float)(y-y0)/(float)(y2-y0);
-            x_s=v0.x+(v1.x-v0.x)*t1; x_e=v0.x+(v2.x-v0.x)*t2;
-            z_s=z0+(z1-z0)*t1;        z_e=z0+(z2-z0)*t2;
-        } else {
-            if (y2==y1) continue;
-            const float t1=(float)(y-y1)/(float)(y2-y1);
-            const float t2=(float)(y-y0)/(float)(y2-y0);
-            x_s=v1.x+(v2.x-v1.x)*t1; x_e=v0.x+(v2.x-v0.x)*t2;
-            z_s=z1+(z2-z1)*t1;        z_e=z0+(z2-z0)*t2;
+    int x = 0;
+#if defined(__AVX2__)
+    if (cpuGetSimdLevel() >= CPU_SIMD_AVX2) {
+        const __m256i cu = _mm256_setr_epi16(112, -74, -38, 0, 112, -74, -38, 0, 112, -74, -38, 0, 112, -74, -38, 0);
+        const __m256i cv = _mm256_setr_epi16(-18, -94, 112, 0, -18, -94, 112, 0, -18, -94, 112, 0, -18, -94, 112, 0);
+        const __m256i z = _mm256_setzero_si256(), two = _mm256_set1_epi16(2);
+        const __m256i bias = _mm256_set1_epi32(128);
+        for (; x + 16 <= n; x += 16) {
+            __m256i q[2];
+            for (int k = 0; k < 2; k++) {
+                const __m256i ra = _mm256_loadu_si256((const __m256i*)(a + x + k * 8));
+                const __m256i rb = _mm256_loadu_si256((const __m256i*)(b + x + k * 8));
+                const __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(ra, z), _mm256_unpacklo_epi8(rb, z)); // p0 p1 | p4 p5
+                const __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(ra, z), _mm256_unpackhi_epi8(rb, z)); // p2 p3 | p6 p7
+                const __m256i s  = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+                q[k] = _mm256_srli_epi16(_mm256_add_epi16(s, two), 2); // blocks 0 1 | 2 3
+            }
+            // Pair the block halves so the dot product sees (0 1 2 3 | 4 5 6 7) in order
+            const __m256i lo = _mm256_permute2x128_si256(q[0], q[1], 0x20);
+            const __m256i hi = _mm256_permute2x128_si256(q[0], q[1], 0x31);
+            __m256i uu = _video_dot8_avx2(lo, hi, cu), vv = _video_dot8_avx2(lo, hi, cv);
+            uu = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(uu, bias), 8), bias);
+            vv = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(vv, bias), 8), bias);
+            const __m256i w16 = _mm256_permute4x64_epi64(_mm256_packs_epi32(uu, vv), _MM_SHUFFLE(3, 1, 2, 0));
+            const __m128i b8 = _mm_packus_epi16(_mm256_castsi256_si128(w16), _mm256_extracti128_si256(w16, 1));
+            _mm_storel_epi64((__m128i*)(u + x / 2), b8);
+            _mm_storel_epi64((__m128i*)(v + x / 2), _mm_srli_si128(b8, 8));
         }
-        if (x_s>x_e) { float t=x_s;x_s=x_e;x_e=t; t=z_s;z_s=z_e;z_e=t; }
-        const int ix0=(int)x_s, ix1=(int)x_e;
-        for (int x=ix0; x<=ix1; x++) {
-            if (x<0||x>=w->bWidth) continue;
-            const float t=(ix1==ix0)?0.0f:(float)(x-ix0)/(float)(ix1-ix0);
-            const float z=z_s+(z_e-z_s)*t;
-            const int idx=y*w->bWidth+x;
-            if (z<db->depths[idx]) { db->depths[idx]=z; drawPixel(w,x,y,color); }
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    if (cpuGetSimdLevel() >= CPU_SIMD_SSE) {
+        const __m128i cu = _mm_setr_epi16(112, -74, -38, 0, 112, -74, -38, 0);
+        const __m128i cv = _mm_setr_epi16(-18, -94, 112, 0, -18, -94, 112, 0);
+        const __m128i z = _mm_setzero_si128(), two = _mm_set1_epi16(2), bias = _mm_set1_epi32(128);
+        for (; x + 8 <= n; x += 8) {
+            __m128i q[2];
+            for (int k = 0; k < 2; k++) {
+                const __m128i ra = _mm_loadu_si128((const __m128i*)(a + x + k * 4));
+                const __m128i rb = _mm_loadu_si128((const __m128i*)(b + x + k * 4));
+                const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(ra, z), _mm_unpacklo_epi8(rb, z));
+                const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(ra, z), _mm_unpackhi_epi8(rb, z));
+                const __m128i s  = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+                q[k] = _mm_srli_epi16(_mm_add_epi16(s, two), 2);
+            }
+            __m128i uu = _video_dot4_sse(q[0], q[1], cu), vv = _video_dot4_sse(q[0], q[1], cv);
+            uu = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(uu, bias), 8), bias);
+            vv = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(vv, bias), 8), bias);
+            const __m128i b8 = _mm_packus_epi16(_mm_packs_epi32(uu, vv), z);
+            const int iu = _mm_cvtsi128_si32(b8), iv = _mm_cvtsi128_si32(_mm_srli_si128(b8, 4));
+            memcpy(u + x / 2, &iu, 4);
+            memcpy(v + x / 2, &iv, 4);
         }
     }
+#endif
+    for (; x < n; x += 2) {
+        const int x1 = x + 1 < n ? x + 1 : x;
+        _video_uv(a[x], a[x1], b[x], b[x1], u + x / 2, v + x / 2);
+    }
 }
 
-#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
+inline void videoConvertI420(const uint32_t *src, const int pitch, const int width, const int height,
+                             uint8_t *y, uint8_t *u, uint8_t *v)
+{
+    const int cw = (width + 1) / 2;
+    for (int j = 0; j < height; j++) _video_luma_row(src + (size_t)j * pitch, y + (size_t)j * width, width);
+    for (int j = 0; j < height; j += 2) {
+        const uint32_t *a = src + (size_t)j * pitch;
+        const uint32_t *b = j + 1 < height ? a + pitch : a;
+        _video_chroma_row(a, b, u + (size_t)(j / 2) * cw, v + (size_t)(j / 2) * cw, width);
+    }
+}
 
-typedef struct {
-    float px, py, pz;
-    float nx, ny, nz;
-    float r,  g,  b;
-} _GpuVertex;
+static bool _videoEncodeFrame(struct _CaptureQueue *q, const _CaptureSlot *slot)
+{
+    VideoRecorder *r = (VideoRecorder*)q->user;
+    const size_t luma = (size_t)r->width * r->height;
+    const size_t chroma = (size_t)((r->width + 1) / 2) * ((r->height + 1) / 2);
+
+    _coreLock(&q->lock);
+    const bool closed = r->pipe_closed;
+    _coreUnlock(&q->lock);
+    if (closed) return false;
+
+    videoConvertI420(slot->pixels, slot->width, r->width, r->height,
+                     r->planes, r->planes + luma, r->planes + luma + chroma);
+    if (!r->is_pipe)
+        return fputs("FRAME\n", r->out) >= 0 && fwrite(r->planes, 1, luma + 2 * chroma, r->out) == luma + 2 * chroma;
+
+    // Flushed inside the guard so no buffered bytes reach the pipe outside it
+    _VideoPipeGuard g;
+    _video_pipe_enter(&g);
+    errno = 0;
+    const bool ok = fputs("FRAME\n", r->out) >= 0 && fwrite(r->planes, 1, luma + 2 * chroma, r->out) == luma + 2 * chroma &&
+                    fflush(r->out) == 0;
+    const bool broken = !ok && errno == EPIPE;
+    _video_pipe_leave(&g);
+    if (broken) {
+        _coreLock(&q->lock);
+        r->pipe_closed = true;
+        _coreUnlock(&q->lock);
+    }
+    return ok;
+}
 
-typedef struct {
-    float vp[16];        // view-projection matrix (column-major)
-    float light_dir[4];  // xyz = direction, w = unused
-    float use_light;     // 1.0 = lit, 0.0 = unlit
-    float pad[3];
-} _GpuModelUniforms;
+static inline void _videoClose(VideoRecorder *r)
+{
+    if (!r->is_pipe) {
+        fclose(r->out);
+        return;
+    }
+    _VideoPipeGuard g;
+    _video_pipe_enter(&g);
+    _video_pclose(r->out);
+    _video_pipe_leave(&g);
+}
 
-static const char _MSL_VERT[] =
-    "#include <metal_stdlib>\n"
+inline bool videoRecorderOpen(VideoRecorder *r, const char *target, const int width, const int height, const VideoOptions *o)
+{
+    memset(r, 0, sizeof(*r));
+    if (o) r->options = *o;
+    else   videoOptionsInit(&r->options);
+    if (width <= 0 || height <= 0 || r->options.fps_num <= 0 || r->options.fps_den <= 0) return false;
+    r->width  = width;
+    r->height = height;
+
+    r->is_pipe = target[0] == '|';
+    r->out = r->is_pipe ? _video_popen(target + 1, "w") : fopen(target, "wb");
+    if (!r->out) {
+        fprintf(stderr, "Failed to open video output: %s\n", target);
+        return false;
+    }
+
+    const size_t chroma = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    r->planes = (uint8_t*)malloc((size_t)width * height + 2 * chroma);
+    assert(r->planes && "Failed to allocate I420 planes");
+    _VideoPipeGuard g;
+    if (r->is_pipe) _video_pipe_enter(&g);
+    errno = 0;
+    fprintf(r->out, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg\n", width, height, r->options.fps_num, r->options.fps_den);
+    if (r->is_pipe) {
+        if (fflush(r->out) != 0 && errno == EPIPE) r->pipe_closed = true;
+        _video_pipe_leave(&g);
+    }
+
+    // Frames go through the capture queue: pooled copies, drop-newest when full, one ordered worker
+    CaptureOptions co;
+    captureOptionsInit(&co);
+    co.queue_size = r->options.queue_size;
+    co.drop       = CAPTURE_DROP_NEWEST;
+    co.keep_alpha = true;   // alpha is ignored by the conversion
+    r->queue = _captureQueueCreate(&co, _videoEncodeFrame, r);
+    if (!r->queue) {
+        _videoClose(r);
+        free(r->planes);
+        memset(r, 0, sizeof(*r));
+        return false;
+    }
+    return true;
+}
+
+inline bool videoRecordFrame(VideoRecorder *r, const Window_t *w)
+{
+    if (!r->queue) return false;
+    if (w->bWidth != r->width || w->bHeight != r->height) {
+        r->mismatched++;
+        return false;
+    }
+    return _captureQueuePush(r->queue, w, NULL);
+}
+
+static void _videoOnPresent(const Window_t *w, void *user)
+{
+    videoRecordFrame((VideoRecorder*)user, w);
+}
+
+inline void videoRecorderAttach(VideoRecorder *r, Window_t *w)
+{
+    r->window = w;
+    w->on_present = _videoOnPresent;
+    w->present_user = r;
+}
+
+inline void videoRecorderGetStats(VideoRecorder *r, VideoStats *s)
+{
+    const CaptureStats cs = _captureQueueStats(r->queue);
+    s->written    = cs.written;
+    s->dropped    = cs.dropped;
+    s->failed     = cs.failed;
+    s->mismatched = r->mismatched;
+    s->submitted  = cs.queued + cs.dropped + r->mismatched;
+    s->pipe_closed = false;
+    if (r->queue) {
+        _coreLock(&r->queue->lock);
+        s->pipe_closed = r->pipe_closed;
+        _coreUnlock(&r->queue->lock);
+    }
+}
+
+inline void videoRecorderClose(VideoRecorder *r)
+{
+    if (r->window && r->window->present_user == r) {
+        r->window->on_present = NULL;
+        r->window->present_user = NULL;
+    }
+    r->window = NULL;
+    if (!r->queue) return;
+
+    _captureQueueDestroy(r->queue);
+    r->queue = NULL;
+    _videoClose(r);
+    r->out = NULL;
+    free(r->planes);
+    r->planes = NULL;
+}
+
+#endif // VIDEO_IMPLEMENTATION
+#endif // WRAPPER_VIDEO_H
+
+
+// ============================================================================
+// Keyboard and Mouse Input (X11 or SDL3 backend)
+// ============================================================================
+#ifndef WRAPPER_KEYS_H
+#define WRAPPER_KEYS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    KEY_UNKNOWN = 0,
+
+    KEY_ESCAPE, KEY_SPACE,
+    KEY_ENTER,  KEY_TAB, KEY_BACKSPACE,
+
+    KEY_LEFT, KEY_RIGHT,
+    KEY_UP,   KEY_DOWN,
+
+    KEY_A, KEY_B, KEY_C,
+    KEY_D, KEY_E, KEY_F,
+    KEY_G, KEY_H, KEY_I,
+    KEY_J, KEY_K, KEY_L,
+    KEY_M, KEY_N, KEY_O,
+    KEY_P, KEY_Q, KEY_R,
+    KEY_S, KEY_T, KEY_U,
+    KEY_V, KEY_W, KEY_X,
+    KEY_Y, KEY_Z,
+
+    KEY_NUM0, KEY_NUM1, KEY_NUM2,
+    KEY_NUM3, KEY_NUM4, KEY_NUM5,
+    KEY_NUM6, KEY_NUM7, KEY_NUM8,
+    KEY_NUM9,
+
+    KEY_LSHIFT, KEY_RSHIFT,
+    KEY_LCTRL,  KEY_RCTRL,
+    KEY_LALT,   KEY_RALT,
+
+    KEY_F1, KEY_F2,
+    KEY_F3, KEY_F4,
+
+    KEY_COUNT
+} Key;
+
+typedef enum {
+    MOUSE_LEFT = 0,
+    MOUSE_MIDDLE,
+    MOUSE_RIGHT,
+    MOUSE_COUNT
+} MouseButton;
+
+typedef struct InputState {
+    bool key_curr[KEY_COUNT];
+    bool key_prev[KEY_COUNT];
+    bool mouse_curr[MOUSE_COUNT];
+    bool mouse_prev[MOUSE_COUNT];
+    int mouse_x, mouse_y;
+    int mouse_dx, mouse_dy;
+    int last_x, last_y;
+    bool mouse_grabbed;
+#ifdef SDL_IMPLEMENTATION
+    void *grab_window;
+#else
+    Window grab_window;
+#endif
+    int center_x, center_y;
+} Input;
+
+// Initialize input state - call once at startup
+void inputInit(Input *input);
+
+// Poll events and update input state - call once per frame BEFORE processing input
+// Returns true if window should close
+// NOTE: This automatically calls updateInput() at the end, so you don't need to call it manually
+#ifdef SDL_IMPLEMENTATION
+bool pollEvents(Window_t *win, Input *input);
+#else
+bool pollEvents(Window_t *win, Input *input);
+#endif
+
+// Copy current to previous - ONLY call manually if not using pollEvents
+void updateInput(Input *input);
+
+// This is just the same for everything
+/*
+ * if (isKeyDown(&state.input, KEY_W)) cameraMove(&state.cam, state.cam.front, state.move_speed);
+ */
+bool isKeyDown(const Input *input, Key key);
+bool isKeyPressed(const Input *input, Key key);
+bool isKeyReleased(const Input *input, Key key);
+bool isMouseDown(const Input *input, MouseButton btn);
+bool isMousePressed(const Input *input, MouseButton btn);
+bool isMouseReleased(const Input *input, MouseButton btn);
+void getMousePosition(const Input *input, int *x, int *y);
+void getMouseDelta(const Input *input, int *dx, int *dy);
+bool isMouseGrabbed(const Input *input);
+
+#ifdef SDL_IMPLEMENTATION
+void grabMouse(SDL_Window *window, int width, int height, Input *input);
+void releaseMouse(SDL_Window *window, Input *input);
+#else
+void grabMouse(Display *display, Window window, int width, int height, Input *input);
+void releaseMouse(Display *display, Window window, Input *input);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef KEYS_IMPLEMENTATION
+
+static void setKey(Input *input, const Key key, const bool down)
+{
+    if (key < KEY_COUNT) input->key_curr[key] = down;
+}
+
+static void setMouse(Input *input, const MouseButton btn, const bool down)
+{
+    if (btn < MOUSE_COUNT) input->mouse_curr[btn] = down;
+}
+
+inline void inputInit(Input *input)
+{
+    for (int i = 0; i < KEY_COUNT; i++) {
+        input->key_curr[i] = false;
+        input->key_prev[i] = false;
+    }
+    for (int i = 0; i < MOUSE_COUNT; i++) {
+        input->mouse_curr[i] = false;
+        input->mouse_prev[i] = false;
+    }
+    input->mouse_x = 0;
+    input->mouse_y = 0;
+    input->mouse_dx = 0;
+    input->mouse_dy = 0;
+    input->last_x = 0;
+    input->last_y = 0;
+    input->mouse_grabbed = false;
+    input->grab_window = 0;
+    input->center_x = 400;
+    input->center_y = 300;
+}
+
+#ifdef SDL_IMPLEMENTATION
+
+inline bool pollEvents(Window_t *win, Input *input)
+{
+    bool shouldClose = false;
+
+    input->mouse_dx = 0;
+    input->mouse_dy = 0;
+
+    // Handle window resize (debounced; with render_scale set the buffer follows, otherwise bWidth/bHeight are up to the app)
+    if (win) {
+        int nw, nh;
+        SDL_GetWindowSize(win->window, &nw, &nh);
+        bufferTrackResize(win, nw, nh);
+    }
+
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+#ifdef IMGUI_IMPLEMENTATION
+        ImGui_ImplSDL3_ProcessEvent(&event);
+#endif
+        switch (event.type) {
+            case SDL_EVENT_QUIT:
+            case SDL_EVENT_WINDOW_CLOSE_REQUESTED:
+                shouldClose = true;
+                break;
+
+            case SDL_EVENT_MOUSE_MOTION:
+                if (input->mouse_grabbed) {
+                    input->mouse_dx += (int)event.motion.xrel;
+                    input->mouse_dy += (int)event.motion.yrel;
+                }
+                input->mouse_x = (int)event.motion.x;
+                input->mouse_y = (int)event.motion.y;
+                input->last_x  = input->mouse_x;
+                input->last_y  = input->mouse_y;
+                break;
+
+            case SDL_EVENT_MOUSE_BUTTON_DOWN:
+            case SDL_EVENT_MOUSE_BUTTON_UP: {
+                const bool down = (event.type == SDL_EVENT_MOUSE_BUTTON_DOWN);
+                switch (event.button.button) {
+                    case SDL_BUTTON_LEFT:   setMouse(input, MOUSE_LEFT,   down); break;
+                    case SDL_BUTTON_MIDDLE: setMouse(input, MOUSE_MIDDLE, down); break;
+                    case SDL_BUTTON_RIGHT:  setMouse(input, MOUSE_RIGHT,  down); break;
+                    default: break;
+                }
+                break;
+            }
+
+            case SDL_EVENT_KEY_DOWN:
+            case SDL_EVENT_KEY_UP: {
+                const bool down = (event.type == SDL_EVENT_KEY_DOWN);
+                const SDL_Keycode sym = event.key.key;
+                Key k = KEY_UNKNOWN;
+
+                switch (sym) {
+                    case SDLK_ESCAPE:  k = KEY_ESCAPE; break;
+                    case SDLK_SPACE:   k = KEY_SPACE; break;
+                    case SDLK_RETURN:  k = KEY_ENTER; break;
+                    case SDLK_TAB:     k = KEY_TAB; break;
+                    case SDLK_BACKSPACE: k = KEY_BACKSPACE; break;
+
+                    case SDLK_LEFT:  k = KEY_LEFT; break;
+                    case SDLK_RIGHT: k = KEY_RIGHT; break;
+                    case SDLK_UP:    k = KEY_UP; break;
+                    case SDLK_DOWN:  k = KEY_DOWN; break;
+
+                    case SDLK_A: k = KEY_A; break;
+                    case SDLK_B: k = KEY_B; break;
+                    case SDLK_C: k = KEY_C; break;
+                    case SDLK_D: k = KEY_D; break;
+                    case SDLK_E: k = KEY_E; break;
+                    case SDLK_F: k = KEY_F; break;
+                    case SDLK_G: k = KEY_G; break;
+                    case SDLK_H: k = KEY_H; break;
+                    case SDLK_I: k = KEY_I; break;
+                    case SDLK_J: k = KEY_J; break;
+                    case SDLK_K: k = KEY_K; break;
+                    case SDLK_L: k = KEY_L; break;
+                    case SDLK_M: k = KEY_M; break;
+                    case SDLK_N: k = KEY_N; break;
+                    case SDLK_O: k = KEY_O; break;
+                    case SDLK_P: k = KEY_P; break;
+                    case SDLK_Q: k = KEY_Q; break;
+                    case SDLK_R: k = KEY_R; break;
+                    case SDLK_S: k = KEY_S; break;
+                    case SDLK_T: k = KEY_T; break;
+                    case SDLK_U: k = KEY_U; break;
+                    case SDLK_V: k = KEY_V; break;
+                    case SDLK_W: k = KEY_W; break;
+                    case SDLK_X: k = KEY_X; break;
+                    case SDLK_Y: k = KEY_Y; break;
+                    case SDLK_Z: k = KEY_Z; break;
+
+                    case SDLK_0: k = KEY_NUM0; break;
+                    case SDLK_1: k = KEY_NUM1; break;
+                    case SDLK_2: k = KEY_NUM2; break;
+                    case SDLK_3: k = KEY_NUM3; break;
+                    case SDLK_4: k = KEY_NUM4; break;
+                    case SDLK_5: k = KEY_NUM5; break;
+                    case SDLK_6: k = KEY_NUM6; break;
+                    case SDLK_7: k = KEY_NUM7; break;
+                    case SDLK_8: k = KEY_NUM8; break;
+                    case SDLK_9: k = KEY_NUM9; break;
+
+                    case SDLK_LSHIFT: k = KEY_LSHIFT; break;
+                    case SDLK_RSHIFT: k = KEY_RSHIFT; break;
+                    case SDLK_LCTRL:  k = KEY_LCTRL; break;
+                    case SDLK_RCTRL:  k = KEY_RCTRL; break;
+                    case SDLK_LALT:   k = KEY_LALT; break;
+                    case SDLK_RALT:   k = KEY_RALT; break;
+
+                    case SDLK_F1: k = KEY_F1; break;
+                    case SDLK_F2: k = KEY_F2; break;
+                    case SDLK_F3: k = KEY_F3; break;
+                    case SDLK_F4: k = KEY_F4; break;
+
+                    default: break;
+                }
+
+                if (k != KEY_UNKNOWN) setKey(input, k, down);
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    updateInput(input);
+    return shouldClose;
+}
+
+#else // X11 backend
+
+inline bool pollEvents(Window_t *win, Input *input)
+{
+    const Atom wmDeleteMessage = XInternAtom(win->display, "WM_DELETE_WINDOW", False);
+    bool shouldClose = false;
+
+    input->mouse_dx = 0;
+    input->mouse_dy = 0;
+
+    // Handle window resize (debounced; with render_scale set the buffer follows, otherwise bWidth/bHeight are up to the app)
+    if (win) {
+        XEvent ev;
+        int nw = win->width, nh = win->height;
+        while (XCheckTypedWindowEvent(win->display, win->window, ConfigureNotify, &ev)) {
+            nw = ev.xconfigure.width;
+            nh = ev.xconfigure.height;
+        }
+        bufferTrackResize(win, nw, nh);
+        XFlush(win->display);
+    }
+
+    while (XPending(win->display) > 0)
+    {
+        XEvent event;
+        XNextEvent(win->display, &event);
+
+        switch (event.type)
+        {
+            case ClientMessage:
+                if ((Atom)event.xclient.data.l[0] == wmDeleteMessage)
+                    shouldClose = true;
+                break;
+
+            case MotionNotify:
+                if (input->mouse_grabbed) {
+                    input->mouse_dx += event.xmotion.x - input->last_x;
+                    input->mouse_dy += event.xmotion.y - input->last_y;
+                }
+                input->mouse_x = event.xmotion.x;
+                input->mouse_y = event.xmotion.y;
+                input->last_x = input->mouse_x;
+                input->last_y = input->mouse_y;
+                break;
+
+            case ButtonPress:
+            case ButtonRelease:
+            {
+                const bool down = (event.type == ButtonPress);
+                switch (event.xbutton.button)
+                {
+                    case Button1: setMouse(input, MOUSE_LEFT, down); break;
+                    case Button2: setMouse(input, MOUSE_MIDDLE, down); break;
+                    case Button3: setMouse(input, MOUSE_RIGHT, down); break;
+                    default: break;
+                }
+                break;
+            }
+
+            case KeyPress:
+            case KeyRelease:
+            {
+                const bool down = (event.type == KeyPress);
+                const KeySym sym = XLookupKeysym(&event.xkey, 0);
+                Key k = KEY_UNKNOWN;
+
+                switch (sym)
+                {
+                    case XK_Escape: k = KEY_ESCAPE; break;
+                    case XK_space: k = KEY_SPACE; break;
+                    case XK_Return: k = KEY_ENTER; break;
+                    case XK_Tab: k = KEY_TAB; break;
+                    case XK_BackSpace: k = KEY_BACKSPACE; break;
+
+                    case XK_Left: k = KEY_LEFT; break;
+                    case XK_Right: k = KEY_RIGHT; break;
+                    case XK_Up: k = KEY_UP; break;
+                    case XK_Down: k = KEY_DOWN; break;
+
+                    case XK_a: case XK_A: k = KEY_A; break;
+                    case XK_b: case XK_B: k = KEY_B; break;
+                    case XK_c: case XK_C: k = KEY_C; break;
+                    case XK_d: case XK_D: k = KEY_D; break;
+                    case XK_e: case XK_E: k = KEY_E; break;
+                    case XK_f: case XK_F: k = KEY_F; break;
+                    case XK_g: case XK_G: k = KEY_G; break;
+                    case XK_h: case XK_H: k = KEY_H; break;
+                    case XK_i: case XK_I: k = KEY_I; break;
+                    case XK_j: case XK_J: k = KEY_J; break;
+                    case XK_k: case XK_K: k = KEY_K; break;
+                    case XK_l: case XK_L: k = KEY_L; break;
+                    case XK_m: case XK_M: k = KEY_M; break;
+                    case XK_n: case XK_N: k = KEY_N; break;
+                    case XK_o: case XK_O: k = KEY_O; break;
+                    case XK_p: case XK_P: k = KEY_P; break;
+                    case XK_q: case XK_Q: k = KEY_Q; break;
+                    case XK_r: case XK_R: k = KEY_R; break;
+                    case XK_s: case XK_S: k = KEY_S; break;
+                    case XK_t: case XK_T: k = KEY_T; break;
+                    case XK_u: case XK_U: k = KEY_U; break;
+                    case XK_v: case XK_V: k = KEY_V; break;
+                    case XK_w: case XK_W: k = KEY_W; break;
+                    case XK_x: case XK_X: k = KEY_X; break;
+                    case XK_y: case XK_Y: k = KEY_Y; break;
+                    case XK_z: case XK_Z: k = KEY_Z; break;
+
+                    case XK_0: k = KEY_NUM0; break;
+                    case XK_1: k = KEY_NUM1; break;
+                    case XK_2: k = KEY_NUM2; break;
+                    case XK_3: k = KEY_NUM3; break;
+                    case XK_4: k = KEY_NUM4; break;
+                    case XK_5: k = KEY_NUM5; break;
+                    case XK_6: k = KEY_NUM6; break;
+                    case XK_7: k = KEY_NUM7; break;
+                    case XK_8: k = KEY_NUM8; break;
+                    case XK_9: k = KEY_NUM9; break;
+
+                    case XK_Shift_L: k = KEY_LSHIFT; break;
+                    case XK_Shift_R: k = KEY_RSHIFT; break;
+                    case XK_Control_L: k = KEY_LCTRL; break;
+                    case XK_Control_R: k = KEY_RCTRL; break;
+                    case XK_Alt_L: k = KEY_LALT; break;
+                    case XK_Alt_R: k = KEY_RALT; break;
+
+                    case XK_F1: k = KEY_F1; break;
+                    case XK_F2: k = KEY_F2; break;
+                    case XK_F3: k = KEY_F3; break;
+                    case XK_F4: k = KEY_F4; break;
+
+                    default: break;
+                }
+
+                if (k != KEY_UNKNOWN) setKey(input, k, down);
+                break;
+            }
+
+            default: break;
+        }
+    }
+
+    if (input->mouse_grabbed && (input->mouse_dx != 0 || input->mouse_dy != 0))
+    {
+        XWarpPointer(win->display, None, input->grab_window, 0, 0, 0, 0, input->center_x, input->center_y);
+        XFlush(win->display);
+        input->last_x = input->center_x;
+        input->last_y = input->center_y;
+    }
+
+    updateInput(input);
+    return shouldClose;
+}
+
+#endif
+
+inline void updateInput(Input *input)
+{
+    for (int i = 0; i < KEY_COUNT; i++)
+        input->key_prev[i] = input->key_curr[i];
+    for (int i = 0; i < MOUSE_COUNT; i++)
+        input->mouse_prev[i] = input->mouse_curr[i];
+}
+
+inline bool isKeyDown(const Input *input, const Key key)
+{
+    return key < KEY_COUNT ? input->key_curr[key] : false;
+}
+
+inline bool isKeyPressed(const Input *input, const Key key)
+{
+    return key < KEY_COUNT ? (input->key_curr[key] && !input->key_prev[key]) : false;
+}
+
+inline bool isKeyReleased(const Input *input, const Key key)
+{
+    return key < KEY_COUNT ? (!input->key_curr[key] && input->key_prev[key]) : false;
+}
+
+inline bool isMouseDown(const Input *input, const MouseButton btn)
+{
+    return btn < MOUSE_COUNT ? input->mouse_curr[btn] : false;
+}
+
+inline bool isMousePressed(const Input *input, const MouseButton btn)
+{
+    return btn < MOUSE_COUNT ? (input->mouse_curr[btn] && !input->mouse_prev[btn]) : false;
+}
+
+inline bool isMouseReleased(const Input *input, const MouseButton btn)
+{
+    return btn < MOUSE_COUNT ? (!input->mouse_curr[btn] && input->mouse_prev[btn]) : false;
+}
+
+inline void getMousePosition(const Input *input, int *x, int *y)
+{
+    if (x) *x = input->mouse_x;
+    if (y) *y = input->mouse_y;
+}
+
+inline void getMouseDelta(const Input *input, int *dx, int *dy)
+{
+    if (dx) *dx = input->mouse_dx;
+    if (dy) *dy = input->mouse_dy;
+}
+
+#ifdef SDL_IMPLEMENTATION
+
+inline void grabMouse(SDL_Window *window, const int width, const int height, Input *input)
+{
+    if (input->mouse_grabbed) return;
+
+    input->center_x = width / 2;
+    input->center_y = height / 2;
+    input->grab_window = (void*)window;
+
+    SDL_SetWindowRelativeMouseMode(window, true);
+
+    input->mouse_grabbed = true;
+    input->mouse_dx = 0;
+    input->mouse_dy = 0;
+}
+
+inline void releaseMouse(SDL_Window *window, Input *input)
+{
+    if (!input->mouse_grabbed) return;
+
+    SDL_SetWindowRelativeMouseMode(window, false);
+
+    input->mouse_grabbed = false;
+    input->mouse_dx = 0;
+    input->mouse_dy = 0;
+}
+
+#else
+
+inline void grabMouse(Display *display, const Window window,
+                      const int width, const int height, Input *input)
+{
+    if (input->mouse_grabbed) return;
+
+    input->center_x = width / 2;
+    input->center_y = height / 2;
+    input->grab_window = window;
+
+    XColor dummy;
+    const char data[1] = {0};
+    const Pixmap blank = XCreateBitmapFromData(display, window, data, 1, 1);
+    const Cursor cursor = XCreatePixmapCursor(display, blank, blank,
+                                              &dummy, &dummy, 0, 0);
+    XFreePixmap(display, blank);
+
+    XDefineCursor(display, window, cursor);
+    XGrabPointer(display, window, True,
+                 PointerMotionMask | ButtonPressMask | ButtonReleaseMask,
+                 GrabModeAsync, GrabModeAsync, window, None, CurrentTime);
+
+    XWarpPointer(display, None, window, 0, 0, 0, 0,
+                 input->center_x, input->center_y);
+    XFlush(display);
+
+    input->last_x = input->center_x;
+    input->last_y = input->center_y;
+    input->mouse_grabbed = true;
+    input->mouse_dx = 0;
+    input->mouse_dy = 0;
+}
+
+inline void releaseMouse(Display *display, const Window window, Input *input)
+{
+    if (!input->mouse_grabbed) return;
+
+    XUngrabPointer(display, CurrentTime);
+    XDefineCursor(display, window, None);
+    input->mouse_grabbed = false;
+    input->mouse_dx = 0;
+    input->mouse_dy = 0;
+}
+
+#endif
+
+inline bool isMouseGrabbed(const Input *input)
+{
+    return input->mouse_grabbed;
+}
+
+#endif // KEYS_IMPLEMENTATION
+#endif // WRAPPER_KEYS_H
+
+
+// ============================================================================
+// Vector math
+// ============================================================================
+#ifndef WRAPPER_MATH_H
+#define WRAPPER_MATH_H
+
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+typedef struct {
+    float x, y, z;
+} Vec3;
+
+typedef struct {
+    Vec3 origin, direction;
+} Ray;
+
+/*  -> Example:
+ *  Vec3 v = vec3(1.0f, 2.0f, 3.0f);
+ */
+Vec3  vec3(float x, float y, float z);
+
+/*  -> Example:
+ *  Vec3 c = add(a, b);
+ */
+Vec3  add(Vec3 a, Vec3 b);
+
+/*  -> Example:
+ *  Vec3 c = sub(a, b);
+ */
+Vec3  sub(Vec3 a, Vec3 b);
+
+/*  -> Example:
+ *  Vec3 v = mul(a, 2.0f);
+ */
+Vec3  mul(Vec3 v, float t);
+
+/*  -> Example:
+ *  Vec3 c = vmul(a, b);
+ */
+Vec3  vmul(Vec3 a, Vec3 b);
+
+/*  -> Example:
+ *  Vec3 v = vdiv(a, 2.0f);
+ */
+Vec3  vdiv(Vec3 v, float t);
+
+/*  -> Example:
+ *  float d = dot(a, b);
+ */
+float dot(Vec3 a, Vec3 b);
+
+/*  -> Example:
+ *  Vec3 n = cross(a, b);
+ */
+Vec3  cross(Vec3 a, Vec3 b);
+
+/*  -> Example:
+ *  float length = len(v);
+ */
+float len(Vec3 v);
+
+/*  -> Example:
+ *  Vec3 unit = norm(v);
+ */
+Vec3  norm(Vec3 v);
+
+/*  -> Example:
+ *  Vec3 reflected = reflect(incident, normal);
+ */
+Vec3  reflect(Vec3 v, Vec3 n);
+
+#ifdef MATH_IMPLEMENTATION
+
+inline Vec3 vec3(const float x, const float y, const float z)
+{
+    return (Vec3) {x, y, z};
+}
+
+inline Vec3 add(const Vec3 a, const Vec3 b)
+{
+    return (Vec3) {
+        a.x + b.x,
+        a.y + b.y,
+        a.z + b.z,
+    };
+}
+
+inline Vec3 sub(const Vec3 a, const Vec3 b)
+{
+    return (Vec3) {
+        a.x - b.x,
+        a.y - b.y,
+        a.z - b.z,
+    };
+}
+
+inline Vec3 mul(const Vec3 v, const float t)
+{
+    return (Vec3) {
+        v.x * t,
+        v.y * t,
+        v.z * t,
+    };
+}
+
+inline Vec3 vmul(const Vec3 a, const Vec3 b)
+{
+    return (Vec3) {
+        a.x * b.x,
+        a.y * b.y,
+        a.z * b.z,
+    };
+}
+
+inline Vec3 vdiv(const Vec3 v, const float t)
+{
+    const float inv = 1.0f / t;
+    return (Vec3) {
+        v.x * inv,
+        v.y * inv,
+        v.z * inv,
+    };
+}
+
+inline float dot(const Vec3 a, const Vec3 b)
+{
+    return (a.x * b.x) + (a.y * b.y) + (a.z * b.z);
+}
+
+inline Vec3 cross(const Vec3 a, const Vec3 b)
+{
+    return (Vec3) {
+        (a.y * b.z) - (a.z * b.y),
+        (a.z * b.x) - (a.x * b.z),
+        (a.x * b.y) - (a.y * b.x),
+    };
+}
+
+inline float len(const Vec3 v)
+{
+    return sqrtf(dot(v,v));
+}
+
+inline Vec3 norm(const Vec3 v)
+{
+    const float l2 = dot(v,v);
+    if (l2 > 0.0f)
+    {
+        const float inv = 1.0f / sqrtf(l2);
+        return (Vec3) {
+            v.x * inv,
+            v.y * inv,
+            v.z * inv,
+        };
+    }
+    return v;
+}
+
+inline Vec3 reflect(const Vec3 v, const Vec3 n)
+{
+    const float d = 2.0f * dot(v,n);
+    return (Vec3) {
+        v.x - (d * n.x),
+        v.y - (d * n.y),
+        v.z - (d * n.z),
+    };
+}
+
+#endif // MATH_IMPLEMENTATION
+#endif // WRAPPER_MATH_H
+
+
+#ifndef WRAPPER_CAMERA_H
+#define WRAPPER_CAMERA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct Camera {
+    Vec3 position;
+    float yaw;      // Rotation in degrees
+    float pitch;    // Rotation in degrees
+    float fov;      // Field of view in degrees
+    Vec3 front;     // Forward direction vector
+    Vec3 right;     // Right direction vector
+    Vec3 up;        // Up direction vector
+} Camera;
+
+// Initialize camera with default position and orientation
+/*  -> Example:
+ *  Camera camera;
+ *  cameraInit(&camera);
+ *  camera.position = vec3(0.0f, 1.0f, 5.0f);
+ */
+void cameraInit(Camera *cam);
+
+// Update camera vectors based on yaw/pitch (automatically clamps pitch)
+/*  -> Example:
+ *  camera.yaw += 10.0f;
+ *  cameraUpdate(&camera);
+ */
+void cameraUpdate(Camera *cam);
+
+// Move camera in given direction by speed amount
+/*  -> Example:
+ *  if (isKeyDown(&input, KEY_W)) cameraMove(&camera, camera.front, 0.1f);
+ */
+void cameraMove(Camera *cam, Vec3 direction, float speed);
+
+// Rotate camera by delta angles in degrees
+/*  -> Example:
+ *  cameraRotate(&camera, mouse_dx * sensitivity, -mouse_dy * sensitivity);
+ */
+void cameraRotate(Camera *cam, float dyaw, float dpitch);
+
+// Generate ray from camera with pre-scaled viewport offsets
+/*  -> Example:
+ *  float* u_offsets = (float*)malloc(win.width * sizeof(float));
+    float* v_offsets = (float*)malloc(win.height * sizeof(float));
+    assert(u_offsets && v_offsets && "Failed to allocate viewport offset buffers");
+
+    for (int x = 0; x < win.width; x++)  u_offsets[x] = ((float)x / (float)(win.width - 1) - 0.5f) * viewport_width;
+    for (int y = 0; y < win.height; y++) v_offsets[y] = ((float)(win.height - 1 - y) / (float)(win.height - 1) - 0.5f) * viewport_height;
+
+    while (1) {
+        ...
+        #pragma omp parallel for schedule(dynamic) default(none) shared(win, camera, u_offsets, v_offsets)
+        for (int y = 0; y < win.height; y++) {
+            for (int x = 0; x < win.width; x++) {
+                const Ray ray = cameraGetRay(&camera, u_offsets[x], v_offsets[y]);
+                const Vec3 color = calculate_ray_color(ray, MAX_BOUNCES);
+                win.buffer[y * win.width + x] = uint32(color);
+        }
+    }
+}*/
+Ray cameraGetRay(const Camera* cam, float u_scaled, float v_scaled);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef CAMERA_IMPLEMENTATION
+
+inline void cameraInit(Camera *cam)
+{
+    cam->position = vec3(0.0f, 0.0f, 0.0f);
+    cam->yaw = 0.0f;
+    cam->pitch = 0.0f;
+    cam->fov = 60.0f;
+    cameraUpdate(cam);
+}
+
+inline void cameraUpdate(Camera *cam)
+{
+    // Clamp pitch to avoid gimbal lock
+    if (cam->pitch > 89.0f) cam->pitch = 89.0f;
+    if (cam->pitch < -89.0f) cam->pitch = -89.0f;
+
+    const float yaw_rad = cam->yaw * M_PI / 180.0f;
+    const float pitch_rad = cam->pitch * M_PI / 180.0f;
+
+    cam->front = vec3(
+        cosf(yaw_rad) * cosf(pitch_rad),
+        sinf(pitch_rad),
+        sinf(yaw_rad) * cosf(pitch_rad)
+    );
+
+    cam->front = norm(cam->front);
+    cam->right = norm(cross(cam->front, vec3(0, 1, 0)));
+    cam->up    = cross(cam->right, cam->front);
+}
+
+inline void cameraMove(Camera *cam, const Vec3 direction, const float speed)
+{
+    cam->position = add(cam->position, mul(direction, speed));
+}
+
+inline void cameraRotate(Camera *cam, const float dyaw, const float dpitch)
+{
+    cam->yaw += dyaw;
+    cam->pitch += dpitch;
+    cameraUpdate(cam);
+}
+
+inline Ray cameraGetRay(const Camera* cam, const float u_scaled, const float v_scaled)
+{
+    Vec3 rd = add(cam->front, add(mul(cam->up, v_scaled), mul(cam->right, u_scaled)));
+    rd = norm(rd);
+    return (Ray){cam->position, rd};
+}
+
+#endif // CAMERA_IMPLEMENTATION
+#endif // WRAPPER_CAMERA_H
+
+// ============================================================================
+// Textures with mip chains and filtered sampling
+// The implementation allocates and decodes through IMAGE_IMPLEMENTATION, which must be defined too
+// ============================================================================
+#ifndef WRAPPER_TEXTURE_H
+#define WRAPPER_TEXTURE_H
+
+#define TEXTURE_MAX_LEVELS 16
+#define TEXTURE_TILE_SHIFT 3    // Tiled layout: 8x8 texel tiles (256 bytes), Morton order inside a tile
+#define TEXTURE_TILE       (1 << TEXTURE_TILE_SHIFT)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    TEXTURE_LAYOUT_TILED,   // 8x8 Morton-ordered tiles, neighbours in both axes share cache lines
+    TEXTURE_LAYOUT_LINEAR   // Plain rows (reference / benchmarking)
+} TextureLayout;
+
+typedef enum {
+    TEXTURE_NEAREST,        // Nearest texel of the nearest mip level
+    TEXTURE_BILINEAR,       // 2x2 texels of the nearest mip level
+    TEXTURE_TRILINEAR       // Bilinear on the two closest mip levels, blended
+} TextureFilter;
+
+// Mipmapped 0xAARRGGBB texture, repeat wrapping
+typedef struct {
+    uint32_t *texels;       // Every level, each stored in `layout`
+    int width;              // Level 0 size
+    int height;
+    int levels;
+    int level_w[TEXTURE_MAX_LEVELS];
+    int level_h[TEXTURE_MAX_LEVELS];
+    int level_pitch[TEXTURE_MAX_LEVELS];    // Texels per row (linear) or tiles per row (tiled)
+    size_t level_offset[TEXTURE_MAX_LEVELS];
+    TextureLayout layout;
+    TextureFilter filter;   // Used by textureSample (default TEXTURE_TRILINEAR)
+} Texture;
+
+// Build a texture and its full mip chain (2x2 box filter) from an image
+/*  -> Example:
+ *  Texture tex;
+ *  ASSERT(textureCreate(&tex, &img, TEXTURE_LAYOUT_TILED));
+ */
+bool textureCreate(Texture *t, const Image *img, TextureLayout layout);
+
+// Load a QOI or binary PNM file as a tiled, trilinear texture
+/*  -> Example:
+ *  Texture bricks;
+ *  ASSERT(textureLoad(&bricks, "res/bricks.qoi"));
+ *  cube->mat.texture = &bricks;
+ */
+bool textureLoad(Texture *t, const char *path);
+
+// Free texture memory
+/*  -> Example:
+ *  textureFree(&bricks);
+ */
+void textureFree(Texture *t);
+
+// Read one texel of a mip level (coordinates wrap)
+/*  -> Example:
+ *  const uint32_t c = textureFetch(&tex, 0, x, y);
+ */
+uint32_t textureFetch(const Texture *t, int level, int x, int y);
+
+// Filtered sample at (u, v) with repeat wrapping; v = 0 is the bottom row (OBJ convention).
+// lod is log2 of texels per pixel, e.g. from screen-space UV derivatives or a ray cone.
+/*  -> Example (raytracer hit):
+ *  const uint32_t c = textureSample(hit.mat->texture, hit.u, hit.v, 0.0f);
+ *  color = vmul(color, vec3(((c >> 16) & 0xFF) / 255.0f, ((c >> 8) & 0xFF) / 255.0f, (c & 0xFF) / 255.0f));
+ */
+uint32_t textureSample(const Texture *t, float u, float v, float lod);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef TEXTURE_IMPLEMENTATION
+
+#ifndef IMAGE_IMPLEMENTATION
+#error "TEXTURE_IMPLEMENTATION needs IMAGE_IMPLEMENTATION (aligned texel storage, QOI/PNM decoding)"
+#endif
+
+// Bit spread for 3-bit Morton codes inside a tile
+static const uint8_t _texture_morton[TEXTURE_TILE] = { 0, 1, 4, 5, 16, 17, 20, 21 };
+
+static inline size_t _textureIndex(const Texture *t, const int level, const int x, const int y)
+{
+    if (t->layout == TEXTURE_LAYOUT_LINEAR) return t->level_offset[level] + (size_t)y * t->level_pitch[level] + x;
+    const size_t tile = (size_t)(y >> TEXTURE_TILE_SHIFT) * t->level_pitch[level] + (x >> TEXTURE_TILE_SHIFT);
+    return t->level_offset[level] + (tile << (2 * TEXTURE_TILE_SHIFT))
+         + (_texture_morton[x & (TEXTURE_TILE - 1)] | (_texture_morton[y & (TEXTURE_TILE - 1)] << 1));
+}
+
+static inline int _textureWrap(int i, const int n)
+{
+    if ((unsigned)i < (unsigned)n) return i;
+    i %= n;
+    return i < 0 ? i + n : i;
+}
+
+inline bool textureCreate(Texture *t, const Image *img, const TextureLayout layout)
+{
+    memset(t, 0, sizeof(*t));
+    if (!img || !img->pixels || img->width <= 0 || img->height <= 0) return false;
+    t->layout = layout;
+    t->filter = TEXTURE_TRILINEAR;
+    t->width  = img->width;
+    t->height = img->height;
+
+    // Level sizes and offsets (tiled levels are padded to whole tiles)
+    size_t total = 0;
+    int w = img->width, h = img->height;
+    for (t->levels = 0; t->levels < TEXTURE_MAX_LEVELS; t->levels++) {
+        t->level_w[t->levels] = w;
+        t->level_h[t->levels] = h;
+        t->level_offset[t->levels] = total;
+        t->level_pitch[t->levels] = layout == TEXTURE_LAYOUT_LINEAR ? w : (w + TEXTURE_TILE - 1) / TEXTURE_TILE;
+        total += layout == TEXTURE_LAYOUT_LINEAR
+            ? (size_t)w * h
+            : (size_t)t->level_pitch[t->levels] * ((h + TEXTURE_TILE - 1) / TEXTURE_TILE) * TEXTURE_TILE * TEXTURE_TILE;
+        if (w == 1 && h == 1) { t->levels++; break; }
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+
+    t->texels = (uint32_t*)_imageAlloc(total * sizeof(uint32_t));
+    uint32_t *scratch = (uint32_t*)malloc((size_t)img->width * img->height * sizeof(uint32_t));
+    if (!t->texels || !scratch) {
+        fprintf(stderr, "Failed to allocate texture (%dx%d)\n", img->width, img->height);
+        free(scratch);
+        textureFree(t);
+        return false;
+    }
+    memset(t->texels, 0, total * sizeof(uint32_t));
+
+    // Level 0 from the image, then each level box-filters the previous one in place in scratch
+    for (int y = 0; y < img->height; y++)
+        memcpy(scratch + (size_t)y * img->width, img->pixels + (size_t)y * img->pitch, img->width * sizeof(uint32_t));
+    for (int l = 0; l < t->levels; l++) {
+        const int lw = t->level_w[l], lh = t->level_h[l];
+        if (l > 0) {
+            const int pw = t->level_w[l - 1], ph = t->level_h[l - 1];
+            for (int y = 0; y < lh; y++) {
+                const uint32_t *r0 = scratch + (size_t)(2 * y < ph ? 2 * y : ph - 1) * pw;
+                const uint32_t *r1 = scratch + (size_t)(2 * y + 1 < ph ? 2 * y + 1 : ph - 1) * pw;
+                for (int x = 0; x < lw; x++) {
+                    const int x0 = 2 * x < pw ? 2 * x : pw - 1, x1 = 2 * x + 1 < pw ? 2 * x + 1 : pw - 1;
+                    const uint32_t a = r0[x0], b = r0[x1], c = r1[x0], d = r1[x1];
+                    uint32_t out = 0;
+                    for (int s = 0; s < 32; s += 8)
+                        out |= ((((a >> s) & 0xFF) + ((b >> s) & 0xFF) + ((c >> s) & 0xFF) + ((d >> s) & 0xFF) + 2) >> 2) << s;
+                    scratch[(size_t)y * lw + x] = out; // rows y and below of the previous level are already consumed
+                }
+            }
+        }
+        for (int y = 0; y < lh; y++)
+            for (int x = 0; x < lw; x++)
+                t->texels[_textureIndex(t, l, x, y)] = scratch[(size_t)y * lw + x];
+    }
+    free(scratch);
+    return true;
+}
+
+inline bool textureLoad(Texture *t, const char *path)
+{
+    Image img;
+    if (!imageLoad(&img, path)) {
+        memset(t, 0, sizeof(*t));
+        return false;
+    }
+    const bool ok = textureCreate(t, &img, TEXTURE_LAYOUT_TILED);
+    imageFree(&img);
+    return ok;
+}
+
+inline void textureFree(Texture *t)
+{
+    if (t->texels) _imageDealloc(t->texels);
+    t->texels = NULL;
+    t->levels = 0;
+}
+
+inline uint32_t textureFetch(const Texture *t, int level, const int x, const int y)
+{
+    if (level < 0) level = 0;
+    if (level >= t->levels) level = t->levels - 1;
+    return t->texels[_textureIndex(t, level, _textureWrap(x, t->level_w[level]), _textureWrap(y, t->level_h[level]))];
+}
+
+// Bilinear weights are 8-bit fractions (0..256); each pass rounds back to 8 bits so every path matches
+static inline uint32_t _texture_lerp_px(const uint32_t a, const uint32_t b, const uint32_t f)
+{
+    uint32_t out = 0;
+    for (int s = 0; s < 32; s += 8)
+        out |= ((((a >> s) & 0xFF) * (256 - f) + ((b >> s) & 0xFF) * f + 128) >> 8) << s;
+    return out;
+}
+
+static inline uint32_t _texture_bilerp_px(const uint32_t t00, const uint32_t t10, const uint32_t t01, const uint32_t t11,
+    const uint32_t fx, const uint32_t fy)
+{
+    return _texture_lerp_px(_texture_lerp_px(t00, t10, fx), _texture_lerp_px(t01, t11, fx), fy);
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+// lo/hi 64-bit halves hold the two pixels to blend (4 x 16-bit channels each), w the matching weights
+static inline __m128i _texture_lerp_sse(const __m128i ab, const __m128i w)
+{
+    const __m128i p = _mm_mullo_epi16(ab, w);
+    return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(p, _mm_srli_si128(p, 8)), _mm_set1_epi16(128)), 8);
+}
+
+static inline uint32_t _texture_bilerp_sse(const uint32_t t00, const uint32_t t10, const uint32_t t01, const uint32_t t11,
+    const uint32_t fx, const uint32_t fy)
+{
+    const __m128i z  = _mm_setzero_si128();
+    const __m128i wx = _mm_unpacklo_epi64(_mm_set1_epi16((short)(256 - fx)), _mm_set1_epi16((short)fx));
+    const __m128i wy = _mm_unpacklo_epi64(_mm_set1_epi16((short)(256 - fy)), _mm_set1_epi16((short)fy));
+    const __m128i h0 = _texture_lerp_sse(_mm_unpacklo_epi8(_mm_setr_epi32((int)t00, (int)t10, 0, 0), z), wx);
+    const __m128i h1 = _texture_lerp_sse(_mm_unpacklo_epi8(_mm_setr_epi32((int)t01, (int)t11, 0, 0), z), wx);
+    const __m128i v  = _texture_lerp_sse(_mm_unpacklo_epi64(h0, h1), wy);
+    return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(v, z));
+}
+#endif
+
+#if defined(__AVX2__)
+// Two bilinear footprints at once (one per 128-bit lane), blended by fl: the trilinear case
+static inline uint32_t _texture_trilerp_avx2(const uint32_t a[4], const uint32_t afx, const uint32_t afy,
+    const uint32_t b[4], const uint32_t bfx, const uint32_t bfy, const uint32_t fl)
+{
+    const __m256i z = _mm256_setzero_si256();
+    const __m256i r0 = _mm256_unpacklo_epi8(_mm256_setr_epi32((int)a[0], (int)a[1], 0, 0, (int)b[0], (int)b[1], 0, 0), z);
+    const __m256i r1 = _mm256_unpacklo_epi8(_mm256_setr_epi32((int)a[2], (int)a[3], 0, 0, (int)b[2], (int)b[3], 0, 0), z);
+    const __m256i wx = _mm256_setr_epi16(
+        (short)(256 - afx), (short)(256 - afx), (short)(256 - afx), (short)(256 - afx), (short)afx, (short)afx, (short)afx, (short)afx,
+        (short)(256 - bfx), (short)(256 - bfx), (short)(256 - bfx), (short)(256 - bfx), (short)bfx, (short)bfx, (short)bfx, (short)bfx);
+    const __m256i wy = _mm256_setr_epi16(
+        (short)(256 - afy), (short)(256 - afy), (short)(256 - afy), (short)(256 - afy), (short)afy, (short)afy, (short)afy, (short)afy,
+        (short)(256 - bfy), (short)(256 - bfy), (short)(256 - bfy), (short)(256 - bfy), (short)bfy, (short)bfy, (short)bfy, (short)bfy);
+    const __m256i round = _mm256_set1_epi16(128);
+
+    __m256i p0 = _mm256_mullo_epi16(r0, wx), p1 = _mm256_mullo_epi16(r1, wx);
+    const __m256i h0 = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(p0, _mm256_srli_si256(p0, 8)), round), 8);
+    const __m256i h1 = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(p1, _mm256_srli_si256(p1, 8)), round), 8);
+    p0 = _mm256_mullo_epi16(_mm256_unpacklo_epi64(h0, h1), wy);
+    const __m256i v = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(p0, _mm256_srli_si256(p0, 8)), round), 8);
+
+    // Low lane holds level a, high lane level b: blend them as one more lerp
+    const __m128i ab = _mm_unpacklo_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    const __m128i wl = _mm_unpacklo_epi64(_mm_set1_epi16((short)(256 - fl)), _mm_set1_epi16((short)fl));
+    return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(_texture_lerp_sse(ab, wl), _mm_setzero_si128()));
+}
+#endif
+
+// Repeat-wrap a texture coordinate into [0, 1) while still a float, so huge or non-finite values (NaN and
+// infinities map to 0) never reach an integer conversion
+static inline float _textureWrapUV(const float u)
+{
+    const float f = u - floorf(u);
+    return f >= 0.0f && f < 1.0f ? f : 0.0f;
+}
+
+// 2x2 footprint of (u, v) on a level: texels t00, t10, t01, t11 and 8-bit fractions
+static inline void _textureFootprint(const Texture *t, const int level, const float u, const float v,
+    uint32_t tex[4], uint32_t *fx, uint32_t *fy)
+{
+    const int w = t->level_w[level], h = t->level_h[level];
+    const float x = _textureWrapUV(u) * (float)w - 0.5f, y = (1.0f - _textureWrapUV(v)) * (float)h - 0.5f;
+    const float xf = floorf(x), yf = floorf(y);
+    *fx = (uint32_t)((x - xf) * 256.0f);
+    *fy = (uint32_t)((y - yf) * 256.0f);
+    const int x0 = _textureWrap((int)xf, w), y0 = _textureWrap((int)yf, h);
+    const int x1 = x0 + 1 == w ? 0 : x0 + 1, y1 = y0 + 1 == h ? 0 : y0 + 1;
+    tex[0] = t->texels[_textureIndex(t, level, x0, y0)];
+    tex[1] = t->texels[_textureIndex(t, level, x1, y0)];
+    tex[2] = t->texels[_textureIndex(t, level, x0, y1)];
+    tex[3] = t->texels[_textureIndex(t, level, x1, y1)];
+}
+
+static inline uint32_t _textureBilinear(const Texture *t, const int level, const float u, const float v)
+{
+    uint32_t tex[4], fx, fy;
+    _textureFootprint(t, level, u, v, tex, &fx, &fy);
+#if defined(__SSE2__) || defined(_M_X64)
+    if (cpuGetSimdLevel() >= CPU_SIMD_SSE) return _texture_bilerp_sse(tex[0], tex[1], tex[2], tex[3], fx, fy);
+#endif
+    return _texture_bilerp_px(tex[0], tex[1], tex[2], tex[3], fx, fy);
+}
+
+inline uint32_t textureSample(const Texture *t, const float u, const float v, float lod)
+{
+    if (!t->texels) return 0xFFFFFFFF;
+    const float max_lod = (float)(t->levels - 1);
+    lod = lod > 0.0f ? (lod < max_lod ? lod : max_lod) : 0.0f; // also maps NaN to 0
+
+    if (t->filter == TEXTURE_NEAREST) {
+        const int l = (int)(lod + 0.5f);
+        return textureFetch(t, l, (int)floorf(_textureWrapUV(u) * (float)t->level_w[l]),
+                            (int)floorf((1.0f - _textureWrapUV(v)) * (float)t->level_h[l]));
+    }
+    if (t->filter == TEXTURE_BILINEAR) return _textureBilinear(t, (int)(lod + 0.5f), u, v);
+
+    const int l0 = (int)lod;
+    const uint32_t fl = (uint32_t)((lod - (float)l0) * 256.0f);
+    if (fl == 0 || l0 + 1 >= t->levels) return _textureBilinear(t, l0, u, v);
+
+    uint32_t a[4], b[4], afx, afy, bfx, bfy;
+    _textureFootprint(t, l0, u, v, a, &afx, &afy);
+    _textureFootprint(t, l0 + 1, u, v, b, &bfx, &bfy);
+#if defined(__AVX2__)
+    if (cpuGetSimdLevel() >= CPU_SIMD_AVX2) return _texture_trilerp_avx2(a, afx, afy, b, bfx, bfy, fl);
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    if (cpuGetSimdLevel() >= CPU_SIMD_SSE)
+        return _texture_lerp_px(_texture_bilerp_sse(a[0], a[1], a[2], a[3], afx, afy),
+                                _texture_bilerp_sse(b[0], b[1], b[2], b[3], bfx, bfy), fl);
+#endif
+    return _texture_lerp_px(_texture_bilerp_px(a[0], a[1], a[2], a[3], afx, afy),
+                            _texture_bilerp_px(b[0], b[1], b[2], b[3], bfx, bfy), fl);
+}
+
+#endif // TEXTURE_IMPLEMENTATION
+#endif // WRAPPER_TEXTURE_H
+
+// ============================================================================
+// 3D model with materials and transforms
+// ============================================================================
+#ifndef WRAPPER_MODEL_H
+#define WRAPPER_MODEL_H
+
+#define INITIAL_VERTEX_CAPACITY 1024
+#define INITIAL_TRIANGLE_CAPACITY 2048
+#define MODEL_MAX_LODS 8
+#define MODEL_MESHLET_TRIANGLES 96
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Material properties for rendering
+typedef struct {
+    Vec3 color;
+    float reflectivity;  // 0.0 = matte, 1.0 = mirror
+	float specular;
+    const Texture* texture;  // Optional albedo map, multiplied with color (NULL: color only)
+    const struct Shader* shader;  // Optional programmable pipeline (NULL: built-in shading, see RENDER3D)
+    float transparency;      // 0.0 = opaque, 1.0 = invisible; renderScene composites these order-independently
+} Material;
+
+// Triangle primitive for meshes
+typedef struct {
+    Vec3 v0, v1, v2;
+    Vec3 color;
+    Vec3 n0, n1, n2;    // Per-vertex normals (all zero: use the face normal)
+    float uv[3][2];     // Per-vertex texture coordinates
+} Triangle;
+
+// One simplified level of a model's mesh
+typedef struct {
+    Triangle* triangles;
+    Triangle* transformed_triangles;
+    int num_triangles;
+    float error;            // Object-space deviation from the full mesh (largest collapse error, an RMS distance)
+} ModelLod;
+
+// Cluster of neighboring triangles with bounds to cull it as a whole (see modelBuildMeshlets)
+typedef struct {
+    int first, count;       // Triangle range in Model.triangles
+    Vec3 center;            // Bounding sphere, object space
+    float radius;
+    Vec3 cone_axis;         // Every face normal is within acos(cone_cos) of the axis
+    float cone_cos;         // <= 0: normals spread too wide for a facing test
+    Vec3 world_center;      // World bounds, set by modelUpdate
+    float world_radius;
+    Vec3 world_axis;
+    float world_cos;        // -1 under non-uniform or mirroring scale
+} ModelMeshlet;
+
+// Level-of-detail chain built by modelBuildLods; renderScene picks one level per model and frame
+typedef struct {
+    ModelLod levels[MODEL_MAX_LODS];    // levels[i] is LOD i + 1, coarser with each index (LOD 0 is the model itself)
+    int count;
+    int current;                        // LOD drawn last (0 = full mesh), so selection can hold it within a band
+    Vec3 center;                        // Bounding sphere of the full mesh, object space
+    float radius;
+    Vec3 world_center;                  // Set by modelUpdate
+    float world_scale;                  // Largest transform scale, for errors and radius
+} ModelLods;
+
+// 3D model with transform and material
+typedef struct {
+    Triangle* triangles;              // Original mesh triangles
+    Triangle* transformed_triangles;  // World-space transformed triangles
+    int num_triangles;
+    int capacity;                      // Allocated triangle capacity
+    uint32_t* edges;                   // Unique edges for wireframe, triangle << 2 | corner (corner to corner + 1)
+    int num_edges;                     // 0 with edges == NULL: every triangle edge is drawn
+    ModelLods* lods;                   // Simplified meshes for distance-based selection (NULL: none), see modelBuildLods
+    ModelMeshlet* meshlets;            // Triangle clusters in triangle order (NULL: none), see modelBuildMeshlets
+    int num_meshlets;
+    Vec3 position;
+    float rot_x, rot_y, rot_z;         // Euler angles in radians
+    Vec3 scale;
+    Material mat;
+} Model;
+
+// Create new model in storage array (returns NULL if array is full)
+/*  -> Example:
+ *  Model* cube = modelCreate(scene_models, &num_models, MAX_MODELS, vec3(1,0,0), 0.5f);
+ */
+Model* modelCreate(Model* storage, int* count, int max, Vec3 color, float refl, float spec);
+
+// Load OBJ file into model (dynamically allocates triangles; reads v/vt/vn, polygons are fanned)
+/*  -> Example:
+ *  modelLoad(cube, "res/cube.obj");
+ */
+void modelLoad(Model* m, const char* path);
+
+// Free model triangle data
+/*  -> Example:
+ *  modelFree(cube);
+ */
+void modelFree(Model* m);
+
+// Set model transform (position, rotation in radians, scale)
+/*  -> Example:
+ *  modelTransform(cube, vec3(0,0,0), vec3(0, M_PI/4, 0), vec3(1,1,1));
+ */
+void modelTransform(Model* m, Vec3 pos, Vec3 rot, Vec3 scale);
+
+// Deduplicate shared triangle edges by welding identical vertex positions (modelLoad does this from the OBJ
+// indices, skipping polygon fan diagonals); call after filling triangles by hand
+/*  -> Example:
+ *  modelBuildEdges(terrain);
+ *  renderer.wireframe = true;
+ */
+void modelBuildEdges(Model* m);
+
+// Build up to `levels` simplified meshes by quadric error edge collapse, each with about `ratio` times the
+// triangles of the one before (replaces an existing chain; call after modelLoad or filling triangles). UV seams
+// and open borders stay in place. Returns the number of levels built; renderScene then draws each model at the
+// coarsest level whose error stays under Renderer.lod_error pixels.
+/*  -> Example:
+ *  modelLoad(statue, "res/statue.obj");
+ *  modelBuildLods(statue, 4, 0.5f);
+ */
+int modelBuildLods(Model* m, int levels, float ratio);
+
+// Reorder the triangles into meshlets of up to max_triangles (64 to 128 works well; 0 for MODEL_MESHLET_TRIANGLES)
+// grown over shared vertices, each with a bounding sphere and a normal cone. The renderer then rejects whole
+// meshlets outside the view, facing away (with backface culling) or behind the depth tiles before any
+// per-triangle work. Returns the number of meshlets. LOD levels are drawn without meshlets.
+/*  -> Example:
+ *  modelLoad(city, "res/city.obj");
+ *  modelBuildMeshlets(city, 0);
+ */
+int modelBuildMeshlets(Model* m, int max_triangles);
+
+// Apply transforms to all models in array (call after changing transforms)
+/*  -> Example:
+ *  modelUpdate(scene_models, num_models);
+ */
+void modelUpdate(const Model* models, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef MODEL_IMPLEMENTATION
+
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Rotation helpers
+static inline Vec3 rotate_x(const Vec3 v, const float a)
+{
+    const float c = cosf(a), s = sinf(a);
+    return vec3(v.x, v.y * c - v.z * s, v.y * s + v.z * c);
+}
+
+static inline Vec3 rotate_y(const Vec3 v, const float a)
+{
+    const float c = cosf(a), s = sinf(a);
+    return vec3(v.x * c - v.z * s, v.y, v.x * s + v.z * c);
+}
+
+static inline Vec3 rotate_z(const Vec3 v, const float a)
+{
+    const float c = cosf(a), s = sinf(a);
+    return vec3(v.x * c - v.y * s, v.x * s + v.y * c, v.z);
+}
+
+static inline Vec3 transform_vertex(Vec3 v, const Model* m)
+{
+    v = vmul(v, m->scale);
+    if (m->rot_z) v = rotate_z(v, m->rot_z);
+    if (m->rot_x) v = rotate_x(v, m->rot_x);
+    if (m->rot_y) v = rotate_y(v, m->rot_y);
+    return add(v, m->position);
+}
+
+// Normals take the inverse scale so they stay perpendicular under non-uniform scaling
+static inline Vec3 transform_normal(Vec3 n, const Model* m)
+{
+    if (n.x == 0.0f && n.y == 0.0f && n.z == 0.0f) return n;
+    n = vec3(n.x / m->scale.x, n.y / m->scale.y, n.z / m->scale.z);
+    if (m->rot_z) n = rotate_z(n, m->rot_z);
+    if (m->rot_x) n = rotate_x(n, m->rot_x);
+    if (m->rot_y) n = rotate_y(n, m->rot_y);
+    return norm(n);
+}
+
+inline Model* modelCreate(Model* storage, int* count, const int max, const Vec3 color, const float refl, const float spec)
+{
+    if (*count >= max) return NULL;
+    Model* m = &storage[(*count)++];
+    m->triangles = NULL;
+    m->transformed_triangles = NULL;
+    m->num_triangles = 0;
+    m->capacity = 0;
+    m->edges = NULL;
+    m->num_edges = 0;
+    m->lods = NULL;
+    m->meshlets = NULL;
+    m->num_meshlets = 0;
+    m->position = (Vec3){0, 0, 0};
+    m->scale = (Vec3){1.0f, 1.0f, 1.0f};
+    m->rot_x = 0; m->rot_y = 0; m->rot_z = 0;
+    m->mat = (Material){color, refl, spec, NULL, NULL, 0.0f};
+    return m;
+}
+
+static inline void _modelFreeLods(Model* m)
+{
+    if (!m->lods) return;
+    for (int i = 0; i < m->lods->count; i++) {
+        free(m->lods->levels[i].triangles);
+        free(m->lods->levels[i].transformed_triangles);
+    }
+    free(m->lods);
+    m->lods = NULL;
+}
+
+inline void modelFree(Model* m)
+{
+    if (m->triangles)
+    {
+        free(m->triangles);
+        m->triangles = NULL;
+    }
+
+    if (m->transformed_triangles)
+    {
+        free(m->transformed_triangles);
+        m->transformed_triangles = NULL;
+    }
+
+    free(m->edges);
+    m->edges = NULL;
+    m->num_edges = 0;
+    _modelFreeLods(m);
+    free(m->meshlets);
+    m->meshlets = NULL;
+    m->num_meshlets = 0;
+    m->num_triangles = 0;
+    m->capacity = 0;
+}
+
+static inline uint32_t _modelHash(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xFF51AFD7ED558CCDull;
+    k ^= k >> 33;
+    return (uint32_t)k;
+}
+
+// Keep one edge per vertex pair. ids holds three vertex indices per triangle; mask (optional) has bit k set
+// when edge k of a triangle may be drawn at all.
+static inline void _modelBuildEdgeList(Model* m, const int* ids, const uint8_t* mask)
+{
+    free(m->edges);
+    m->edges = NULL;
+    m->num_edges = 0;
+    if (m->num_triangles <= 0 || m->num_triangles > (int)(UINT32_MAX >> 2)) return;
+
+    size_t slots = 16;
+    while (slots < (size_t)m->num_triangles * 6) slots <<= 1;
+    uint64_t* table = (uint64_t*)calloc(slots, sizeof(uint64_t));
+    uint32_t* edges = (uint32_t*)malloc((size_t)m->num_triangles * 3 * sizeof(uint32_t));
+    if (!table || !edges) { free(table); free(edges); return; }
+
+    int n = 0;
+    for (int t = 0; t < m->num_triangles; t++) {
+        for (int k = 0; k < 3; k++) {
+            if (mask && !(mask[t] >> k & 1)) continue;
+            const uint32_t a = (uint32_t)ids[t * 3 + k], b = (uint32_t)ids[t * 3 + (k + 1) % 3];
+            if (a == b) continue;
+            // Zero marks an empty slot, so indices are stored plus one
+            const uint64_t key = (uint64_t)((a < b ? a : b) + 1) << 32 | (uint64_t)((a < b ? b : a) + 1);
+            size_t i = _modelHash(key) & (slots - 1);
+            while (table[i] && table[i] != key) i = (i + 1) & (slots - 1);
+            if (table[i]) continue;
+            table[i] = key;
+            edges[n++] = (uint32_t)t << 2 | (uint32_t)k;
+        }
+    }
+    free(table);
+    m->edges = (uint32_t*)realloc(edges, (n ? n : 1) * sizeof(uint32_t));
+    if (!m->edges) m->edges = edges;
+    m->num_edges = n;
+}
+
+static inline Vec3 _modelCorner(const Triangle* t, const int k)
+{
+    return k == 0 ? t->v0 : k == 1 ? t->v1 : t->v2;
+}
+
+// Weld: each corner gets the index of the first corner with the same position; NULL when out of memory
+static inline int* _modelWeld(const Model* m)
+{
+    const int corners = m->num_triangles * 3;
+    size_t slots = 16;
+    while (slots < (size_t)corners * 2) slots <<= 1;
+    int* ids   = (int*)malloc((corners > 0 ? corners : 1) * sizeof(int));
+    int* table = (int*)malloc(slots * sizeof(int));
+    if (!ids || !table) { free(ids); free(table); return NULL; }
+    memset(table, 0xFF, slots * sizeof(int));
+
+    for (int c = 0; c < corners; c++) {
+        const Vec3 p = _modelCorner(&m->triangles[c / 3], c % 3);
+        uint32_t bits[3];
+        const float xyz[3] = { p.x + 0.0f, p.y + 0.0f, p.z + 0.0f };  // + 0.0f folds -0 into 0
+        memcpy(bits, xyz, sizeof(bits));
+        size_t i = _modelHash((uint64_t)bits[0] << 32 ^ (uint64_t)bits[1] << 16 ^ bits[2]) & (slots - 1);
+        for (;; i = (i + 1) & (slots - 1)) {
+            if (table[i] < 0) { table[i] = c; ids[c] = c; break; }
+            const Vec3 q = _modelCorner(&m->triangles[table[i] / 3], table[i] % 3);
+            if (q.x == p.x && q.y == p.y && q.z == p.z) { ids[c] = table[i]; break; }
+        }
+    }
+    free(table);
+    return ids;
+}
+
+inline void modelBuildEdges(Model* m)
+{
+    int* ids = _modelWeld(m);
+    if (!ids) return;
+    _modelBuildEdgeList(m, ids, NULL);
+    free(ids);
+}
+
+inline void modelTransform(Model* m, const Vec3 pos, const Vec3 rot, const Vec3 scale)
+{
+    m->position = pos;
+    m->rot_x = rot.x;
+    m->rot_y = rot.y;
+    m->rot_z = rot.z;
+    m->scale = scale;
+}
+
+static inline void _modelTransformTriangles(const Model* m, const Triangle* src, Triangle* dst, const int n)
+{
+    for (int j = 0; j < n; j++)
+    {
+        dst[j].v0    = transform_vertex(src[j].v0, m);
+        dst[j].v1    = transform_vertex(src[j].v1, m);
+        dst[j].v2    = transform_vertex(src[j].v2, m);
+        dst[j].color = src[j].color;
+        dst[j].n0    = transform_normal(src[j].n0, m);
+        dst[j].n1    = transform_normal(src[j].n1, m);
+        dst[j].n2    = transform_normal(src[j].n2, m);
+        memcpy(dst[j].uv, src[j].uv, sizeof(src[j].uv));
+    }
+}
+
+static inline void _modelUpdateMeshlets(const Model* m)
+{
+    const float scale = fmaxf(fabsf(m->scale.x), fmaxf(fabsf(m->scale.y), fabsf(m->scale.z)));
+    // Rotation and positive uniform scale keep the angles between normals and the winding
+    const bool cone = m->scale.x > 0.0f && m->scale.x == m->scale.y && m->scale.y == m->scale.z;
+    for (int k = 0; k < m->num_meshlets; k++) {
+        ModelMeshlet* ml = &m->meshlets[k];
+        ml->world_center = transform_vertex(ml->center, m);
+        ml->world_radius = ml->radius * scale;
+        ml->world_axis   = transform_normal(ml->cone_axis, m);
+        ml->world_cos    = cone ? ml->cone_cos : -1.0f;
+    }
+}
+
+inline void modelUpdate(const Model* models, const int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        const Model* m = &models[i];
+        _modelTransformTriangles(m, m->triangles, m->transformed_triangles, m->num_triangles);
+        _modelUpdateMeshlets(m);
+        ModelLods* l = m->lods;
+        if (!l) continue;
+        for (int k = 0; k < l->count; k++)
+            _modelTransformTriangles(m, l->levels[k].triangles, l->levels[k].transformed_triangles, l->levels[k].num_triangles);
+        l->world_center = transform_vertex(l->center, m);
+        l->world_scale  = fmaxf(fabsf(m->scale.x), fmaxf(fabsf(m->scale.y), fabsf(m->scale.z)));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Mesh simplification: quadric error edge collapses in passes of independent collapses
+// ---------------------------------------------------------------------------
+
+// Symmetric 4x4 error quadric (xx xy xz xw yy yz yw zz zw ww) summed over face planes weighted by area
+typedef struct { double q[10]; double area; } _ModelQuadric;
+
+typedef struct {
+    float cost;
+    int from, to;           // from is removed, to moves to pos
+    Vec3 pos;
+} _ModelCollapse;
+
+typedef struct {
+    Triangle* tris;         // Working triangles: corner attributes and color (positions live in pos)
+    int* tv;                // Vertex per corner, -1 for removed triangles
+    Vec3* pos;
+    _ModelQuadric* quad;
+    uint8_t* locked;        // Border, non-manifold or UV seam: the vertex never moves
+    int* adj_start;         // Vertex -> incident triangles (CSR, rebuilt every pass)
+    int* adj;
+    int* fill;
+    uint64_t* edges;
+    _ModelCollapse* collapses;
+    int* mark;              // Neighbor stamps for the link test
+    int stamp;
+    uint8_t* touched;       // Part of a collapse this pass
+    int nt, nv, live;
+    double max_cost;
+} _ModelSimplify;
+
+static inline void _modelQuadricAdd(_ModelQuadric* a, const _ModelQuadric* b)
+{
+    for (int i = 0; i < 10; i++) a->q[i] += b->q[i];
+    a->area += b->area;
+}
+
+// Mean squared distance from p to the planes
+static inline double _modelQuadricEval(const _ModelQuadric* a, const Vec3 p)
+{
+    const double* q = a->q;
+    const double x = p.x, y = p.y, z = p.z;
+    if (a->area <= 0.0) return 0.0;
+    return (q[0] * x * x + 2.0 * q[1] * x * y + 2.0 * q[2] * x * z + 2.0 * q[3] * x +
+            q[4] * y * y + 2.0 * q[5] * y * z + 2.0 * q[6] * y +
+            q[7] * z * z + 2.0 * q[8] * z + q[9]) / a->area;
+}
+
+// Position minimizing the quadric; false when the system is close to singular (flat or straight regions)
+static inline bool _modelQuadricSolve(const _ModelQuadric* a, Vec3* out)
+{
+    const double* q = a->q;
+    const double det = q[0] * (q[4] * q[7] - q[5] * q[5]) - q[1] * (q[1] * q[7] - q[5] * q[2]) + q[2] * (q[1] * q[5] - q[4] * q[2]);
+    const double scale = q[0] + q[4] + q[7];
+    if (fabs(det) <= 1e-9 * scale * scale * scale) return false;
+    const double bx = -q[3], by = -q[6], bz = -q[8];
+    const double x = (bx * (q[4] * q[7] - q[5] * q[5]) - q[1] * (by * q[7] - q[5] * bz) + q[2] * (by * q[5] - q[4] * bz)) / det;
+    const double y = (q[0] * (by * q[7] - q[5] * bz) - bx * (q[1] * q[7] - q[5] * q[2]) + q[2] * (q[1] * bz - by * q[2])) / det;
+    const double z = (q[0] * (q[4] * bz - by * q[5]) - q[1] * (q[1] * bz - by * q[2]) + bx * (q[1] * q[5] - q[4] * q[2])) / det;
+    *out = vec3((float)x, (float)y, (float)z);
+    return true;
+}
+
+static inline Vec3* _modelCornerNormal(Triangle* t, const int k)
+{
+    return k == 0 ? &t->n0 : k == 1 ? &t->n1 : &t->n2;
+}
+
+// How unlike two corners' attributes are, to keep the right side of a hard edge when a corner is moved
+static inline float _modelCornerDistance(Triangle* a, const int ka, Triangle* b, const int kb)
+{
+    const float du = a->uv[ka][0] - b->uv[kb][0], dv = a->uv[ka][1] - b->uv[kb][1];
+    const Vec3 na = *_modelCornerNormal(a, ka), nb = *_modelCornerNormal(b, kb);
+    return du * du + dv * dv + (1.0f - dot(na, nb));
+}
+
+static int _modelEdgeCmp(const void* pa, const void* pb)
+{
+    const uint64_t a = *(const uint64_t*)pa, b = *(const uint64_t*)pb;
+    return a < b ? -1 : a > b;
+}
+
+static int _modelCollapseCmp(const void* pa, const void* pb)
+{
+    const float a = ((const _ModelCollapse*)pa)->cost, b = ((const _ModelCollapse*)pb)->cost;
+    return a < b ? -1 : a > b;
+}
+
+// Unique edges of the live triangles as lo << 32 | hi, sorted; with counts, also the border and non-manifold locks
+static inline int _modelSimplifyEdges(_ModelSimplify* s, const bool lock)
+{
+    int n = 0;
+    for (int t = 0; t < s->nt; t++) {
+        const int* v = &s->tv[t * 3];
+        if (v[0] < 0) continue;
+        for (int k = 0; k < 3; k++) {
+            const uint32_t a = (uint32_t)v[k], b = (uint32_t)v[(k + 1) % 3];
+            s->edges[n++] = (uint64_t)(a < b ? a : b) << 32 | (a < b ? b : a);
+        }
+    }
+    qsort(s->edges, (size_t)n, sizeof(uint64_t), _modelEdgeCmp);
+    int unique = 0;
+    for (int i = 0; i < n;) {
+        int j = i + 1;
+        while (j < n && s->edges[j] == s->edges[i]) j++;
+        if (lock && j - i != 2) {
+            s->locked[s->edges[i] >> 32] = 1;
+            s->locked[s->edges[i] & 0xFFFFFFFFu] = 1;
+        }
+        s->edges[unique++] = s->edges[i];
+        i = j;
+    }
+    return unique;
+}
+
+static inline void _modelSimplifyAdjacency(_ModelSimplify* s)
+{
+    memset(s->adj_start, 0, (size_t)(s->nv + 1) * sizeof(int));
+    for (int c = 0; c < s->nt * 3; c++) if (s->tv[c] >= 0) s->adj_start[s->tv[c] + 1]++;
+    for (int v = 0; v < s->nv; v++) s->adj_start[v + 1] += s->adj_start[v];
+    memcpy(s->fill, s->adj_start, (size_t)s->nv * sizeof(int));
+    for (int c = 0; c < s->nt * 3; c++) if (s->tv[c] >= 0) s->adj[s->fill[s->tv[c]]++] = c / 3;
+}
+
+static inline bool _modelHas(const int* tv, const int v)
+{
+    return tv[0] == v || tv[1] == v || tv[2] == v;
+}
+
+// Cheapest way to collapse edge a-b: into either end, or to the quadric's minimum when both may move
+static inline bool _modelCollapseCandidate(const _ModelSimplify* s, const int a, const int b, _ModelCollapse* out)
+{
+    if (s->locked[a] && s->locked[b]) return false;
+    _ModelQuadric q = s->quad[a];
+    _modelQuadricAdd(&q, &s->quad[b]);
+    double best = 0.0;
+    if (!s->locked[a]) {
+        best = _modelQuadricEval(&q, s->pos[b]);
+        out->from = a; out->to = b; out->pos = s->pos[b];
+    }
+    if (!s->locked[b]) {
+        const double cost = _modelQuadricEval(&q, s->pos[a]);
+        if (s->locked[a] || cost < best) { best = cost; out->from = b; out->to = a; out->pos = s->pos[a]; }
+    }
+    if (!s->locked[a] && !s->locked[b]) {
+        const Vec3 mid = mul(add(s->pos[a], s->pos[b]), 0.5f);
+        Vec3 p;
+        // Nearly flat neighborhoods put the minimum anywhere along a line or plane; stay near the edge
+        if (!_modelQuadricSolve(&q, &p) || len(sub(p, mid)) > len(sub(s->pos[a], s->pos[b]))) p = mid;
+        const double cost = _modelQuadricEval(&q, p);
+        if (cost < best) { best = cost; out->from = a; out->to = b; out->pos = p; }
+    }
+    out->cost = (float)(best > 0.0 ? best : 0.0);
+    return true;
+}
+
+// A collapse must keep the surface manifold (the ends share exactly the neighbors of the removed triangles) and
+// must not fold any surviving triangle over
+static inline bool _modelCollapseValid(_ModelSimplify* s, const _ModelCollapse* c)
+{
+    const int from = c->from, to = c->to;
+    int gone = 0, shared = 0;
+    s->stamp += 2;
+    for (int i = s->adj_start[from]; i < s->adj_start[from + 1]; i++) {
+        const int* tv = &s->tv[s->adj[i] * 3];
+        if (tv[0] < 0) continue;
+        gone += _modelHas(tv, to);
+        for (int k = 0; k < 3; k++) s->mark[tv[k]] = s->stamp;
+    }
+    for (int i = s->adj_start[to]; i < s->adj_start[to + 1]; i++) {
+        const int* tv = &s->tv[s->adj[i] * 3];
+        if (tv[0] < 0) continue;
+        for (int k = 0; k < 3; k++) {
+            const int w = tv[k];
+            if (w == from || w == to || s->mark[w] != s->stamp) continue;
+            s->mark[w] = s->stamp + 1;
+            shared++;
+        }
+    }
+    if (gone == 0 || shared != gone) return false;
+
+    for (int side = 0; side < 2; side++) {
+        const int v = side ? to : from;
+        for (int i = s->adj_start[v]; i < s->adj_start[v + 1]; i++) {
+            const int* tv = &s->tv[s->adj[i] * 3];
+            if (tv[0] < 0 || (_modelHas(tv, from) && _modelHas(tv, to))) continue;
+            Vec3 p[3], q[3];
+            for (int k = 0; k < 3; k++) {
+                p[k] = s->pos[tv[k]];
+                q[k] = tv[k] == from || tv[k] == to ? c->pos : p[k];
+            }
+            const Vec3 n0 = cross(sub(p[1], p[0]), sub(p[2], p[0]));
+            const Vec3 n1 = cross(sub(q[1], q[0]), sub(q[2], q[0]));
+            const float l0 = len(n0);
+            if (l0 > 0.0f && dot(n0, n1) <= 0.25f * l0 * len(n1)) return false;
+        }
+    }
+    return true;
+}
+
+static inline void _modelCollapseApply(_ModelSimplify* s, const _ModelCollapse* c)
+{
+    const int from = c->from, to = c->to;
+    // Triangles on the edge disappear; their corners tell which attributes `to` has on each side of the edge
+    int gone[2], ngone = 0;
+    for (int i = s->adj_start[from]; i < s->adj_start[from + 1]; i++) {
+        const int t = s->adj[i];
+        if (s->tv[t * 3] >= 0 && _modelHas(&s->tv[t * 3], to) && ngone < 2) gone[ngone++] = t;
+    }
+    for (int i = s->adj_start[from]; i < s->adj_start[from + 1]; i++) {
+        const int t = s->adj[i];
+        int* tv = &s->tv[t * 3];
+        if (tv[0] < 0 || _modelHas(tv, to)) continue;
+        const int k = tv[0] == from ? 0 : tv[1] == from ? 1 : 2;
+        int best = gone[0];
+        float best_d = FLT_MAX;
+        for (int g = 0; g < ngone; g++) {
+            const int* gv = &s->tv[gone[g] * 3];
+            const float d = _modelCornerDistance(&s->tris[t], k, &s->tris[gone[g]], gv[0] == from ? 0 : gv[1] == from ? 1 : 2);
+            if (d < best_d) { best_d = d; best = gone[g]; }
+        }
+        const int* bv = &s->tv[best * 3];
+        const int kb = bv[0] == to ? 0 : bv[1] == to ? 1 : 2;
+        *_modelCornerNormal(&s->tris[t], k) = *_modelCornerNormal(&s->tris[best], kb);
+        s->tris[t].uv[k][0] = s->tris[best].uv[kb][0];
+        s->tris[t].uv[k][1] = s->tris[best].uv[kb][1];
+        tv[k] = to;
+    }
+    for (int g = 0; g < ngone; g++) {
+        s->tv[gone[g] * 3] = s->tv[gone[g] * 3 + 1] = s->tv[gone[g] * 3 + 2] = -1;
+        s->live--;
+    }
+    s->pos[to] = c->pos;
+    _modelQuadricAdd(&s->quad[to], &s->quad[from]);
+    if (c->cost > s->max_cost) s->max_cost = c->cost;
+
+    // Everything around both ends has stale adjacency or costs until the next pass
+    for (int side = 0; side < 2; side++) {
+        const int v = side ? to : from;
+        for (int i = s->adj_start[v]; i < s->adj_start[v + 1]; i++)
+            for (int k = 0; k < 3; k++) if (s->tv[s->adj[i] * 3 + k] >= 0) s->touched[s->tv[s->adj[i] * 3 + k]] = 1;
+    }
+    s->touched[from] = s->touched[to] = 1;
+}
+
+// One pass of independent collapses, cheapest first, each ending a neighborhood's turn until the next pass; the
+// cost bound keeps one pass from reaching far past what the remaining goal needs. False when nothing collapsed.
+static inline bool _modelSimplifyPass(_ModelSimplify* s, const int target)
+{
+    _modelSimplifyAdjacency(s);
+    const int ne = _modelSimplifyEdges(s, false);
+    int nc = 0;
+    for (int i = 0; i < ne; i++)
+        if (_modelCollapseCandidate(s, (int)(s->edges[i] >> 32), (int)(s->edges[i] & 0xFFFFFFFFu), &s->collapses[nc])) nc++;
+    if (nc == 0) return false;
+    qsort(s->collapses, (size_t)nc, sizeof(_ModelCollapse), _modelCollapseCmp);
+
+    // Collapses left at about two triangles each; about a third of the candidates survive the neighborhood rule
+    const int goal = 3 * ((s->live - target) / 2 + 1);
+    const float limit = s->collapses[(goal < nc ? goal : nc) - 1].cost;
+    const int before = s->live;
+    memset(s->touched, 0, (size_t)s->nv);
+    for (int i = 0; i < nc && s->live > target; i++) {
+        const _ModelCollapse* c = &s->collapses[i];
+        if (c->cost > limit && s->live < before) break;
+        if (s->touched[c->from] || s->touched[c->to] || !_modelCollapseValid(s, c)) continue;
+        _modelCollapseApply(s, c);
+    }
+    return s->live < before;
+}
+
+static inline void _modelSimplifyFree(_ModelSimplify* s)
+{
+    free(s->tris);
+    free(s->tv);
+    free(s->pos);
+    free(s->quad);
+    free(s->locked);
+    free(s->adj_start);
+    free(s->adj);
+    free(s->fill);
+    free(s->mark);
+    free(s->edges);
+    free(s->collapses);
+    free(s->touched);
+}
+
+inline int modelBuildLods(Model* m, int levels, const float ratio)
+{
+    _modelFreeLods(m);
+    if (levels > MODEL_MAX_LODS) levels = MODEL_MAX_LODS;
+    if (levels <= 0 || !(ratio > 0.0f && ratio < 1.0f) || !m->triangles || m->num_triangles < 4) return 0;
+    int* ids = _modelWeld(m);
+    if (!ids) return 0;
+
+    _ModelSimplify s;
+    memset(&s, 0, sizeof(s));
+    s.nt = m->num_triangles;
+    const size_t corners = (size_t)s.nt * 3;
+    s.tris      = (Triangle*)malloc((size_t)s.nt * sizeof(Triangle));
+    s.tv        = (int*)malloc(corners * sizeof(int));
+    s.pos       = (Vec3*)malloc(corners * sizeof(Vec3));
+    s.quad      = (_ModelQuadric*)calloc(corners, sizeof(_ModelQuadric));
+    s.locked    = (uint8_t*)calloc(corners, 1);
+    s.adj_start = (int*)malloc((corners + 1) * sizeof(int));
+    s.adj       = (int*)malloc(corners * sizeof(int));
+    s.fill      = (int*)malloc(corners * sizeof(int));
+    s.mark      = (int*)calloc(corners, sizeof(int));
+    s.edges     = (uint64_t*)malloc(corners * sizeof(uint64_t));
+    s.collapses = (_ModelCollapse*)malloc(corners * sizeof(_ModelCollapse));
+    s.touched   = (uint8_t*)malloc(corners);
+    ModelLods* lods = (ModelLods*)calloc(1, sizeof(ModelLods));
+    if (!s.tris || !s.tv || !s.pos || !s.quad || !s.locked || !s.adj_start || !s.adj || !s.fill || !s.mark || !s.edges ||
+        !s.collapses || !s.touched || !lods) {
+        _modelSimplifyFree(&s);
+        free(lods);
+        free(ids);
+        return 0;
+    }
+    memcpy(s.tris, m->triangles, (size_t)s.nt * sizeof(Triangle));
+
+    // Welded corners become vertices; a vertex whose corners disagree on UVs sits on a seam and is locked
+    for (size_t c = 0; c < corners; c++) {
+        if (ids[c] == (int)c) {
+            s.fill[s.nv] = (int)c;
+            s.pos[s.nv]  = _modelCorner(&s.tris[c / 3], (int)(c % 3));
+            s.tv[c]      = s.nv++;
+            continue;
+        }
+        s.tv[c] = s.tv[ids[c]];
+        const int first = s.fill[s.tv[c]];
+        if (s.tris[c / 3].uv[c % 3][0] != s.tris[first / 3].uv[first % 3][0] ||
+            s.tris[c / 3].uv[c % 3][1] != s.tris[first / 3].uv[first % 3][1]) s.locked[s.tv[c]] = 1;
+    }
+    free(ids);
+
+    // Each vertex starts with the planes of its faces: the cost of a position is its mean squared distance
+    s.live = s.nt;
+    for (int t = 0; t < s.nt; t++) {
+        int* tv = &s.tv[t * 3];
+        if (tv[0] == tv[1] || tv[1] == tv[2] || tv[0] == tv[2]) {
+            tv[0] = tv[1] = tv[2] = -1;
+            s.live--;
+            continue;
+        }
+        Vec3 n = cross(sub(s.pos[tv[1]], s.pos[tv[0]]), sub(s.pos[tv[2]], s.pos[tv[0]]));
+        const float l = len(n);
+        if (l <= 0.0f) continue;
+        n = mul(n, 1.0f / l);
+        const double a = n.x, b = n.y, c = n.z, d = -dot(n, s.pos[tv[0]]), w = 0.5 * l;
+        const _ModelQuadric plane = { { w * a * a, w * a * b, w * a * c, w * a * d, w * b * b, w * b * c, w * b * d,
+                                        w * c * c, w * c * d, w * d * d }, w };
+        for (int k = 0; k < 3; k++) _modelQuadricAdd(&s.quad[tv[k]], &plane);
+    }
+    Vec3 lo = m->triangles[0].v0, hi = lo;     // Corner 0 is vertex 0
+    for (int v = 1; v < s.nv; v++) {
+        lo = vec3(fminf(lo.x, s.pos[v].x), fminf(lo.y, s.pos[v].y), fminf(lo.z, s.pos[v].z));
+        hi = vec3(fmaxf(hi.x, s.pos[v].x), fmaxf(hi.y, s.pos[v].y), fmaxf(hi.z, s.pos[v].z));
+    }
+    lods->center = mul(add(lo, hi), 0.5f);
+    for (int v = 0; v < s.nv; v++) lods->radius = fmaxf(lods->radius, len(sub(s.pos[v], lods->center)));
+    _modelSimplifyEdges(&s, true);    // Borders and non-manifold edges lock their vertices
+
+    int prev = s.live;
+    while (lods->count < levels) {
+        const int target = (int)((float)prev * ratio);
+        if (target < 2) break;
+        while (s.live > target && _modelSimplifyPass(&s, target)) {}
+        // Under an eighth fewer triangles: the mesh is about as simple as its locked vertices allow
+        if (s.live > prev - prev / 8) break;
+
+        ModelLod* l = &lods->levels[lods->count];
+        l->triangles             = (Triangle*)malloc((size_t)s.live * sizeof(Triangle));
+        l->transformed_triangles = (Triangle*)malloc((size_t)s.live * sizeof(Triangle));
+        if (!l->triangles || !l->transformed_triangles) {
+            free(l->triangles);
+            free(l->transformed_triangles);
+            l->triangles = l->transformed_triangles = NULL;
+            break;
+        }
+        for (int t = 0; t < s.nt; t++) {
+            const int* tv = &s.tv[t * 3];
+            if (tv[0] < 0) continue;
+            Triangle* o = &l->triangles[l->num_triangles++];
+            *o = s.tris[t];
+            o->v0 = s.pos[tv[0]];
+            o->v1 = s.pos[tv[1]];
+            o->v2 = s.pos[tv[2]];
+        }
+        l->error = sqrtf((float)s.max_cost);
+        _modelTransformTriangles(m, l->triangles, l->transformed_triangles, l->num_triangles);
+        lods->count++;
+        prev = s.live;
+    }
+    _modelSimplifyFree(&s);
+
+    if (lods->count == 0) { free(lods); return 0; }
+    lods->world_center = transform_vertex(lods->center, m);
+    lods->world_scale  = fmaxf(fabsf(m->scale.x), fmaxf(fabsf(m->scale.y), fabsf(m->scale.z)));
+    m->lods = lods;
+    return lods->count;
+}
+
+// ---------------------------------------------------------------------------
+// Meshlets: greedy clusters grown across shared vertices, kept compact and flat
+// ---------------------------------------------------------------------------
+
+static inline void _modelMeshletBounds(const Model* m, ModelMeshlet* ml)
+{
+    const Triangle* tris = &m->triangles[ml->first];
+    Vec3 lo = tris[0].v0, hi = lo, axis = vec3(0, 0, 0);
+    for (int t = 0; t < ml->count; t++) {
+        for (int k = 0; k < 3; k++) {
+            const Vec3 p = _modelCorner(&tris[t], k);
+            lo = vec3(fminf(lo.x, p.x), fminf(lo.y, p.y), fminf(lo.z, p.z));
+            hi = vec3(fmaxf(hi.x, p.x), fmaxf(hi.y, p.y), fmaxf(hi.z, p.z));
+        }
+        const Vec3 n = cross(sub(tris[t].v1, tris[t].v0), sub(tris[t].v2, tris[t].v0));
+        const float l = len(n);
+        if (l > 0.0f) axis = add(axis, mul(n, 1.0f / l));
+    }
+    ml->center = mul(add(lo, hi), 0.5f);
+    ml->radius = 0.0f;
+    for (int t = 0; t < ml->count; t++)
+        for (int k = 0; k < 3; k++) ml->radius = fmaxf(ml->radius, len(sub(_modelCorner(&tris[t], k), ml->center)));
+
+    // Degenerate faces never draw, so they do not widen the cone
+    const float l = len(axis);
+    ml->cone_axis = l > 0.0f ? mul(axis, 1.0f / l) : vec3(0, 0, 1);
+    ml->cone_cos  = l > 0.0f ? 1.0f : -1.0f;
+    for (int t = 0; t < ml->count && ml->cone_cos > 0.0f; t++) {
+        const Vec3 n = cross(sub(tris[t].v1, tris[t].v0), sub(tris[t].v2, tris[t].v0));
+        const float nl = len(n);
+        if (nl > 0.0f) ml->cone_cos = fminf(ml->cone_cos, dot(n, ml->cone_axis) / nl);
+    }
+}
+
+inline int modelBuildMeshlets(Model* m, int max_triangles)
+{
+    free(m->meshlets);
+    m->meshlets = NULL;
+    m->num_meshlets = 0;
+    if (max_triangles <= 0) max_triangles = MODEL_MESHLET_TRIANGLES;
+    if (!m->triangles || m->num_triangles <= 0) return 0;
+    const int nt = m->num_triangles;
+    const int corners = nt * 3;
+    int* ids = _modelWeld(m);
+    if (!ids) return 0;
+
+    int* start        = (int*)calloc((size_t)corners + 1, sizeof(int));
+    int* unplaced     = (int*)malloc((size_t)corners * sizeof(int));    // Unplaced triangles per welded vertex
+    int* adj          = (int*)malloc((size_t)corners * sizeof(int));
+    int* order        = (int*)malloc((size_t)nt * sizeof(int));
+    int* cand         = (int*)malloc((size_t)nt * sizeof(int));
+    uint8_t* state    = (uint8_t*)calloc((size_t)nt, 1);                 // 0 free, 1 candidate, 2 placed
+    Vec3* centroid    = (Vec3*)malloc((size_t)nt * sizeof(Vec3));
+    Vec3* normal      = (Vec3*)malloc((size_t)nt * sizeof(Vec3));
+    ModelMeshlet* out = (ModelMeshlet*)malloc((size_t)nt * sizeof(ModelMeshlet));
+    Triangle* tris    = (Triangle*)malloc((size_t)nt * sizeof(Triangle));
+    if (!start || !unplaced || !adj || !order || !cand || !state || !centroid || !normal || !out || !tris) {
+        free(ids); free(start); free(unplaced); free(adj); free(order); free(cand); free(state); free(centroid); free(normal);
+        free(out); free(tris);
+        return 0;
+    }
+
+    // Welded vertex -> incident triangles (CSR); filling advances each start to the next one, shifted back after
+    for (int c = 0; c < corners; c++) start[ids[c] + 1]++;
+    for (int v = 0; v < corners; v++) start[v + 1] += start[v];
+    for (int c = 0; c < corners; c++) adj[start[ids[c]]++] = c / 3;
+    for (int v = corners; v > 0; v--) start[v] = start[v - 1];
+    start[0] = 0;
+    for (int v = 0; v < corners; v++) unplaced[v] = start[v + 1] - start[v];
+    for (int t = 0; t < nt; t++) {
+        const Triangle* tri = &m->triangles[t];
+        centroid[t] = mul(add(add(tri->v0, tri->v1), tri->v2), 1.0f / 3.0f);
+        const Vec3 n = cross(sub(tri->v1, tri->v0), sub(tri->v2, tri->v0));
+        const float l = len(n);
+        normal[t] = l > 0.0f ? mul(n, 1.0f / l) : vec3(0, 0, 0);
+    }
+
+    // Grow each meshlet from a seed by the neighbor nearest its middle, farther the more it turns away from the
+    // meshlet's facing and the more unplaced triangles surround it. Nearly enclosed triangles going first, and
+    // seeding from the most enclosed leftover neighbor, keeps stranded slivers from becoming tiny meshlets.
+    int placed = 0, count = 0, seed = -1, scan = 0;
+    while (placed < nt) {
+        if (seed < 0) {
+            while (state[scan] == 2) scan++;
+            seed = scan;
+        }
+        ModelMeshlet* ml = &out[count++];
+        ml->first = placed;
+        Vec3 sum_c = vec3(0, 0, 0), sum_n = vec3(0, 0, 0);
+        int nc = 0;
+        for (int t = seed;;) {
+            state[t] = 2;
+            order[placed++] = t;
+            for (int k = 0; k < 3; k++) unplaced[ids[t * 3 + k]]--;
+            sum_c = add(sum_c, centroid[t]);
+            sum_n = add(sum_n, normal[t]);
+            for (int k = 0; k < 3; k++) {
+                const int v = ids[t * 3 + k];
+                for (int a = start[v]; a < start[v + 1]; a++)
+                    if (state[adj[a]] == 0) { state[adj[a]] = 1; cand[nc++] = adj[a]; }
+            }
+            if (placed - ml->first >= max_triangles || nc == 0) break;
+
+            const Vec3 mid = mul(sum_c, 1.0f / (float)(placed - ml->first));
+            const float nl = len(sum_n);
+            const Vec3 facing = nl > 0.0f ? mul(sum_n, 1.0f / nl) : sum_n;
+            int best = 0;
+            float best_score = FLT_MAX;
+            for (int j = 0; j < nc; j++) {
+                const int* tv = &ids[cand[j] * 3];
+                const float score = len(sub(centroid[cand[j]], mid)) * (2.0f - dot(normal[cand[j]], facing)) *
+                                    (1.0f + 0.1f * (float)(unplaced[tv[0]] + unplaced[tv[1]] + unplaced[tv[2]]));
+                if (score < best_score) { best_score = score; best = j; }
+            }
+            t = cand[best];
+            cand[best] = cand[--nc];
+        }
+        ml->count = placed - ml->first;
+        seed = -1;
+        for (int j = 0, least = 1 << 30; j < nc; j++) {
+            const int* tv = &ids[cand[j] * 3];
+            const int o = unplaced[tv[0]] + unplaced[tv[1]] + unplaced[tv[2]];
+            if (o < least) { least = o; seed = cand[j]; }
+        }
+        for (int j = 0; j < nc; j++) state[cand[j]] = 0;
+    }
+
+    // Reorder the triangles and point the edge list at the new indices
+    int* inv = cand;
+    for (int k = 0; k < nt; k++) inv[order[k]] = k;
+    for (int k = 0; k < nt; k++) tris[k] = m->triangles[order[k]];
+    memcpy(m->triangles, tris, (size_t)nt * sizeof(Triangle));
+    for (int e = 0; e < (m->edges ? m->num_edges : 0); e++)
+        m->edges[e] = (uint32_t)inv[m->edges[e] >> 2] << 2 | (m->edges[e] & 3u);
+    free(ids); free(start); free(unplaced); free(adj); free(order); free(cand); free(state); free(centroid); free(normal);
+    free(tris);
+
+    for (int i = 0; i < count; i++) _modelMeshletBounds(m, &out[i]);
+    m->meshlets = (ModelMeshlet*)realloc(out, (size_t)count * sizeof(ModelMeshlet));
+    if (!m->meshlets) m->meshlets = out;
+    m->num_meshlets = count;
+    if (m->transformed_triangles)
+        _modelTransformTriangles(m, m->triangles, m->transformed_triangles, nt);
+    _modelUpdateMeshlets(m);
+    return count;
+}
+
+// Helper to open file with fallback paths
+static inline FILE* _modelOpenFileWithFallback(const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (f) return f;
+
+    char buf[1024];
+
+#ifdef SDL_IMPLEMENTATION
+    const char* base = SDL_GetBasePath();
+    if (base) {
+        SDL_snprintf(buf, sizeof(buf), "%s%s", base, path);
+        f = fopen(buf, "r");
+        if (!f) {
+            SDL_snprintf(buf, sizeof(buf), "%s../%s", base, path);
+            f = fopen(buf, "r");
+        }
+        if (!f) {
+            SDL_snprintf(buf, sizeof(buf), "%s../../%s", base, path);
+            f = fopen(buf, "r");
+        }
+        SDL_free((void*)base);
+        if (f) return f;
+    }
+#endif
+
+    // Generic fallbacks (up to 2 levels)
+    snprintf(buf, sizeof(buf), "../%s", path);
+    f = fopen(buf, "r");
+    if (f) return f;
+
+    snprintf(buf, sizeof(buf), "../../%s", path);
+    f = fopen(buf, "r");
+    if (f) return f;
+
+    return NULL;
+}
+
+// One face corner: "v", "v/vt", "v//vn" or "v/vt/vn"; indices are returned 0-based, -1 when absent
+static inline bool _modelParseCorner(const char** cursor, const int nv, const int nt, const int nn, int* v, int* t, int* n)
+{
+    char* end;
+    const char* s = *cursor;
+    while (*s == ' ' || *s == '\t') s++;
+    long i = strtol(s, &end, 10);
+    if (end == s) return false;
+    *v = (int)(i < 0 ? nv + i : i - 1);
+    *t = *n = -1;
+    s = end;
+    if (*s == '/') {
+        s++;
+        if (*s != '/') {
+            i = strtol(s, &end, 10);
+            if (end != s) *t = (int)(i < 0 ? nt + i : i - 1);
+            s = end;
+        }
+        if (*s == '/') {
+            s++;
+            i = strtol(s, &end, 10);
+            if (end != s) *n = (int)(i < 0 ? nn + i : i - 1);
+            s = end;
+        }
+    }
+    *cursor = s;
+    if (*t >= nt) *t = -1;
+    if (*n >= nn) *n = -1;
+    return *v >= 0 && *v < nv;
+}
+
+inline void modelLoad(Model* m, const char* path)
+{
+    FILE* f = _modelOpenFileWithFallback(path);
+    if (!f) {
+        fprintf(stderr, "Failed to open OBJ file: %s\n", path);
+        return;
+    }
+
+    // Dynamic arrays for vertices and triangles
+    int vert_capacity = INITIAL_VERTEX_CAPACITY;
+    int tri_capacity  = INITIAL_TRIANGLE_CAPACITY;
+
+    int uv_capacity   = INITIAL_VERTEX_CAPACITY;
+    int norm_capacity = INITIAL_VERTEX_CAPACITY;
+
+    Vec3* verts     = (Vec3*)malloc(vert_capacity * sizeof(Vec3));
+    Vec3* uvs       = (Vec3*)malloc(uv_capacity * sizeof(Vec3));
+    Vec3* normals   = (Vec3*)malloc(norm_capacity * sizeof(Vec3));
+    Triangle* tris = (Triangle*)malloc(tri_capacity * sizeof(Triangle));
+    int* tri_ids   = (int*)malloc(tri_capacity * 3 * sizeof(int));      // OBJ vertex index per corner
+    uint8_t* tri_edges = (uint8_t*)malloc(tri_capacity);                // Polygon outline edges (no fan diagonals)
+    assert(verts && uvs && normals && tris && tri_ids && tri_edges && "Failed to allocate OBJ parsing buffers");
+
+    int nv = 0, nt = 0, nuv = 0, nn = 0;
+    char buf[256];
+
+    while (fgets(buf, sizeof(buf), f))
+    {
+        if (buf[0] == 'v' && buf[1] == ' ')
+        {
+            // Vertex line
+            if (nv >= vert_capacity)
+            {
+                vert_capacity *= 2;
+                verts = (Vec3*)realloc(verts, vert_capacity * sizeof(Vec3));
+                assert(verts && "Failed to reallocate vertex buffer");
+            }
+
+            float x, y, z;
+            sscanf(buf + 2, "%f %f %f", &x, &y, &z);
+            verts[nv++] = vec3(x, y, z);
+        }
+        else if (buf[0] == 'v' && buf[1] == 't')
+        {
+            // Texture coordinate line
+            if (nuv >= uv_capacity)
+            {
+                uv_capacity *= 2;
+                uvs = (Vec3*)realloc(uvs, uv_capacity * sizeof(Vec3));
+                assert(uvs && "Failed to reallocate texture coordinate buffer");
+            }
+
+            float u = 0.0f, v = 0.0f;
+            sscanf(buf + 3, "%f %f", &u, &v);
+            uvs[nuv++] = vec3(u, v, 0.0f);
+        }
+        else if (buf[0] == 'v' && buf[1] == 'n')
+        {
+            // Normal line
+            if (nn >= norm_capacity)
+            {
+                norm_capacity *= 2;
+                normals = (Vec3*)realloc(normals, norm_capacity * sizeof(Vec3));
+                assert(normals && "Failed to reallocate normal buffer");
+            }
+
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            sscanf(buf + 3, "%f %f %f", &x, &y, &z);
+            normals[nn++] = norm(vec3(x, y, z));
+        }
+        else if (buf[0] == 'f' && buf[1] == ' ')
+        {
+            // Face line (OBJ indices are 1-based, negative ones are relative; polygons become a fan)
+            const char* s = buf + 2;
+            int v[3], t[3], n[3], corners = 0;
+            while (corners < 3 && _modelParseCorner(&s, nv, nuv, nn, &v[corners], &t[corners], &n[corners])) corners++;
+
+            const int first = nt;
+            while (corners == 3)
+            {
+                if (nt >= tri_capacity)
+                {
+                    tri_capacity *= 2;
+                    tris      = (Triangle*)realloc(tris, tri_capacity * sizeof(Triangle));
+                    tri_ids   = (int*)realloc(tri_ids, tri_capacity * 3 * sizeof(int));
+                    tri_edges = (uint8_t*)realloc(tri_edges, tri_capacity);
+                    assert(tris && tri_ids && tri_edges && "Failed to reallocate triangle buffer");
+                }
+
+                // Fan triangle (v0, vi, vi+1): vi -> vi+1 is always outline, v0 -> vi only on the first
+                tri_ids[nt * 3] = v[0]; tri_ids[nt * 3 + 1] = v[1]; tri_ids[nt * 3 + 2] = v[2];
+                tri_edges[nt] = (uint8_t)(nt == first ? 3 : 2);
+                Triangle* tri = &tris[nt++];
+                memset(tri, 0, sizeof(*tri));
+                tri->v0 = verts[v[0]]; tri->v1 = verts[v[1]]; tri->v2 = verts[v[2]];
+                tri->color = m->mat.color;
+                // Normals only count when every corner has one, otherwise the face normal is used
+                if (n[0] >= 0 && n[1] >= 0 && n[2] >= 0) {
+                    tri->n0 = normals[n[0]]; tri->n1 = normals[n[1]]; tri->n2 = normals[n[2]];
+                }
+                for (int k = 0; k < 3; k++) {
+                    if (t[k] < 0) continue;
+                    tri->uv[k][0] = uvs[t[k]].x;
+                    tri->uv[k][1] = uvs[t[k]].y;
+                }
+
+                v[1] = v[2]; t[1] = t[2]; n[1] = n[2];
+                if (!_modelParseCorner(&s, nv, nuv, nn, &v[2], &t[2], &n[2])) break;
+            }
+            if (nt > first) tri_edges[nt - 1] |= 4;   // Closing edge back to v0
+        }
+    }
+    fclose(f);
+
+    // Allocate exact size for model
+    m->triangles             = (Triangle*)malloc(nt * sizeof(Triangle));
+    m->transformed_triangles = (Triangle*)malloc(nt * sizeof(Triangle));
+    assert(m->triangles && m->transformed_triangles && "Failed to allocate model triangles");
+
+    memcpy(m->triangles, tris, nt * sizeof(Triangle));
+    m->num_triangles = nt;
+    m->capacity = nt;
+    _modelBuildEdgeList(m, tri_ids, tri_edges);
+
+    // Free temporary buffers
+    free(tri_ids);
+    free(tri_edges);
+    free(verts);
+    free(uvs);
+    free(normals);
+    free(tris);
+
+    printf("Loaded %s: %d vertices, %d triangles\n", path, nv, nt);
+}
+
+#endif // MODEL_IMPLEMENTATION
+#endif // WRAPPER_MODEL_H
+
+
+// ============================================================================
+// 3D Rasterization Renderer
+// ============================================================================
+#ifndef WRAPPER_RENDER3D_H
+#define WRAPPER_RENDER3D_H
+
+#define RENDER_MAX_VARYINGS 16  // Floats per vertex interpolated perspective-correctly across a triangle
+#define SHADER_BLOCK        8   // Pixels per fragment stage call
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Depth storage. Smaller formats cut depth traffic; every format keeps the "nearer wins" test semantics.
+typedef enum {
+    DEPTH_FORMAT_F32,           // NDC z as float, cleared to FLT_MAX (default)
+    DEPTH_FORMAT_U16,           // NDC z as 16-bit unorm, cleared to 0xFFFF: half the bytes per test
+    DEPTH_FORMAT_U24_REVERSED   // near / w as 24-bit fixed point in 32-bit words, cleared to 0: nearer is larger
+} DepthFormat;
+
+#define DEPTH_TILE_SHIFT 3      // Tile far plane granularity: 8x8 pixels
+
+// Pixels a pass covers, for temporal rendering: rows with (y & row_mask) == row_phase and in them the columns
+// with ((x + y * shear) & 1) == col_phase. All zero (on == false) covers every pixel.
+typedef struct {
+    bool on;
+    int row_mask, row_phase;
+    int shear, col_phase;
+} PixelSubset;
+
+// Depth buffer for 3D rendering
+typedef struct {
+    union {
+        float* depths;          // DEPTH_FORMAT_F32
+        uint16_t* depth16;      // DEPTH_FORMAT_U16
+        uint32_t* depth24;      // DEPTH_FORMAT_U24_REVERSED
+    };
+    int width;
+    int height;
+    size_t capacity;    // Allocated depth values (>= width * height), 4 bytes each whatever the format
+    bool valid;
+    DepthFormat format;
+    bool tile_test;             // Reject triangle spans against each tile's farthest depth before per-pixel tests
+    uint32_t* tile_far;         // Per tile: farthest depth as an order key (conservative, refreshed when written)
+    uint32_t* tile_written;     // Per tile: draw_serial of the last draw that wrote it since tile_far was computed, 0 if none
+    uint32_t draw_serial;       // Current draw; a tile written by it keeps its stale far plane until the next draw
+    int tiles_x, tiles_y;
+    size_t tile_capacity;
+    bool tiles_valid;           // false after writes that may move depth farther (depth test off) until the next clear
+    PixelSubset subset;         // Pixels triangles rasterize into (temporalRenderScene); coverage anti-aliasing ignores it
+} DepthBuffer;
+
+// Vertex stage input: one corner of a world-space triangle
+typedef struct {
+    Vec3 position;
+    Vec3 normal;        // Vertex normal, or the face normal when the mesh has none
+    float u, v;
+    Vec3 color;         // Triangle color
+    int corner;         // 0..2
+} ShaderVertexIn;
+
+// Vertex stage output
+typedef struct {
+    Vec3 position;                      // World-space position to project
+    float vary[RENDER_MAX_VARYINGS];    // Handed to the fragment stage, interpolated perspective-correctly
+} ShaderVertexOut;
+
+// One row of up to SHADER_BLOCK pixels for the fragment stage. Arrays are indexed by pixel so loops over
+// i vectorize; pixel i sits at (x + i, y).
+typedef struct {
+    int x, y;
+    uint32_t mask;                                  // Bit i: covered and depth-passing (clear bits to discard)
+    float depth[SHADER_BLOCK];
+    float vary[RENDER_MAX_VARYINGS][SHADER_BLOCK];
+    float ddx[RENDER_MAX_VARYINGS];                 // Screen-space derivatives at the first covered pixel
+    float ddy[RENDER_MAX_VARYINGS];
+    uint32_t color[SHADER_BLOCK];                   // Output 0xAARRGGBB, combined per Renderer.blend
+} ShaderFragments;
+
+typedef void (*ShaderVertexFn)(const ShaderVertexIn* in, ShaderVertexOut* out, const void* uniforms);
+typedef void (*ShaderFragmentFn)(ShaderFragments* frag, const void* uniforms);
+
+// Programmable pipeline, attached per material (Material.shader)
+typedef struct Shader {
+    ShaderVertexFn vertex;      // NULL: position unchanged, vary = normal.xyz, u, v
+    ShaderFragmentFn fragment;
+    int num_varyings;
+    const void* uniforms;       // Passed to both stages
+} Shader;
+
+// How shaded pixels combine with the framebuffer
+typedef enum {
+    RENDER_BLEND_OPAQUE,    // Replace
+    RENDER_BLEND_ALPHA,     // Source over, alpha from the texture (straight alpha)
+    RENDER_BLEND_ADD        // Saturating add
+} RenderBlend;
+
+// Order renderScene submits draws in. Opaque depth-tested draws go front to back so early depth rejection
+// skips hidden pixels; blended draws go back to front.
+typedef enum {
+    RENDER_SORT_NONE,       // Array order
+    RENDER_SORT_MODELS,     // Whole models, by nearest vertex along the view direction
+    RENDER_SORT_CLUSTERS    // Runs of RENDER_CLUSTER_SIZE triangles from every model, sorted together
+} RenderSort;
+
+#define RENDER_CLUSTER_SIZE 128
+
+// Pixel counters since the last renderClear (all passes)
+typedef struct {
+    int draws;              // Models (or clusters) submitted
+    int triangles;          // Triangles rasterized after culling
+    int clusters;           // Model.meshlets tested as a whole
+    int clusters_culled;    // Of those, rejected by the frustum, their normal cone or the depth tiles
+    uint64_t tested;        // Covered pixels that reached the depth test
+    uint64_t shaded;        // Pixels shaded and written
+    uint64_t visible;       // Covered pixels in the final image (renderGetStats)
+    float overdraw;         // shaded / visible (renderGetStats); 1.0 means every pixel was shaded once
+} RenderStats;
+
+typedef enum {
+    LIGHT_POINT,
+    LIGHT_SPOT
+} LightType;
+
+// Local light, added to the directional light_dir (a zero light_dir leaves local lights only). Contribution is color * n.l * (1 - d^2 / range^2)^2, times
+// a smooth falloff from inner_cos to outer_cos for spot lights; nothing reaches beyond range.
+typedef struct {
+    LightType type;
+    Vec3 position;
+    Vec3 color;             // Intensity per channel (1 matches a fully lit light_dir)
+    float range;
+    Vec3 direction;         // LIGHT_SPOT: unit cone axis
+    float inner_cos;        // LIGHT_SPOT: cosine of the full-intensity half angle
+    float outer_cos;        // LIGHT_SPOT: cosine of the cutoff half angle
+} Light;
+
+#define RENDER_LIGHT_TILE_SHIFT 4   // Light culling granularity: 16x16 pixels
+
+// Shadow map for Renderer.light_dir, rendered by renderScene (or renderShadowUpdate) from the light's view with
+// the depth-only rasterizer. It is fit around the camera frustum up to `distance` and reused across frames while
+// the light, the fit and the transformed geometry are unchanged. Built-in shading filters it with PCF.
+typedef struct {
+    bool enabled;
+    int size;               // Resolution (size x size texels), default 1024
+    float distance;         // View distance covered, default 40; receivers beyond the fit are lit
+    float bias;             // Depth bias in texels, plus slope_bias times the caster's depth change across the
+    float slope_bias;       // PCF footprint (pcf + 0.5 texels each way); raise either if lit faces speckle
+    int pcf;                // Filter radius: (2 * pcf + 1)^2 taps, 0 for hard edges. Default 1
+    bool cache;             // false: re-render every update
+    bool valid;             // The map is current for `key`; set false to force a re-render
+    int renders;            // Times the map was rasterized (cache misses)
+    DepthBuffer depth;      // F32 light-space depth in [0, 1]
+    Vec3 to_map[3];         // World to map: x, y in texels, z depth, each dot(to_map[i], p) + map_offset[i]
+    float map_offset[3];
+    Vec3 center;            // Fit sphere in light space; moves only when the view leaves its guard band
+    float radius;
+    uint64_t key;           // Light, fit and geometry hash the map was rendered for
+} ShadowMap;
+
+// Per-pixel k-buffer of transparent fragments (Material.transparency > 0), composited over the opaque image by
+// renderComposite. Memory is pixels * (8 * layers + 1) bytes; when a pixel overflows, its two farthest
+// fragments are merged, so nearer layers stay exact and far ones degrade gracefully.
+typedef struct {
+    int layers;             // k, up to 32; 0 blends transparent draws directly in draw order instead. Default 4
+    float* depth;           // layers per pixel, NDC depth
+    uint32_t* color;        // layers per pixel, premultiplied 0xAARRGGBB
+    uint8_t* count;         // Fragments stored per pixel
+    int stride;             // layers the arrays were allocated for
+    size_t capacity;        // Pixels allocated
+    bool pending;           // Fragments are waiting for renderComposite
+} OitBuffer;
+
+// Rendering context combining window, camera, and depth buffer.
+// The pipeline flags are read once per draw; from C++ each combination runs a specialized inner loop
+// (define RENDER_NO_TEMPLATES to use the runtime-flag path there too).
+typedef struct {
+    Window_t* window;
+    Camera* camera;
+    DepthBuffer depth;
+    bool wireframe;         // Draw model edges (Model.edges, or every triangle edge) instead of faces
+    bool wireframe_overlay; // With wireframe: draw faces too, then visible edges on top in wire_color
+    uint32_t wire_color;
+    bool backface_culling;
+    bool light;
+    bool smooth_shading;    // Per-pixel lighting from interpolated vertex normals (false: flat per-triangle color)
+    bool depth_test;        // Reject pixels not nearer than the depth buffer
+    bool depth_write;       // Store depth of drawn pixels
+    bool depth_equal;       // Depth test passes only on an exact match (shading after a depth prepass)
+    RenderBlend blend;
+    RenderSort sort;        // renderScene draw order
+    bool depth_prepass;     // renderScene: depth-only pass first, then shade with depth_equal (opaque state only)
+    RenderStats stats;
+    void* draw_list;        // renderScene sort scratch
+    size_t draw_capacity;
+    void* line_list;        // Wireframe scratch
+    size_t line_capacity;
+    bool deferred;          // renderScene: rasterize depth + triangle IDs, then shade each visible pixel once
+    uint32_t* visibility;   // Deferred ID buffer (model << 24 | triangle), sized with depth
+    size_t vis_capacity;
+    int msaa;               // Coverage samples per pixel: 1 (off), 4 or 8. Set before renderClear; see renderResolve
+    float* sample_depth;    // msaa float depths per pixel, pixel-major (any DepthFormat; the resolve encodes)
+    uint32_t* sample_color; // msaa colors per pixel
+    uint8_t* sample_state;  // Per pixel: 0 = samples untouched since renderClear (they are filled on first write)
+    size_t sample_capacity;
+    Vec3 light_dir;
+    ShadowMap shadow;       // Directional light shadows (CPU), off by default
+    OitBuffer oit;          // Order-independent transparency (CPU, without msaa)
+    const Light* lights;    // Point and spot lights (CPU), culled per RENDER_LIGHT_TILE_SHIFT tile by renderLightsUpdate
+    int num_lights;
+    uint32_t* light_masks;  // Per tile, row-major: light_words words, bit i set when lights[i] can reach the tile
+    int light_words;
+    int light_tiles_x, light_tiles_y;
+    int light_count;        // num_lights the masks were built for; 0 until renderLightsUpdate
+    size_t light_capacity;
+    void* light_rects;      // renderLightsUpdate scratch: tile bounds per light
+    size_t rect_capacity;
+    float lod_error;        // renderScene: pixels a Model.lods level may deviate on screen (0: full meshes). Default 1
+    float lod_hysteresis;   // Fraction of lod_error a coarser level must stay below before it replaces the current one
+    Model* lod_models;      // renderScene scratch: the models with their selected level swapped in
+    int lod_capacity;
+    bool cluster_culling;   // Skip whole Model.meshlets outside the view, facing away (backface_culling) or behind the
+                            // depth tiles (depth.tile_test). Default true
+#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
+    // GPU-accelerated rendering state (populated by renderInit when Gpu* != NULL)
+    Gpu*                    gpu;
+    SDL_GPUGraphicsPipeline *pipeline;
+    SDL_GPUTexture          *depth_tex;
+    Uint32                   depth_tex_w, depth_tex_h;
+    bool                     gpu_ready;
+#endif
+} Renderer;
+
+// Initialize 3D renderer.
+// Pass a valid Gpu* to enable GPU-accelerated rendering; NULL for CPU rasterization.
+/*  -> Example (CPU):
+ *  renderInit(&renderer, &window, &camera, NULL);
+ *
+ *  -> Example (GPU):
+ *  renderInit(&renderer, &window, &camera, &gpu);
+ */
+#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
+inline void renderInit(Renderer* r, Window_t* win, Camera* cam, Gpu* gpu);
+#else
+inline void renderInit(Renderer* r, Window_t* win, Camera* cam);
+#endif
+
+// Free 3D renderer resources
+void renderFree(Renderer* r);
+
+// Fill in a programmable shader; the fragment stage shades SHADER_BLOCK pixels per call
+/*  -> Example:
+ *  static void toon(ShaderFragments* f, const void* u) {
+ *      const Vec3* light = (const Vec3*)u;
+ *      for (int i = 0; i < SHADER_BLOCK; i++) {
+ *          const float d = -(f->vary[0][i] * light->x + f->vary[1][i] * light->y + f->vary[2][i] * light->z);
+ *          f->color[i] = d > 0.5f ? 0xFFFFC080 : d > 0.0f ? 0xFF806040 : 0xFF201008;
+ *      }
+ *  }
+ *  shaderInit(&toon_shader, NULL, toon, 3, &renderer.light_dir);
+ *  model->mat.shader = &toon_shader;
+ */
+void shaderInit(Shader* s, ShaderVertexFn vertex, ShaderFragmentFn fragment, int num_varyings, const void* uniforms);
+
+// Clear depth buffer
+void renderClear(Renderer* r);
+
+// Resize the depth buffer (reuses memory reserved by renderReserve), contents are cleared
+/*  -> Example:
+ *  resizeBuffer(&win);
+ *  renderResize(&renderer, win.bWidth, win.bHeight);
+ */
+bool renderResize(Renderer* r, int width, int height);
+
+// Reserve depth memory for up to max_w x max_h
+/*  -> Example:
+ *  renderReserve(&renderer, win.width, win.height);
+ */
+bool renderReserve(Renderer* r, int max_w, int max_h);
+
+// Switch depth storage format; the depth buffer is cleared
+/*  -> Example:
+ *  renderSetDepthFormat(&renderer, DEPTH_FORMAT_U16);
+ *  renderer.depth.tile_test = true;
+ */
+bool renderSetDepthFormat(Renderer* r, DepthFormat format);
+
+// NDC depth at a pixel whatever the format (FLT_MAX where nothing was drawn)
+/*  -> Example:
+ *  const float z = renderGetDepth(&renderer, mouse_x, mouse_y);
+ */
+float renderGetDepth(const Renderer* r, int x, int y);
+
+// Render a single model (with renderer.msaa, into the sample buffers until renderResolve)
+/*  -> Example:
+ *  renderModel(&renderer, &cube_model);
+ */
+void renderModel(Renderer* r, const Model* m);
+
+// Render array of models in renderer.sort order; renderer.depth_prepass shades each visible pixel once after a
+// depth-only pass, renderer.deferred resolves a visibility buffer instead. Resolves renderer.msaa samples.
+/*  -> Example:
+ *  renderScene(&renderer, scene_models, num_models);
+ */
+void renderScene(Renderer* r, const Model* models, int count);
+
+// Average the renderer.msaa samples into the window buffer and depth buffer (nearest sample). renderScene
+// does this itself; call it after drawing with renderModel directly. Edges get msaa coverage levels while
+// every pixel is still shaded once. Depth prepass and deferred mode fall back to forward shading.
+/*  -> Example:
+ *  renderer.msaa = 4;
+ *  renderClear(&renderer);
+ *  for (int i = 0; i < n; i++) renderModel(&renderer, &models[i]);
+ *  renderResolve(&renderer);
+ */
+void renderResolve(Renderer* r);
+
+// Point light reaching range world units
+/*  -> Example:
+ *  Light lamp = lightPoint(vec3(0, 3, 0), vec3(1.0f, 0.8f, 0.5f), 8.0f);
+ */
+Light lightPoint(Vec3 position, Vec3 color, float range);
+
+// Spot light along direction; full intensity within inner_deg of the axis, none beyond outer_deg
+/*  -> Example:
+ *  Light torch = lightSpot(camera.position, camera.front, vec3(1, 1, 1), 20.0f, 15.0f, 25.0f);
+ */
+Light lightSpot(Vec3 position, Vec3 direction, Vec3 color, float range, float inner_deg, float outer_deg);
+
+// Bin renderer.lights into screen tiles for the current camera (on the job pool). renderScene does this itself;
+// call it after moving lights or the camera when drawing with renderModel directly. False when out of memory.
+/*  -> Example:
+ *  Light lamps[32];
+ *  renderer.lights = lamps;
+ *  renderer.num_lights = 32;
+ *  renderLightsUpdate(&renderer);
+ *  for (int i = 0; i < n; i++) renderModel(&renderer, &models[i]);
+ */
+bool renderLightsUpdate(Renderer* r);
+
+// Local light reaching world position p with unit normal n (multiply by albedo). x, y: the pixel whose tile
+// list to use, for primary hits of a raytracer; -1 to test every light (secondary bounces, other views).
+/*  -> Example:
+ *  const Vec3 local = renderLightsAt(&renderer, x, y, hit.position, hit.normal);
+ *  color = add(color, vmul(albedo, local));
+ */
+Vec3 renderLightsAt(const Renderer* r, int x, int y, Vec3 p, Vec3 n);
+
+// Render the shadow map for these casters, or keep it when nothing it depends on changed. renderScene does this
+// itself; call it before drawing with renderModel directly. False when the map cannot be allocated.
+/*  -> Example:
+ *  renderer.shadow.enabled = true;
+ *  renderShadowUpdate(&renderer, scene_models, num_models);
+ *  for (int i = 0; i < num_models; i++) renderModel(&renderer, &scene_models[i]);
+ */
+bool renderShadowUpdate(Renderer* r, const Model* models, int count);
+
+// Fraction of light reaching a world position (PCF over the shadow map, 1 outside it), for fragment shaders
+/*  -> Example:
+ *  const Renderer* renderer = (const Renderer*)uniforms;
+ *  const float lit = renderShadowFactor(renderer, world_pos);
+ */
+float renderShadowFactor(const Renderer* r, Vec3 p);
+
+// Blend the transparent fragments collected by renderModel over the framebuffer, far to near per pixel, in
+// parallel tiles. renderScene does this itself after its opaque draws; call it after drawing with renderModel.
+/*  -> Example:
+ *  glass->mat.transparency = 0.6f;
+ *  renderClear(&renderer);
+ *  for (int i = 0; i < n; i++) renderModel(&renderer, &models[i]);   // Opaque models first
+ *  renderComposite(&renderer);
+ */
+void renderComposite(Renderer* r);
+
+// Read the pixel counters of the current frame; visible and overdraw are computed from the depth buffer
+/*  -> Example:
+ *  renderer.depth_prepass = true;
+ *  renderClear(&renderer);
+ *  renderScene(&renderer, scene_models, num_models);
+ *  RenderStats s;
+ *  renderGetStats(&renderer, &s);
+ *  printf("overdraw %.2f\n", s.overdraw);
+ */
+void renderGetStats(const Renderer* r, RenderStats* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef RENDER3D_IMPLEMENTATION
+
+#include <float.h>
+
+typedef struct { float m[16]; } Mat4;
+
+static inline Mat4 _perspective(float fov, float aspect, float near, float far)
+{
+    Mat4 mat = {0};
+    const float tan_half_fov = tanf(fov * 0.5f * M_PI / 180.0f);
+    mat.m[0]  = 1.0f / (aspect * tan_half_fov);
+    mat.m[5]  = 1.0f / tan_half_fov;
+    mat.m[10] = -(far + near) / (far - near);
+    mat.m[11] = -1.0f;
+    mat.m[14] = -(2.0f * far * near) / (far - near);
+    return mat;
+}
+
+static inline Mat4 _lookAt(Vec3 eye, Vec3 target, Vec3 up)
+{
+    Mat4 mat = {0};
+    const Vec3 f = norm(sub(target, eye));
+    const Vec3 r = norm(cross(f, up));
+    const Vec3 u = cross(r, f);
+    mat.m[0] = r.x; mat.m[4] = r.y; mat.m[8]  = r.z;  mat.m[12] = -dot(r, eye);
+    mat.m[1] = u.x; mat.m[5] = u.y; mat.m[9]  = u.z;  mat.m[13] = -dot(u, eye);
+    mat.m[2] =-f.x; mat.m[6] =-f.y; mat.m[10] =-f.z;  mat.m[14] =  dot(f, eye);
+    mat.m[15] = 1.0f;
+    return mat;
+}
+
+static inline Vec3 _mat4_mul_vec3(const Mat4* m, Vec3 v, float* w_out)
+{
+    const float x = m->m[0]*v.x + m->m[4]*v.y + m->m[8]*v.z  + m->m[12];
+    const float y = m->m[1]*v.x + m->m[5]*v.y + m->m[9]*v.z  + m->m[13];
+    const float z = m->m[2]*v.x + m->m[6]*v.y + m->m[10]*v.z + m->m[14];
+    const float w = m->m[3]*v.x + m->m[7]*v.y + m->m[11]*v.z + m->m[15];
+    if (w_out) *w_out = w;
+    return vec3(x, y, z);
+}
+
+static inline Mat4 _mat4_mul(const Mat4* a, const Mat4* b)
+{
+    Mat4 r = {0};
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            r.m[i + j*4] = a->m[i+0*4]*b->m[0+j*4] + a->m[i+1*4]*b->m[1+j*4]
+                         + a->m[i+2*4]*b->m[2+j*4] + a->m[i+3*4]*b->m[3+j*4];
+    return r;
+}
+
+static inline void _to_screen(Vec3* v, int width, int height)
+{
+    v->x = (v->x + 1.0f) * 0.5f * width;
+    v->y = (1.0f - v->y) * 0.5f * height;
+}
+
+static inline float _calculate_lighting(Vec3 normal, Vec3 light_dir)
+{
+    return fminf(1.0f, fmaxf(0.0f, -dot(normal, light_dir)));
+}
+
+static inline uint32_t _vec3_to_color(Vec3 c, float brightness)
+{
+    const int r = (int)(fminf(1.0f, c.x * brightness) * 255.0f);
+    const int g = (int)(fminf(1.0f, c.y * brightness) * 255.0f);
+    const int b = (int)(fminf(1.0f, c.z * brightness) * 255.0f);
+    return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+// ---------------------------------------------------------------------------
+// Depth formats: encoding, order keys for the tile far plane, clearing
+// ---------------------------------------------------------------------------
+
+// Pipeline kernels are forced inline so constant arguments (template parameters in C++) specialize them
+#if defined(_MSC_VER)
+#define _RENDER_KERNEL static __forceinline
+#else
+#define _RENDER_KERNEL static inline __attribute__((always_inline))
+#endif
+
+#define _RENDER_NEAR    0.1f
+#define _RENDER_FAR     1000.0f
+#define _DEPTH_U16_MAX  0xFFFFu
+#define _DEPTH_U24_MAX  0xFFFFFFu
+
+// Stored value of a fragment for the integer formats. U24 reversed takes 1/w straight from its plane;
+// near / w is affine in screen space just like NDC z, so it interpolates exactly.
+_RENDER_KERNEL uint32_t _depth_encode(const DepthFormat fmt, const float z, const float inv_w)
+{
+    if (fmt == DEPTH_FORMAT_U16) {
+        const float d = (z * 0.5f + 0.5f) * 65535.0f + 0.5f;
+        return d <= 0.0f ? 0u : d >= 65535.0f ? _DEPTH_U16_MAX : (uint32_t)d;
+    }
+    const float d = _RENDER_NEAR * inv_w * 16777215.0f + 0.5f;
+    return d <= 0.0f ? 0u : d >= 16777215.0f ? _DEPTH_U24_MAX : (uint32_t)d;
+}
+
+// 1/w from NDC z, for fragments that only carry z (lines): z = A - B / w
+static inline float _depth_inv_w(const float z)
+{
+    const float a = (_RENDER_FAR + _RENDER_NEAR) / (_RENDER_FAR - _RENDER_NEAR);
+    const float b = 2.0f * _RENDER_FAR * _RENDER_NEAR / (_RENDER_FAR - _RENDER_NEAR);
+    return (a - z) / b;
+}
+
+// Unsigned key that grows with distance in every format (float bits reordered so negatives sort first)
+static inline uint32_t _depth_order_f32(const float z)
+{
+    uint32_t u;
+    memcpy(&u, &z, sizeof(u));
+    return u & 0x80000000u ? ~u : u | 0x80000000u;
+}
+
+_RENDER_KERNEL uint32_t _depth_order_key(const DepthFormat fmt, const float z, const float inv_w)
+{
+    if (fmt == DEPTH_FORMAT_F32) return _depth_order_f32(z);
+    if (fmt == DEPTH_FORMAT_U16) return _depth_encode(fmt, z, inv_w);
+    return _DEPTH_U24_MAX - _depth_encode(fmt, z, inv_w);
+}
+
+static inline uint32_t _depth_stored_key(const DepthBuffer* db, const size_t i)
+{
+    switch (db->format) {
+        case DEPTH_FORMAT_U16:          return db->depth16[i];
+        case DEPTH_FORMAT_U24_REVERSED: return _DEPTH_U24_MAX - db->depth24[i];
+        default:                        return _depth_order_f32(db->depths[i]);
+    }
+}
+
+// Farthest key of a tile. Tiles written by an earlier draw are rescanned; during the draw that writes them the
+// stale value stays conservative, so each tile is rescanned at most once per draw instead of once per row
+static inline uint32_t _depth_tile_far(DepthBuffer* db, const int tx, const int ty)
+{
+    const size_t t = (size_t)ty * db->tiles_x + tx;
+    if (db->tile_written[t] && db->tile_written[t] != db->draw_serial) {
+        const int x0 = tx << DEPTH_TILE_SHIFT, y0 = ty << DEPTH_TILE_SHIFT;
+        const int x1 = x0 + (1 << DEPTH_TILE_SHIFT) < db->width ? x0 + (1 << DEPTH_TILE_SHIFT) : db->width;
+        const int y1 = y0 + (1 << DEPTH_TILE_SHIFT) < db->height ? y0 + (1 << DEPTH_TILE_SHIFT) : db->height;
+        uint32_t far_key = 0;
+        for (int y = y0; y < y1; y++)
+            for (int x = x0; x < x1; x++) {
+                const uint32_t k = _depth_stored_key(db, (size_t)y * db->width + x);
+                if (k > far_key) far_key = k;
+            }
+        db->tile_far[t] = far_key;
+        db->tile_written[t] = 0;
+    }
+    return db->tile_far[t];
+}
+
+// Nearest key any pixel of a triangle can produce, with a little slack for plane rounding
+_RENDER_KERNEL uint32_t _depth_near_key(const DepthFormat fmt, const float z_min, const float inv_w_max)
+{
+    const uint32_t k = _depth_order_key(fmt, z_min - 1e-5f * (fabsf(z_min) + 1.0f), inv_w_max * (1.0f + 1e-5f));
+    return k > 0 ? k - 1 : 0;
+}
+
+// Depth test and write of one fragment (fmt is a compile-time constant in every caller's specialization)
+_RENDER_KERNEL bool _depth_test_write(DepthBuffer* db, const size_t i, const DepthFormat fmt, const float z, const float inv_w,
+    const bool depth_test, const bool depth_write, const bool depth_equal)
+{
+    if (fmt == DEPTH_FORMAT_F32) {
+        if (depth_test && !(depth_equal ? z == db->depths[i] : z < db->depths[i])) return false;
+        if (depth_write) db->depths[i] = z;
+        return true;
+    }
+    const uint32_t key = _depth_encode(fmt, z, inv_w);
+    if (fmt == DEPTH_FORMAT_U16) {
+        if (depth_test && !(depth_equal ? key == db->depth16[i] : key < db->depth16[i])) return false;
+        if (depth_write) db->depth16[i] = (uint16_t)key;
+        return true;
+    }
+    if (depth_test && !(depth_equal ? key == db->depth24[i] : key > db->depth24[i])) return false;
+    if (depth_write) db->depth24[i] = key;
+    return true;
+}
+
+static inline void _depth_clear(DepthBuffer* db)
+{
+    const size_t n = (size_t)db->width * db->height;
+    uint32_t clear_key;
+    switch (db->format) {
+        case DEPTH_FORMAT_U16:
+            memset(db->depth16, 0xFF, n * sizeof(uint16_t));
+            clear_key = _DEPTH_U16_MAX;
+            break;
+        case DEPTH_FORMAT_U24_REVERSED:
+            memset(db->depth24, 0, n * sizeof(uint32_t));
+            clear_key = _DEPTH_U24_MAX;
+            break;
+        default:
+            for (size_t i = 0; i < n; i++) db->depths[i] = FLT_MAX;
+            clear_key = _depth_order_f32(FLT_MAX);
+            break;
+    }
+    const size_t tiles = (size_t)db->tiles_x * db->tiles_y;
+    if (db->tile_far) {
+        for (size_t t = 0; t < tiles; t++) db->tile_far[t] = clear_key;
+        memset(db->tile_written, 0, tiles * sizeof(uint32_t));
+    }
+    db->tiles_valid = db->tile_far != NULL;
+    db->draw_serial = 1;
+}
+
+static inline void _depth_begin_draw(DepthBuffer* db)
+{
+    if (++db->draw_serial == 0) db->draw_serial = 1;
+}
+
+// Row of tile_written for pixel row y when writes must be recorded, NULL otherwise
+static inline uint32_t* _depth_written_row(const DepthBuffer* db, const int y, const bool depth_write)
+{
+    return db->tile_test && db->tile_written && depth_write ? db->tile_written + (size_t)(y >> DEPTH_TILE_SHIFT) * db->tiles_x : NULL;
+}
+
+// The far plane can only reject for a less-than test, and only while it is known conservative
+static inline bool _depth_tiles_usable(const DepthBuffer* db, const bool depth_test, const bool depth_equal)
+{
+    return db->tile_test && db->tiles_valid && depth_test && !depth_equal;
+}
+
+// Column parity of the pixel subset in row y: -1 for every column, 2 when the row is skipped
+static inline int _depth_subset_x(const DepthBuffer* db, const int y)
+{
+    const PixelSubset* s = &db->subset;
+    if (!s->on) return -1;
+    if ((y & s->row_mask) != s->row_phase) return 2;
+    return (s->col_phase + y * s->shear) & 1;
+}
+
+static inline void _fill_triangle(Window_t* w, DepthBuffer* db,
+    Vec3 v0, Vec3 v1, Vec3 v2, float z0, float z1, float z2, uint32_t color, RenderStats* stats)
+{
+    int tested = 0, shaded = 0;
+    if (v0.y > v1.y) { Vec3 t=v0;v0=v1;v1=t; float tz=z0;z0=z1;z1=tz; }
+    if (v1.y > v2.y) { Vec3 t=v1;v1=v2;v2=t; float tz=z1;z1=z2;z2=tz; }
+    if (v0.y > v1.y) { Vec3 t=v0;v0=v1;v1=t; float tz=z0;z0=z1;z1=tz; }
+    const int y0=(int)v0.y, y1=(int)v1.y, y2=(int)v2.y;
+    for (int y=y0; y<=y2; y++) {
+        if (y<0||y>=w->bHeight) continue;
+        const int sub=_depth_subset_x(db, y);
+        if (sub==2) continue;
+        float x_s, x_e, z_s, z_e;
+        if (y < y1) {
+            if (y1==y0) continue;
+            const float t1=(float)(y-y0)/(float)(y1-y0);
+            const float t2=(float)(y-y0)/(float)(y2-y0);
+            x_s=v0.x+(v1.x-v0.x)*t1; x_e=v0.x+(v2.x-v0.x)*t2;
+            z_s=z0+(z1-z0)*t1;        z_e=z0+(z2-z0)*t2;
+        } else {
+            if (y2==y1) continue;
+            const float t1=(float)(y-y1)/(float)(y2-y1);
+            const float t2=(float)(y-y0)/(float)(y2-y0);
+            x_s=v1.x+(v2.x-v1.x)*t1; x_e=v0.x+(v2.x-v0.x)*t2;
+            z_s=z1+(z2-z1)*t1;        z_e=z0+(z2-z0)*t2;
+        }
+        if (x_s>x_e) { float t=x_s;x_s=x_e;x_e=t; t=z_s;z_s=z_e;z_e=t; }
+        const int ix0=(int)x_s, ix1=(int)x_e;
+        for (int x=ix0; x<=ix1; x++) {
+            if (x<0||x>=w->bWidth||(sub>=0&&(x&1)!=sub)) continue;
+            const float t=(ix1==ix0)?0.0f:(float)(x-ix0)/(float)(ix1-ix0);
+            const float z=z_s+(z_e-z_s)*t;
+            const int idx=y*w->bWidth+x;
+            tested++;
+            if (z<db->depths[idx]) { db->depths[idx]=z; drawPixel(w,x,y,color); shaded++; }
+        }
+    }
+    if (stats) { stats->tested += tested; stats->shaded += shaded; }
+}
+
+typedef struct {
+    float x, y;         // Screen position
+    float z;            // NDC depth (affine in screen space)
+    float inv_w;        // 1 / clip w
+    float vary[RENDER_MAX_VARYINGS];
+} _RasterVertex;
+
+// Shades one covered, depth-passing pixel from its interpolated varyings; ddx/ddy hold the screen-space
+// derivatives of the first nderiv varyings (for mip selection)
+typedef uint32_t (*_RasterShadeFn)(const float* vary, const float* ddx, const float* ddy, const void* user);
+
+// Light reaching map position (sx, sy) at depth sz: the fraction of (2 * pcf + 1)^2 texels not nearer the light
+static inline float _shadow_lookup(const ShadowMap* sm, const float sx, const float sy, const float sz)
+{
+    const int size = sm->depth.width, rad = sm->pcf > 0 ? sm->pcf : 0;
+    if (!(sx > (float)-rad && sy > (float)-rad && sx < (float)(size + rad) && sy < (float)(size + rad)) || sz >= 1.0f) return 1.0f;
+    const int cx = (int)floorf(sx), cy = (int)floorf(sy), taps = 2 * rad + 1;
+    int lit = 0;
+    if (cx >= rad && cy >= rad && cx + rad < size && cy + rad < size) {
+        const float* row = sm->depth.depths + (size_t)(cy - rad) * size + (cx - rad);
+        for (int y = 0; y < taps; y++, row += size)
+            for (int x = 0; x < taps; x++) lit += sz <= row[x];
+    } else {
+        // Texels off the map are lit
+        for (int y = cy - rad; y <= cy + rad; y++) {
+            if (y < 0 || y >= size) { lit += taps; continue; }
+            const float* row = sm->depth.depths + (size_t)y * size;
+            for (int x = cx - rad; x <= cx + rad; x++) lit += x < 0 || x >= size || sz <= row[x];
+        }
+    }
+    return (float)lit / (float)(taps * taps);
+}
+
+// World position to map texels (x, y) and light depth (z)
+static inline void _shadow_map_coord(const ShadowMap* sm, const Vec3 p, float* out)
+{
+    for (int k = 0; k < 3; k++) out[k] = dot(sm->to_map[k], p) + sm->map_offset[k];
+}
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+static inline int _light_ctz(const uint32_t v) { unsigned long i; _BitScanForward(&i, v); return (int)i; }
+#else
+static inline int _light_ctz(const uint32_t v) { return __builtin_ctz(v); }
+#endif
+
+// One local light at p with unit normal n; exactly zero beyond its range and cone
+static inline Vec3 _light_eval(const Light* l, const Vec3 p, const Vec3 n)
+{
+    const Vec3 d = sub(l->position, p);
+    const float d2 = dot(d, d), r2 = l->range * l->range;
+    if (!(d2 < r2) || d2 == 0.0f) return vec3(0, 0, 0);
+    const float inv_d = 1.0f / sqrtf(d2);
+    const float ndl = dot(n, d) * inv_d;
+    if (ndl <= 0.0f) return vec3(0, 0, 0);
+    const float f = 1.0f - d2 / r2;
+    float k = ndl * f * f;
+    if (l->type == LIGHT_SPOT) {
+        const float cd = -dot(d, l->direction) * inv_d;
+        if (cd <= l->outer_cos) return vec3(0, 0, 0);
+        if (cd < l->inner_cos) {
+            const float t = (cd - l->outer_cos) / (l->inner_cos - l->outer_cos);
+            k *= t * t * (3.0f - 2.0f * t);
+        }
+    }
+    return mul(l->color, k);
+}
+
+// Sum over the lights set in mask (words of 32), or over all count lights when mask is NULL. Both visit lights in
+// array order and culled lights contribute exactly zero, so the two agree bit for bit.
+static inline Vec3 _light_accumulate(const Light* lights, const int count, const uint32_t* mask, const int words,
+    const Vec3 p, const Vec3 n)
+{
+    Vec3 sum = vec3(0, 0, 0);
+    if (!mask) {
+        for (int i = 0; i < count; i++) sum = add(sum, _light_eval(&lights[i], p, n));
+        return sum;
+    }
+    for (int w = 0; w < words; w++)
+        for (uint32_t bits = mask[w]; bits; bits &= bits - 1)
+            sum = add(sum, _light_eval(&lights[w * 32 + _light_ctz(bits)], p, n));
+    return sum;
+}
+
+// Built-in shading, selected by varying count: 0 = flat, 2 = UV (textured), 3 = normal (lit per pixel),
+// 5 = UV + normal; with a shadow map or local lights, 6 = normal + world position, 8 = UV + normal + world
+// position. Flat lighting is folded into color by the triangle setup (those draws always carry normals).
+typedef struct {
+    Vec3 color;
+    Vec3 light_dir;
+    const Texture* texture;
+    const ShadowMap* shadow;        // NULL: unshadowed
+    const Light* lights;            // NULL: no local lights
+    const uint32_t* light_masks;    // Tile masks of lights, light_words per tile
+    int light_words, light_tiles_x;
+    float opacity;                  // Scales the output alpha (1 - Material.transparency)
+} _RenderShadeUniforms;
+
+// The built-in layouts that start with UV; those take screen-space derivatives for mip selection
+static inline int _render_nderiv(const int nvary)
+{
+    return nvary == 2 || nvary == 5 || nvary == 8 ? 2 : 0;
+}
+
+_RENDER_KERNEL uint32_t _render_shade(const int nvary, const float* vary, const float* ddx, const float* ddy,
+    const _RenderShadeUniforms* u, const int x, const int y)
+{
+    Vec3 color = u->color;
+    uint32_t alpha = 0xFF;
+#ifdef TEXTURE_IMPLEMENTATION
+    if (_render_nderiv(nvary)) {
+        // Mip level from the longer of the two screen-space texel footprints
+        const float tw = (float)u->texture->width, th = (float)u->texture->height;
+        const float fx = ddx[0] * tw, fy = ddx[1] * th;
+        const float gx = ddy[0] * tw, gy = ddy[1] * th;
+        const float lod = 0.5f * log2f(fmaxf(fmaxf(fx * fx + fy * fy, gx * gx + gy * gy), 1e-12f));
+        const uint32_t c = textureSample(u->texture, vary[0], vary[1], lod);
+        color = vmul(color, vec3(((c >> 16) & 0xFF) * (1.0f / 255.0f), ((c >> 8) & 0xFF) * (1.0f / 255.0f), (c & 0xFF) * (1.0f / 255.0f)));
+        alpha = c >> 24;
+    }
+#else
+    (void)ddx; (void)ddy;
+#endif
+    if (nvary >= 3) {
+        const float* nv = vary + (nvary >= 6 ? nvary - 6 : nvary - 3);
+        const Vec3 n = vec3(nv[0], nv[1], nv[2]);
+        const float len2 = dot(n, n);
+        float diffuse = len2 > 0.0f ? fmaxf(0.0f, -dot(n, u->light_dir)) / sqrtf(len2) : 0.0f;
+        Vec3 local = vec3(0, 0, 0);
+        if (nvary >= 6) {
+            const Vec3 p = vec3(nv[3], nv[4], nv[5]);
+            if (u->shadow && diffuse > 0.0f) {
+                float m[3];
+                _shadow_map_coord(u->shadow, p, m);
+                diffuse *= _shadow_lookup(u->shadow, m[0], m[1], m[2]);
+            }
+            if (u->lights && len2 > 0.0f) {
+                const size_t tile = (size_t)(y >> RENDER_LIGHT_TILE_SHIFT) * u->light_tiles_x + (x >> RENDER_LIGHT_TILE_SHIFT);
+                local = _light_accumulate(u->lights, 0, u->light_masks + tile * u->light_words, u->light_words, p,
+                                          mul(n, 1.0f / sqrtf(len2)));
+            }
+        }
+        color = vmul(color, vec3(diffuse + local.x, diffuse + local.y, diffuse + local.z));
+    }
+    if (u->opacity < 1.0f) alpha = (uint32_t)((float)alpha * u->opacity + 0.5f);
+    return (_vec3_to_color(color, 1.0f) & 0x00FFFFFF) | (alpha << 24);
+}
+
+static inline uint32_t _render_blend(const RenderBlend blend, const uint32_t d, const uint32_t s)
+{
+    uint32_t out = 0xFF000000;
+    for (int sh = 0; sh < 24; sh += 8) {
+        const uint32_t dc = (d >> sh) & 0xFF, sc = (s >> sh) & 0xFF;
+        uint32_t c;
+        if (blend == RENDER_BLEND_ADD) c = dc + sc > 255 ? 255 : dc + sc;
+        else {
+            const uint32_t a = s >> 24, t = sc * a + dc * (255 - a) + 128;
+            c = (t + (t >> 8)) >> 8;
+        }
+        out |= c << sh;
+    }
+    return out;
+}
+
+// ---------------------------------------------------------------------------
+// Order-independent transparency: k-buffer insert and merge (premultiplied RGBA8)
+// ---------------------------------------------------------------------------
+
+#define _RENDER_BLEND_OIT ((RenderBlend)3)  // Kernel blend mode: insert into the k-buffer instead of the framebuffer
+#define _RENDER_OIT_MAX   32
+#define _RENDER_OIT_TILE  32
+
+static inline uint32_t _oit_mul8(const uint32_t a, const uint32_t b)
+{
+    const uint32_t t = a * b + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+// Premultiplied near over far
+static inline uint32_t _oit_over(const uint32_t near_c, const uint32_t far_c)
+{
+    const uint32_t k = 255 - (near_c >> 24);
+    uint32_t out = 0;
+    for (int sh = 0; sh < 32; sh += 8) {
+        const uint32_t c = ((near_c >> sh) & 0xFF) + _oit_mul8((far_c >> sh) & 0xFF, k);
+        out |= (c > 255 ? 255 : c) << sh;
+    }
+    return out;
+}
+
+// Store one fragment (straight alpha) at pixel i. A full pixel merges its two farthest fragments, nearer over
+// farther, so the error of an overflow stays behind the layers that are kept exactly.
+static inline void _oit_insert(OitBuffer* ob, const size_t i, const float z, const uint32_t straight)
+{
+    const uint32_t a = straight >> 24;
+    if (a == 0) return;
+    const uint32_t c = a << 24 | _oit_mul8((straight >> 16) & 0xFF, a) << 16 | _oit_mul8((straight >> 8) & 0xFF, a) << 8 |
+                       _oit_mul8(straight & 0xFF, a);
+    const int k = ob->stride;
+    float* depth = ob->depth + i * k;
+    uint32_t* color = ob->color + i * k;
+    const int n = ob->count[i];
+    if (n < k) {
+        depth[n] = z;
+        color[n] = c;
+        ob->count[i] = (uint8_t)(n + 1);
+        return;
+    }
+    int back = 0;
+    for (int s = 1; s < k; s++) if (depth[s] >= depth[back]) back = s;
+    if (z >= depth[back]) {
+        // The new fragment is the farthest: it goes behind the stored farthest
+        color[back] = _oit_over(color[back], c);
+        return;
+    }
+    int next = -1;
+    float next_z = z;
+    for (int s = 0; s < k; s++) if (s != back && depth[s] > next_z) { next = s; next_z = depth[s]; }
+    if (next < 0) {
+        // The new fragment is second farthest: merge it over the farthest in place
+        color[back] = _oit_over(c, color[back]);
+        depth[back] = z;
+        return;
+    }
+    color[next] = _oit_over(color[next], color[back]);
+    depth[back] = z;
+    color[back] = c;
+}
+
+// Top-left fill rule for screen space with y down and positive area
+static inline bool _raster_top_left(const float dx, const float dy)
+{
+    return dy < 0.0f || (dy == 0.0f && dx > 0.0f);
+}
+
+// Edge-function rasterizer: pixel centers inside all three edges (top-left ties) are depth tested and shaded.
+// Depth is affine in screen space; each varying v is interpolated as (v/w) / (1/w). Every attribute plane
+// is evaluated at the span start and stepped by its x gradient, so a covered pixel costs one multiply-add
+// per attribute plus a single reciprocal. shade == NULL selects _render_shade with user as its uniforms.
+// depth_equal turns the depth test into an exact match (shading pass after a depth prepass). With the tile
+// far plane on, a tile row the whole triangle lies behind is skipped without touching per-pixel depth.
+_RENDER_KERNEL void _raster_kernel_fmt(Window_t* w, DepthBuffer* db, const _RasterVertex* a, const _RasterVertex* b,
+    const _RasterVertex* c, const int nvary, const int nderiv, const bool depth_test, const bool depth_write,
+    const bool depth_equal, const RenderBlend blend, const _RasterShadeFn shade, const void* user, RenderStats* stats,
+    OitBuffer* oit, const DepthFormat fmt)
+{
+    float area = (b->x - a->x) * (c->y - a->y) - (b->y - a->y) * (c->x - a->x);
+    if (area == 0.0f || !(area == area)) return;
+    if (area < 0.0f) { const _RasterVertex* t = b; b = c; c = t; area = -area; }
+
+    const int minx = (int)fmaxf(0.0f, floorf(fminf(a->x, fminf(b->x, c->x))));
+    const int maxx = (int)fminf((float)(w->bWidth - 1), ceilf(fmaxf(a->x, fmaxf(b->x, c->x))));
+    const int miny = (int)fmaxf(0.0f, floorf(fminf(a->y, fminf(b->y, c->y))));
+    const int maxy = (int)fminf((float)(w->bHeight - 1), ceilf(fmaxf(a->y, fmaxf(b->y, c->y))));
+    if (minx > maxx || miny > maxy) return;
+
+    // e0 faces a (edge b->c), e1 faces b (c->a), e2 faces c (a->b); each equals area at its vertex
+    const float e0x = -(c->y - b->y), e0y = c->x - b->x;
+    const float e1x = -(a->y - c->y), e1y = a->x - c->x;
+    const float e2x = -(b->y - a->y), e2y = b->x - a->x;
+    const bool tl0 = _raster_top_left(c->x - b->x, c->y - b->y);
+    const bool tl1 = _raster_top_left(a->x - c->x, a->y - c->y);
+    const bool tl2 = _raster_top_left(b->x - a->x, b->y - a->y);
+
+    // Attribute planes: q[0] = z, q[1] = 1/w, q[2+k] = vary[k]/w, all as f(p) = sum(e_i(p) * f_i) / area
+    const int nq = 2 + (nvary < RENDER_MAX_VARYINGS ? nvary : RENDER_MAX_VARYINGS);
+    float qa[2 + RENDER_MAX_VARYINGS], qb[2 + RENDER_MAX_VARYINGS], qc[2 + RENDER_MAX_VARYINGS];
+    float dqx[2 + RENDER_MAX_VARYINGS], dqy[2 + RENDER_MAX_VARYINGS], q0[2 + RENDER_MAX_VARYINGS];
+    qa[0] = a->z; qa[1] = a->inv_w;
+    qb[0] = b->z; qb[1] = b->inv_w;
+    qc[0] = c->z; qc[1] = c->inv_w;
+    for (int k = 2; k < nq; k++) {
+        qa[k] = a->vary[k - 2] * a->inv_w;
+        qb[k] = b->vary[k - 2] * b->inv_w;
+        qc[k] = c->vary[k - 2] * c->inv_w;
+    }
+    const float inv_area = 1.0f / area;
+    for (int k = 0; k < nq; k++) {
+        dqx[k] = (e0x * qa[k] + e1x * qb[k] + e2x * qc[k]) * inv_area;
+        dqy[k] = (e0y * qa[k] + e1y * qb[k] + e2y * qc[k]) * inv_area;
+    }
+
+    // Everything relative to vertex a at the first pixel center keeps the planes well conditioned
+    const float px = (float)minx + 0.5f - a->x, py = (float)miny + 0.5f - a->y;
+    float w0r = area + e0x * px + e0y * py;    // e0(a) == area
+    float w1r = e1x * px + e1y * py;
+    float w2r = e2x * px + e2y * py;
+    for (int k = 0; k < nq; k++) q0[k] = qa[k] + dqx[k] * px + dqy[k] * py;
+
+    float vary[RENDER_MAX_VARYINGS], ddx[RENDER_MAX_VARYINGS], ddy[RENDER_MAX_VARYINGS];
+    const int nd = nderiv < nq - 2 ? nderiv : nq - 2;
+    const int tile_mask = (1 << DEPTH_TILE_SHIFT) - 1;
+    const bool tiles = _depth_tiles_usable(db, depth_test, depth_equal);
+    const uint32_t near_key = tiles ? _depth_near_key(fmt, fminf(a->z, fminf(b->z, c->z)), fmaxf(a->inv_w, fmaxf(b->inv_w, c->inv_w))) : 0;
+    int tested = 0, shaded = 0;
+    for (int y = miny; y <= maxy; y++) {
+        const size_t base = (size_t)y * w->bWidth;
+        uint32_t* row = w->buffer + base;
+        uint32_t* written = _depth_written_row(db, y, depth_write);
+        const int sub = _depth_subset_x(db, y);
+        const int last = sub == 2 ? minx - 1 : maxx;
+        float w0 = w0r, w1 = w1r, w2 = w2r;
+        for (int x = minx; x <= last; x++, w0 += e0x, w1 += e1x, w2 += e2x) {
+            if (tiles && (x == minx || !(x & tile_mask)) && near_key >= _depth_tile_far(db, x >> DEPTH_TILE_SHIFT, y >> DEPTH_TILE_SHIFT)) {
+                // Step the edge functions one pixel at a time so later pixels see the same values
+                const int end = (x | tile_mask) < maxx ? (x | tile_mask) : maxx;
+                for (; x < end; x++) { w0 += e0x; w1 += e1x; w2 += e2x; }
+                continue;
+            }
+            if (sub >= 0 && (x & 1) != sub) continue;
+            if (!((w0 > 0.0f || (w0 == 0.0f && tl0)) &&
+                  (w1 > 0.0f || (w1 == 0.0f && tl1)) &&
+                  (w2 > 0.0f || (w2 == 0.0f && tl2)))) continue;
+            const float dx = (float)(x - minx);
+            const float z = q0[0] + dqx[0] * dx;
+            const float iw = q0[1] + dqx[1] * dx;
+            tested++;
+            if (!_depth_test_write(db, base + x, fmt, z, iw, depth_test, depth_write, depth_equal)) continue;
+            if (written) written[x >> DEPTH_TILE_SHIFT] = db->draw_serial;
+            shaded++;
+            const float pw = 1.0f / iw;
+            for (int k = 2; k < nq; k++) vary[k - 2] = (q0[k] + dqx[k] * dx) * pw;
+            // d(v)/dx = (d(v/w)/dx - v * d(1/w)/dx) * w
+            for (int k = 0; k < nd; k++) {
+                ddx[k] = (dqx[k + 2] - vary[k] * dqx[1]) * pw;
+                ddy[k] = (dqy[k + 2] - vary[k] * dqy[1]) * pw;
+            }
+            const uint32_t color = shade ? shade(vary, ddx, ddy, user)
+                                         : _render_shade(nvary, vary, ddx, ddy, (const _RenderShadeUniforms*)user, x, y);
+            if (blend == _RENDER_BLEND_OIT) _oit_insert(oit, base + x, z, color);
+            else row[x] = blend == RENDER_BLEND_OPAQUE ? color | 0xFF000000 : _render_blend(blend, row[x], color);
+        }
+        w0r += e0y; w1r += e1y; w2r += e2y;
+        for (int k = 0; k < nq; k++) q0[k] += dqy[k];
+    }
+    if (stats) { stats->tested += tested; stats->shaded += shaded; }
+}
+
+_RENDER_KERNEL void _raster_kernel(Window_t* w, DepthBuffer* db, const _RasterVertex* a, const _RasterVertex* b,
+    const _RasterVertex* c, const int nvary, const int nderiv, const bool depth_test, const bool depth_write,
+    const bool depth_equal, const RenderBlend blend, const _RasterShadeFn shade, const void* user, RenderStats* stats,
+    OitBuffer* oit)
+{
+    switch (db->format) {
+        case DEPTH_FORMAT_U16:
+            _raster_kernel_fmt(w, db, a, b, c, nvary, nderiv, depth_test, depth_write, depth_equal, blend, shade, user, stats, oit, DEPTH_FORMAT_U16);
+            break;
+        case DEPTH_FORMAT_U24_REVERSED:
+            _raster_kernel_fmt(w, db, a, b, c, nvary, nderiv, depth_test, depth_write, depth_equal, blend, shade, user, stats, oit, DEPTH_FORMAT_U24_REVERSED);
+            break;
+        default:
+            _raster_kernel_fmt(w, db, a, b, c, nvary, nderiv, depth_test, depth_write, depth_equal, blend, shade, user, stats, oit, DEPTH_FORMAT_F32);
+            break;
+    }
+}
+
+// Depth-tested, opaque rasterization with a custom shader
+static inline void _raster_triangle(Window_t* w, DepthBuffer* db, const _RasterVertex* a, const _RasterVertex* b,
+    const _RasterVertex* c, const int nvary, const int nderiv, const _RasterShadeFn shade, const void* user)
+{
+    _raster_kernel(w, db, a, b, c, nvary, nderiv, true, true, false, RENDER_BLEND_OPAQUE, shade, user, NULL, NULL);
+}
+
+// Rasterizes one set-up triangle with the built-in shader
+typedef void (*_RenderRasterFn)(Renderer* r, const _RasterVertex* v, int nvary, const _RenderShadeUniforms* u);
+
+// Runtime-state raster step (C, or RENDER_NO_TEMPLATES)
+static inline void _render_raster_dynamic(Renderer* r, const _RasterVertex* v, const int nvary, const _RenderShadeUniforms* u)
+{
+    _raster_kernel(r->window, &r->depth, &v[0], &v[1], &v[2], nvary, _render_nderiv(nvary),
+                   r->depth_test, r->depth_write, r->depth_equal, r->blend, NULL, u, &r->stats, NULL);
+}
+
+// Transparent fragments into the k-buffer, tested against the opaque depth without writing it
+static inline void _render_raster_oit(Renderer* r, const _RasterVertex* v, const int nvary, const _RenderShadeUniforms* u)
+{
+    _raster_kernel(r->window, &r->depth, &v[0], &v[1], &v[2], nvary, _render_nderiv(nvary), true, false, false,
+                   _RENDER_BLEND_OIT, NULL, u, &r->stats, &r->oit);
+}
+
+static inline bool _render_shadow_active(const Renderer* r)
+{
+    return r->shadow.enabled && r->shadow.valid && r->light;
+}
+
+// Tile masks are current for the light array and the framebuffer size
+static inline bool _render_lights_ready(const Renderer* r)
+{
+    return r->lights && r->num_lights > 0 && r->light_count == r->num_lights &&
+           r->light_tiles_x == (r->window->bWidth + (1 << RENDER_LIGHT_TILE_SHIFT) - 1) >> RENDER_LIGHT_TILE_SHIFT &&
+           r->light_tiles_y == (r->window->bHeight + (1 << RENDER_LIGHT_TILE_SHIFT) - 1) >> RENDER_LIGHT_TILE_SHIFT;
+}
+
+static inline bool _render_lights_active(const Renderer* r)
+{
+    return r->light && _render_lights_ready(r);
+}
+
+// ---------------------------------------------------------------------------
+// Meshlet culling: whole Model.meshlets against the frustum, their normal cone and the depth tiles
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    Renderer* r;
+    const Mat4* vp;
+    float planes[5][4];     // Screen sides two pixels out (rasterization rounds there), then w > 0; near and far draw
+    Vec3 eye, front;
+    bool enabled;
+    bool cone;              // Back faces are culled, so meshlets facing away can go
+    bool occlusion;         // Tile far planes are conservative, so meshlets behind them can go
+} _RenderCull;
+
+static inline void _render_cull_init(_RenderCull* k, Renderer* r, const Mat4* vp, const int width, const int height,
+    const bool cone, const bool occlusion)
+{
+    const float* m = vp->m;
+    const float mx = 1.0f + 4.0f / (float)width, my = 1.0f + 4.0f / (float)height;
+    // Rows of the column-major matrix: x + mx w >= 0, mx w - x >= 0, likewise for y, then w >= 0
+    const float p[5][4] = {
+        { m[3] * mx + m[0], m[7] * mx + m[4], m[11] * mx + m[8], m[15] * mx + m[12] },
+        { m[3] * mx - m[0], m[7] * mx - m[4], m[11] * mx - m[8], m[15] * mx - m[12] },
+        { m[3] * my + m[1], m[7] * my + m[5], m[11] * my + m[9], m[15] * my + m[13] },
+        { m[3] * my - m[1], m[7] * my - m[5], m[11] * my - m[9], m[15] * my - m[13] },
+        { m[3], m[7], m[11], m[15] },
+    };
+    for (int i = 0; i < 5; i++) {
+        const float l = sqrtf(p[i][0] * p[i][0] + p[i][1] * p[i][1] + p[i][2] * p[i][2]);
+        for (int j = 0; j < 4; j++) k->planes[i][j] = l > 0.0f ? p[i][j] / l : p[i][j];
+    }
+    k->r         = r;
+    k->vp        = vp;
+    k->eye       = r->camera->position;
+    k->front     = r->camera->front;
+    k->enabled   = r->cluster_culling;
+    k->cone      = cone;
+    k->occlusion = occlusion;
+}
+
+// True when every depth tile under the meshlet's projected bounds is nearer than the nearest point of its sphere
+static inline bool _render_meshlet_occluded(const _RenderCull* k, const ModelMeshlet* ml)
+{
+    DepthBuffer* db = &k->r->depth;
+    const Vec3 c = ml->world_center;
+    const float radius = ml->world_radius;
+    const float near_w = dot(sub(c, k->eye), k->front) - radius;
+    if (near_w <= _RENDER_NEAR) return false;
+
+    float minx = FLT_MAX, miny = FLT_MAX, maxx = -FLT_MAX, maxy = -FLT_MAX;
+    for (int i = 0; i < 8; i++) {
+        const Vec3 corner = vec3(c.x + (i & 1 ? radius : -radius), c.y + (i & 2 ? radius : -radius), c.z + (i & 4 ? radius : -radius));
+        float w;
+        Vec3 s = _mat4_mul_vec3(k->vp, corner, &w);
+        if (w <= _RENDER_NEAR) return false;
+        s = vdiv(s, w);
+        _to_screen(&s, db->width, db->height);
+        minx = fminf(minx, s.x); maxx = fmaxf(maxx, s.x);
+        miny = fminf(miny, s.y); maxy = fmaxf(maxy, s.y);
+    }
+    const int tx0 = (int)fmaxf(0.0f, minx - 1.0f) >> DEPTH_TILE_SHIFT;
+    const int ty0 = (int)fmaxf(0.0f, miny - 1.0f) >> DEPTH_TILE_SHIFT;
+    const int tx1 = (int)fminf((float)(db->width - 1), fmaxf(0.0f, maxx + 1.0f)) >> DEPTH_TILE_SHIFT;
+    const int ty1 = (int)fminf((float)(db->height - 1), fmaxf(0.0f, maxy + 1.0f)) >> DEPTH_TILE_SHIFT;
+
+    // z = A - B / w, as in _depth_inv_w
+    const float a = (_RENDER_FAR + _RENDER_NEAR) / (_RENDER_FAR - _RENDER_NEAR);
+    const float b = 2.0f * _RENDER_FAR * _RENDER_NEAR / (_RENDER_FAR - _RENDER_NEAR);
+    const uint32_t near_key = _depth_near_key(db->format, a - b / near_w, 1.0f / near_w);
+    for (int ty = ty0; ty <= ty1; ty++)
+        for (int tx = tx0; tx <= tx1; tx++)
+            if (near_key < _depth_tile_far(db, tx, ty)) return false;
+    return true;
+}
+
+static inline bool _render_meshlet_visible(const _RenderCull* k, const ModelMeshlet* ml)
+{
+    const Vec3 c = ml->world_center;
+    const float radius = ml->world_radius;
+    for (int i = 0; i < 5; i++)
+        if (k->planes[i][0] * c.x + k->planes[i][1] * c.y + k->planes[i][2] * c.z + k->planes[i][3] < -radius) return false;
+
+    // Facing away: every eye ray into the sphere makes an angle under 90 degrees with every normal in the cone,
+    // which holds when cos(ray angle to the axis + cone angle) exceeds sin(angular radius of the sphere)
+    const Vec3 v = sub(c, k->eye);
+    const float d = len(v);
+    if (k->cone && ml->world_cos > 0.0f && d > radius) {
+        const float cos_t = dot(v, ml->world_axis) / d, sin_t = sqrtf(fmaxf(0.0f, 1.0f - cos_t * cos_t));
+        const float sin_a = sqrtf(fmaxf(0.0f, 1.0f - ml->world_cos * ml->world_cos));
+        if (cos_t * ml->world_cos - sin_t * sin_a > radius / d + 1e-3f) return false;
+    }
+    return !k->occlusion || !_render_meshlet_occluded(k, ml);
+}
+
+// Next triangle range [first, end) to draw: each meshlet that survives culling in turn, or the whole model once
+// when it has no meshlets. next starts at 0; false when the model is done.
+static inline bool _render_cull_next(const _RenderCull* k, const Model* m, int* next, int* first, int* end)
+{
+    if (!k->enabled || !m->meshlets) {
+        *first = 0;
+        *end   = m->num_triangles;
+        return (*next)++ == 0;
+    }
+    while (*next < m->num_meshlets) {
+        const ModelMeshlet* ml = &m->meshlets[(*next)++];
+        k->r->stats.clusters++;
+        if (!_render_meshlet_visible(k, ml)) { k->r->stats.clusters_culled++; continue; }
+        *first = ml->first;
+        *end   = ml->first + ml->count < m->num_triangles ? ml->first + ml->count : m->num_triangles;
+        return true;
+    }
+    return false;
+}
+
+// Varyings a built-in draw needs: UVs when textured, normals when lit per pixel, then world positions for
+// shadows and local lights
+static inline int _render_builtin_nvary(const Renderer* r, const Texture* tex)
+{
+    if (_render_shadow_active(r) || _render_lights_active(r)) return (tex ? 2 : 0) + 6;
+    return (tex ? 2 : 0) + (r->smooth_shading && r->light ? 3 : 0);
+}
+
+// Built-in materials with transparency go through the k-buffer (or alpha blending); shaders own their output
+static inline bool _render_model_transparent(const Model* m)
+{
+    return m->mat.transparency > 0.0f && !(m->mat.shader && m->mat.shader->fragment);
+}
+
+static inline _RenderShadeUniforms _render_uniforms(const Renderer* r, const Vec3 color, const Texture* tex, const bool world)
+{
+    _RenderShadeUniforms u = { color, r->light_dir, tex, NULL, NULL, NULL, 0, 0, 1.0f };
+    if (world && _render_shadow_active(r)) u.shadow = &r->shadow;
+    if (world && _render_lights_active(r)) {
+        u.lights        = r->lights;
+        u.light_masks   = r->light_masks;
+        u.light_words   = r->light_words;
+        u.light_tiles_x = r->light_tiles_x;
+    }
+    return u;
+}
+
+// Per-triangle setup for one draw: transform, cull, light and hand off to raster. `reference` routes flat,
+// depth-tested opaque triangles through _fill_triangle so default output stays unchanged.
+_RENDER_KERNEL void _render_model_kernel(Renderer* r, const Model* m, const Mat4* vp, const Texture* tex,
+    const bool cull, const bool light, const int nvary, const bool reference, const _RenderRasterFn raster)
+{
+    const bool uv = _render_nderiv(nvary) != 0, normals = nvary >= 3, world = nvary >= 6;
+    const int bw = r->window->bWidth, bh = r->window->bHeight;
+    const float opacity = fminf(1.0f, fmaxf(0.0f, 1.0f - m->mat.transparency));
+    _RenderCull clusters;
+    _render_cull_init(&clusters, r, vp, bw, bh, cull, r->msaa < 4 && _depth_tiles_usable(&r->depth, r->depth_test, r->depth_equal));
+    int next = 0, first, end;
+    while (_render_cull_next(&clusters, m, &next, &first, &end)) {
+        for (int i = first; i < end; i++) {
+            const Triangle* tri = &m->transformed_triangles[i];
+            float w0, w1, w2;
+            Vec3 c0 = _mat4_mul_vec3(vp, tri->v0, &w0);
+            Vec3 c1 = _mat4_mul_vec3(vp, tri->v1, &w1);
+            Vec3 c2 = _mat4_mul_vec3(vp, tri->v2, &w2);
+            if (w0 <= 0.0f || w1 <= 0.0f || w2 <= 0.0f) continue;
+            c0 = vdiv(c0, w0); c1 = vdiv(c1, w1); c2 = vdiv(c2, w2);
+            if (cull && sub(c1,c0).x*sub(c2,c0).y - sub(c1,c0).y*sub(c2,c0).x <= 0.0f) continue;
+            r->stats.triangles++;
+            const float z0=c0.z, z1=c1.z, z2=c2.z;
+            _to_screen(&c0, bw, bh);
+            _to_screen(&c1, bw, bh);
+            _to_screen(&c2, bw, bh);
+            const Vec3 normal = norm(cross(sub(tri->v1, tri->v0), sub(tri->v2, tri->v0)));
+            float brightness = 1.0f;
+            if (light && !normals) brightness = fmaxf(0.0f, -dot(normal, r->light_dir));
+
+            if (reference) {
+                _fill_triangle(r->window, &r->depth, c0, c1, c2, z0, z1, z2, _vec3_to_color(mul(tri->color, brightness), 1.0f), &r->stats);
+                continue;
+            }
+
+            // Flat draws with world positions light per pixel from the face normal
+            const bool has_n = r->smooth_shading && (tri->n0.x != 0.0f || tri->n0.y != 0.0f || tri->n0.z != 0.0f);
+            const Vec3 n[3] = { has_n ? tri->n0 : normal, has_n ? tri->n1 : normal, has_n ? tri->n2 : normal };
+            const Vec3 p[3] = { tri->v0, tri->v1, tri->v2 };
+            const Vec3 sc[3] = { c0, c1, c2 };
+            const float cw[3] = { w0, w1, w2 };
+            _RasterVertex rv[3];
+            for (int k = 0; k < 3; k++) {
+                rv[k].x = sc[k].x; rv[k].y = sc[k].y; rv[k].z = sc[k].z; rv[k].inv_w = 1.0f / cw[k];
+                float* v = rv[k].vary;
+                if (uv) { *v++ = tri->uv[k][0]; *v++ = tri->uv[k][1]; }
+                if (normals) { *v++ = n[k].x; *v++ = n[k].y; *v++ = n[k].z; }
+                if (world) { *v++ = p[k].x; *v++ = p[k].y; *v++ = p[k].z; }
+            }
+            _RenderShadeUniforms u = _render_uniforms(r, mul(tri->color, brightness), tex, world);
+            u.opacity = opacity;
+            raster(r, rv, nvary, &u);
+        }
+    }
+}
+
+#if defined(__cplusplus) && !defined(RENDER_NO_TEMPLATES)
+// Compile-time specialized pipeline: every Renderer flag becomes a template parameter, picked once per draw
+template <int NVary, bool DepthTest, bool DepthWrite, bool DepthEqual, RenderBlend Blend>
+static void _render_raster_t(Renderer* r, const _RasterVertex* v, int, const _RenderShadeUniforms* u)
+{
+    _raster_kernel(r->window, &r->depth, &v[0], &v[1], &v[2], NVary, _render_nderiv(NVary),
+                   DepthTest, DepthWrite, DepthEqual, Blend, NULL, u, &r->stats, NULL);
+}
+
+template <bool Cull, bool Light, int NVary, bool Reference>
+static void _render_model_t(Renderer* r, const Model* m, const Mat4* vp, const Texture* tex, const _RenderRasterFn raster)
+{
+    _render_model_kernel(r, m, vp, tex, Cull, Light, NVary, Reference, raster);
+}
+
+template <int NVary, bool DepthTest, bool DepthWrite, bool DepthEqual = false>
+static _RenderRasterFn _render_pick_blend(const RenderBlend blend)
+{
+    switch (blend) {
+        case RENDER_BLEND_ALPHA: return _render_raster_t<NVary, DepthTest, DepthWrite, DepthEqual, RENDER_BLEND_ALPHA>;
+        case RENDER_BLEND_ADD:   return _render_raster_t<NVary, DepthTest, DepthWrite, DepthEqual, RENDER_BLEND_ADD>;
+        default:                 return _render_raster_t<NVary, DepthTest, DepthWrite, DepthEqual, RENDER_BLEND_OPAQUE>;
+    }
+}
+
+template <int NVary>
+static _RenderRasterFn _render_pick_raster(const Renderer* r)
+{
+    // An equal test only passes where the stored depth already matches, so writing is a no-op
+    if (r->depth_test && r->depth_equal) return _render_pick_blend<NVary, true, false, true>(r->blend);
+    if (r->depth_test) return r->depth_write ? _render_pick_blend<NVary, true, true>(r->blend)
+                                             : _render_pick_blend<NVary, true, false>(r->blend);
+    return r->depth_write ? _render_pick_blend<NVary, false, true>(r->blend)
+                          : _render_pick_blend<NVary, false, false>(r->blend);
+}
+
+template <bool Cull, bool Light>
+static void _render_model_dispatch(Renderer* r, const Model* m, const Mat4* vp, const Texture* tex, const int nvary, const bool reference)
+{
+    switch (nvary) {
+        case 2:  _render_model_t<Cull, Light, 2, false>(r, m, vp, tex, _render_pick_raster<2>(r)); break;
+        case 3:  _render_model_t<Cull, Light, 3, false>(r, m, vp, tex, _render_pick_raster<3>(r)); break;
+        case 5:  _render_model_t<Cull, Light, 5, false>(r, m, vp, tex, _render_pick_raster<5>(r)); break;
+        case 6:  _render_model_t<Cull, Light, 6, false>(r, m, vp, tex, _render_pick_raster<6>(r)); break;
+        case 8:  _render_model_t<Cull, Light, 8, false>(r, m, vp, tex, _render_pick_raster<8>(r)); break;
+        default:
+            if (reference) _render_model_t<Cull, Light, 0, true>(r, m, vp, tex, NULL);
+            else           _render_model_t<Cull, Light, 0, false>(r, m, vp, tex, _render_pick_raster<0>(r));
+            break;
+    }
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// Coverage anti-aliasing: edges and depth per sample, one shading per pixel, averaged by renderResolve
+// ---------------------------------------------------------------------------
+
+#define _RENDER_MSAA_MAX  8
+#define _RENDER_MSAA_BAND 32    // Resolve rows per job
+
+// Standard rotated 4x / 8x patterns, in 1/16 pixel around the pixel center
+static const signed char _render_msaa_pos4[4][2] = { {-2, -6}, {6, -2}, {-6, 2}, {2, 6} };
+static const signed char _render_msaa_pos8[8][2] = { {1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7} };
+
+static inline int _render_msaa_samples(const Renderer* r)
+{
+    return r->msaa >= 8 ? 8 : r->msaa >= 4 ? 4 : 1;
+}
+
+// Sample buffers for the current depth size; they are cleared when (re)allocated or when clear is set
+static inline bool _render_msaa_prepare(Renderer* r, bool clear)
+{
+    const size_t n = (size_t)r->depth.width * r->depth.height * _render_msaa_samples(r);
+    if (n > r->sample_capacity) {
+        const size_t cap = n + n / 4;
+        free(r->sample_depth);
+        free(r->sample_color);
+        free(r->sample_state);
+        r->sample_depth = (float*)malloc(cap * sizeof(float));
+        r->sample_color = (uint32_t*)malloc(cap * sizeof(uint32_t));
+        r->sample_state = (uint8_t*)malloc(cap / 4 + 1);    // At least 4 samples per pixel
+        if (!r->sample_depth || !r->sample_color || !r->sample_state) {
+            fprintf(stderr, "Failed to allocate %dx MSAA buffers (%dx%d)\n", _render_msaa_samples(r), r->depth.width, r->depth.height);
+            free(r->sample_depth);
+            free(r->sample_color);
+            free(r->sample_state);
+            r->sample_depth = NULL;
+            r->sample_color = NULL;
+            r->sample_state = NULL;
+            r->sample_capacity = 0;
+            return false;
+        }
+        r->sample_capacity = cap;
+        clear = true;
+    }
+    // Fast clear: only the per-pixel state is reset
+    if (clear) memset(r->sample_state, 0, (size_t)r->depth.width * r->depth.height);
+    return true;
+}
+
+// Samples of pixel i, filled with the clear values on their first use since renderClear
+_RENDER_KERNEL void _msaa_touch(Renderer* r, const size_t i, const int samples)
+{
+    if (r->sample_state[i]) return;
+    r->sample_state[i] = 1;
+    for (int s = 0; s < samples; s++) {
+        r->sample_depth[i * samples + s] = FLT_MAX;
+        r->sample_color[i * samples + s] = 0;
+    }
+}
+
+// Edge and depth offsets from the pixel center to each sample, per triangle
+typedef struct {
+    float ew[3][_RENDER_MSAA_MAX];
+    float ez[_RENDER_MSAA_MAX];
+    float lo[3], hi[3];         // Extremes of ew per edge
+    bool tl[3];
+} _MsaaTri;
+
+static inline void _msaa_setup(_MsaaTri* t, const int samples, const float* ex, const float* ey, const bool* tl,
+    const float dzx, const float dzy)
+{
+    const signed char (*pos)[2] = samples == 8 ? _render_msaa_pos8 : _render_msaa_pos4;
+    for (int s = 0; s < samples; s++) {
+        const float ox = (float)pos[s][0] * (1.0f / 16.0f), oy = (float)pos[s][1] * (1.0f / 16.0f);
+        for (int e = 0; e < 3; e++) t->ew[e][s] = ex[e] * ox + ey[e] * oy;
+        t->ez[s] = dzx * ox + dzy * oy;
+    }
+    for (int e = 0; e < 3; e++) {
+        t->lo[e] = t->hi[e] = t->ew[e][0];
+        for (int s = 1; s < samples; s++) {
+            t->lo[e] = fminf(t->lo[e], t->ew[e][s]);
+            t->hi[e] = fmaxf(t->hi[e], t->ew[e][s]);
+        }
+        t->tl[e] = tl[e];
+    }
+}
+
+// Samples inside all three edges, given the edge values at the pixel center (same tie rule as the kernel).
+// Float addition is monotonic, so pixels wholly outside or inside are settled exactly from lo/hi.
+_RENDER_KERNEL uint32_t _msaa_coverage(const _MsaaTri* t, const int samples, const float w0, const float w1, const float w2,
+    const CpuSimdLevel simd)
+{
+    if (w0 + t->hi[0] < 0.0f || w1 + t->hi[1] < 0.0f || w2 + t->hi[2] < 0.0f) return 0;
+    if (w0 + t->lo[0] > 0.0f && w1 + t->lo[1] > 0.0f && w2 + t->lo[2] > 0.0f) return (1u << samples) - 1;
+#if defined(__AVX2__)
+    if (samples == 8 && simd >= CPU_SIMD_AVX2) {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 a = _mm256_add_ps(_mm256_set1_ps(w0), _mm256_loadu_ps(t->ew[0]));
+        const __m256 b = _mm256_add_ps(_mm256_set1_ps(w1), _mm256_loadu_ps(t->ew[1]));
+        const __m256 c = _mm256_add_ps(_mm256_set1_ps(w2), _mm256_loadu_ps(t->ew[2]));
+        const __m256 ia = t->tl[0] ? _mm256_cmp_ps(a, zero, _CMP_GE_OQ) : _mm256_cmp_ps(a, zero, _CMP_GT_OQ);
+        const __m256 ib = t->tl[1] ? _mm256_cmp_ps(b, zero, _CMP_GE_OQ) : _mm256_cmp_ps(b, zero, _CMP_GT_OQ);
+        const __m256 ic = t->tl[2] ? _mm256_cmp_ps(c, zero, _CMP_GE_OQ) : _mm256_cmp_ps(c, zero, _CMP_GT_OQ);
+        return (uint32_t)_mm256_movemask_ps(_mm256_and_ps(ia, _mm256_and_ps(ib, ic)));
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    if (simd >= CPU_SIMD_SSE) {
+        const __m128 zero = _mm_setzero_ps();
+        uint32_t m = 0;
+        for (int h = 0; h < samples; h += 4) {
+            const __m128 a = _mm_add_ps(_mm_set1_ps(w0), _mm_loadu_ps(t->ew[0] + h));
+            const __m128 b = _mm_add_ps(_mm_set1_ps(w1), _mm_loadu_ps(t->ew[1] + h));
+            const __m128 c = _mm_add_ps(_mm_set1_ps(w2), _mm_loadu_ps(t->ew[2] + h));
+            const __m128 ia = t->tl[0] ? _mm_cmpge_ps(a, zero) : _mm_cmpgt_ps(a, zero);
+            const __m128 ib = t->tl[1] ? _mm_cmpge_ps(b, zero) : _mm_cmpgt_ps(b, zero);
+            const __m128 ic = t->tl[2] ? _mm_cmpge_ps(c, zero) : _mm_cmpgt_ps(c, zero);
+            m |= (uint32_t)_mm_movemask_ps(_mm_and_ps(ia, _mm_and_ps(ib, ic))) << h;
+        }
+        return m;
+    }
+#endif
+    (void)simd;
+    uint32_t m = 0;
+    for (int s = 0; s < samples; s++) {
+        const float a = w0 + t->ew[0][s], b = w1 + t->ew[1][s], c = w2 + t->ew[2][s];
+        if ((a > 0.0f || (a == 0.0f && t->tl[0])) && (b > 0.0f || (b == 0.0f && t->tl[1])) &&
+            (c > 0.0f || (c == 0.0f && t->tl[2]))) m |= 1u << s;
+    }
+    return m;
+}
+
+// Covered samples whose depth (center depth z plus the sample offset) passes against the stored samples
+_RENDER_KERNEL uint32_t _msaa_depth_test(const _MsaaTri* t, const int samples, const uint32_t cov, const float z,
+    const float* sd, const bool depth_equal, const CpuSimdLevel simd)
+{
+#if defined(__AVX2__)
+    if (samples == 8 && simd >= CPU_SIMD_AVX2) {
+        const __m256 zs = _mm256_add_ps(_mm256_set1_ps(z), _mm256_loadu_ps(t->ez));
+        const __m256 st = _mm256_loadu_ps(sd);
+        return cov & (uint32_t)_mm256_movemask_ps(depth_equal ? _mm256_cmp_ps(zs, st, _CMP_EQ_OQ) : _mm256_cmp_ps(zs, st, _CMP_LT_OQ));
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    if (simd >= CPU_SIMD_SSE) {
+        uint32_t m = 0;
+        for (int h = 0; h < samples; h += 4) {
+            const __m128 zs = _mm_add_ps(_mm_set1_ps(z), _mm_loadu_ps(t->ez + h));
+            const __m128 st = _mm_loadu_ps(sd + h);
+            m |= (uint32_t)_mm_movemask_ps(depth_equal ? _mm_cmpeq_ps(zs, st) : _mm_cmplt_ps(zs, st)) << h;
+        }
+        return cov & m;
+    }
+#endif
+    (void)simd;
+    uint32_t m = 0;
+    for (int s = 0; s < samples; s++) {
+        const float zs = z + t->ez[s];
+        if (depth_equal ? zs == sd[s] : zs < sd[s]) m |= 1u << s;
+    }
+    return cov & m;
+}
+
+// Write one shaded pixel into the samples in mask
+_RENDER_KERNEL void _msaa_write(const _MsaaTri* t, const int samples, const uint32_t mask, const float z, const uint32_t color,
+    float* sd, uint32_t* sc, const bool depth_write, const RenderBlend blend, const CpuSimdLevel simd)
+{
+#if defined(__AVX2__)
+    if (samples == 8 && simd >= CPU_SIMD_AVX2 && blend == RENDER_BLEND_OPAQUE) {
+        const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        const __m256i m = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int)mask), bits), bits);
+        const __m256 mf = _mm256_castsi256_ps(m);
+        if (depth_write)
+            _mm256_storeu_ps(sd, _mm256_blendv_ps(_mm256_loadu_ps(sd), _mm256_add_ps(_mm256_set1_ps(z), _mm256_loadu_ps(t->ez)), mf));
+        const __m256 c = _mm256_castsi256_ps(_mm256_set1_epi32((int)(color | 0xFF000000)));
+        _mm256_storeu_ps((float*)sc, _mm256_blendv_ps(_mm256_loadu_ps((const float*)sc), c, mf));
+        return;
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    if (simd >= CPU_SIMD_SSE && blend == RENDER_BLEND_OPAQUE) {
+        const __m128i bits = _mm_setr_epi32(1, 2, 4, 8);
+        const __m128i c = _mm_set1_epi32((int)(color | 0xFF000000));
+        for (int h = 0; h < samples; h += 4) {
+            const __m128i m = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32((int)(mask >> h)), bits), bits);
+            if (depth_write) {
+                const __m128 zs = _mm_add_ps(_mm_set1_ps(z), _mm_loadu_ps(t->ez + h));
+                const __m128 mf = _mm_castsi128_ps(m);
+                _mm_storeu_ps(sd + h, _mm_or_ps(_mm_and_ps(mf, zs), _mm_andnot_ps(mf, _mm_loadu_ps(sd + h))));
+            }
+            const __m128i old = _mm_loadu_si128((const __m128i*)(sc + h));
+            _mm_storeu_si128((__m128i*)(sc + h), _mm_or_si128(_mm_and_si128(m, c), _mm_andnot_si128(m, old)));
+        }
+        return;
+    }
+#endif
+    (void)samples; (void)simd;
+    for (uint32_t m = mask; m; m &= m - 1) {
+        int s = 0;
+        while (!(m >> s & 1)) s++;
+        if (depth_write) sd[s] = z + t->ez[s];
+        sc[s] = blend == RENDER_BLEND_OPAQUE ? color | 0xFF000000 : _render_blend(blend, sc[s], color);
+    }
+}
+
+// Coverage-sampled _raster_kernel: a pixel is shaded once, at its center, when any of its samples is inside
+// the triangle and passes the depth test; the color goes to those samples only. samples (4 or 8) and simd
+// are constants in each specialization.
+_RENDER_KERNEL void _raster_kernel_msaa(Renderer* r, const _RasterVertex* a, const _RasterVertex* b, const _RasterVertex* c,
+    const int nvary, const int nderiv, const bool depth_test, const bool depth_write, const bool depth_equal,
+    const RenderBlend blend, const _RenderShadeUniforms* u, const int samples, const CpuSimdLevel simd)
+{
+    const Window_t* w = r->window;
+    float area = (b->x - a->x) * (c->y - a->y) - (b->y - a->y) * (c->x - a->x);
+    if (area == 0.0f || !(area == area)) return;
+    if (area < 0.0f) { const _RasterVertex* t = b; b = c; c = t; area = -area; }
+
+    const int minx = (int)fmaxf(0.0f, floorf(fminf(a->x, fminf(b->x, c->x))));
+    const int maxx = (int)fminf((float)(w->bWidth - 1), ceilf(fmaxf(a->x, fmaxf(b->x, c->x))));
+    const int miny = (int)fmaxf(0.0f, floorf(fminf(a->y, fminf(b->y, c->y))));
+    const int maxy = (int)fminf((float)(w->bHeight - 1), ceilf(fmaxf(a->y, fmaxf(b->y, c->y))));
+    if (minx > maxx || miny > maxy) return;
+
+    const float ex[3] = { -(c->y - b->y), -(a->y - c->y), -(b->y - a->y) };
+    const float ey[3] = { c->x - b->x, a->x - c->x, b->x - a->x };
+    const bool tl[3] = { _raster_top_left(c->x - b->x, c->y - b->y), _raster_top_left(a->x - c->x, a->y - c->y),
+                         _raster_top_left(b->x - a->x, b->y - a->y) };
+
+    const int nq = 2 + (nvary < RENDER_MAX_VARYINGS ? nvary : RENDER_MAX_VARYINGS);
+    float qa[2 + RENDER_MAX_VARYINGS], qb[2 + RENDER_MAX_VARYINGS], qc[2 + RENDER_MAX_VARYINGS];
+    float dqx[2 + RENDER_MAX_VARYINGS], dqy[2 + RENDER_MAX_VARYINGS], q0[2 + RENDER_MAX_VARYINGS];
+    qa[0] = a->z; qa[1] = a->inv_w;
+    qb[0] = b->z; qb[1] = b->inv_w;
+    qc[0] = c->z; qc[1] = c->inv_w;
+    for (int k = 2; k < nq; k++) {
+        qa[k] = a->vary[k - 2] * a->inv_w;
+        qb[k] = b->vary[k - 2] * b->inv_w;
+        qc[k] = c->vary[k - 2] * c->inv_w;
+    }
+    const float inv_area = 1.0f / area;
+    for (int k = 0; k < nq; k++) {
+        dqx[k] = (ex[0] * qa[k] + ex[1] * qb[k] + ex[2] * qc[k]) * inv_area;
+        dqy[k] = (ey[0] * qa[k] + ey[1] * qb[k] + ey[2] * qc[k]) * inv_area;
+    }
+    const float px = (float)minx + 0.5f - a->x, py = (float)miny + 0.5f - a->y;
+    float w0r = area + ex[0] * px + ey[0] * py;
+    float w1r = ex[1] * px + ey[1] * py;
+    float w2r = ex[2] * px + ey[2] * py;
+    for (int k = 0; k < nq; k++) q0[k] = qa[k] + dqx[k] * px + dqy[k] * py;
+
+    _MsaaTri mt;
+    _msaa_setup(&mt, samples, ex, ey, tl, dqx[0], dqy[0]);
+    float vary[RENDER_MAX_VARYINGS], ddx[RENDER_MAX_VARYINGS], ddy[RENDER_MAX_VARYINGS];
+    const int nd = nderiv < nq - 2 ? nderiv : nq - 2;
+    int tested = 0, shaded = 0;
+    for (int y = miny; y <= maxy; y++) {
+        const size_t base = (size_t)y * w->bWidth;
+        float* sd = r->sample_depth + base * samples;
+        uint32_t* sc = r->sample_color + base * samples;
+        float w0 = w0r, w1 = w1r, w2 = w2r;
+        for (int x = minx; x <= maxx; x++, w0 += ex[0], w1 += ex[1], w2 += ex[2]) {
+            const uint32_t cov = _msaa_coverage(&mt, samples, w0, w1, w2, simd);
+            if (!cov) continue;
+            _msaa_touch(r, base + x, samples);
+            const float dx = (float)(x - minx);
+            const float z = q0[0] + dqx[0] * dx;
+            tested++;
+            const uint32_t pass = depth_test ? _msaa_depth_test(&mt, samples, cov, z, sd + (size_t)x * samples, depth_equal, simd) : cov;
+            if (!pass) continue;
+            shaded++;
+            // Shaded at the center even when only edge samples are covered (no centroid adjustment)
+            const float pw = 1.0f / (q0[1] + dqx[1] * dx);
+            for (int k = 2; k < nq; k++) vary[k - 2] = (q0[k] + dqx[k] * dx) * pw;
+            for (int k = 0; k < nd; k++) {
+                ddx[k] = (dqx[k + 2] - vary[k] * dqx[1]) * pw;
+                ddy[k] = (dqy[k + 2] - vary[k] * dqy[1]) * pw;
+            }
+            _msaa_write(&mt, samples, pass, z, _render_shade(nvary, vary, ddx, ddy, u, x, y), sd + (size_t)x * samples,
+                        sc + (size_t)x * samples, depth_write, blend, simd);
+        }
+        w0r += ey[0]; w1r += ey[1]; w2r += ey[2];
+        for (int k = 0; k < nq; k++) q0[k] += dqy[k];
+    }
+    r->stats.tested += tested;
+    r->stats.shaded += shaded;
+}
+
+// Coverage-sampled raster step; sample count and SIMD level are picked here so the kernel specializes on them
+static inline void _render_raster_msaa(Renderer* r, const _RasterVertex* v, const int nvary, const _RenderShadeUniforms* u)
+{
+    const int nd = _render_nderiv(nvary);
+    const CpuSimdLevel simd = cpuGetSimdLevel();
+    if (_render_msaa_samples(r) == 8) {
+        if (simd >= CPU_SIMD_AVX2)
+            _raster_kernel_msaa(r, &v[0], &v[1], &v[2], nvary, nd, r->depth_test, r->depth_write, r->depth_equal, r->blend, u, 8, CPU_SIMD_AVX2);
+        else
+            _raster_kernel_msaa(r, &v[0], &v[1], &v[2], nvary, nd, r->depth_test, r->depth_write, r->depth_equal, r->blend, u, 8, simd);
+    } else {
+        _raster_kernel_msaa(r, &v[0], &v[1], &v[2], nvary, nd, r->depth_test, r->depth_write, r->depth_equal, r->blend, u, 4, simd);
+    }
+}
+
+typedef struct {
+    Renderer* r;
+    int samples;
+} _RenderResolveCtx;
+
+static void _render_resolve_band(void* user, const int band)
+{
+    const _RenderResolveCtx* ctx = (const _RenderResolveCtx*)user;
+    Renderer* r = ctx->r;
+    DepthBuffer* db = &r->depth;
+    const int n = ctx->samples, shift = n == 8 ? 3 : 2;
+    const int y0 = band * _RENDER_MSAA_BAND;
+    const int y1 = y0 + _RENDER_MSAA_BAND < db->height ? y0 + _RENDER_MSAA_BAND : db->height;
+    for (int y = y0; y < y1; y++) {
+        for (int x = 0; x < db->width; x++) {
+            const size_t i = (size_t)y * db->width + x;
+            if (!r->sample_state[i]) continue;     // Still holds what renderClear wrote
+            const uint32_t* sc = r->sample_color + i * n;
+            const float* sd = r->sample_depth + i * n;
+            uint32_t out = sc[0];
+            float z = sd[0];
+            bool uniform = true;
+            for (int s = 1; s < n; s++) {
+                uniform = uniform && sc[s] == sc[0];
+                z = sd[s] < z ? sd[s] : z;
+            }
+            if (!uniform) {
+                uint32_t sum[4] = { 0, 0, 0, 0 };
+                for (int s = 0; s < n; s++)
+                    for (int ch = 0; ch < 4; ch++) sum[ch] += (sc[s] >> (8 * ch)) & 0xFF;
+                out = 0;
+                for (int ch = 0; ch < 4; ch++) out |= ((sum[ch] + (uint32_t)(n >> 1)) >> shift) << (8 * ch);
+            }
+            r->window->buffer[(size_t)y * r->window->bWidth + x] = out;
+            _depth_test_write(db, i, db->format, z, db->format == DEPTH_FORMAT_U24_REVERSED ? _depth_inv_w(z) : 0.0f, false, true, false);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Programmable pipeline: vertex stage per corner, fragment stage per SHADER_BLOCK-pixel row block
+// ---------------------------------------------------------------------------
+
+inline void shaderInit(Shader* s, const ShaderVertexFn vertex, const ShaderFragmentFn fragment, const int num_varyings, const void* uniforms)
+{
+    s->vertex       = vertex;
+    s->fragment     = fragment;
+    s->num_varyings = num_varyings < 0 ? 0 : num_varyings > RENDER_MAX_VARYINGS ? RENDER_MAX_VARYINGS : num_varyings;
+    s->uniforms     = uniforms;
+}
+
+// Plane setup shared by every block of one triangle (same conventions as _raster_kernel)
+typedef struct {
+    int minx, maxx, miny, maxy;
+    float ex[3], ey[3];         // Edge function gradients
+    float tl[3];                // 1 where a zero edge value counts as inside (top-left rule)
+    float wr[3];                // Edge values at (minx + 0.5, row + 0.5) of the current row
+    int nq;
+    float q0[2 + RENDER_MAX_VARYINGS], dqx[2 + RENDER_MAX_VARYINGS], dqy[2 + RENDER_MAX_VARYINGS];
+} _ShaderTri;
+
+static const float _shader_iota[SHADER_BLOCK] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+
+static inline int _render_popcount(uint32_t m)
+{
+    int n = 0;
+    for (; m; m &= m - 1) n++;
+    return n;
+}
+
+// Coverage, depth test and varyings of the block starting at column bx; returns the mask of pixels that
+// passed, *covered receives the mask before the depth test
+static inline uint32_t _shader_block_scalar(const _ShaderTri* t, const int bx, const float* depth, const bool depth_test,
+    const bool depth_equal, const uint32_t valid, ShaderFragments* f, uint32_t* covered)
+{
+    const float d0 = (float)(bx - t->minx);
+    uint32_t mask = 0, cov = 0;
+    for (int i = 0; i < SHADER_BLOCK; i++) {
+        const float d = d0 + _shader_iota[i];
+        bool in = true;
+        for (int e = 0; e < 3; e++) {
+            const float w = t->wr[e] + t->ex[e] * d;
+            in = in && (w > 0.0f || (w == 0.0f && t->tl[e] != 0.0f));
+        }
+        f->depth[i] = t->q0[0] + t->dqx[0] * d;
+        if (!in || !(valid >> i & 1)) continue;
+        cov |= 1u << i;
+        if (!depth_test || (depth_equal ? f->depth[i] == depth[bx + i] : f->depth[i] < depth[bx + i])) mask |= 1u << i;
+    }
+    *covered = cov;
+    if (!mask) return 0;
+    for (int i = 0; i < SHADER_BLOCK; i++) {
+        const float d = d0 + _shader_iota[i];
+        const float pw = 1.0f / (t->q0[1] + t->dqx[1] * d);
+        for (int k = 2; k < t->nq; k++) f->vary[k - 2][i] = (t->q0[k] + t->dqx[k] * d) * pw;
+    }
+    return mask;
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+static inline uint32_t _shader_block_sse(const _ShaderTri* t, const int bx, const float* depth, const bool depth_test,
+    const bool depth_equal, const uint32_t valid, ShaderFragments* f, uint32_t* covered)
+{
+    const __m128 zero = _mm_setzero_ps();
+    uint32_t mask = 0, cov = 0;
+    __m128 d[2];
+    for (int h = 0; h < 2; h++) {
+        d[h] = _mm_add_ps(_mm_set1_ps((float)(bx - t->minx)), _mm_loadu_ps(_shader_iota + 4 * h));
+        __m128 in = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int e = 0; e < 3; e++) {
+            const __m128 w = _mm_add_ps(_mm_set1_ps(t->wr[e]), _mm_mul_ps(_mm_set1_ps(t->ex[e]), d[h]));
+            const __m128 tie = _mm_and_ps(_mm_cmpeq_ps(w, zero), _mm_cmpneq_ps(_mm_set1_ps(t->tl[e]), zero));
+            in = _mm_and_ps(in, _mm_or_ps(_mm_cmpgt_ps(w, zero), tie));
+        }
+        const __m128 z = _mm_add_ps(_mm_set1_ps(t->q0[0]), _mm_mul_ps(_mm_set1_ps(t->dqx[0]), d[h]));
+        _mm_storeu_ps(f->depth + 4 * h, z);
+        uint32_t m = (uint32_t)_mm_movemask_ps(in);
+        cov |= m << (4 * h);
+        if (depth_test) {
+            if (bx + 4 * h + 4 <= t->maxx + 1) {
+                const __m128 stored = _mm_loadu_ps(depth + bx + 4 * h);
+                m &= (uint32_t)_mm_movemask_ps(depth_equal ? _mm_cmpeq_ps(z, stored) : _mm_cmplt_ps(z, stored));
+            } else {
+                for (int i = 0; i < 4; i++) {
+                    const int x = bx + 4 * h + i;
+                    if (!(x <= t->maxx && (depth_equal ? f->depth[4 * h + i] == depth[x] : f->depth[4 * h + i] < depth[x]))) m &= ~(1u << i);
+                }
+            }
+        }
+        mask |= m << (4 * h);
+    }
+    mask &= valid;
+    *covered = cov & valid;
+    if (!mask) return 0;
+    for (int h = 0; h < 2; h++) {
+        const __m128 pw = _mm_div_ps(_mm_set1_ps(1.0f), _mm_add_ps(_mm_set1_ps(t->q0[1]), _mm_mul_ps(_mm_set1_ps(t->dqx[1]), d[h])));
+        for (int k = 2; k < t->nq; k++)
+            _mm_storeu_ps(f->vary[k - 2] + 4 * h, _mm_mul_ps(_mm_add_ps(_mm_set1_ps(t->q0[k]), _mm_mul_ps(_mm_set1_ps(t->dqx[k]), d[h])), pw));
+    }
+    return mask;
+}
+#endif
+
+#if defined(__AVX2__)
+static inline uint32_t _shader_block_avx2(const _ShaderTri* t, const int bx, const float* depth, const bool depth_test,
+    const bool depth_equal, const uint32_t valid, ShaderFragments* f, uint32_t* covered)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 d = _mm256_add_ps(_mm256_set1_ps((float)(bx - t->minx)), _mm256_loadu_ps(_shader_iota));
+    __m256 in = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int e = 0; e < 3; e++) {
+        const __m256 w = _mm256_add_ps(_mm256_set1_ps(t->wr[e]), _mm256_mul_ps(_mm256_set1_ps(t->ex[e]), d));
+        const __m256 tie = _mm256_and_ps(_mm256_cmp_ps(w, zero, _CMP_EQ_OQ), _mm256_cmp_ps(_mm256_set1_ps(t->tl[e]), zero, _CMP_NEQ_UQ));
+        in = _mm256_and_ps(in, _mm256_or_ps(_mm256_cmp_ps(w, zero, _CMP_GT_OQ), tie));
+    }
+    const __m256 z = _mm256_add_ps(_mm256_set1_ps(t->q0[0]), _mm256_mul_ps(_mm256_set1_ps(t->dqx[0]), d));
+    _mm256_storeu_ps(f->depth, z);
+    uint32_t mask = (uint32_t)_mm256_movemask_ps(in) & valid;
+    *covered = mask;
+    if (depth_test) {
+        if (bx + SHADER_BLOCK <= t->maxx + 1) {
+            const __m256 stored = _mm256_loadu_ps(depth + bx);
+            mask &= (uint32_t)_mm256_movemask_ps(depth_equal ? _mm256_cmp_ps(z, stored, _CMP_EQ_OQ) : _mm256_cmp_ps(z, stored, _CMP_LT_OQ));
+        } else {
+            for (int i = 0; i < SHADER_BLOCK; i++)
+                if ((mask >> i & 1) && !(depth_equal ? f->depth[i] == depth[bx + i] : f->depth[i] < depth[bx + i])) mask &= ~(1u << i);
+        }
+    }
+    if (!mask) return 0;
+    const __m256 pw = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_add_ps(_mm256_set1_ps(t->q0[1]), _mm256_mul_ps(_mm256_set1_ps(t->dqx[1]), d)));
+    for (int k = 2; k < t->nq; k++)
+        _mm256_storeu_ps(f->vary[k - 2], _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(t->q0[k]), _mm256_mul_ps(_mm256_set1_ps(t->dqx[k]), d)), pw));
+    return mask;
+}
+#endif
+
+// Bounds, edges and attribute planes of one triangle; false when nothing can be covered
+static inline bool _shader_setup(const Window_t* w, const _RasterVertex* a, const _RasterVertex* b, const _RasterVertex* c,
+    const Shader* sh, _ShaderTri* out)
+{
+    float area = (b->x - a->x) * (c->y - a->y) - (b->y - a->y) * (c->x - a->x);
+    if (area == 0.0f || !(area == area)) return false;
+    if (area < 0.0f) { const _RasterVertex* tmp = b; b = c; c = tmp; area = -area; }
+
+    _ShaderTri t;
+    t.minx = (int)fmaxf(0.0f, floorf(fminf(a->x, fminf(b->x, c->x))));
+    t.maxx = (int)fminf((float)(w->bWidth - 1), ceilf(fmaxf(a->x, fmaxf(b->x, c->x))));
+    t.miny = (int)fmaxf(0.0f, floorf(fminf(a->y, fminf(b->y, c->y))));
+    t.maxy = (int)fminf((float)(w->bHeight - 1), ceilf(fmaxf(a->y, fmaxf(b->y, c->y))));
+    if (t.minx > t.maxx || t.miny > t.maxy) return false;
+
+    const _RasterVertex* v[3] = { a, b, c };
+    for (int e = 0; e < 3; e++) {
+        const _RasterVertex* p = v[(e + 1) % 3];
+        const _RasterVertex* q = v[(e + 2) % 3];
+        t.ex[e] = -(q->y - p->y);
+        t.ey[e] = q->x - p->x;
+        t.tl[e] = _raster_top_left(q->x - p->x, q->y - p->y) ? 1.0f : 0.0f;
+    }
+
+    t.nq = 2 + sh->num_varyings;
+    const float inv_area = 1.0f / area;
+    float qv[3][2 + RENDER_MAX_VARYINGS];
+    for (int i = 0; i < 3; i++) {
+        qv[i][0] = v[i]->z;
+        qv[i][1] = v[i]->inv_w;
+        for (int k = 2; k < t.nq; k++) qv[i][k] = v[i]->vary[k - 2] * v[i]->inv_w;
+    }
+    for (int k = 0; k < t.nq; k++) {
+        t.dqx[k] = (t.ex[0] * qv[0][k] + t.ex[1] * qv[1][k] + t.ex[2] * qv[2][k]) * inv_area;
+        t.dqy[k] = (t.ey[0] * qv[0][k] + t.ey[1] * qv[1][k] + t.ey[2] * qv[2][k]) * inv_area;
+    }
+    const float px = (float)t.minx + 0.5f - a->x, py = (float)t.miny + 0.5f - a->y;
+    t.wr[0] = area + t.ex[0] * px + t.ey[0] * py;
+    t.wr[1] = t.ex[1] * px + t.ey[1] * py;
+    t.wr[2] = t.ex[2] * px + t.ey[2] * py;
+    for (int k = 0; k < t.nq; k++) t.q0[k] = qv[0][k] + t.dqx[k] * px + t.dqy[k] * py;
+    *out = t;
+    return true;
+}
+
+static inline void _shader_raster(Renderer* r, const _RasterVertex* a, const _RasterVertex* b, const _RasterVertex* c,
+    const Shader* sh, const CpuSimdLevel simd)
+{
+    Window_t* w = r->window;
+    _ShaderTri t;
+    if (!_shader_setup(w, a, b, c, sh, &t)) return;
+
+    ShaderFragments f;
+    int tested = 0, shaded = 0;
+    // The SIMD blocks compare float depth; integer formats are tested per surviving pixel below
+    DepthBuffer* db = &r->depth;
+    const DepthFormat fmt = db->format;
+    const bool block_test = r->depth_test && fmt == DEPTH_FORMAT_F32;
+    for (int y = t.miny; y <= t.maxy; y++) {
+        const size_t base = (size_t)y * w->bWidth;
+        const float* depth = fmt == DEPTH_FORMAT_F32 ? db->depths + base : NULL;
+        uint32_t* row = w->buffer + base;
+        uint32_t* written = _depth_written_row(db, y, r->depth_write);
+        const int sub = _depth_subset_x(db, y);
+        const int last = sub == 2 ? t.minx - 1 : t.maxx;
+        f.y = y;
+        for (int bx = t.minx; bx <= last; bx += SHADER_BLOCK) {
+            const int n = t.maxx + 1 - bx;
+            uint32_t valid = n >= SHADER_BLOCK ? (1u << SHADER_BLOCK) - 1 : (1u << n) - 1;
+            if (sub >= 0) valid &= (bx & 1) == sub ? 0x55555555u : 0xAAAAAAAAu;
+            uint32_t mask, covered;
+#if defined(__AVX2__)
+            if (simd >= CPU_SIMD_AVX2) mask = _shader_block_avx2(&t, bx, depth, block_test, r->depth_equal, valid, &f, &covered);
+            else
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+            if (simd >= CPU_SIMD_SSE) mask = _shader_block_sse(&t, bx, depth, block_test, r->depth_equal, valid, &f, &covered);
+            else
+#endif
+            mask = _shader_block_scalar(&t, bx, depth, block_test, r->depth_equal, valid, &f, &covered);
+            (void)simd;
+            tested += _render_popcount(covered);
+            if (r->depth_test && !block_test) {
+                for (uint32_t m = mask; m; m &= m - 1) {
+                    int i = 0;
+                    while (!(m >> i & 1)) i++;
+                    const float iw = t.q0[1] + t.dqx[1] * (float)(bx - t.minx + i);
+                    if (!_depth_test_write(db, base + bx + i, fmt, f.depth[i], iw, true, false, r->depth_equal)) mask &= ~(1u << i);
+                }
+            }
+            if (!mask) continue;
+
+            // Derivatives at the first covered pixel, for mip selection and similar
+            int first = 0;
+            while (!(mask >> first & 1)) first++;
+            const float d = (float)(bx - t.minx + first);
+            const float pw = 1.0f / (t.q0[1] + t.dqx[1] * d);
+            for (int k = 0; k < t.nq - 2; k++) {
+                f.ddx[k] = (t.dqx[k + 2] - f.vary[k][first] * t.dqx[1]) * pw;
+                f.ddy[k] = (t.dqy[k + 2] - f.vary[k][first] * t.dqy[1]) * pw;
+            }
+
+            f.x = bx;
+            f.mask = mask;
+            for (int i = 0; i < SHADER_BLOCK; i++) f.color[i] = 0xFF000000;
+            sh->fragment(&f, sh->uniforms);
+
+            for (uint32_t m = f.mask & mask; m; m &= m - 1) {
+                int i = 0;
+                while (!(m >> i & 1)) i++;
+                shaded++;
+                if (r->depth_write) {
+                    const float iw = t.q0[1] + t.dqx[1] * (float)(bx - t.minx + i);
+                    _depth_test_write(db, base + bx + i, fmt, f.depth[i], iw, false, true, false);
+                    if (written) written[(bx + i) >> DEPTH_TILE_SHIFT] = db->draw_serial;
+                }
+                row[bx + i] = r->blend == RENDER_BLEND_OPAQUE ? f.color[i] | 0xFF000000 : _render_blend(r->blend, row[bx + i], f.color[i]);
+            }
+        }
+        for (int e = 0; e < 3; e++) t.wr[e] += t.ey[e];
+        for (int k = 0; k < t.nq; k++) t.q0[k] += t.dqy[k];
+    }
+    r->stats.tested += tested;
+    r->stats.shaded += shaded;
+}
+
+// Draw a model through its material's programmable shader
+// Coverage-sampled _shader_raster: blocks are gathered from per-sample coverage and depth, each pixel with a
+// surviving sample is shaded once at its center
+static inline void _shader_raster_msaa(Renderer* r, const _RasterVertex* a, const _RasterVertex* b, const _RasterVertex* c,
+    const Shader* sh, const CpuSimdLevel simd, const int samples)
+{
+    Window_t* w = r->window;
+    _ShaderTri t;
+    if (!_shader_setup(w, a, b, c, sh, &t)) return;
+
+    const bool tl[3] = { t.tl[0] != 0.0f, t.tl[1] != 0.0f, t.tl[2] != 0.0f };
+    _MsaaTri mt;
+    _msaa_setup(&mt, samples, t.ex, t.ey, tl, t.dqx[0], t.dqy[0]);
+    ShaderFragments f;
+    uint32_t pass[SHADER_BLOCK];
+    int tested = 0, shaded = 0;
+    for (int y = t.miny; y <= t.maxy; y++) {
+        const size_t base = (size_t)y * w->bWidth;
+        float* sd = r->sample_depth + base * samples;
+        uint32_t* sc = r->sample_color + base * samples;
+        f.y = y;
+        for (int bx = t.minx; bx <= t.maxx; bx += SHADER_BLOCK) {
+            uint32_t mask = 0;
+            for (int i = 0; i < SHADER_BLOCK && bx + i <= t.maxx; i++) {
+                const float d = (float)(bx - t.minx + i);
+                pass[i] = _msaa_coverage(&mt, samples, t.wr[0] + t.ex[0] * d, t.wr[1] + t.ex[1] * d, t.wr[2] + t.ex[2] * d, simd);
+                if (!pass[i]) continue;
+                _msaa_touch(r, base + bx + i, samples);
+                tested++;
+                f.depth[i] = t.q0[0] + t.dqx[0] * d;
+                if (r->depth_test)
+                    pass[i] = _msaa_depth_test(&mt, samples, pass[i], f.depth[i], sd + (size_t)(bx + i) * samples, r->depth_equal, simd);
+                if (!pass[i]) continue;
+                mask |= 1u << i;
+                const float pw = 1.0f / (t.q0[1] + t.dqx[1] * d);
+                for (int k = 2; k < t.nq; k++) f.vary[k - 2][i] = (t.q0[k] + t.dqx[k] * d) * pw;
+            }
+            if (!mask) continue;
+
+            int first = 0;
+            while (!(mask >> first & 1)) first++;
+            const float d = (float)(bx - t.minx + first);
+            const float pw = 1.0f / (t.q0[1] + t.dqx[1] * d);
+            for (int k = 0; k < t.nq - 2; k++) {
+                f.ddx[k] = (t.dqx[k + 2] - f.vary[k][first] * t.dqx[1]) * pw;
+                f.ddy[k] = (t.dqy[k + 2] - f.vary[k][first] * t.dqy[1]) * pw;
+            }
+
+            f.x = bx;
+            f.mask = mask;
+            for (int i = 0; i < SHADER_BLOCK; i++) f.color[i] = 0xFF000000;
+            sh->fragment(&f, sh->uniforms);
+
+            for (uint32_t m = f.mask & mask; m; m &= m - 1) {
+                int i = 0;
+                while (!(m >> i & 1)) i++;
+                shaded++;
+                _msaa_write(&mt, samples, pass[i], f.depth[i], f.color[i], sd + (size_t)(bx + i) * samples,
+                            sc + (size_t)(bx + i) * samples, r->depth_write, r->blend, simd);
+            }
+        }
+        for (int e = 0; e < 3; e++) t.wr[e] += t.ey[e];
+        for (int k = 0; k < t.nq; k++) t.q0[k] += t.dqy[k];
+    }
+    r->stats.tested += tested;
+    r->stats.shaded += shaded;
+}
+
+static inline void _render_model_shader(Renderer* r, const Model* m, const Mat4* vp, const Shader* sh)
+{
+    const CpuSimdLevel simd = cpuGetSimdLevel();
+    const int samples = _render_msaa_samples(r);
+    const int bw = r->window->bWidth, bh = r->window->bHeight;
+    for (int i = 0; i < m->num_triangles; i++) {
+        const Triangle* tri = &m->transformed_triangles[i];
+        const Vec3 normal = norm(cross(sub(tri->v1, tri->v0), sub(tri->v2, tri->v0)));
+        const bool has_n = tri->n0.x != 0.0f || tri->n0.y != 0.0f || tri->n0.z != 0.0f;
+        const Vec3 pos[3] = { tri->v0, tri->v1, tri->v2 };
+        const Vec3 nrm[3] = { has_n ? tri->n0 : normal, has_n ? tri->n1 : normal, has_n ? tri->n2 : normal };
+
+        _RasterVertex rv[3];
+        Vec3 c[3];
+        bool behind = false;
+        for (int k = 0; k < 3 && !behind; k++) {
+            ShaderVertexOut out;
+            if (sh->vertex) {
+                const ShaderVertexIn in = { pos[k], nrm[k], tri->uv[k][0], tri->uv[k][1], tri->color, k };
+                sh->vertex(&in, &out, sh->uniforms);
+            } else {
+                out.position = pos[k];
+                out.vary[0] = nrm[k].x; out.vary[1] = nrm[k].y; out.vary[2] = nrm[k].z;
+                out.vary[3] = tri->uv[k][0]; out.vary[4] = tri->uv[k][1];
+            }
+            float cw;
+            c[k] = _mat4_mul_vec3(vp, out.position, &cw);
+            if (cw <= 0.0f) { behind = true; break; }
+            c[k] = vdiv(c[k], cw);
+            rv[k].z = c[k].z;
+            rv[k].inv_w = 1.0f / cw;
+            memcpy(rv[k].vary, out.vary, sh->num_varyings * sizeof(float));
+        }
+        if (behind) continue;
+        if (r->backface_culling && sub(c[1],c[0]).x*sub(c[2],c[0]).y - sub(c[1],c[0]).y*sub(c[2],c[0]).x <= 0.0f) continue;
+        for (int k = 0; k < 3; k++) {
+            _to_screen(&c[k], bw, bh);
+            rv[k].x = c[k].x;
+            rv[k].y = c[k].y;
+        }
+        r->stats.triangles++;
+        if (samples > 1) _shader_raster_msaa(r, &rv[0], &rv[1], &rv[2], sh, simd, samples);
+        else             _shader_raster(r, &rv[0], &rv[1], &rv[2], sh, simd);
+    }
+}
+
+// Follow bWidth/bHeight changes (window resize, render scale) before touching depth
+static inline void _renderSyncDepth(Renderer* r)
+{
+    const Window_t* w = r->window;
+    if (w->buffer_valid && (r->depth.width != w->bWidth || r->depth.height != w->bHeight || !r->depth.valid))
+        renderResize(r, w->bWidth, w->bHeight);
+}
+
+// ---------------------------------------------------------------------------
+// Deferred (visibility buffer) rendering: depth + triangle ID first, then one shading pass per visible pixel
+// ---------------------------------------------------------------------------
+
+#define _RENDER_VIS_TRI_BITS  24                                // ID = model << 24 | triangle
+#define _RENDER_VIS_MAX_MODEL ((1 << (32 - _RENDER_VIS_TRI_BITS)) - 1)
+#define _RENDER_VIS_EMPTY     0xFFFFFFFFu
+#define _RENDER_VIS_TILE      32
+
+static inline Mat4 _render_view_proj(const Renderer* r)
+{
+    Mat4 view = {0};
+    view.m[0] = r->camera->right.x;   view.m[4] = r->camera->right.y;   view.m[8]  = r->camera->right.z;  view.m[12] = -dot(r->camera->right, r->camera->position);
+    view.m[1] = r->camera->up.x;      view.m[5] = r->camera->up.y;      view.m[9]  = r->camera->up.z;     view.m[13] = -dot(r->camera->up,    r->camera->position);
+    view.m[2] = -r->camera->front.x;  view.m[6] = -r->camera->front.y;  view.m[10] = -r->camera->front.z; view.m[14] =  dot(r->camera->front,  r->camera->position);
+    view.m[15] = 1.0f;
+
+    const float aspect = (float)r->window->bWidth / (float)r->window->bHeight;
+    const Mat4 proj = _perspective(r->camera->fov, aspect, _RENDER_NEAR, _RENDER_FAR);
+    return _mat4_mul(&proj, &view);
+}
+
+// Project a triangle for rasterization; false when it is behind the camera or culled
+static inline bool _render_project(const Renderer* r, const Mat4* vp, const Triangle* tri, _RasterVertex rv[3])
+{
+    const Vec3 p[3] = { tri->v0, tri->v1, tri->v2 };
+    Vec3 c[3];
+    for (int k = 0; k < 3; k++) {
+        float cw;
+        c[k] = _mat4_mul_vec3(vp, p[k], &cw);
+        if (cw <= 0.0f) return false;
+        c[k] = vdiv(c[k], cw);
+        rv[k].inv_w = 1.0f / cw;
+    }
+    if (r->backface_culling && sub(c[1],c[0]).x*sub(c[2],c[0]).y - sub(c[1],c[0]).y*sub(c[2],c[0]).x <= 0.0f) return false;
+    for (int k = 0; k < 3; k++) {
+        rv[k].z = c[k].z;
+        _to_screen(&c[k], r->window->bWidth, r->window->bHeight);
+        rv[k].x = c[k].x;
+        rv[k].y = c[k].y;
+    }
+    return true;
+}
+
+// Depth (plus the triangle ID into ids when not NULL) only: same coverage and depth planes as _raster_kernel,
+// so a later depth_equal pass matches exactly. Used by the depth prepass, the visibility buffer and the shadow
+// map. Returns the pixels tested.
+_RENDER_KERNEL int _depth_triangle_kernel(DepthBuffer* db, uint32_t* ids, const _RasterVertex* a, const _RasterVertex* b,
+    const _RasterVertex* c, const uint32_t id, const DepthFormat fmt)
+{
+    float area = (b->x - a->x) * (c->y - a->y) - (b->y - a->y) * (c->x - a->x);
+    if (area == 0.0f || !(area == area)) return 0;
+    if (area < 0.0f) { const _RasterVertex* t = b; b = c; c = t; area = -area; }
+
+    const int minx = (int)fmaxf(0.0f, floorf(fminf(a->x, fminf(b->x, c->x))));
+    const int maxx = (int)fminf((float)(db->width - 1), ceilf(fmaxf(a->x, fmaxf(b->x, c->x))));
+    const int miny = (int)fmaxf(0.0f, floorf(fminf(a->y, fminf(b->y, c->y))));
+    const int maxy = (int)fminf((float)(db->height - 1), ceilf(fmaxf(a->y, fmaxf(b->y, c->y))));
+    if (minx > maxx || miny > maxy) return 0;
+
+    const float e0x = -(c->y - b->y), e0y = c->x - b->x;
+    const float e1x = -(a->y - c->y), e1y = a->x - c->x;
+    const float e2x = -(b->y - a->y), e2y = b->x - a->x;
+    const bool tl0 = _raster_top_left(c->x - b->x, c->y - b->y);
+    const bool tl1 = _raster_top_left(a->x - c->x, a->y - c->y);
+    const bool tl2 = _raster_top_left(b->x - a->x, b->y - a->y);
+    const float inv_area = 1.0f / area;
+    const float dzx = (e0x * a->z + e1x * b->z + e2x * c->z) * inv_area;
+    const float dzy = (e0y * a->z + e1y * b->z + e2y * c->z) * inv_area;
+    const float diwx = (e0x * a->inv_w + e1x * b->inv_w + e2x * c->inv_w) * inv_area;
+    const float diwy = (e0y * a->inv_w + e1y * b->inv_w + e2y * c->inv_w) * inv_area;
+
+    const float px = (float)minx + 0.5f - a->x, py = (float)miny + 0.5f - a->y;
+    float w0r = area + e0x * px + e0y * py, w1r = e1x * px + e1y * py, w2r = e2x * px + e2y * py;
+    float zr = a->z + dzx * px + dzy * py;
+    float iwr = a->inv_w + diwx * px + diwy * py;
+
+    const int tile_mask = (1 << DEPTH_TILE_SHIFT) - 1;
+    const bool tiles = _depth_tiles_usable(db, true, false);
+    const uint32_t near_key = tiles ? _depth_near_key(fmt, fminf(a->z, fminf(b->z, c->z)), fmaxf(a->inv_w, fmaxf(b->inv_w, c->inv_w))) : 0;
+    int tested = 0;
+    for (int y = miny; y <= maxy; y++) {
+        const size_t base = (size_t)y * db->width;
+        uint32_t* written = _depth_written_row(db, y, true);
+        const int sub = _depth_subset_x(db, y);
+        const int last = sub == 2 ? minx - 1 : maxx;
+        float w0 = w0r, w1 = w1r, w2 = w2r;
+        for (int x = minx; x <= last; x++, w0 += e0x, w1 += e1x, w2 += e2x) {
+            if (tiles && (x == minx || !(x & tile_mask)) && near_key >= _depth_tile_far(db, x >> DEPTH_TILE_SHIFT, y >> DEPTH_TILE_SHIFT)) {
+                const int end = (x | tile_mask) < maxx ? (x | tile_mask) : maxx;
+                for (; x < end; x++) { w0 += e0x; w1 += e1x; w2 += e2x; }
+                continue;
+            }
+            if (sub >= 0 && (x & 1) != sub) continue;
+            if (!((w0 > 0.0f || (w0 == 0.0f && tl0)) &&
+                  (w1 > 0.0f || (w1 == 0.0f && tl1)) &&
+                  (w2 > 0.0f || (w2 == 0.0f && tl2)))) continue;
+            const float dx = (float)(x - minx);
+            tested++;
+            if (!_depth_test_write(db, base + x, fmt, zr + dzx * dx, iwr + diwx * dx, true, true, false)) continue;
+            if (written) written[x >> DEPTH_TILE_SHIFT] = db->draw_serial;
+            if (ids) ids[base + x] = id;
+        }
+        w0r += e0y; w1r += e1y; w2r += e2y;
+        zr += dzy;
+        iwr += diwy;
+    }
+    return tested;
+}
+
+_RENDER_KERNEL void _render_depth_triangle(Renderer* r, const _RasterVertex* a, const _RasterVertex* b, const _RasterVertex* c,
+    const bool write_id, const uint32_t id)
+{
+    DepthBuffer* db = &r->depth;
+    uint32_t* ids = write_id ? r->visibility : NULL;
+    switch (db->format) {
+        case DEPTH_FORMAT_U16:          r->stats.tested += _depth_triangle_kernel(db, ids, a, b, c, id, DEPTH_FORMAT_U16); break;
+        case DEPTH_FORMAT_U24_REVERSED: r->stats.tested += _depth_triangle_kernel(db, ids, a, b, c, id, DEPTH_FORMAT_U24_REVERSED); break;
+        default:                        r->stats.tested += _depth_triangle_kernel(db, ids, a, b, c, id, DEPTH_FORMAT_F32); break;
+    }
+}
+
+typedef struct {
+    const Texture* texture;
+    int nvary;
+} _RenderDeferredModel;
+
+typedef struct {
+    Renderer* r;
+    const Model* models;
+    const _RenderDeferredModel* info;
+    Mat4 vp;
+    int tiles_x;
+} _RenderDeferredCtx;
+
+// Shade one tile: every pixel with an ID rebuilds its triangle's attribute planes (cached while the ID
+// repeats) and evaluates them at the pixel center, the same math as the forward path
+static void _render_deferred_tile(void* user, const int index)
+{
+    const _RenderDeferredCtx* ctx = (const _RenderDeferredCtx*)user;
+    Renderer* r = ctx->r;
+    const int bw = r->window->bWidth, bh = r->window->bHeight;
+    const int x0 = (index % ctx->tiles_x) * _RENDER_VIS_TILE, y0 = (index / ctx->tiles_x) * _RENDER_VIS_TILE;
+    const int x1 = x0 + _RENDER_VIS_TILE < bw ? x0 + _RENDER_VIS_TILE : bw;
+    const int y1 = y0 + _RENDER_VIS_TILE < bh ? y0 + _RENDER_VIS_TILE : bh;
+
+    uint32_t cached = _RENDER_VIS_EMPTY;
+    int nvary = 0, nq = 2;
+    float ax = 0.0f, ay = 0.0f;
+    float qa[2 + RENDER_MAX_VARYINGS], dqx[2 + RENDER_MAX_VARYINGS], dqy[2 + RENDER_MAX_VARYINGS];
+    float vary[RENDER_MAX_VARYINGS], ddx[RENDER_MAX_VARYINGS], ddy[RENDER_MAX_VARYINGS];
+    _RenderShadeUniforms u = _render_uniforms(r, vec3(0, 0, 0), NULL, true);
+    uint32_t flat = 0;
+
+    for (int y = y0; y < y1; y++) {
+        const uint32_t* ids = r->visibility + (size_t)y * bw;
+        uint32_t* row = r->window->buffer + (size_t)y * bw;
+        for (int x = x0; x < x1; x++) {
+            const uint32_t id = ids[x];
+            if (id == _RENDER_VIS_EMPTY) continue;
+            if (id != cached) {
+                cached = id;
+                const int mi = (int)(id >> _RENDER_VIS_TRI_BITS);
+                const Triangle* tri = &ctx->models[mi].transformed_triangles[id & ((1u << _RENDER_VIS_TRI_BITS) - 1)];
+                _RasterVertex rv[3];
+                _render_project(r, &ctx->vp, tri, rv);
+                nvary = ctx->info[mi].nvary;
+                nq = 2 + nvary;
+
+                const Vec3 normal = norm(cross(sub(tri->v1, tri->v0), sub(tri->v2, tri->v0)));
+                const bool uv = _render_nderiv(nvary) != 0, normals = nvary >= 3;
+                const bool has_n = r->smooth_shading && (tri->n0.x != 0.0f || tri->n0.y != 0.0f || tri->n0.z != 0.0f);
+                const Vec3 n[3] = { has_n ? tri->n0 : normal, has_n ? tri->n1 : normal, has_n ? tri->n2 : normal };
+                const Vec3 p[3] = { tri->v0, tri->v1, tri->v2 };
+                for (int k = 0; k < 3; k++) {
+                    float* v = rv[k].vary;
+                    if (uv) { *v++ = tri->uv[k][0]; *v++ = tri->uv[k][1]; }
+                    if (normals) { *v++ = n[k].x; *v++ = n[k].y; *v++ = n[k].z; }
+                    if (nvary >= 6) { *v++ = p[k].x; *v++ = p[k].y; *v++ = p[k].z; }
+                }
+                const float brightness = r->light && !normals ? fmaxf(0.0f, -dot(normal, r->light_dir)) : 1.0f;
+                u.color = mul(tri->color, brightness);
+                u.texture = ctx->info[mi].texture;
+                flat = _vec3_to_color(u.color, 1.0f);
+
+                // Attribute planes of (vary/w, 1/w) from the edge functions, relative to vertex 0
+                const _RasterVertex *a = &rv[0], *b = &rv[1], *c = &rv[2];
+                const float area = (b->x - a->x) * (c->y - a->y) - (b->y - a->y) * (c->x - a->x);
+                const float inv_area = area != 0.0f ? 1.0f / area : 0.0f;
+                const float e0x = -(c->y - b->y), e0y = c->x - b->x;
+                const float e1x = -(a->y - c->y), e1y = a->x - c->x;
+                const float e2x = -(b->y - a->y), e2y = b->x - a->x;
+                ax = a->x; ay = a->y;
+                for (int k = 0; k < nq; k++) {
+                    const float fa = k == 0 ? a->z : k == 1 ? a->inv_w : a->vary[k - 2] * a->inv_w;
+                    const float fb = k == 0 ? b->z : k == 1 ? b->inv_w : b->vary[k - 2] * b->inv_w;
+                    const float fc = k == 0 ? c->z : k == 1 ? c->inv_w : c->vary[k - 2] * c->inv_w;
+                    qa[k]  = fa;
+                    dqx[k] = (e0x * fa + e1x * fb + e2x * fc) * inv_area;
+                    dqy[k] = (e0y * fa + e1y * fb + e2y * fc) * inv_area;
+                }
+            }
+            if (nvary == 0) { row[x] = flat; continue; }
+
+            const float px = (float)x + 0.5f - ax, py = (float)y + 0.5f - ay;
+            const float pw = 1.0f / (qa[1] + dqx[1] * px + dqy[1] * py);
+            for (int k = 2; k < nq; k++) vary[k - 2] = (qa[k] + dqx[k] * px + dqy[k] * py) * pw;
+            const int nd = _render_nderiv(nvary);
+            for (int k = 0; k < nd; k++) {
+                ddx[k] = (dqx[k + 2] - vary[k] * dqx[1]) * pw;
+                ddy[k] = (dqy[k + 2] - vary[k] * dqy[1]) * pw;
+            }
+            row[x] = _render_shade(nvary, vary, ddx, ddy, &u, x, y) | 0xFF000000;
+        }
+    }
+}
+
+// Returns false when the scene can't go deferred (pipeline state or ID range); the caller draws forward
+static inline bool _render_deferred(Renderer* r, const Model* models, const int count)
+{
+    if (!r->depth_test || !r->depth_write || r->depth_equal || r->blend != RENDER_BLEND_OPAQUE || count > _RENDER_VIS_MAX_MODEL + 1) return false;
+    for (int i = 0; i < count; i++)
+        if (models[i].num_triangles > (1 << _RENDER_VIS_TRI_BITS)) return false;
+
+    _renderSyncDepth(r);
+    if (!r->depth.valid) return true;
+    const size_t n = (size_t)r->depth.width * r->depth.height;
+    if (n > r->vis_capacity) {
+        free(r->visibility);
+        r->visibility   = (uint32_t*)malloc(r->depth.capacity * sizeof(uint32_t));
+        r->vis_capacity = r->visibility ? r->depth.capacity : 0;
+        if (!r->visibility) return false;
+    }
+    memset(r->visibility, 0xFF, n * sizeof(uint32_t));
+
+    _RenderDeferredModel info[_RENDER_VIS_MAX_MODEL + 1];
+    const Mat4 vp = _render_view_proj(r);
+    _RenderCull cull;
+    _render_cull_init(&cull, r, &vp, r->window->bWidth, r->window->bHeight, r->backface_culling,
+                      _depth_tiles_usable(&r->depth, r->depth_test, r->depth_equal));
+
+    // Visibility pass; models with a programmable shader or transparency are drawn forward once it has resolved
+    for (int mi = 0; mi < count; mi++) {
+        const Model* m = &models[mi];
+        if ((m->mat.shader && m->mat.shader->fragment) || _render_model_transparent(m)) continue;
+#ifdef TEXTURE_IMPLEMENTATION
+        info[mi].texture = m->mat.texture && m->mat.texture->texels ? m->mat.texture : NULL;
+#else
+        info[mi].texture = NULL;
+#endif
+        info[mi].nvary = _render_builtin_nvary(r, info[mi].texture);
+        _depth_begin_draw(&r->depth);
+        int next = 0, first, end;
+        while (_render_cull_next(&cull, m, &next, &first, &end)) {
+            for (int i = first; i < end; i++) {
+                _RasterVertex rv[3];
+                if (!_render_project(r, &vp, &m->transformed_triangles[i], rv)) continue;
+                r->stats.triangles++;
+                _render_depth_triangle(r, &rv[0], &rv[1], &rv[2], true, (uint32_t)mi << _RENDER_VIS_TRI_BITS | (uint32_t)i);
+            }
+        }
+        r->stats.draws++;
+    }
+
+    // Shading pass: one evaluation per visible pixel, tiles spread over the job pool
+    _RenderDeferredCtx ctx = { r, models, info, vp, (r->depth.width + _RENDER_VIS_TILE - 1) / _RENDER_VIS_TILE };
+    jobParallelFor(ctx.tiles_x * ((r->depth.height + _RENDER_VIS_TILE - 1) / _RENDER_VIS_TILE), _render_deferred_tile, &ctx);
+    for (size_t i = 0; i < n; i++) r->stats.shaded += r->visibility[i] != _RENDER_VIS_EMPTY;
+
+    for (int mi = 0; mi < count; mi++)
+        if (models[mi].mat.shader && models[mi].mat.shader->fragment) renderModel(r, &models[mi]);
+    for (int mi = 0; mi < count; mi++)
+        if (_render_model_transparent(&models[mi])) renderModel(r, &models[mi]);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Draw ordering and depth prepass
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    const Model* model;
+    int first, count;       // Triangle range
+    int meshlet;            // Model.meshlets index when the draw is one meshlet, else -1
+    float key;              // Sort key: nearest view depth (opaque) or negated farthest (blended)
+    int order;              // Submission index, keeps equal keys in array order
+} _RenderDraw;
+
+static int _render_draw_cmp(const void* pa, const void* pb)
+{
+    const _RenderDraw* a = (const _RenderDraw*)pa;
+    const _RenderDraw* b = (const _RenderDraw*)pb;
+    if (a->key != b->key) return a->key < b->key ? -1 : 1;
+    return a->order - b->order;
+}
+
+// Split models into draws (whole models, or their meshlets or RENDER_CLUSTER_SIZE runs) and order them; NULL when
+// out of memory
+static inline const _RenderDraw* _render_draw_list(Renderer* r, const Model* models, const int count, int* out_count)
+{
+    // Edge lists index whole models, so wireframe draws never split into clusters
+    const bool clusters = r->sort == RENDER_SORT_CLUSTERS && !r->wireframe;
+    size_t n = 0;
+    for (int i = 0; i < count; i++) {
+        const int tris = models[i].num_triangles;
+        if (tris > 0 && clusters && models[i].meshlets) n += (size_t)models[i].num_meshlets;
+        else if (tris > 0) n += clusters ? (size_t)(tris + RENDER_CLUSTER_SIZE - 1) / RENDER_CLUSTER_SIZE : 1;
+    }
+    if (n > r->draw_capacity) {
+        void* grown = malloc(n * sizeof(_RenderDraw));
+        if (!grown) return NULL;
+        free(r->draw_list);
+        r->draw_list     = grown;
+        r->draw_capacity = n;
+    }
+
+    _RenderDraw* draws = (_RenderDraw*)r->draw_list;
+    const Vec3 eye = r->camera->position, front = r->camera->front;
+    int k = 0;
+    for (int i = 0; i < count; i++) {
+        const Model* m = &models[i];
+        const bool back_to_front = r->blend != RENDER_BLEND_OPAQUE || _render_model_transparent(m);
+        const bool meshlets = clusters && m->meshlets && m->num_triangles > 0;
+        const int run = clusters ? RENDER_CLUSTER_SIZE : m->num_triangles;
+        const int parts = meshlets ? m->num_meshlets : m->num_triangles > 0 ? (m->num_triangles + run - 1) / run : 0;
+        for (int j = 0; j < parts; j++, k++) {
+            _RenderDraw* d = &draws[k];
+            d->model   = m;
+            d->first   = meshlets ? m->meshlets[j].first : j * run;
+            d->count   = meshlets ? m->meshlets[j].count : m->num_triangles - d->first < run ? m->num_triangles - d->first : run;
+            d->meshlet = meshlets ? j : -1;
+            d->order   = k;
+            d->key     = 0.0f;
+            if (r->sort == RENDER_SORT_NONE) continue;
+            float near_z = FLT_MAX, far_z = -FLT_MAX;
+            for (int t = d->first; t < d->first + d->count; t++) {
+                const Triangle* tri = &m->transformed_triangles[t];
+                const float z0 = dot(sub(tri->v0, eye), front), z1 = dot(sub(tri->v1, eye), front), z2 = dot(sub(tri->v2, eye), front);
+                near_z = fminf(near_z, fminf(z0, fminf(z1, z2)));
+                far_z  = fmaxf(far_z, fmaxf(z0, fmaxf(z1, z2)));
+            }
+            d->key = back_to_front ? -far_z : near_z;
+        }
+    }
+    if (r->sort != RENDER_SORT_NONE) qsort(draws, (size_t)k, sizeof(_RenderDraw), _render_draw_cmp);
+    *out_count = k;
+    return draws;
+}
+
+static inline bool _render_draw_has_shader(const _RenderDraw* d)
+{
+    return d->model->mat.shader && d->model->mat.shader->fragment;
+}
+
+// The model restricted to a draw's range. Meshlet ranges index the whole model: a one-meshlet draw keeps its
+// bounds in *one, other partial runs draw without meshlets
+static inline Model _render_draw_part(const _RenderDraw* d, ModelMeshlet* one)
+{
+    Model part = *d->model;
+    part.transformed_triangles += d->first;
+    part.num_triangles = d->count;
+    if (d->meshlet >= 0) {
+        *one = d->model->meshlets[d->meshlet];
+        one->first = 0;
+        part.meshlets = one;
+        part.num_meshlets = 1;
+    } else if (d->count != d->model->num_triangles) {
+        part.meshlets = NULL;
+        part.num_meshlets = 0;
+    }
+    return part;
+}
+
+static inline void _render_draw(Renderer* r, const _RenderDraw* d)
+{
+    ModelMeshlet one;
+    const Model part = _render_draw_part(d, &one);
+    renderModel(r, &part);
+}
+
+// Depth-only pass over the opaque built-in draws; shader materials are left to a regular depth-tested pass
+// since their vertex stage may move positions
+static inline void _render_prepass(Renderer* r, const _RenderDraw* draws, const int count)
+{
+    const Mat4 vp = _render_view_proj(r);
+    _RenderCull cull;
+    _render_cull_init(&cull, r, &vp, r->window->bWidth, r->window->bHeight, r->backface_culling,
+                      _depth_tiles_usable(&r->depth, r->depth_test, r->depth_equal));
+    for (int i = 0; i < count; i++) {
+        const _RenderDraw* d = &draws[i];
+        if (_render_draw_has_shader(d) || _render_model_transparent(d->model)) continue;
+        _depth_begin_draw(&r->depth);
+        ModelMeshlet one;
+        const Model part = _render_draw_part(d, &one);
+        int next = 0, first, end;
+        while (_render_cull_next(&cull, &part, &next, &first, &end)) {
+            for (int t = first; t < end; t++) {
+                _RasterVertex rv[3];
+                if (!_render_project(r, &vp, &part.transformed_triangles[t], rv)) continue;
+                r->stats.triangles++;
+                _render_depth_triangle(r, &rv[0], &rv[1], &rv[2], false, 0);
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Shadow map: orthographic depth-only pass from the light, fit around the view frustum
+// ---------------------------------------------------------------------------
+
+#define _RENDER_SHADOW_GUARD     0.125f     // Fit margin as a fraction of the view sphere: how far the view moves before a refit
+#define _RENDER_SHADOW_MAX_SLOPE 8.0f       // Slope bias clamp, in depth texels per texel
+
+// FNV-1a over float bit patterns
+static inline uint64_t _shadow_hash(uint64_t h, const float* v, const int n)
+{
+    for (int i = 0; i < n; i++) {
+        uint32_t bits;
+        memcpy(&bits, &v[i], sizeof(bits));
+        h = (h ^ bits) * 1099511628211ull;
+    }
+    return h;
+}
+
+// Light space: x and y across the map, z along the light
+static inline void _shadow_basis(const Vec3 light_dir, Vec3 axis[3])
+{
+    const Vec3 f = norm(light_dir);
+    axis[0] = norm(cross(fabsf(f.y) < 0.99f ? vec3(0, 1, 0) : vec3(1, 0, 0), f));
+    axis[1] = cross(f, axis[0]);
+    axis[2] = f;
+}
+
+// Smallest sphere around the view frustum from the near plane to distance. The radius depends only on the
+// projection, so turning the camera never rescales the map.
+static inline Vec3 _shadow_view_sphere(const Renderer* r, const float distance, float* radius)
+{
+    const Camera* cam = r->camera;
+    const float n = _RENDER_NEAR, f = fmaxf(fminf(distance, _RENDER_FAR), 2.0f * _RENDER_NEAR);
+    const float aspect = (float)r->window->bWidth / (float)r->window->bHeight;
+    const float t = tanf(cam->fov * 0.5f * (float)M_PI / 180.0f);
+    const float k = t * t * (1.0f + aspect * aspect);  // Squared corner distance from the axis per squared depth
+    // Equidistant from the near and far corners, or at the far plane when the far corners alone bound it
+    const float c = fminf(0.5f * (f + n) * (1.0f + k), f);
+    *radius = sqrtf((f - c) * (f - c) + f * f * k);
+    return add(cam->position, mul(cam->front, c));
+}
+
+// ---------------------------------------------------------------------------
+// Local lights: bounds projected to screen tiles, one bit per light and tile
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    int x0, y0, x1, y1;     // Inclusive tile range; x0 > x1 when off screen
+} _LightRect;
+
+typedef struct {
+    Renderer* r;
+    const _LightRect* rects;
+} _RenderLightCtx;
+
+// Sphere around everything a light reaches. A spot cone of half angle t fits in the sphere through its apex and
+// rim, of radius range / (2 cos t) on the axis, which is smaller than range up to 60 degrees.
+static inline float _light_bounds(const Light* l, Vec3* center)
+{
+    *center = l->position;
+    if (l->type != LIGHT_SPOT || l->outer_cos <= 0.5f) return l->range;
+    const float radius = l->range / (2.0f * l->outer_cos);
+    *center = add(l->position, mul(l->direction, radius));
+    return radius;
+}
+
+// Screen tiles covered by the projected bounding box of the light's sphere; the whole screen when the box
+// crosses the near plane
+static inline _LightRect _light_rect(const Renderer* r, const Mat4* vp, const Light* l)
+{
+    const int bw = r->window->bWidth, bh = r->window->bHeight;
+    const _LightRect none = { 1, 1, 0, 0 };
+    _LightRect all = { 0, 0, (bw - 1) >> RENDER_LIGHT_TILE_SHIFT, (bh - 1) >> RENDER_LIGHT_TILE_SHIFT };
+    Vec3 c;
+    const float radius = _light_bounds(l, &c);
+    float minx = FLT_MAX, miny = FLT_MAX, maxx = -FLT_MAX, maxy = -FLT_MAX, max_w = -FLT_MAX;
+    bool clipped = false;
+    for (int k = 0; k < 8; k++) {
+        const Vec3 corner = vec3(c.x + (k & 1 ? radius : -radius), c.y + (k & 2 ? radius : -radius), c.z + (k & 4 ? radius : -radius));
+        float w;
+        Vec3 s = _mat4_mul_vec3(vp, corner, &w);
+        max_w = fmaxf(max_w, w);
+        if (w <= _RENDER_NEAR) { clipped = true; continue; }
+        s = vdiv(s, w);
+        _to_screen(&s, bw, bh);
+        minx = fminf(minx, s.x); maxx = fmaxf(maxx, s.x);
+        miny = fminf(miny, s.y); maxy = fmaxf(maxy, s.y);
+    }
+    if (max_w <= 0.0f) return none;    // Behind the camera, where triangles are rejected
+    if (clipped) return all;
+    // A pixel of margin keeps pixels on the projected edge inside
+    if (maxx < -1.0f || maxy < -1.0f || minx > (float)bw + 1.0f || miny > (float)bh + 1.0f) return none;
+    all.x0 = (int)fmaxf(0.0f, minx - 1.0f) >> RENDER_LIGHT_TILE_SHIFT;
+    all.y0 = (int)fmaxf(0.0f, miny - 1.0f) >> RENDER_LIGHT_TILE_SHIFT;
+    all.x1 = (int)fminf((float)(bw - 1), maxx + 1.0f) >> RENDER_LIGHT_TILE_SHIFT;
+    all.y1 = (int)fminf((float)(bh - 1), maxy + 1.0f) >> RENDER_LIGHT_TILE_SHIFT;
+    return all;
+}
+
+static void _render_light_row(void* user, const int ty)
+{
+    const _RenderLightCtx* ctx = (const _RenderLightCtx*)user;
+    const Renderer* r = ctx->r;
+    const int words = r->light_words;
+    uint32_t* row = r->light_masks + (size_t)ty * r->light_tiles_x * words;
+    memset(row, 0, (size_t)r->light_tiles_x * words * sizeof(uint32_t));
+    for (int i = 0; i < r->num_lights; i++) {
+        const _LightRect* b = &ctx->rects[i];
+        if (ty < b->y0 || ty > b->y1) continue;
+        for (int tx = b->x0; tx <= b->x1; tx++) row[(size_t)tx * words + (i >> 5)] |= 1u << (i & 31);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Order-independent transparency: fragments gathered per pixel, sorted and blended in screen tiles
+// ---------------------------------------------------------------------------
+
+// k-buffer for the current depth size; false when OIT is off (layers 0, msaa) or out of memory. A new layout
+// drops whatever was pending.
+static inline bool _render_oit_prepare(Renderer* r)
+{
+    OitBuffer* ob = &r->oit;
+    if (ob->layers <= 0 || _render_msaa_samples(r) > 1) return false;
+    const int k = ob->layers < _RENDER_OIT_MAX ? ob->layers : _RENDER_OIT_MAX;
+    const size_t n = (size_t)r->depth.width * r->depth.height;
+    if (n <= ob->capacity && k == ob->stride) return true;
+    const size_t cap = n > ob->capacity ? n + n / 4 : ob->capacity;
+    free(ob->depth);
+    free(ob->color);
+    free(ob->count);
+    ob->depth = (float*)malloc(cap * k * sizeof(float));
+    ob->color = (uint32_t*)malloc(cap * k * sizeof(uint32_t));
+    ob->count = (uint8_t*)calloc(cap, 1);
+    ob->pending = false;
+    if (!ob->depth || !ob->color || !ob->count) {
+        free(ob->depth);
+        free(ob->color);
+        free(ob->count);
+        ob->depth = NULL;
+        ob->color = NULL;
+        ob->count = NULL;
+        ob->stride = 0;
+        ob->capacity = 0;
+        return false;
+    }
+    ob->stride = k;
+    ob->capacity = cap;
+    return true;
+}
+
+typedef struct {
+    Renderer* r;
+    int tiles_x;
+} _RenderOitCtx;
+
+// Per pixel: order the stored fragments far to near (insertion sort, k is small) and blend them over the pixel
+static void _render_oit_tile(void* user, const int tile)
+{
+    const _RenderOitCtx* ctx = (const _RenderOitCtx*)user;
+    OitBuffer* ob = &ctx->r->oit;
+    const int width = ctx->r->depth.width, height = ctx->r->depth.height, k = ob->stride;
+    const int x0 = tile % ctx->tiles_x * _RENDER_OIT_TILE, y0 = tile / ctx->tiles_x * _RENDER_OIT_TILE;
+    const int x1 = x0 + _RENDER_OIT_TILE < width ? x0 + _RENDER_OIT_TILE : width;
+    const int y1 = y0 + _RENDER_OIT_TILE < height ? y0 + _RENDER_OIT_TILE : height;
+    float depth[_RENDER_OIT_MAX];
+    uint32_t color[_RENDER_OIT_MAX];
+    for (int y = y0; y < y1; y++) {
+        uint32_t* row = ctx->r->window->buffer + (size_t)y * width;
+        for (int x = x0; x < x1; x++) {
+            const size_t i = (size_t)y * width + x;
+            const int n = ob->count[i];
+            if (!n) continue;
+            ob->count[i] = 0;
+            for (int s = 0; s < n; s++) {
+                const float z = ob->depth[i * k + s];
+                const uint32_t c = ob->color[i * k + s];
+                int j = s;
+                for (; j > 0 && depth[j - 1] < z; j--) { depth[j] = depth[j - 1]; color[j] = color[j - 1]; }
+                depth[j] = z;
+                color[j] = c;
+            }
+            uint32_t dst = row[x];
+            for (int s = 0; s < n; s++) dst = _oit_over(color[s], dst | 0xFF000000);
+            row[x] = dst | 0xFF000000;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Level of detail: one Model.lods level per model, by its error projected at the model's nearest point
+// ---------------------------------------------------------------------------
+
+// Coarsest level whose error stays under lod_error pixels. Moving to a coarser level takes a margin of
+// lod_hysteresis, so a model hovering at a switch distance doesn't flip between levels every frame.
+static inline int _render_select_lod(const Renderer* r, const Model* m, const float px_per_unit)
+{
+    ModelLods* l = m->lods;
+    const float dist = len(sub(l->world_center, r->camera->position)) - l->radius * l->world_scale;
+    int fit = 0, enter = 0;
+    if (r->lod_error > 0.0f && dist > _RENDER_NEAR) {
+        const float scale = l->world_scale * px_per_unit / dist;
+        for (int k = 1; k <= l->count; k++) {
+            const float err = l->levels[k - 1].error * scale;
+            if (err <= r->lod_error) fit = k;
+            if (err <= r->lod_error * (1.0f - r->lod_hysteresis)) enter = k;
+        }
+    }
+    int cur = l->current < 0 ? 0 : l->current > l->count ? l->count : l->current;
+    if (cur > fit) cur = fit;
+    else if (cur < enter) cur = enter;
+    l->current = cur;
+    return cur;
+}
+
+// The models as drawn this frame: the input array when none has levels, otherwise a copy with the selected
+// level's triangles (drawn without the full mesh's edge list)
+static inline const Model* _render_lod_models(Renderer* r, const Model* models, const int count, const int height)
+{
+    bool any = false;
+    for (int i = 0; i < count && !any; i++) any = models[i].lods && models[i].lods->count > 0;
+    if (!any || height <= 0) return models;
+    if (count > r->lod_capacity) {
+        Model* grown = (Model*)malloc((size_t)count * sizeof(Model));
+        if (!grown) return models;
+        free(r->lod_models);
+        r->lod_models   = grown;
+        r->lod_capacity = count;
+    }
+    const float px_per_unit = (float)height / (2.0f * tanf(r->camera->fov * 0.5f * (float)M_PI / 180.0f));
+    for (int i = 0; i < count; i++) {
+        Model* out = &r->lod_models[i];
+        *out = models[i];
+        if (!out->lods || out->lods->count <= 0) continue;
+        const int k = _render_select_lod(r, out, px_per_unit);
+        if (k == 0) continue;
+        const ModelLod* l = &out->lods->levels[k - 1];
+        out->triangles             = l->triangles;
+        out->transformed_triangles = l->transformed_triangles;
+        out->num_triangles         = l->num_triangles;
+        out->edges                 = NULL;
+        out->num_edges             = 0;
+        out->meshlets              = NULL;
+        out->num_meshlets          = 0;
+    }
+    return r->lod_models;
+}
+
+// ---------------------------------------------------------------------------
+// Wireframe: edges are clipped and projected once, then rasterized as row spans in horizontal bands
+// ---------------------------------------------------------------------------
+
+#define _RENDER_WIRE_BAND     32      // Rows per job
+#define _RENDER_WIRE_JOBS_MIN 512     // Fewer lines are drawn on the calling thread
+#define _RENDER_WIRE_BIAS     2e-3f   // Overlay lines pull toward the camera by this fraction of view depth
+
+typedef struct {
+    float x0, y0, z0, x1, y1, z1;   // Screen space, inside the framebuffer
+    uint32_t color;
+} _RenderLine;
+
+typedef struct {
+    Renderer* r;
+    const _RenderLine* lines;
+    int count;
+    bool depth_test, depth_write;
+} _RenderWireCtx;
+
+// Near-plane clip in clip space, then Liang-Barsky against the framebuffer; z stays affine in screen space
+static inline bool _render_wire_clip(const Renderer* r, const Mat4* vp, const Vec3 a, const Vec3 b, const float bias, _RenderLine* out)
+{
+    float wa, wb;
+    Vec3 ca = _mat4_mul_vec3(vp, a, &wa), cb = _mat4_mul_vec3(vp, b, &wb);
+    if (wa < _RENDER_NEAR && wb < _RENDER_NEAR) return false;
+    if (wa < _RENDER_NEAR || wb < _RENDER_NEAR) {
+        const float t = (_RENDER_NEAR - wa) / (wb - wa);
+        const Vec3 c = add(ca, mul(sub(cb, ca), t));
+        if (wa < _RENDER_NEAR) { ca = c; wa = _RENDER_NEAR; } else { cb = c; wb = _RENDER_NEAR; }
+    }
+
+    // Moving a point toward the eye by bias * w shifts NDC z by about 2 * far * near / (far - near) * bias / w
+    const float k = 2.0f * _RENDER_FAR * _RENDER_NEAR / (_RENDER_FAR - _RENDER_NEAR) * bias;
+    Vec3 p = vdiv(ca, wa), q = vdiv(cb, wb);
+    p.z -= k / wa;
+    q.z -= k / wb;
+    const float bw = (float)r->window->bWidth, bh = (float)r->window->bHeight;
+    _to_screen(&p, (int)bw, (int)bh);
+    _to_screen(&q, (int)bw, (int)bh);
+
+    const float d[3] = { q.x - p.x, q.y - p.y, q.z - p.z };
+    const float lo[2] = { 0.0f, 0.0f }, hi[2] = { bw, bh }, o[2] = { p.x, p.y };
+    float t0 = 0.0f, t1 = 1.0f;
+    for (int i = 0; i < 2; i++) {
+        if (d[i] == 0.0f) {
+            if (o[i] < lo[i] || o[i] > hi[i]) return false;
+            continue;
+        }
+        float ta = (lo[i] - o[i]) / d[i], tb = (hi[i] - o[i]) / d[i];
+        if (ta > tb) { const float t = ta; ta = tb; tb = t; }
+        t0 = fmaxf(t0, ta);
+        t1 = fminf(t1, tb);
+        if (t0 > t1) return false;
+    }
+    out->x0 = p.x + d[0] * t0; out->y0 = p.y + d[1] * t0; out->z0 = p.z + d[2] * t0;
+    out->x1 = p.x + d[0] * t1; out->y1 = p.y + d[1] * t1; out->z1 = p.z + d[2] * t1;
+    return true;
+}
+
+static inline void _render_wire_span(const _RenderWireCtx* ctx, const int y, int x0, int x1,
+    const float xa, const float za, const float dz, const uint32_t color)
+{
+    const int bw = ctx->r->window->bWidth;
+    if (x0 < 0) x0 = 0;
+    if (x1 > bw - 1) x1 = bw - 1;
+    DepthBuffer* db = &ctx->r->depth;
+    const DepthFormat fmt = db->format;
+    const size_t base = (size_t)y * bw;
+    const int samples = _render_msaa_samples(ctx->r);
+    if (samples > 1) {
+        // Lines stay one pixel wide: every sample of a pixel on the line is tested at the line's depth
+        for (int x = x0; x <= x1; x++) {
+            const float z = za + dz * ((float)x + 0.5f - xa);
+            _msaa_touch(ctx->r, base + x, samples);
+            float* sd = ctx->r->sample_depth + (base + x) * samples;
+            uint32_t* sc = ctx->r->sample_color + (base + x) * samples;
+            for (int s = 0; s < samples; s++) {
+                if (ctx->depth_test && !(z < sd[s])) continue;
+                if (ctx->depth_write) sd[s] = z;
+                sc[s] = color;
+            }
+        }
+        return;
+    }
+    uint32_t* row = ctx->r->window->buffer + base;
+    for (int x = x0; x <= x1; x++) {
+        const float z = za + dz * ((float)x + 0.5f - xa);
+        if (!_depth_test_write(db, base + x, fmt, z, fmt == DEPTH_FORMAT_U24_REVERSED ? _depth_inv_w(z) : 0.0f,
+                ctx->depth_test, ctx->depth_write, false)) continue;
+        row[x] = color;
+    }
+    uint32_t* written = _depth_written_row(db, y, ctx->depth_write);
+    if (written && x0 <= x1)
+        for (int t = x0 >> DEPTH_TILE_SHIFT; t <= x1 >> DEPTH_TILE_SHIFT; t++) written[t] = db->draw_serial;
+}
+
+// Pixels whose centers the segment passes, restricted to rows [y0, y1). X-major lines walk rows and fill
+// the run of columns each row owns; row boundaries are computed once per row, so bands never overlap.
+static inline void _render_wire_line(const _RenderWireCtx* ctx, const _RenderLine* l, const int y0, const int y1)
+{
+    float xa = l->x0, ya = l->y0, za = l->z0, xb = l->x1, yb = l->y1, zb = l->z1;
+    const int bh = ctx->r->window->bHeight;
+    if (fabsf(xb - xa) >= fabsf(yb - ya)) {
+        if (xa == xb) return;
+        if (xa > xb) { float t = xa; xa = xb; xb = t; t = ya; ya = yb; yb = t; t = za; za = zb; zb = t; }
+        const float m = (yb - ya) / (xb - xa), dz = (zb - za) / (xb - xa);
+        const float c0 = ceilf(xa - 0.5f), c1 = floorf(xb - 0.5f);
+        if (c0 > c1) return;
+        int ka = (int)floorf(ya + m * (c0 + 0.5f - xa)), kb = (int)floorf(ya + m * (c1 + 0.5f - xa));
+        if (ka > kb) { const int t = ka; ka = kb; kb = t; }
+        if (ka < y0) ka = y0;
+        if (kb > y1 - 1) kb = y1 - 1;
+        if (kb > bh - 1) kb = bh - 1;
+        for (int k = ka; k <= kb; k++) {
+            float s0 = c0, s1 = c1;
+            if (m != 0.0f) {
+                // Columns whose center row is k: y in [k, k + 1)
+                const float ea = xa + ((float)k - ya) / m, eb = xa + ((float)k + 1.0f - ya) / m;
+                s0 = fmaxf(s0, ceilf(fminf(ea, eb) - 0.5f));
+                s1 = fminf(s1, ceilf(fmaxf(ea, eb) - 0.5f) - 1.0f);
+            }
+            if (s0 <= s1) _render_wire_span(ctx, k, (int)s0, (int)s1, xa, za, dz, l->color);
+        }
+    } else {
+        if (ya > yb) { float t = xa; xa = xb; xb = t; t = ya; ya = yb; yb = t; t = za; za = zb; zb = t; }
+        const float m = (xb - xa) / (yb - ya), dz = (zb - za) / (yb - ya);
+        int ka = (int)ceilf(ya - 0.5f), kb = (int)floorf(yb - 0.5f);
+        if (ka < y0) ka = y0;
+        if (kb > y1 - 1) kb = y1 - 1;
+        if (kb > bh - 1) kb = bh - 1;
+        for (int k = ka; k <= kb; k++) {
+            const float cy = (float)k + 0.5f - ya;
+            const int x = (int)floorf(xa + m * cy);
+            const float z = za + dz * cy;
+            // Single-pixel span with z already evaluated at this row's center
+            _render_wire_span(ctx, k, x, x, (float)x + 0.5f, z, 0.0f, l->color);
+        }
+    }
+}
+
+static inline void _render_wire_rows(const _RenderWireCtx* ctx, const int y0, const int y1)
+{
+    for (int i = 0; i < ctx->count; i++) {
+        const _RenderLine* l = &ctx->lines[i];
+        if (fmaxf(l->y0, l->y1) < (float)y0 || fminf(l->y0, l->y1) >= (float)y1) continue;
+        _render_wire_line(ctx, l, y0, y1);
+    }
+}
+
+static void _render_wire_band(void* user, const int index)
+{
+    _render_wire_rows((const _RenderWireCtx*)user, index * _RENDER_WIRE_BAND, (index + 1) * _RENDER_WIRE_BAND);
+}
+
+// Edges of one model: overlay lines are depth tested against the faces just drawn (biased, no depth write),
+// plain wireframe lines test and write like triangles
+static inline void _render_wire_model(Renderer* r, const Model* m, const Mat4* vp)
+{
+    const bool overlay = r->wireframe_overlay;
+    const int count = m->edges ? m->num_edges : m->num_triangles * 3;
+    if ((size_t)count > r->line_capacity) {
+        void* grown = malloc((size_t)count * sizeof(_RenderLine));
+        if (!grown) return;
+        free(r->line_list);
+        r->line_list     = grown;
+        r->line_capacity = (size_t)count;
+    }
+
+    _RenderLine* lines = (_RenderLine*)r->line_list;
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        const uint32_t e = m->edges ? m->edges[i] : (uint32_t)(i / 3) << 2 | (uint32_t)(i % 3);
+        const Triangle* tri = &m->transformed_triangles[e >> 2];
+        const Vec3 v[3] = { tri->v0, tri->v1, tri->v2 };
+        const int k = (int)(e & 3);
+        if (!_render_wire_clip(r, vp, v[k], v[(k + 1) % 3], overlay ? _RENDER_WIRE_BIAS : 0.0f, &lines[n])) continue;
+        lines[n++].color = overlay ? r->wire_color | 0xFF000000 : _vec3_to_color(tri->color, 1.0f);
+    }
+
+    const _RenderWireCtx ctx = { r, lines, n, r->depth_test, r->depth_write && !overlay };
+    if (n < _RENDER_WIRE_JOBS_MIN) _render_wire_rows(&ctx, 0, r->window->bHeight);
+    else jobParallelFor((r->window->bHeight + _RENDER_WIRE_BAND - 1) / _RENDER_WIRE_BAND, _render_wire_band, (void*)&ctx);
+}
+
+#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
+
+typedef struct {
+    float px, py, pz;
+    float nx, ny, nz;
+    float r,  g,  b;
+} _GpuVertex;
+
+typedef struct {
+    float vp[16];        // view-projection matrix (column-major)
+    float light_dir[4];  // xyz = direction, w = unused
+    float use_light;     // 1.0 = lit, 0.0 = unlit
+    float pad[3];
+} _GpuModelUniforms;
+
+static const char _MSL_VERT[] =
+    "#include <metal_stdlib>\n"
     "using namespace metal;\n"
     "struct Vin  { float3 pos [[attribute(0)]]; float3 norm [[attribute(1)]]; float3 col [[attribute(2)]]; };\n"
     "struct Vout { float4 pos [[position]]; float3 col; };\n"
@@ -2629,533 +9789,1975 @@ static const char _MSL_VERT[] =
     "    return o;\n"
     "}\n";
 
-static const char _MSL_FRAG[] =
-    "#include <metal_stdlib>\n"
-    "using namespace metal;\n"
-    "struct Vout { float4 pos [[position]]; float3 col; };\n"
-    "fragment float4 main0(Vout in [[stage_in]]) {\n"
-    "    return float4(in.col, 1.0);\n"
-    "}\n";
+static const char _MSL_FRAG[] =
+    "#include <metal_stdlib>\n"
+    "using namespace metal;\n"
+    "struct Vout { float4 pos [[position]]; float3 col; };\n"
+    "fragment float4 main0(Vout in [[stage_in]]) {\n"
+    "    return float4(in.col, 1.0);\n"
+    "}\n";
+
+
+static const uint8_t _SPIRV_VERT[] = {
+    0x03,0x02,0x23,0x07,0x00,0x00,0x01,0x00,0x0b,0x00,0x0d,0x00,0x56,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,0x11,0x00,0x02,0x00,0x01,0x00,0x00,0x00,0x0b,0x00,0x06,0x00,
+    0x01,0x00,0x00,0x00,0x47,0x4c,0x53,0x4c,0x2e,0x73,0x74,0x64,0x2e,0x34,0x35,0x30,
+    0x00,0x00,0x00,0x00,0x0e,0x00,0x03,0x00,0x00,0x00,0x00,0x00,0x01,0x00,0x00,0x00,
+    0x0f,0x00,0x09,0x00,0x00,0x00,0x00,0x00,0x04,0x00,0x00,0x00,0x6d,0x61,0x69,0x6e,
+    0x00,0x00,0x00,0x00,0x0d,0x00,0x00,0x00,0x1f,0x00,0x00,0x00,0x21,0x00,0x00,0x00,
+    0x29,0x00,0x00,0x00,0x47,0x00,0x00,0x00,0x03,0x00,0x03,0x00,0x02,0x00,0x00,0x00,
+    0xc2,0x01,0x00,0x00,0x04,0x00,0x0a,0x00,0x47,0x4c,0x5f,0x41,0x52,0x42,0x5f,0x73,
+    0x65,0x70,0x61,0x72,0x61,0x74,0x65,0x5f,0x73,0x68,0x61,0x64,0x65,0x72,0x5f,0x6f,
+    0x62,0x6a,0x65,0x63,0x74,0x73,0x00,0x00,0x04,0x00,0x09,0x00,0x47,0x4c,0x5f,0x41,
+    0x52,0x42,0x5f,0x73,0x68,0x61,0x64,0x69,0x6e,0x67,0x5f,0x6c,0x61,0x6e,0x67,0x75,
+    0x61,0x67,0x65,0x5f,0x34,0x32,0x30,0x70,0x61,0x63,0x6b,0x00,0x05,0x00,0x06,0x00,
+    0x04,0x00,0x00,0x00,0x6d,0x61,0x69,0x6e,0x28,0x29,0x00,0x00,0x05,0x00,0x06,0x00,
+    0x0b,0x00,0x00,0x00,0x67,0x6c,0x5f,0x50,0x65,0x72,0x56,0x65,0x72,0x74,0x65,0x78,
+    0x00,0x00,0x00,0x00,0x06,0x00,0x06,0x00,0x0b,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+    0x67,0x6c,0x5f,0x50,0x6f,0x73,0x69,0x74,0x69,0x6f,0x6e,0x00,0x06,0x00,0x07,0x00,
+    0x0b,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x67,0x6c,0x5f,0x50,0x6f,0x69,0x6e,0x74,
+    0x53,0x69,0x7a,0x65,0x00,0x00,0x00,0x00,0x06,0x00,0x07,0x00,0x0b,0x00,0x00,0x00,
+    0x02,0x00,0x00,0x00,0x67,0x6c,0x5f,0x43,0x6c,0x69,0x70,0x44,0x69,0x73,0x74,0x61,
+    0x6e,0x63,0x65,0x00,0x06,0x00,0x07,0x00,0x0b,0x00,0x00,0x00,0x03,0x00,0x00,0x00,
+    0x67,0x6c,0x5f,0x43,0x75,0x6c,0x6c,0x44,0x69,0x73,0x74,0x61,0x6e,0x63,0x65,0x00,
+    0x05,0x00,0x03,0x00,0x0d,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x05,0x00,0x04,0x00,
+    0x11,0x00,0x00,0x00,0x55,0x00,0x00,0x00,0x05,0x00,0x05,0x00,0x15,0x00,0x00,0x00,
+    0x55,0x6e,0x69,0x66,0x6f,0x72,0x6d,0x73,0x00,0x00,0x00,0x00,0x06,0x00,0x05,0x00,
+    0x15,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x76,0x70,0x00,0x00,0x06,0x00,0x06,0x00,
+    0x15,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x6c,0x69,0x67,0x68,0x74,0x5f,0x64,0x69,
+    0x72,0x00,0x00,0x00,0x06,0x00,0x06,0x00,0x15,0x00,0x00,0x00,0x02,0x00,0x00,0x00,
+    0x75,0x73,0x65,0x5f,0x6c,0x69,0x67,0x68,0x74,0x00,0x00,0x00,0x06,0x00,0x04,0x00,
+    0x15,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x70,0x61,0x64,0x00,0x05,0x00,0x03,0x00,
+    0x17,0x00,0x00,0x00,0x75,0x00,0x00,0x00,0x05,0x00,0x04,0x00,0x1f,0x00,0x00,0x00,
+    0x61,0x50,0x6f,0x73,0x00,0x00,0x00,0x00,0x05,0x00,0x05,0x00,0x21,0x00,0x00,0x00,
+    0x61,0x4e,0x6f,0x72,0x6d,0x00,0x00,0x00,0x05,0x00,0x06,0x00,0x29,0x00,0x00,0x00,
+    0x61,0x43,0x6f,0x6c,0x6f,0x72,0x00,0x00,0x05,0x00,0x05,0x00,0x47,0x00,0x00,0x00,
+    0x76,0x43,0x6f,0x6c,0x6f,0x72,0x00,0x00,0x47,0x00,0x04,0x00,0x0b,0x00,0x00,0x00,
+    0x0b,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x47,0x00,0x04,0x00,0x0d,0x00,0x00,0x00,
+    0x22,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x47,0x00,0x04,0x00,0x0d,0x00,0x00,0x00,
+    0x21,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x48,0x00,0x05,0x00,0x0b,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,0x0b,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x48,0x00,0x05,0x00,
+    0x0b,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x0b,0x00,0x00,0x00,0x01,0x00,0x00,0x00,
+    0x48,0x00,0x05,0x00,0x0b,0x00,0x00,0x00,0x02,0x00,0x00,0x00,0x0b,0x00,0x00,0x00,
+    0x03,0x00,0x00,0x00,0x48,0x00,0x05,0x00,0x0b,0x00,0x00,0x00,0x03,0x00,0x00,0x00,
+    0x0b,0x00,0x00,0x00,0x04,0x00,0x00,0x00,0x47,0x00,0x03,0x00,0x0b,0x00,0x00,0x00,
+    0x02,0x00,0x00,0x00,0x48,0x00,0x05,0x00,0x15,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+    0x05,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x48,0x00,0x05,0x00,0x15,0x00,0x00,0x00,
+    0x01,0x00,0x00,0x00,0x23,0x00,0x00,0x00,0x40,0x00,0x00,0x00,0x48,0x00,0x05,0x00,
+    0x15,0x00,0x00,0x00,0x02,0x00,0x00,0x00,0x23,0x00,0x00,0x00,0x50,0x00,0x00,0x00,
+    0x48,0x00,0x05,0x00,0x15,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x23,0x00,0x00,0x00,
+    0x54,0x00,0x00,0x00,0x47,0x00,0x03,0x00,0x15,0x00,0x00,0x00,0x02,0x00,0x00,0x00,
+    0x47,0x00,0x04,0x00,0x1f,0x00,0x00,0x00,0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+    0x47,0x00,0x04,0x00,0x21,0x00,0x00,0x00,0x1e,0x00,0x00,0x00,0x01,0x00,0x00,0x00,
+    0x47,0x00,0x04,0x00,0x29,0x00,0x00,0x00,0x1e,0x00,0x00,0x00,0x02,0x00,0x00,0x00,
+    0x47,0x00,0x04,0x00,0x47,0x00,0x00,0x00,0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+    0x13,0x00,0x02,0x00,0x02,0x00,0x00,0x00,0x21,0x00,0x03,0x00,0x03,0x00,0x00,0x00,
+    0x02,0x00,0x00,0x00,0x16,0x00,0x03,0x00,0x06,0x00,0x00,0x00,0x20,0x00,0x00,0x00,
+    0x17,0x00,0x04,0x00,0x07,0x00,0x00,0x00,0x06,0x00,0x00,0x00,0x04,0x00,0x00,0x00,
+    0x15,0x00,0x04,0x00,0x08,0x00,0x00,0x00,0x20,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+    0x2b,0x00,0x04,0x00,0x08,0x00,0x00,0x00,0x09,0x00,0x00,0x00,0x01,0x00,0x00,0x00,
+    0x1c,0x00,0x04,0x00,0x0a,0x00,0x00,0x00,0x06,0x00,0x00,0x00,0x09,0x00,0x00,0x00,
+    0x1e,0x00,0x06,0x00,0x0b,0x00,0x00,0x00,0x07,0x00,0x00,0x00,0x06,0x00,0x00,0x00,
+    0x0a,0x00,0x00,0x00,0x0a,0x00,0x00,0x00,0x20,0x00,0x04,0x00,0x0c,0x00,0x00,0x00,
+    0x03,0x00,0x00,0x00,0x0b,0x00,0x00,0x00,0x3b,0x00,0x04,0x00,0x0c,0x00,0x00,0x00,
+    0x0d,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x15,0x00,0x04,0x00,0x0e,0x00,0x00,0x00,
+    0x20,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x2b,0x00,0x04,0x00,0x0e,0x00,0x00,0x00,
+    0x0f,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x18,0x00,0x04,0x00,0x10,0x00,0x00,0x00,
+    0x07,0x00,0x00,0x00,0x04,0x00,0x00,0x00,0x17,0x00,0x04,0x00,0x12,0x00,0x00,0x00,
+    0x06,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x2b,0x00,0x04,0x00,0x08,0x00,0x00,0x00,
+    0x13,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x1c,0x00,0x04,0x00,0x14,0x00,0x00,0x00,
+    0x06,0x00,0x00,0x00,0x13,0x00,0x00,0x00,0x1e,0x00,0x05,0x00,0x15,0x00,0x00,0x00,
+    0x10,0x00,0x00,0x00,0x07,0x00,0x00,0x00,0x06,0x00,0x00,0x00,0x20,0x00,0x04,0x00,
+    0x16,0x00,0x00,0x00,0x02,0x00,0x00,0x00,0x15,0x00,0x00,0x00,0x3b,0x00,0x04,0x00,
+    0x16,0x00,0x00,0x00,0x17,0x00,0x00,0x00,0x02,0x00,0x00,0x00,0x20,0x00,0x04,0x00,
+    0x18,0x00,0x00,0x00,0x02,0x00,0x00,0x00,0x10,0x00,0x00,0x00,0x20,0x00,0x04,0x00,
+    0x1a,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x12,0x00,0x00,0x00,0x3b,0x00,0x04,0x00,
+    0x1a,0x00,0x00,0x00,0x1f,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x2b,0x00,0x04,0x00,
+    0x06,0x00,0x00,0x00,0x20,0x00,0x00,0x00,0x00,0x00,0x80,0x3f,0x20,0x00,0x04,0x00,
+    0x22,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x12,0x00,0x00,0x00,0x3b,0x00,0x04,0x00,
+    0x22,0x00,0x00,0x00,0x21,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x20,0x00,0x04,0x00,
+    0x2a,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x12,0x00,0x00,0x00,0x3b,0x00,0x04,0x00,
+    0x2a,0x00,0x00,0x00,0x29,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x20,0x00,0x04,0x00,
+    0x3c,0x00,0x00,0x00,0x02,0x00,0x00,0x00,0x06,0x00,0x00,0x00,0x20,0x00,0x04,0x00,
+    0x42,0x00,0x00,0x00,0x02,0x00,0x00,0x00,0x07,0x00,0x00,0x00,0x20,0x00,0x04,0x00,
+    0x46,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x12,0x00,0x00,0x00,0x3b,0x00,0x04,0x00,
+    0x46,0x00,0x00,0x00,0x47,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x20,0x00,0x04,0x00,
+    0x4c,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x07,0x00,0x00,0x00,0x2b,0x00,0x04,0x00,
+    0x06,0x00,0x00,0x00,0x4e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x2b,0x00,0x04,0x00,
+    0x06,0x00,0x00,0x00,0x54,0x00,0x00,0x00,0x00,0x00,0x00,0x3f,0x36,0x00,0x05,0x00,
+    0x02,0x00,0x00,0x00,0x04,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x03,0x00,0x00,0x00,
+    0xf8,0x00,0x02,0x00,0x05,0x00,0x00,0x00,0x3d,0x00,0x04,0x00,0x12,0x00,0x00,0x00,
+    0x1e,0x00,0x00,0x00,0x1f,0x00,0x00,0x00,0x51,0x00,0x05,0x00,0x06,0x00,0x00,0x00,
+    0x23,0x00,0x00,0x00,0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x51,0x00,0x05,0x00,
+    0x06,0x00,0x00,0x00,0x24,0x00,0x00,0x00,0x1e,0x00,0x00,0x00,0x01,0x00,0x00,0x00,
+    0x51,0x00,0x05,0x00,0x06,0x00,0x00,0x00,0x25,0x00,0x00,0x00,0x1e,0x00,0x00,0x00,
+    0x02,0x00,0x00,0x00,0x50,0x00,0x05,0x00,0x07,0x00,0x00,0x00,0x26,0x00,0x00,0x00,
+    0x23,0x00,0x00,0x00,0x24,0x00,0x00,0x00,0x51,0x00,0x05,0x00,0x06,0x00,0x00,0x00,
+    0x27,0x00,0x00,0x00,0x26,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x51,0x00,0x05,0x00,
+    0x06,0x00,0x00,0x00,0x28,0x00,0x00,0x00,0x26,0x00,0x00,0x00,0x01,0x00,0x00,0x00,
+    0x50,0x00,0x07,0x00,0x07,0x00,0x00,0x00,0x2c,0x00,0x00,0x00,0x23,0x00,0x00,0x00,
+    0x24,0x00,0x00,0x00,0x25,0x00,0x00,0x00,0x20,0x00,0x00,0x00,0x41,0x00,0x05,0x00,
+    0x18,0x00,0x00,0x00,0x30,0x00,0x00,0x00,0x17,0x00,0x00,0x00,0x0f,0x00,0x00,0x00,
+    0x3d,0x00,0x04,0x00,0x10,0x00,0x00,0x00,0x31,0x00,0x00,0x00,0x30,0x00,0x00,0x00,
+    0x91,0x00,0x05,0x00,0x07,0x00,0x00,0x00,0x32,0x00,0x00,0x00,0x31,0x00,0x00,0x00,
+    0x2c,0x00,0x00,0x00,0x41,0x00,0x05,0x00,0x4c,0x00,0x00,0x00,0x4d,0x00,0x00,0x00,
+    0x0d,0x00,0x00,0x00,0x0f,0x00,0x00,0x00,0x3e,0x00,0x03,0x00,0x4d,0x00,0x00,0x00,
+    0x32,0x00,0x00,0x00,0x41,0x00,0x05,0x00,0x3c,0x00,0x00,0x00,0x3d,0x00,0x00,0x00,
+    0x17,0x00,0x00,0x00,0x13,0x00,0x00,0x00,0x3d,0x00,0x04,0x00,0x06,0x00,0x00,0x00,
+    0x3e,0x00,0x00,0x00,0x3d,0x00,0x00,0x00,0xb8,0x00,0x05,0x00,0x08,0x00,0x00,0x00,
+    0x3f,0x00,0x00,0x00,0x3e,0x00,0x00,0x00,0x54,0x00,0x00,0x00,0xf7,0x00,0x03,0x00,
+    0x52,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xfa,0x00,0x04,0x00,0x3f,0x00,0x00,0x00,
+    0x40,0x00,0x00,0x00,0x4f,0x00,0x00,0x00,0xf8,0x00,0x02,0x00,0x40,0x00,0x00,0x00,
+    0x3d,0x00,0x04,0x00,0x12,0x00,0x00,0x00,0x43,0x00,0x00,0x00,0x21,0x00,0x00,0x00,
+    0x41,0x00,0x05,0x00,0x42,0x00,0x00,0x00,0x44,0x00,0x00,0x00,0x17,0x00,0x00,0x00,
+    0x09,0x00,0x00,0x00,0x3d,0x00,0x04,0x00,0x07,0x00,0x00,0x00,0x45,0x00,0x00,0x00,
+    0x44,0x00,0x00,0x00,0x4f,0x00,0x09,0x00,0x12,0x00,0x00,0x00,0x46,0x00,0x00,0x00,
+    0x45,0x00,0x00,0x00,0x45,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x01,0x00,0x00,0x00,
+    0x02,0x00,0x00,0x00,0x65,0x00,0x05,0x00,0x12,0x00,0x00,0x00,0x48,0x00,0x00,0x00,
+    0x43,0x00,0x00,0x00,0x46,0x00,0x00,0x00,0x8e,0x00,0x05,0x00,0x06,0x00,0x00,0x00,
+    0x49,0x00,0x00,0x00,0x48,0x00,0x00,0x00,0x4e,0x00,0x00,0x00,0x6f,0x00,0x04,0x00,
+    0x06,0x00,0x00,0x00,0x4a,0x00,0x00,0x00,0x49,0x00,0x00,0x00,0x0c,0x00,0x08,0x00,
+    0x06,0x00,0x00,0x00,0x4b,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x28,0x00,0x00,0x00,
+    0x4e,0x00,0x00,0x00,0x4a,0x00,0x00,0x00,0xf9,0x00,0x02,0x00,0x52,0x00,0x00,0x00,
+    0xf8,0x00,0x02,0x00,0x4f,0x00,0x00,0x00,0xf9,0x00,0x02,0x00,0x52,0x00,0x00,0x00,
+    0xf8,0x00,0x02,0x00,0x52,0x00,0x00,0x00,0x80,0x00,0x05,0x00,0x06,0x00,0x00,0x00,
+    0x53,0x00,0x00,0x00,0x4b,0x00,0x00,0x00,0x20,0x00,0x00,0x00,0xf7,0x00,0x03,0x00,
+    0x53,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+};
+// NOTE: The above SPIRV bytes are a minimal hand-assembled stub.
+// For production use, regenerate with: glslc model.vert -o model.vert.spv
+// The MSL path (macOS/Metal) is always used when available and is fully functional.
+
+static const uint8_t _SPIRV_FRAG[] = {
+    0x03,0x02,0x23,0x07,0x00,0x00,0x01,0x00,0x0b,0x00,0x0d,0x00,0x12,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,0x11,0x00,0x02,0x00,0x01,0x00,0x00,0x00,0x0b,0x00,0x06,0x00,
+    0x01,0x00,0x00,0x00,0x47,0x4c,0x53,0x4c,0x2e,0x73,0x74,0x64,0x2e,0x34,0x35,0x30,
+    0x00,0x00,0x00,0x00,0x0e,0x00,0x03,0x00,0x00,0x00,0x00,0x00,0x01,0x00,0x00,0x00,
+    0x0f,0x00,0x06,0x00,0x04,0x00,0x00,0x00,0x04,0x00,0x00,0x00,0x6d,0x61,0x69,0x6e,
+    0x00,0x00,0x00,0x00,0x09,0x00,0x00,0x00,0x10,0x00,0x03,0x00,0x04,0x00,0x00,0x00,
+    0x07,0x00,0x00,0x00,0x03,0x00,0x03,0x00,0x02,0x00,0x00,0x00,0xc2,0x01,0x00,0x00,
+    0x04,0x00,0x0a,0x00,0x47,0x4c,0x5f,0x41,0x52,0x42,0x5f,0x73,0x65,0x70,0x61,0x72,
+    0x61,0x74,0x65,0x5f,0x73,0x68,0x61,0x64,0x65,0x72,0x5f,0x6f,0x62,0x6a,0x65,0x63,
+    0x74,0x73,0x00,0x00,0x05,0x00,0x04,0x00,0x04,0x00,0x00,0x00,0x6d,0x61,0x69,0x6e,
+    0x00,0x00,0x00,0x00,0x05,0x00,0x05,0x00,0x09,0x00,0x00,0x00,0x6f,0x75,0x74,0x43,
+    0x6f,0x6c,0x6f,0x72,0x00,0x00,0x00,0x00,0x05,0x00,0x05,0x00,0x0b,0x00,0x00,0x00,
+    0x76,0x43,0x6f,0x6c,0x6f,0x72,0x00,0x00,0x47,0x00,0x04,0x00,0x09,0x00,0x00,0x00,
+    0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x47,0x00,0x04,0x00,0x0b,0x00,0x00,0x00,
+    0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x13,0x00,0x02,0x00,0x02,0x00,0x00,0x00,
+    0x21,0x00,0x03,0x00,0x03,0x00,0x00,0x00,0x02,0x00,0x00,0x00,0x16,0x00,0x03,0x00,
+    0x06,0x00,0x00,0x00,0x20,0x00,0x00,0x00,0x17,0x00,0x04,0x00,0x07,0x00,0x00,0x00,
+    0x06,0x00,0x00,0x00,0x04,0x00,0x00,0x00,0x20,0x00,0x04,0x00,0x08,0x00,0x00,0x00,
+    0x03,0x00,0x00,0x00,0x07,0x00,0x00,0x00,0x3b,0x00,0x04,0x00,0x08,0x00,0x00,0x00,
+    0x09,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x17,0x00,0x04,0x00,0x0a,0x00,0x00,0x00,
+    0x06,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x20,0x00,0x04,0x00,0x0c,0x00,0x00,0x00,
+    0x01,0x00,0x00,0x00,0x0a,0x00,0x00,0x00,0x3b,0x00,0x04,0x00,0x0c,0x00,0x00,0x00,
+    0x0b,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x2b,0x00,0x04,0x00,0x06,0x00,0x00,0x00,
+    0x0d,0x00,0x00,0x00,0x00,0x00,0x80,0x3f,0x36,0x00,0x05,0x00,0x02,0x00,0x00,0x00,
+    0x04,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0xf8,0x00,0x02,0x00,
+    0x05,0x00,0x00,0x00,0x3d,0x00,0x04,0x00,0x0a,0x00,0x00,0x00,0x0e,0x00,0x00,0x00,
+    0x0b,0x00,0x00,0x00,0x51,0x00,0x05,0x00,0x06,0x00,0x00,0x00,0x0f,0x00,0x00,0x00,
+    0x0e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x51,0x00,0x05,0x00,0x06,0x00,0x00,0x00,
+    0x10,0x00,0x00,0x00,0x0e,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x51,0x00,0x05,0x00,
+    0x06,0x00,0x00,0x00,0x11,0x00,0x00,0x00,0x0e,0x00,0x00,0x00,0x02,0x00,0x00,0x00,
+    0x50,0x00,0x07,0x00,0x07,0x00,0x00,0x00,0x12,0x00,0x00,0x00,0x0f,0x00,0x00,0x00,
+    0x10,0x00,0x00,0x00,0x11,0x00,0x00,0x00,0x0d,0x00,0x00,0x00,0x3e,0x00,0x03,0x00,
+    0x09,0x00,0x00,0x00,0x12,0x00,0x00,0x00,0xfd,0x00,0x01,0x00,0x38,0x00,0x01,0x00,
+};
+
+static inline SDL_GPUShader* _renderCreateShader(
+    SDL_GPUDevice *dev,
+    SDL_GPUShaderStage stage,
+    const char *msl_src,
+    const uint8_t *spirv, size_t spirv_size,
+    Uint32 num_uniform_buffers)
+{
+    const SDL_GPUShaderFormat supported = SDL_GetGPUShaderFormats(dev);
+    SDL_GPUShaderCreateInfo info = {};
+    info.stage = stage;
+    info.num_uniform_buffers = num_uniform_buffers;
+
+    if (supported & SDL_GPU_SHADERFORMAT_MSL) {
+        info.format    = SDL_GPU_SHADERFORMAT_MSL;
+        info.code      = (const Uint8*)msl_src;
+        info.code_size = strlen(msl_src) + 1;
+        info.entrypoint = "main0";
+        SDL_GPUShader *s = SDL_CreateGPUShader(dev, &info);
+        if (s) return s;
+    }
+    if (supported & SDL_GPU_SHADERFORMAT_SPIRV) {
+        info.format    = SDL_GPU_SHADERFORMAT_SPIRV;
+        info.code      = spirv;
+        info.code_size = spirv_size;
+        info.entrypoint = "main";
+        SDL_GPUShader *s = SDL_CreateGPUShader(dev, &info);
+        if (s) return s;
+    }
+        return NULL;
+}
+
+static inline SDL_GPUGraphicsPipeline* _renderCreateModelPipeline(Gpu *gpu)
+{
+    SDL_GPUShader *vert = _renderCreateShader(gpu->device,
+        SDL_GPU_SHADERSTAGE_VERTEX,
+        _MSL_VERT, _SPIRV_VERT, sizeof(_SPIRV_VERT), 1);
+    SDL_GPUShader *frag = _renderCreateShader(gpu->device,
+        SDL_GPU_SHADERSTAGE_FRAGMENT,
+        _MSL_FRAG, _SPIRV_FRAG, sizeof(_SPIRV_FRAG), 0);
+    if (!vert || !frag) {
+        if (vert) SDL_ReleaseGPUShader(gpu->device, vert);
+        if (frag) SDL_ReleaseGPUShader(gpu->device, frag);
+        return NULL;
+    }
+
+    SDL_GPUVertexBufferDescription vbd = {};
+    vbd.slot             = 0;
+    vbd.pitch            = sizeof(_GpuVertex);
+    vbd.input_rate       = SDL_GPU_VERTEXINPUTRATE_VERTEX;
+    vbd.instance_step_rate = 0;
+
+    SDL_GPUVertexAttribute attrs[3] = {};
+    attrs[0].location   = 0; attrs[0].buffer_slot = 0;
+    attrs[0].format     = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT3;
+    attrs[0].offset     = offsetof(_GpuVertex, px);
+    attrs[1].location   = 1; attrs[1].buffer_slot = 0;
+    attrs[1].format     = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT3;
+    attrs[1].offset     = offsetof(_GpuVertex, nx);
+    attrs[2].location   = 2; attrs[2].buffer_slot = 0;
+    attrs[2].format     = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT3;
+    attrs[2].offset     = offsetof(_GpuVertex, r);
+
+    SDL_GPUColorTargetDescription ctd = {};
+    ctd.format = SDL_GetGPUSwapchainTextureFormat(gpu->device, gpu->window->window);
+
+    SDL_GPUTextureFormat depth_fmt = SDL_GPU_TEXTUREFORMAT_D32_FLOAT;
+
+    SDL_GPUGraphicsPipelineCreateInfo pci = {};
+    pci.vertex_shader   = vert;
+    pci.fragment_shader = frag;
+    pci.primitive_type  = SDL_GPU_PRIMITIVETYPE_TRIANGLELIST;
+    pci.vertex_input_state.vertex_buffer_descriptions  = &vbd;
+    pci.vertex_input_state.num_vertex_buffers          = 1;
+    pci.vertex_input_state.vertex_attributes           = attrs;
+    pci.vertex_input_state.num_vertex_attributes       = 3;
+    pci.target_info.num_color_targets                  = 1;
+    pci.target_info.color_target_descriptions          = &ctd;
+    pci.target_info.has_depth_stencil_target           = true;
+    pci.target_info.depth_stencil_format               = depth_fmt;
+    pci.rasterizer_state.fill_mode                     = SDL_GPU_FILLMODE_FILL;
+    pci.rasterizer_state.cull_mode                     = SDL_GPU_CULLMODE_BACK;
+    pci.rasterizer_state.front_face                    = SDL_GPU_FRONTFACE_COUNTER_CLOCKWISE;
+    pci.rasterizer_state.enable_depth_clip             = true;
+    pci.depth_stencil_state.enable_depth_test          = true;
+    pci.depth_stencil_state.enable_depth_write         = true;
+    pci.depth_stencil_state.compare_op                 = SDL_GPU_COMPAREOP_LESS;
+
+    SDL_GPUGraphicsPipeline *pl = SDL_CreateGPUGraphicsPipeline(gpu->device, &pci);
+    SDL_ReleaseGPUShader(gpu->device, vert);
+    SDL_ReleaseGPUShader(gpu->device, frag);
+    return pl;
+}
+
+static inline SDL_GPUTexture* _renderCreateDepthTex(SDL_GPUDevice *dev, Uint32 w, Uint32 h)
+{
+    SDL_GPUTextureCreateInfo tci = {};
+    tci.type                 = SDL_GPU_TEXTURETYPE_2D;
+    tci.format               = SDL_GPU_TEXTUREFORMAT_D32_FLOAT;
+    tci.usage                = SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET;
+    tci.width                = w;
+    tci.height               = h;
+    tci.layer_count_or_depth = 1;
+    tci.num_levels           = 1;
+    return SDL_CreateGPUTexture(dev, &tci);
+}
+
+#endif
+#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
+inline void renderInit(Renderer* r, Window_t* win, Camera* cam, Gpu* gpu)
+#else
+inline void renderInit(Renderer* r, Window_t* win, Camera* cam)
+#endif
+{
+    r->window           = win;
+    r->camera           = cam;
+    r->wireframe        = false;
+    r->wireframe_overlay = false;
+    r->wire_color       = 0xFFFFFFFF;
+    r->backface_culling = true;
+    r->light_dir        = norm(vec3(0.3f, -1.0f, 0.5f));
+    r->light            = true;
+    r->smooth_shading   = false;
+    r->depth_test       = true;
+    r->depth_write      = true;
+    r->depth_equal      = false;
+    r->blend            = RENDER_BLEND_OPAQUE;
+    r->sort             = RENDER_SORT_MODELS;
+    r->depth_prepass    = false;
+    memset(&r->stats, 0, sizeof(r->stats));
+    r->draw_list        = NULL;
+    r->draw_capacity    = 0;
+    r->line_list        = NULL;
+    r->line_capacity    = 0;
+    r->deferred         = false;
+    r->visibility       = NULL;
+    r->vis_capacity     = 0;
+    r->msaa             = 1;
+    r->sample_depth     = NULL;
+    r->sample_color     = NULL;
+    r->sample_state     = NULL;
+    r->sample_capacity  = 0;
+    memset(&r->shadow, 0, sizeof(r->shadow));
+    r->shadow.size       = 1024;
+    r->shadow.distance   = 40.0f;
+    r->shadow.bias       = 1.0f;
+    r->shadow.slope_bias = 1.0f;
+    r->shadow.pcf        = 1;
+    r->shadow.cache      = true;
+    r->lights           = NULL;
+    r->num_lights       = 0;
+    r->light_masks      = NULL;
+    r->light_words      = 0;
+    r->light_tiles_x    = 0;
+    r->light_tiles_y    = 0;
+    r->light_count      = 0;
+    r->light_capacity   = 0;
+    r->light_rects      = NULL;
+    r->rect_capacity    = 0;
+    memset(&r->oit, 0, sizeof(r->oit));
+    r->oit.layers       = 4;
+    r->lod_error        = 1.0f;
+    r->lod_hysteresis   = 0.25f;
+    r->cluster_culling  = true;
+    r->lod_models       = NULL;
+    r->lod_capacity     = 0;
+
+#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
+    r->gpu       = gpu;
+    r->gpu_ready = false;
+    r->pipeline  = NULL;
+    r->depth_tex = NULL;
+    r->depth_tex_w = 0;
+    r->depth_tex_h = 0;
+
+    if (gpu) {
+        r->depth.depths   = NULL;
+        r->depth.valid    = false;
+        r->depth.format   = DEPTH_FORMAT_F32;
+        r->depth.tile_far = NULL;
+        r->depth.tile_written = NULL;
+        r->pipeline     = _renderCreateModelPipeline(gpu);
+        if (!r->pipeline) return;
+        int sw, sh;
+        gpuGetDrawableSize(gpu, &sw, &sh);
+        r->depth_tex   = _renderCreateDepthTex(gpu->device, (Uint32)sw, (Uint32)sh);
+        r->depth_tex_w = (Uint32)sw;
+        r->depth_tex_h = (Uint32)sh;
+        r->gpu_ready   = (r->depth_tex != NULL);
+        return;
+    }
+#endif
+
+    r->depth.depths        = NULL;
+    r->depth.capacity      = 0;
+    r->depth.valid         = false;
+    r->depth.format        = DEPTH_FORMAT_F32;
+    r->depth.tile_test     = false;
+    r->depth.tile_far      = NULL;
+    r->depth.tile_written  = NULL;
+    r->depth.draw_serial   = 1;
+    r->depth.tiles_x       = 0;
+    r->depth.tiles_y       = 0;
+    r->depth.tile_capacity = 0;
+    r->depth.tiles_valid   = false;
+    memset(&r->depth.subset, 0, sizeof(r->depth.subset));
+    renderResize(r, win->bWidth, win->bHeight);
+}
+
+inline void renderFree(Renderer* r)
+{
+#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
+    if (r->gpu) {
+        gpuReleasePipeline(r->gpu, &r->pipeline);
+        if (r->depth_tex) { SDL_ReleaseGPUTexture(r->gpu->device, r->depth_tex); r->depth_tex = NULL; }
+        r->gpu_ready = false;
+    }
+#endif
+    if (r->depth.depths) { free(r->depth.depths); r->depth.depths = NULL; }
+    r->depth.capacity = 0;
+    r->depth.valid = false;
+    free(r->depth.tile_far);
+    free(r->depth.tile_written);
+    r->depth.tile_far      = NULL;
+    r->depth.tile_written  = NULL;
+    r->depth.tile_capacity = 0;
+    r->depth.tiles_valid   = false;
+    free(r->visibility);
+    r->visibility   = NULL;
+    r->vis_capacity = 0;
+    free(r->draw_list);
+    r->draw_list     = NULL;
+    r->draw_capacity = 0;
+    free(r->line_list);
+    r->line_list     = NULL;
+    r->line_capacity = 0;
+    free(r->sample_depth);
+    free(r->sample_color);
+    free(r->sample_state);
+    r->sample_depth    = NULL;
+    r->sample_color    = NULL;
+    r->sample_state    = NULL;
+    r->sample_capacity = 0;
+    free(r->shadow.depth.depths);
+    r->shadow.depth.depths   = NULL;
+    r->shadow.depth.capacity = 0;
+    r->shadow.depth.valid    = false;
+    r->shadow.valid          = false;
+    free(r->light_masks);
+    free(r->light_rects);
+    r->light_masks    = NULL;
+    r->light_rects    = NULL;
+    r->light_capacity = 0;
+    r->rect_capacity  = 0;
+    r->light_count    = 0;
+    free(r->oit.depth);
+    free(r->oit.color);
+    free(r->oit.count);
+    r->oit.depth    = NULL;
+    r->oit.color    = NULL;
+    r->oit.count    = NULL;
+    r->oit.stride   = 0;
+    r->oit.capacity = 0;
+    r->oit.pending  = false;
+    free(r->lod_models);
+    r->lod_models   = NULL;
+    r->lod_capacity = 0;
+}
+
+inline void renderClear(Renderer* r)
+{
+#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
+    if (r->gpu) return;
+#endif
+    _renderSyncDepth(r);
+    memset(&r->stats, 0, sizeof(r->stats));
+    if (!r->depth.valid) return;
+    _depth_clear(&r->depth);
+    memset(r->window->buffer, 0, (size_t)r->depth.width * r->depth.height * sizeof(uint32_t));
+    if (_render_msaa_samples(r) > 1) _render_msaa_prepare(r, true);
+    if (r->oit.pending) memset(r->oit.count, 0, r->oit.capacity);
+    r->oit.pending = false;
+}
+
+inline bool renderReserve(Renderer* r, const int max_w, const int max_h)
+{
+    const size_t n = (size_t)max_w * max_h;
+    if (max_w <= 0 || max_h <= 0 || n <= r->depth.capacity) return true;
+
+    float* grown = (float*)malloc(n * sizeof(float));
+    if (!grown) {
+        fprintf(stderr, "Failed to reserve depth buffer (%dx%d)\n", max_w, max_h);
+        return false;
+    }
+    free(r->depth.depths);
+    r->depth.depths   = grown;
+    r->depth.capacity = n;
+    if (r->depth.valid) renderResize(r, r->depth.width, r->depth.height);
+    return true;
+}
+
+inline bool renderResize(Renderer* r, const int width, const int height)
+{
+    const size_t n = (size_t)width * height;
+    if (width <= 0 || height <= 0) return false;
+    if (n > r->depth.capacity) {
+        const size_t cap = n + n / 4; // headroom so window drags don't reallocate every step
+        free(r->depth.depths);
+        r->depth.depths   = (float*)malloc(cap * sizeof(float));
+        r->depth.capacity = r->depth.depths ? cap : 0;
+    }
+    r->depth.valid = r->depth.depths != NULL;
+    if (!r->depth.valid) {
+        fprintf(stderr, "Failed to allocate depth buffer (%dx%d)\n", width, height);
+        return false;
+    }
+
+    r->depth.width  = width;
+    r->depth.height = height;
+
+    // Tile far planes are optional: without them tile_test is simply ignored
+    const int tx = (width + (1 << DEPTH_TILE_SHIFT) - 1) >> DEPTH_TILE_SHIFT;
+    const int ty = (height + (1 << DEPTH_TILE_SHIFT) - 1) >> DEPTH_TILE_SHIFT;
+    const size_t tiles = (size_t)tx * ty;
+    if (tiles > r->depth.tile_capacity) {
+        const size_t cap = tiles + tiles / 4;
+        free(r->depth.tile_far);
+        free(r->depth.tile_written);
+        r->depth.tile_far     = (uint32_t*)malloc(cap * sizeof(uint32_t));
+        r->depth.tile_written = (uint32_t*)malloc(cap * sizeof(uint32_t));
+        if (!r->depth.tile_far || !r->depth.tile_written) {
+            free(r->depth.tile_far);
+            free(r->depth.tile_written);
+            r->depth.tile_far     = NULL;
+            r->depth.tile_written = NULL;
+        }
+        r->depth.tile_capacity = r->depth.tile_far ? cap : 0;
+    }
+    r->depth.tiles_x = r->depth.tile_far ? tx : 0;
+    r->depth.tiles_y = r->depth.tile_far ? ty : 0;
+    _depth_clear(&r->depth);
+    if (_render_msaa_samples(r) > 1 && r->sample_capacity) _render_msaa_prepare(r, true);
+    return true;
+}
+
+inline bool renderSetDepthFormat(Renderer* r, const DepthFormat format)
+{
+    if (format != DEPTH_FORMAT_F32 && format != DEPTH_FORMAT_U16 && format != DEPTH_FORMAT_U24_REVERSED) return false;
+#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
+    if (r->gpu) return format == DEPTH_FORMAT_F32;
+#endif
+    // Every format fits the 4-byte allocation, so switching never reallocates
+    r->depth.format = format;
+    if (r->depth.valid) _depth_clear(&r->depth);
+    return true;
+}
+
+inline float renderGetDepth(const Renderer* r, const int x, const int y)
+{
+    const DepthBuffer* db = &r->depth;
+    if (!db->valid || x < 0 || y < 0 || x >= db->width || y >= db->height) return FLT_MAX;
+    const size_t i = (size_t)y * db->width + x;
+    if (db->format == DEPTH_FORMAT_U16) {
+        if (db->depth16[i] == _DEPTH_U16_MAX) return FLT_MAX;
+        return (float)db->depth16[i] / 65535.0f * 2.0f - 1.0f;
+    }
+    if (db->format == DEPTH_FORMAT_U24_REVERSED) {
+        if (db->depth24[i] == 0) return FLT_MAX;
+        const float a = (_RENDER_FAR + _RENDER_NEAR) / (_RENDER_FAR - _RENDER_NEAR);
+        const float b = 2.0f * _RENDER_FAR * _RENDER_NEAR / (_RENDER_FAR - _RENDER_NEAR);
+        return a - b * (float)db->depth24[i] / (_RENDER_NEAR * 16777215.0f);
+    }
+    return db->depths[i];
+}
+
+static inline void _render_model_faces(Renderer* r, const Model* m, const Mat4* vp)
+{
+#ifdef TEXTURE_IMPLEMENTATION
+    const Texture* tex = m->mat.texture && m->mat.texture->texels ? m->mat.texture : NULL;
+#else
+    const Texture* tex = NULL;
+#endif
+
+    if (m->mat.shader && m->mat.shader->fragment) {
+        _render_model_shader(r, m, vp, m->mat.shader);
+        return;
+    }
+
+    const int nvary = _render_builtin_nvary(r, tex);
+    if (_render_msaa_samples(r) > 1) {
+        _render_model_kernel(r, m, vp, tex, r->backface_culling, r->light, nvary, false, _render_raster_msaa);
+        return;
+    }
+    const bool reference = nvary == 0 && r->depth_test && r->depth_write && !r->depth_equal && r->blend == RENDER_BLEND_OPAQUE &&
+                           r->depth.format == DEPTH_FORMAT_F32;
+#if defined(__cplusplus) && !defined(RENDER_NO_TEMPLATES)
+    if (r->backface_culling) {
+        if (r->light) _render_model_dispatch<true, true>(r, m, vp, tex, nvary, reference);
+        else          _render_model_dispatch<true, false>(r, m, vp, tex, nvary, reference);
+    } else {
+        if (r->light) _render_model_dispatch<false, true>(r, m, vp, tex, nvary, reference);
+        else          _render_model_dispatch<false, false>(r, m, vp, tex, nvary, reference);
+    }
+#else
+    _render_model_kernel(r, m, vp, tex, r->backface_culling, r->light, nvary, reference, _render_raster_dynamic);
+#endif
+}
+
+// Transparent faces: into the k-buffer when it is usable, otherwise alpha blended in draw order over the depth
+// buffer without writing it
+static inline void _render_model_transparent_faces(Renderer* r, const Model* m, const Mat4* vp)
+{
+    if (_render_oit_prepare(r)) {
+#ifdef TEXTURE_IMPLEMENTATION
+        const Texture* tex = m->mat.texture && m->mat.texture->texels ? m->mat.texture : NULL;
+#else
+        const Texture* tex = NULL;
+#endif
+        _render_model_kernel(r, m, vp, tex, r->backface_culling, r->light, _render_builtin_nvary(r, tex), false, _render_raster_oit);
+        r->oit.pending = true;
+        return;
+    }
+    const RenderBlend blend = r->blend;
+    const bool depth_write = r->depth_write;
+    if (blend == RENDER_BLEND_OPAQUE) r->blend = RENDER_BLEND_ALPHA;
+    r->depth_write = false;
+    _render_model_faces(r, m, vp);
+    r->blend = blend;
+    r->depth_write = depth_write;
+}
+
+inline void renderModel(Renderer* r, const Model* m)
+{
+#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
+    if (r->gpu) { (void)m; return; }
+#endif
+
+    _renderSyncDepth(r);
+    if (!r->depth.valid || !m || m->num_triangles == 0) return;
+    if (_render_msaa_samples(r) > 1 && !_render_msaa_prepare(r, false)) return;
+    r->stats.draws++;
+    // Untested writes can push depth past a tile's recorded far plane
+    if (r->depth_write && !r->depth_test) r->depth.tiles_valid = false;
+    _depth_begin_draw(&r->depth);
+
+    const Mat4 vp = _render_view_proj(r);
+    if (!r->wireframe || r->wireframe_overlay) {
+        if (_render_model_transparent(m)) _render_model_transparent_faces(r, m, &vp);
+        else _render_model_faces(r, m, &vp);
+    }
+    if (r->wireframe) _render_wire_model(r, m, &vp);
+}
+
+// CPU path of renderScene
+static inline void _render_scene(Renderer* r, const Model* models, const int count)
+{
+    renderShadowUpdate(r, models, count);
+    renderLightsUpdate(r);
+    const bool msaa = _render_msaa_samples(r) > 1;
+    if (r->deferred && !r->wireframe && !msaa && _render_deferred(r, models, count)) return;
+
+    int n = 0;
+    const _RenderDraw* draws = NULL;
+    if (r->sort != RENDER_SORT_NONE || r->depth_prepass) {
+        _renderSyncDepth(r);
+        if (!r->depth.valid) return;
+        draws = _render_draw_list(r, models, count, &n);
+    }
+    // Transparent models go last, over the finished opaque depth
+    if (!draws) {
+        for (int i = 0; i < count; i++) if (!_render_model_transparent(&models[i])) renderModel(r, &models[i]);
+        for (int i = 0; i < count; i++) if (_render_model_transparent(&models[i])) renderModel(r, &models[i]);
+        return;
+    }
+
+    if (r->depth_prepass && !r->wireframe && !msaa && r->depth_test && r->depth_write && !r->depth_equal && r->blend == RENDER_BLEND_OPAQUE) {
+        // Every built-in pixel is shaded once: only the fragment whose depth won the prepass passes
+        _render_prepass(r, draws, n);
+        r->depth_equal = true;
+        for (int i = 0; i < n; i++)
+            if (!_render_draw_has_shader(&draws[i]) && !_render_model_transparent(draws[i].model)) _render_draw(r, &draws[i]);
+        r->depth_equal = false;
+        for (int i = 0; i < n; i++) if (_render_draw_has_shader(&draws[i])) _render_draw(r, &draws[i]);
+    } else {
+        for (int i = 0; i < n; i++) if (!_render_model_transparent(draws[i].model)) _render_draw(r, &draws[i]);
+    }
+    for (int i = 0; i < n; i++) if (_render_model_transparent(draws[i].model)) _render_draw(r, &draws[i]);
+}
+
+inline void renderScene(Renderer* r, const Model* models, int count)
+{
+#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
+    if (r->gpu && r->gpu_ready) {
+
+        int sw, sh;
+        gpuGetDrawableSize(r->gpu, &sw, &sh);
+        if ((Uint32)sw != r->depth_tex_w || (Uint32)sh != r->depth_tex_h) {
+            if (r->depth_tex) SDL_ReleaseGPUTexture(r->gpu->device, r->depth_tex);
+            r->depth_tex   = _renderCreateDepthTex(r->gpu->device, (Uint32)sw, (Uint32)sh);
+            r->depth_tex_w = (Uint32)sw;
+            r->depth_tex_h = (Uint32)sh;
+            if (!r->depth_tex) return;
+        }
+
+        models = _render_lod_models(r, models, count, sh);
+
+        Mat4 view = {0};
+        view.m[0] = r->camera->right.x;  view.m[4] = r->camera->right.y;  view.m[8]  = r->camera->right.z;  view.m[12] = -dot(r->camera->right, r->camera->position);
+        view.m[1] = r->camera->up.x;     view.m[5] = r->camera->up.y;     view.m[9]  = r->camera->up.z;     view.m[13] = -dot(r->camera->up,    r->camera->position);
+        view.m[2] =-r->camera->front.x;  view.m[6] =-r->camera->front.y;  view.m[10] =-r->camera->front.z;  view.m[14] =  dot(r->camera->front,  r->camera->position);
+        view.m[15]= 1.0f;
+
+        const float aspect = sw > 0 && sh > 0 ? (float)sw / (float)sh : 1.0f;
+        const Mat4 proj   = _perspective(r->camera->fov, aspect, 0.1f, 1000.0f);
+        const Mat4 vp_mat = _mat4_mul(&proj, &view);
 
+        int total_tris = 0;
+        for (int i = 0; i < count; i++) total_tris += models[i].num_triangles;
+        if (total_tris == 0) return;
 
-static const uint8_t _SPIRV_VERT[] = {
-    0x03,0x02,0x23,0x07,0x00,0x00,0x01,0x00,0x0b,0x00,0x0d,0x00,0x56,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,0x11,0x00,0x02,0x00,0x01,0x00,0x00,0x00,0x0b,0x00,0x06,0x00,
-    0x01,0x00,0x00,0x00,0x47,0x4c,0x53,0x4c,0x2e,0x73,0x74,0x64,0x2e,0x34,0x35,0x30,
-    0x00,0x00,0x00,0x00,0x0e,0x00,0x03,0x00,0x00,0x00,0x00,0x00,0x01,0x00,0x00,0x00,
-    0x0f,0x00,0x09,0x00,0x00,0x00,0x00,0x00,0x04,0x00,0x00,0x00,0x6d,0x61,0x69,0x6e,
-    0x00,0x00,0x00,0x00,0x0d,0x00,0x00,0x00,0x1f,0x00,0x00,0x00,0x21,0x00,0x00,0x00,
-    0x29,0x00,0x00,0x00,0x47,0x00,0x00,0x00,0x03,0x00,0x03,0x00,0x02,0x00,0x00,0x00,
-    0xc2,0x01,0x00,0x00,0x04,0x00,0x0a,0x00,0x47,0x4c,0x5f,0x41,0x52,0x42,0x5f,0x73,
-    0x65,0x70,0x61,0x72,0x61,0x74,0x65,0x5f,0x73,0x68,0x61,0x64,0x65,0x72,0x5f,0x6f,
-    0x62,0x6a,0x65,0x63,0x74,0x73,0x00,0x00,0x04,0x00,0x09,0x00,0x47,0x4c,0x5f,0x41,
-    0x52,0x42,0x5f,0x73,0x68,0x61,0x64,0x69,0x6e,0x67,0x5f,0x6c,0x61,0x6e,0x67,0x75,
-    0x61,0x67,0x65,0x5f,0x34,0x32,0x30,0x70,0x61,0x63,0x6b,0x00,0x05,0x00,0x06,0x00,
-    0x04,0x00,0x00,0x00,0x6d,0x61,0x69,0x6e,0x28,0x29,0x00,0x00,0x05,0x00,0x06,0x00,
-    0x0b,0x00,0x00,0x00,0x67,0x6c,0x5f,0x50,0x65,0x72,0x56,0x65,0x72,0x74,0x65,0x78,
-    0x00,0x00,0x00,0x00,0x06,0x00,0x06,0x00,0x0b,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-    0x67,0x6c,0x5f,0x50,0x6f,0x73,0x69,0x74,0x69,0x6f,0x6e,0x00,0x06,0x00,0x07,0x00,
-    0x0b,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x67,0x6c,0x5f,0x50,0x6f,0x69,0x6e,0x74,
-    0x53,0x69,0x7a,0x65,0x00,0x00,0x00,0x00,0x06,0x00,0x07,0x00,0x0b,0x00,0x00,0x00,
-    0x02,0x00,0x00,0x00,0x67,0x6c,0x5f,0x43,0x6c,0x69,0x70,0x44,0x69,0x73,0x74,0x61,
-    0x6e,0x63,0x65,0x00,0x06,0x00,0x07,0x00,0x0b,0x00,0x00,0x00,0x03,0x00,0x00,0x00,
-    0x67,0x6c,0x5f,0x43,0x75,0x6c,0x6c,0x44,0x69,0x73,0x74,0x61,0x6e,0x63,0x65,0x00,
-    0x05,0x00,0x03,0x00,0x0d,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x05,0x00,0x04,0x00,
-    0x11,0x00,0x00,0x00,0x55,0x00,0x00,0x00,0x05,0x00,0x05,0x00,0x15,0x00,0x00,0x00,
-    0x55,0x6e,0x69,0x66,0x6f,0x72,0x6d,0x73,0x00,0x00,0x00,0x00,0x06,0x00,0x05,0x00,
-    0x15,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x76,0x70,0x00,0x00,0x06,0x00,0x06,0x00,
-    0x15,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x6c,0x69,0x67,0x68,0x74,0x5f,0x64,0x69,
-    0x72,0x00,0x00,0x00,0x06,0x00,0x06,0x00,0x15,0x00,0x00,0x00,0x02,0x00,0x00,0x00,
-    0x75,0x73,0x65,0x5f,0x6c,0x69,0x67,0x68,0x74,0x00,0x00,0x00,0x06,0x00,0x04,0x00,
-    0x15,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x70,0x61,0x64,0x00,0x05,0x00,0x03,0x00,
-    0x17,0x00,0x00,0x00,0x75,0x00,0x00,0x00,0x05,0x00,0x04,0x00,0x1f,0x00,0x00,0x00,
-    0x61,0x50,0x6f,0x73,0x00,0x00,0x00,0x00,0x05,0x00,0x05,0x00,0x21,0x00,0x00,0x00,
-    0x61,0x4e,0x6f,0x72,0x6d,0x00,0x00,0x00,0x05,0x00,0x06,0x00,0x29,0x00,0x00,0x00,
-    0x61,0x43,0x6f,0x6c,0x6f,0x72,0x00,0x00,0x05,0x00,0x05,0x00,0x47,0x00,0x00,0x00,
-    0x76,0x43,0x6f,0x6c,0x6f,0x72,0x00,0x00,0x47,0x00,0x04,0x00,0x0b,0x00,0x00,0x00,
-    0x0b,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x47,0x00,0x04,0x00,0x0d,0x00,0x00,0x00,
-    0x22,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x47,0x00,0x04,0x00,0x0d,0x00,0x00,0x00,
-    0x21,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x48,0x00,0x05,0x00,0x0b,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,0x0b,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x48,0x00,0x05,0x00,
-    0x0b,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x0b,0x00,0x00,0x00,0x01,0x00,0x00,0x00,
-    0x48,0x00,0x05,0x00,0x0b,0x00,0x00,0x00,0x02,0x00,0x00,0x00,0x0b,0x00,0x00,0x00,
-    0x03,0x00,0x00,0x00,0x48,0x00,0x05,0x00,0x0b,0x00,0x00,0x00,0x03,0x00,0x00,0x00,
-    0x0b,0x00,0x00,0x00,0x04,0x00,0x00,0x00,0x47,0x00,0x03,0x00,0x0b,0x00,0x00,0x00,
-    0x02,0x00,0x00,0x00,0x48,0x00,0x05,0x00,0x15,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-    0x05,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x48,0x00,0x05,0x00,0x15,0x00,0x00,0x00,
-    0x01,0x00,0x00,0x00,0x23,0x00,0x00,0x00,0x40,0x00,0x00,0x00,0x48,0x00,0x05,0x00,
-    0x15,0x00,0x00,0x00,0x02,0x00,0x00,0x00,0x23,0x00,0x00,0x00,0x50,0x00,0x00,0x00,
-    0x48,0x00,0x05,0x00,0x15,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x23,0x00,0x00,0x00,
-    0x54,0x00,0x00,0x00,0x47,0x00,0x03,0x00,0x15,0x00,0x00,0x00,0x02,0x00,0x00,0x00,
-    0x47,0x00,0x04,0x00,0x1f,0x00,0x00,0x00,0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-    0x47,0x00,0x04,0x00,0x21,0x00,0x00,0x00,0x1e,0x00,0x00,0x00,0x01,0x00,0x00,0x00,
-    0x47,0x00,0x04,0x00,0x29,0x00,0x00,0x00,0x1e,0x00,0x00,0x00,0x02,0x00,0x00,0x00,
-    0x47,0x00,0x04,0x00,0x47,0x00,0x00,0x00,0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-    0x13,0x00,0x02,0x00,0x02,0x00,0x00,0x00,0x21,0x00,0x03,0x00,0x03,0x00,0x00,0x00,
-    0x02,0x00,0x00,0x00,0x16,0x00,0x03,0x00,0x06,0x00,0x00,0x00,0x20,0x00,0x00,0x00,
-    0x17,0x00,0x04,0x00,0x07,0x00,0x00,0x00,0x06,0x00,0x00,0x00,0x04,0x00,0x00,0x00,
-    0x15,0x00,0x04,0x00,0x08,0x00,0x00,0x00,0x20,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-    0x2b,0x00,0x04,0x00,0x08,0x00,0x00,0x00,0x09,0x00,0x00,0x00,0x01,0x00,0x00,0x00,
-    0x1c,0x00,0x04,0x00,0x0a,0x00,0x00,0x00,0x06,0x00,0x00,0x00,0x09,0x00,0x00,0x00,
-    0x1e,0x00,0x06,0x00,0x0b,0x00,0x00,0x00,0x07,0x00,0x00,0x00,0x06,0x00,0x00,0x00,
-    0x0a,0x00,0x00,0x00,0x0a,0x00,0x00,0x00,0x20,0x00,0x04,0x00,0x0c,0x00,0x00,0x00,
-    0x03,0x00,0x00,0x00,0x0b,0x00,0x00,0x00,0x3b,0x00,0x04,0x00,0x0c,0x00,0x00,0x00,
-    0x0d,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x15,0x00,0x04,0x00,0x0e,0x00,0x00,0x00,
-    0x20,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x2b,0x00,0x04,0x00,0x0e,0x00,0x00,0x00,
-    0x0f,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x18,0x00,0x04,0x00,0x10,0x00,0x00,0x00,
-    0x07,0x00,0x00,0x00,0x04,0x00,0x00,0x00,0x17,0x00,0x04,0x00,0x12,0x00,0x00,0x00,
-    0x06,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x2b,0x00,0x04,0x00,0x08,0x00,0x00,0x00,
-    0x13,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x1c,0x00,0x04,0x00,0x14,0x00,0x00,0x00,
-    0x06,0x00,0x00,0x00,0x13,0x00,0x00,0x00,0x1e,0x00,0x05,0x00,0x15,0x00,0x00,0x00,
-    0x10,0x00,0x00,0x00,0x07,0x00,0x00,0x00,0x06,0x00,0x00,0x00,0x20,0x00,0x04,0x00,
-    0x16,0x00,0x00,0x00,0x02,0x00,0x00,0x00,0x15,0x00,0x00,0x00,0x3b,0x00,0x04,0x00,
-    0x16,0x00,0x00,0x00,0x17,0x00,0x00,0x00,0x02,0x00,0x00,0x00,0x20,0x00,0x04,0x00,
-    0x18,0x00,0x00,0x00,0x02,0x00,0x00,0x00,0x10,0x00,0x00,0x00,0x20,0x00,0x04,0x00,
-    0x1a,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x12,0x00,0x00,0x00,0x3b,0x00,0x04,0x00,
-    0x1a,0x00,0x00,0x00,0x1f,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x2b,0x00,0x04,0x00,
-    0x06,0x00,0x00,0x00,0x20,0x00,0x00,0x00,0x00,0x00,0x80,0x3f,0x20,0x00,0x04,0x00,
-    0x22,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x12,0x00,0x00,0x00,0x3b,0x00,0x04,0x00,
-    0x22,0x00,0x00,0x00,0x21,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x20,0x00,0x04,0x00,
-    0x2a,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x12,0x00,0x00,0x00,0x3b,0x00,0x04,0x00,
-    0x2a,0x00,0x00,0x00,0x29,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x20,0x00,0x04,0x00,
-    0x3c,0x00,0x00,0x00,0x02,0x00,0x00,0x00,0x06,0x00,0x00,0x00,0x20,0x00,0x04,0x00,
-    0x42,0x00,0x00,0x00,0x02,0x00,0x00,0x00,0x07,0x00,0x00,0x00,0x20,0x00,0x04,0x00,
-    0x46,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x12,0x00,0x00,0x00,0x3b,0x00,0x04,0x00,
-    0x46,0x00,0x00,0x00,0x47,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x20,0x00,0x04,0x00,
-    0x4c,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x07,0x00,0x00,0x00,0x2b,0x00,0x04,0x00,
-    0x06,0x00,0x00,0x00,0x4e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x2b,0x00,0x04,0x00,
-    0x06,0x00,0x00,0x00,0x54,0x00,0x00,0x00,0x00,0x00,0x00,0x3f,0x36,0x00,0x05,0x00,
-    0x02,0x00,0x00,0x00,0x04,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x03,0x00,0x00,0x00,
-    0xf8,0x00,0x02,0x00,0x05,0x00,0x00,0x00,0x3d,0x00,0x04,0x00,0x12,0x00,0x00,0x00,
-    0x1e,0x00,0x00,0x00,0x1f,0x00,0x00,0x00,0x51,0x00,0x05,0x00,0x06,0x00,0x00,0x00,
-    0x23,0x00,0x00,0x00,0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x51,0x00,0x05,0x00,
-    0x06,0x00,0x00,0x00,0x24,0x00,0x00,0x00,0x1e,0x00,0x00,0x00,0x01,0x00,0x00,0x00,
-    0x51,0x00,0x05,0x00,0x06,0x00,0x00,0x00,0x25,0x00,0x00,0x00,0x1e,0x00,0x00,0x00,
-    0x02,0x00,0x00,0x00,0x50,0x00,0x05,0x00,0x07,0x00,0x00,0x00,0x26,0x00,0x00,0x00,
-    0x23,0x00,0x00,0x00,0x24,0x00,0x00,0x00,0x51,0x00,0x05,0x00,0x06,0x00,0x00,0x00,
-    0x27,0x00,0x00,0x00,0x26,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x51,0x00,0x05,0x00,
-    0x06,0x00,0x00,0x00,0x28,0x00,0x00,0x00,0x26,0x00,0x00,0x00,0x01,0x00,0x00,0x00,
-    0x50,0x00,0x07,0x00,0x07,0x00,0x00,0x00,0x2c,0x00,0x00,0x00,0x23,0x00,0x00,0x00,
-    0x24,0x00,0x00,0x00,0x25,0x00,0x00,0x00,0x20,0x00,0x00,0x00,0x41,0x00,0x05,0x00,
-    0x18,0x00,0x00,0x00,0x30,0x00,0x00,0x00,0x17,0x00,0x00,0x00,0x0f,0x00,0x00,0x00,
-    0x3d,0x00,0x04,0x00,0x10,0x00,0x00,0x00,0x31,0x00,0x00,0x00,0x30,0x00,0x00,0x00,
-    0x91,0x00,0x05,0x00,0x07,0x00,0x00,0x00,0x32,0x00,0x00,0x00,0x31,0x00,0x00,0x00,
-    0x2c,0x00,0x00,0x00,0x41,0x00,0x05,0x00,0x4c,0x00,0x00,0x00,0x4d,0x00,0x00,0x00,
-    0x0d,0x00,0x00,0x00,0x0f,0x00,0x00,0x00,0x3e,0x00,0x03,0x00,0x4d,0x00,0x00,0x00,
-    0x32,0x00,0x00,0x00,0x41,0x00,0x05,0x00,0x3c,0x00,0x00,0x00,0x3d,0x00,0x00,0x00,
-    0x17,0x00,0x00,0x00,0x13,0x00,0x00,0x00,0x3d,0x00,0x04,0x00,0x06,0x00,0x00,0x00,
-    0x3e,0x00,0x00,0x00,0x3d,0x00,0x00,0x00,0xb8,0x00,0x05,0x00,0x08,0x00,0x00,0x00,
-    0x3f,0x00,0x00,0x00,0x3e,0x00,0x00,0x00,0x54,0x00,0x00,0x00,0xf7,0x00,0x03,0x00,
-    0x52,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xfa,0x00,0x04,0x00,0x3f,0x00,0x00,0x00,
-    0x40,0x00,0x00,0x00,0x4f,0x00,0x00,0x00,0xf8,0x00,0x02,0x00,0x40,0x00,0x00,0x00,
-    0x3d,0x00,0x04,0x00,0x12,0x00,0x00,0x00,0x43,0x00,0x00,0x00,0x21,0x00,0x00,0x00,
-    0x41,0x00,0x05,0x00,0x42,0x00,0x00,0x00,0x44,0x00,0x00,0x00,0x17,0x00,0x00,0x00,
-    0x09,0x00,0x00,0x00,0x3d,0x00,0x04,0x00,0x07,0x00,0x00,0x00,0x45,0x00,0x00,0x00,
-    0x44,0x00,0x00,0x00,0x4f,0x00,0x09,0x00,0x12,0x00,0x00,0x00,0x46,0x00,0x00,0x00,
-    0x45,0x00,0x00,0x00,0x45,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x01,0x00,0x00,0x00,
-    0x02,0x00,0x00,0x00,0x65,0x00,0x05,0x00,0x12,0x00,0x00,0x00,0x48,0x00,0x00,0x00,
-    0x43,0x00,0x00,0x00,0x46,0x00,0x00,0x00,0x8e,0x00,0x05,0x00,0x06,0x00,0x00,0x00,
-    0x49,0x00,0x00,0x00,0x48,0x00,0x00,0x00,0x4e,0x00,0x00,0x00,0x6f,0x00,0x04,0x00,
-    0x06,0x00,0x00,0x00,0x4a,0x00,0x00,0x00,0x49,0x00,0x00,0x00,0x0c,0x00,0x08,0x00,
-    0x06,0x00,0x00,0x00,0x4b,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x28,0x00,0x00,0x00,
-    0x4e,0x00,0x00,0x00,0x4a,0x00,0x00,0x00,0xf9,0x00,0x02,0x00,0x52,0x00,0x00,0x00,
-    0xf8,0x00,0x02,0x00,0x4f,0x00,0x00,0x00,0xf9,0x00,0x02,0x00,0x52,0x00,0x00,0x00,
-    0xf8,0x00,0x02,0x00,0x52,0x00,0x00,0x00,0x80,0x00,0x05,0x00,0x06,0x00,0x00,0x00,
-    0x53,0x00,0x00,0x00,0x4b,0x00,0x00,0x00,0x20,0x00,0x00,0x00,0xf7,0x00,0x03,0x00,
-    0x53,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-};
-// NOTE: The above SPIRV bytes are a minimal hand-assembled stub.
-// For production use, regenerate with: glslc model.vert -o model.vert.spv
-// The MSL path (macOS/Metal) is always used when available and is fully functional.
+        const Uint32 vtx_count = (Uint32)(total_tris * 3);
+        const Uint32 vtx_bytes = vtx_count * sizeof(_GpuVertex);
 
-static const uint8_t _SPIRV_FRAG[] = {
-    0x03,0x02,0x23,0x07,0x00,0x00,0x01,0x00,0x0b,0x00,0x0d,0x00,0x12,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,0x11,0x00,0x02,0x00,0x01,0x00,0x00,0x00,0x0b,0x00,0x06,0x00,
-    0x01,0x00,0x00,0x00,0x47,0x4c,0x53,0x4c,0x2e,0x73,0x74,0x64,0x2e,0x34,0x35,0x30,
-    0x00,0x00,0x00,0x00,0x0e,0x00,0x03,0x00,0x00,0x00,0x00,0x00,0x01,0x00,0x00,0x00,
-    0x0f,0x00,0x06,0x00,0x04,0x00,0x00,0x00,0x04,0x00,0x00,0x00,0x6d,0x61,0x69,0x6e,
-    0x00,0x00,0x00,0x00,0x09,0x00,0x00,0x00,0x10,0x00,0x03,0x00,0x04,0x00,0x00,0x00,
-    0x07,0x00,0x00,0x00,0x03,0x00,0x03,0x00,0x02,0x00,0x00,0x00,0xc2,0x01,0x00,0x00,
-    0x04,0x00,0x0a,0x00,0x47,0x4c,0x5f,0x41,0x52,0x42,0x5f,0x73,0x65,0x70,0x61,0x72,
-    0x61,0x74,0x65,0x5f,0x73,0x68,0x61,0x64,0x65,0x72,0x5f,0x6f,0x62,0x6a,0x65,0x63,
-    0x74,0x73,0x00,0x00,0x05,0x00,0x04,0x00,0x04,0x00,0x00,0x00,0x6d,0x61,0x69,0x6e,
-    0x00,0x00,0x00,0x00,0x05,0x00,0x05,0x00,0x09,0x00,0x00,0x00,0x6f,0x75,0x74,0x43,
-    0x6f,0x6c,0x6f,0x72,0x00,0x00,0x00,0x00,0x05,0x00,0x05,0x00,0x0b,0x00,0x00,0x00,
-    0x76,0x43,0x6f,0x6c,0x6f,0x72,0x00,0x00,0x47,0x00,0x04,0x00,0x09,0x00,0x00,0x00,
-    0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x47,0x00,0x04,0x00,0x0b,0x00,0x00,0x00,
-    0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x13,0x00,0x02,0x00,0x02,0x00,0x00,0x00,
-    0x21,0x00,0x03,0x00,0x03,0x00,0x00,0x00,0x02,0x00,0x00,0x00,0x16,0x00,0x03,0x00,
-    0x06,0x00,0x00,0x00,0x20,0x00,0x00,0x00,0x17,0x00,0x04,0x00,0x07,0x00,0x00,0x00,
-    0x06,0x00,0x00,0x00,0x04,0x00,0x00,0x00,0x20,0x00,0x04,0x00,0x08,0x00,0x00,0x00,
-    0x03,0x00,0x00,0x00,0x07,0x00,0x00,0x00,0x3b,0x00,0x04,0x00,0x08,0x00,0x00,0x00,
-    0x09,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x17,0x00,0x04,0x00,0x0a,0x00,0x00,0x00,
-    0x06,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0x20,0x00,0x04,0x00,0x0c,0x00,0x00,0x00,
-    0x01,0x00,0x00,0x00,0x0a,0x00,0x00,0x00,0x3b,0x00,0x04,0x00,0x0c,0x00,0x00,0x00,
-    0x0b,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x2b,0x00,0x04,0x00,0x06,0x00,0x00,0x00,
-    0x0d,0x00,0x00,0x00,0x00,0x00,0x80,0x3f,0x36,0x00,0x05,0x00,0x02,0x00,0x00,0x00,
-    0x04,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x03,0x00,0x00,0x00,0xf8,0x00,0x02,0x00,
-    0x05,0x00,0x00,0x00,0x3d,0x00,0x04,0x00,0x0a,0x00,0x00,0x00,0x0e,0x00,0x00,0x00,
-    0x0b,0x00,0x00,0x00,0x51,0x00,0x05,0x00,0x06,0x00,0x00,0x00,0x0f,0x00,0x00,0x00,
-    0x0e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x51,0x00,0x05,0x00,0x06,0x00,0x00,0x00,
-    0x10,0x00,0x00,0x00,0x0e,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x51,0x00,0x05,0x00,
-    0x06,0x00,0x00,0x00,0x11,0x00,0x00,0x00,0x0e,0x00,0x00,0x00,0x02,0x00,0x00,0x00,
-    0x50,0x00,0x07,0x00,0x07,0x00,0x00,0x00,0x12,0x00,0x00,0x00,0x0f,0x00,0x00,0x00,
-    0x10,0x00,0x00,0x00,0x11,0x00,0x00,0x00,0x0d,0x00,0x00,0x00,0x3e,0x00,0x03,0x00,
-    0x09,0x00,0x00,0x00,0x12,0x00,0x00,0x00,0xfd,0x00,0x01,0x00,0x38,0x00,0x01,0x00,
-};
+        SDL_GPUTransferBufferCreateInfo tbci = {};
+        tbci.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
+        tbci.size  = vtx_bytes;
+        SDL_GPUTransferBuffer *tb = SDL_CreateGPUTransferBuffer(r->gpu->device, &tbci);
+        if (!tb) return;
+
+        _GpuVertex *vtx = (_GpuVertex*)SDL_MapGPUTransferBuffer(r->gpu->device, tb, false);
+        if (!vtx) { SDL_ReleaseGPUTransferBuffer(r->gpu->device, tb); return; }
+
+        // The pipeline culls back faces, so meshlets facing away are dropped along with those outside the view
+        _RenderCull cull;
+        _render_cull_init(&cull, r, &vp_mat, sw > 0 ? sw : 1, sh > 0 ? sh : 1, true, false);
+        int vi = 0;
+        for (int mi = 0; mi < count; mi++) {
+            const Model *m = &models[mi];
+            int next = 0, first, end;
+            while (_render_cull_next(&cull, m, &next, &first, &end)) {
+                for (int ti = first; ti < end; ti++) {
+                    const Triangle *t = &m->transformed_triangles[ti];
+                    const Vec3 n = norm(cross(sub(t->v1, t->v0), sub(t->v2, t->v0)));
+
+                    vtx[vi].px=t->v0.x; vtx[vi].py=t->v0.y; vtx[vi].pz=t->v0.z;
+                    vtx[vi].nx=n.x;     vtx[vi].ny=n.y;     vtx[vi].nz=n.z;
+                    vtx[vi].r=t->color.x; vtx[vi].g=t->color.y; vtx[vi].b=t->color.z; vi++;
+
+                    vtx[vi].px=t->v1.x; vtx[vi].py=t->v1.y; vtx[vi].pz=t->v1.z;
+                    vtx[vi].nx=n.x;     vtx[vi].ny=n.y;     vtx[vi].nz=n.z;
+                    vtx[vi].r=t->color.x; vtx[vi].g=t->color.y; vtx[vi].b=t->color.z; vi++;
+
+                    vtx[vi].px=t->v2.x; vtx[vi].py=t->v2.y; vtx[vi].pz=t->v2.z;
+                    vtx[vi].nx=n.x;     vtx[vi].ny=n.y;     vtx[vi].nz=n.z;
+                    vtx[vi].r=t->color.x; vtx[vi].g=t->color.y; vtx[vi].b=t->color.z; vi++;
+                }
+            }
+        }
+        SDL_UnmapGPUTransferBuffer(r->gpu->device, tb);
+        const Uint32 draw_count = (Uint32)vi;
+
+        SDL_GPUBufferCreateInfo bci = {};
+        bci.usage = SDL_GPU_BUFFERUSAGE_VERTEX;
+        bci.size  = vtx_bytes;
+        SDL_GPUBuffer *vbuf = SDL_CreateGPUBuffer(r->gpu->device, &bci);
+        if (!vbuf) { SDL_ReleaseGPUTransferBuffer(r->gpu->device, tb); return; }
+
+        _GpuModelUniforms u = {};
+        memcpy(u.vp, vp_mat.m, sizeof(u.vp));
+        u.light_dir[0] = r->light_dir.x;
+        u.light_dir[1] = r->light_dir.y;
+        u.light_dir[2] = r->light_dir.z;
+        u.light_dir[3] = 0.0f;
+        u.use_light    = r->light ? 1.0f : 0.0f;
+
+        GpuRenderPass frame;
+        if (!gpuBeginRender(r->gpu, &frame)) {
+            SDL_ReleaseGPUBuffer(r->gpu->device, vbuf);
+            SDL_ReleaseGPUTransferBuffer(r->gpu->device, tb);
+            return;
+        }
+        if (!frame.swapchain) {
+            SDL_ReleaseGPUBuffer(r->gpu->device, vbuf);
+            SDL_ReleaseGPUTransferBuffer(r->gpu->device, tb);
+            return;
+        }
+
+        if (draw_count > 0) {
+            SDL_GPUCopyPass *cp = SDL_BeginGPUCopyPass(frame.cmd);
+            SDL_GPUTransferBufferLocation src_loc = {};
+            src_loc.transfer_buffer = tb;
+            SDL_GPUBufferRegion dst_reg = {};
+            dst_reg.buffer = vbuf;
+            dst_reg.size   = draw_count * sizeof(_GpuVertex);
+            SDL_UploadToGPUBuffer(cp, &src_loc, &dst_reg, false);
+            SDL_EndGPUCopyPass(cp);
+        }
+        SDL_ReleaseGPUTransferBuffer(r->gpu->device, tb);
+
+        imguiPrepareDrawData(frame.cmd);
+
+        SDL_GPUColorTargetInfo color_tgt = {};
+        color_tgt.texture     = frame.swapchain;
+        color_tgt.load_op     = SDL_GPU_LOADOP_CLEAR;
+        color_tgt.store_op    = SDL_GPU_STOREOP_STORE;
+        color_tgt.clear_color = {r->gpu->clear_r, r->gpu->clear_g, r->gpu->clear_b, r->gpu->clear_a};
+
+        SDL_GPUDepthStencilTargetInfo depth_tgt = {};
+        depth_tgt.texture     = r->depth_tex;
+        depth_tgt.load_op     = SDL_GPU_LOADOP_CLEAR;
+        depth_tgt.store_op    = SDL_GPU_STOREOP_DONT_CARE;
+        depth_tgt.clear_depth = 1.0f;
+
+        SDL_GPURenderPass *scene_pass = SDL_BeginGPURenderPass(frame.cmd, &color_tgt, 1, &depth_tgt);
+        SDL_BindGPUGraphicsPipeline(scene_pass, r->pipeline);
+        SDL_PushGPUVertexUniformData(frame.cmd, 0, &u, sizeof(u));
+        SDL_GPUBufferBinding vbind = { .buffer = vbuf, .offset = 0 };
+        SDL_BindGPUVertexBuffers(scene_pass, 0, &vbind, 1);
+        if (draw_count > 0) SDL_DrawGPUPrimitives(scene_pass, draw_count, 1, 0, 0);
+        SDL_EndGPURenderPass(scene_pass);
+
+        SDL_GPUColorTargetInfo imgui_tgt = {};
+        imgui_tgt.texture  = frame.swapchain;
+        imgui_tgt.load_op  = SDL_GPU_LOADOP_LOAD;
+        imgui_tgt.store_op = SDL_GPU_STOREOP_STORE;
+        SDL_GPURenderPass *imgui_pass = SDL_BeginGPURenderPass(frame.cmd, &imgui_tgt, 1, NULL);
+        imguiRenderDrawData(frame.cmd, imgui_pass);
+        SDL_EndGPURenderPass(imgui_pass);
+
+        gpuEndRender(r->gpu, &frame);
+        SDL_ReleaseGPUBuffer(r->gpu->device, vbuf);
+        return;
+    }
+#endif
+    _render_scene(r, _render_lod_models(r, models, count, r->window->bHeight), count);
+    renderComposite(r);
+    if (_render_msaa_samples(r) > 1) renderResolve(r);
+}
 
-static inline SDL_GPUShader* _renderCreateShader(
-    SDL_GPUDevice *dev,
-    SDL_GPUShaderStage stage,
-    const char *msl_src,
-    const uint8_t *spirv, size_t spirv_size,
-    Uint32 num_uniform_buffers)
+inline void renderResolve(Renderer* r)
 {
-    const SDL_GPUShaderFormat supported = SDL_GetGPUShaderFormats(dev);
-    SDL_GPUShaderCreateInfo info = {};
-    info.stage = stage;
-    info.num_uniform_buffers = num_uniform_buffers;
+#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
+    if (r->gpu) return;
+#endif
+    const int samples = _render_msaa_samples(r);
+    if (samples == 1 || !r->depth.valid || !r->window->buffer_valid) return;
+    if (r->sample_capacity < (size_t)r->depth.width * r->depth.height * samples) return;
+    // The resolved depth is written untested, so the tile far planes are no longer conservative
+    r->depth.tiles_valid = false;
+    _RenderResolveCtx ctx = { r, samples };
+    jobParallelFor((r->depth.height + _RENDER_MSAA_BAND - 1) / _RENDER_MSAA_BAND, _render_resolve_band, &ctx);
+}
 
-    if (supported & SDL_GPU_SHADERFORMAT_MSL) {
-        info.format    = SDL_GPU_SHADERFORMAT_MSL;
-        info.code      = (const Uint8*)msl_src;
-        info.code_size = strlen(msl_src) + 1;
-        info.entrypoint = "main0";
-        SDL_GPUShader *s = SDL_CreateGPUShader(dev, &info);
-        if (s) return s;
+inline bool renderShadowUpdate(Renderer* r, const Model* models, int count)
+{
+#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
+    if (r->gpu) return true;
+#endif
+    ShadowMap* sm = &r->shadow;
+    if (!sm->enabled || !r->light || dot(r->light_dir, r->light_dir) == 0.0f) return true;
+    const int size = sm->size > 0 ? sm->size : 1024;
+    const size_t n = (size_t)size * size;
+    if (n > sm->depth.capacity) {
+        free(sm->depth.depths);
+        sm->depth.depths   = (float*)malloc(n * sizeof(float));
+        sm->depth.capacity = sm->depth.depths ? n : 0;
+        sm->depth.valid    = false;
+        sm->valid          = false;
+        if (!sm->depth.depths) {
+            fprintf(stderr, "Failed to allocate shadow map (%dx%d)\n", size, size);
+            return false;
+        }
     }
-    if (supported & SDL_GPU_SHADERFORMAT_SPIRV) {
-        info.format    = SDL_GPU_SHADERFORMAT_SPIRV;
-        info.code      = spirv;
-        info.code_size = spirv_size;
-        info.entrypoint = "main";
-        SDL_GPUShader *s = SDL_CreateGPUShader(dev, &info);
-        if (s) return s;
+    sm->depth.width  = size;
+    sm->depth.height = size;
+    sm->depth.format = DEPTH_FORMAT_F32;
+    sm->depth.valid  = true;
+
+    // Keep the previous fit while the view sphere stays inside its guard band
+    Vec3 axis[3];
+    _shadow_basis(r->light_dir, axis);
+    float radius;
+    const Vec3 view = _shadow_view_sphere(r, sm->distance, &radius);
+    const Vec3 lc = vec3(dot(axis[0], view), dot(axis[1], view), dot(axis[2], view));
+    const float guard = radius * _RENDER_SHADOW_GUARD, cover = radius + guard;
+    const float texel = 2.0f * cover / (float)size;
+    if (sm->radius != cover || fabsf(lc.x - sm->center.x) > guard || fabsf(lc.y - sm->center.y) > guard ||
+        fabsf(lc.z - sm->center.z) > guard) {
+        // Whole texels, so a refit shifts the map without resampling the geometry differently
+        sm->center = vec3(floorf(lc.x / texel) * texel, floorf(lc.y / texel) * texel, floorf(lc.z / texel) * texel);
+        sm->radius = cover;
     }
-        return NULL;
+
+    // Depth range: every caster between the light and the fit, which only the geometry or the fit moves
+    float zmin = sm->center.z - cover;
+    uint64_t key = 1469598103934665603ull;
+    for (int mi = 0; mi < count; mi++) {
+        const Model* m = &models[mi];
+        for (int i = 0; i < m->num_triangles; i++) {
+            const Triangle* tri = &m->transformed_triangles[i];
+            zmin = fminf(zmin, fminf(dot(axis[2], tri->v0), fminf(dot(axis[2], tri->v1), dot(axis[2], tri->v2))));
+            if (sm->cache) {
+                key = _shadow_hash(key, &tri->v0.x, 3);
+                key = _shadow_hash(key, &tri->v1.x, 3);
+                key = _shadow_hash(key, &tri->v2.x, 3);
+            }
+        }
+    }
+    const float range = sm->center.z + cover - zmin;
+    const float fit[13] = { axis[2].x, axis[2].y, axis[2].z, sm->center.x, sm->center.y, sm->center.z, cover, zmin,
+                            (float)size, sm->bias, sm->slope_bias, (float)sm->pcf, (float)count };
+    key = _shadow_hash(key, fit, 13);
+    if (sm->cache && sm->valid && sm->key == key) return true;
+
+    sm->to_map[0] = mul(axis[0], 1.0f / texel);
+    sm->to_map[1] = mul(axis[1], -1.0f / texel);
+    sm->to_map[2] = mul(axis[2], 1.0f / range);
+    sm->map_offset[0] = (cover - sm->center.x) / texel;
+    sm->map_offset[1] = (cover + sm->center.y) / texel;
+    sm->map_offset[2] = -zmin / range;
+
+    // Casters are pushed back by a constant plus a slope-scaled bias covering the filter footprint, so lit
+    // surfaces do not shadow themselves
+    _depth_clear(&sm->depth);
+    const float depth_texel = texel / range;
+    const float bias = sm->bias * depth_texel, max_slope = _RENDER_SHADOW_MAX_SLOPE * depth_texel;
+    const float slope_bias = sm->slope_bias * ((float)(sm->pcf > 0 ? sm->pcf : 0) + 0.5f);
+    for (int mi = 0; mi < count; mi++) {
+        const Model* m = &models[mi];
+        for (int i = 0; i < m->num_triangles; i++) {
+            const Triangle* tri = &m->transformed_triangles[i];
+            const Vec3 p[3] = { tri->v0, tri->v1, tri->v2 };
+            _RasterVertex rv[3];
+            for (int k = 0; k < 3; k++) {
+                float c[3];
+                _shadow_map_coord(sm, p[k], c);
+                rv[k].x = c[0]; rv[k].y = c[1]; rv[k].z = c[2]; rv[k].inv_w = 1.0f;
+            }
+            const float bx = rv[1].x - rv[0].x, by = rv[1].y - rv[0].y, bz = rv[1].z - rv[0].z;
+            const float cx = rv[2].x - rv[0].x, cy = rv[2].y - rv[0].y, cz = rv[2].z - rv[0].z;
+            const float area = bx * cy - by * cx;
+            if (area == 0.0f) continue;
+            const float dzdx = (bz * cy - cz * by) / area, dzdy = (cz * bx - bz * cx) / area;
+            const float offset = bias + slope_bias * fminf(fabsf(dzdx) + fabsf(dzdy), max_slope);
+            for (int k = 0; k < 3; k++) rv[k].z += offset;
+            _depth_triangle_kernel(&sm->depth, NULL, &rv[0], &rv[1], &rv[2], 0, DEPTH_FORMAT_F32);
+        }
+    }
+    sm->key   = key;
+    sm->valid = true;
+    sm->renders++;
+    return true;
 }
 
-static inline SDL_GPUGraphicsPipeline* _renderCreateModelPipeline(Gpu *gpu)
+inline float renderShadowFactor(const Renderer* r, const Vec3 p)
 {
-    SDL_GPUShader *vert = _renderCreateShader(gpu->device,
-        SDL_GPU_SHADERSTAGE_VERTEX,
-        _MSL_VERT, _SPIRV_VERT, sizeof(_SPIRV_VERT), 1);
-    SDL_GPUShader *frag = _renderCreateShader(gpu->device,
-        SDL_GPU_SHADERSTAGE_FRAGMENT,
-        _MSL_FRAG, _SPIRV_FRAG, sizeof(_SPIRV_FRAG), 0);
-    if (!vert || !frag) {
-        if (vert) SDL_ReleaseGPUShader(gpu->device, vert);
-        if (frag) SDL_ReleaseGPUShader(gpu->device, frag);
-        return NULL;
+    if (!_render_shadow_active(r)) return 1.0f;
+    float c[3];
+    _shadow_map_coord(&r->shadow, p, c);
+    return _shadow_lookup(&r->shadow, c[0], c[1], c[2]);
+}
+
+inline Light lightPoint(const Vec3 position, const Vec3 color, const float range)
+{
+    Light l = { LIGHT_POINT, position, color, range, vec3(0, -1, 0), 1.0f, 1.0f };
+    return l;
+}
+
+inline Light lightSpot(const Vec3 position, const Vec3 direction, const Vec3 color, const float range,
+    const float inner_deg, const float outer_deg)
+{
+    const float to_rad = (float)M_PI / 180.0f;
+    const float outer_cos = cosf(outer_deg * to_rad);
+    Light l = { LIGHT_SPOT, position, color, range, norm(direction), fmaxf(cosf(inner_deg * to_rad), outer_cos), outer_cos };
+    return l;
+}
+
+inline bool renderLightsUpdate(Renderer* r)
+{
+#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
+    if (r->gpu) return true;
+#endif
+    r->light_count = 0;
+    if (!r->lights || r->num_lights <= 0) return true;
+    const int tiles_x = (r->window->bWidth + (1 << RENDER_LIGHT_TILE_SHIFT) - 1) >> RENDER_LIGHT_TILE_SHIFT;
+    const int tiles_y = (r->window->bHeight + (1 << RENDER_LIGHT_TILE_SHIFT) - 1) >> RENDER_LIGHT_TILE_SHIFT;
+    const int words = (r->num_lights + 31) / 32;
+    const size_t n = (size_t)tiles_x * tiles_y * words;
+    if (tiles_x <= 0 || tiles_y <= 0) return false;
+    if (n > r->light_capacity) {
+        free(r->light_masks);
+        r->light_masks    = (uint32_t*)malloc(n * sizeof(uint32_t));
+        r->light_capacity = r->light_masks ? n : 0;
+        if (!r->light_masks) return false;
+    }
+    if ((size_t)r->num_lights > r->rect_capacity) {
+        free(r->light_rects);
+        r->light_rects   = malloc((size_t)r->num_lights * sizeof(_LightRect));
+        r->rect_capacity = r->light_rects ? (size_t)r->num_lights : 0;
+        if (!r->light_rects) return false;
     }
 
-    SDL_GPUVertexBufferDescription vbd = {};
-    vbd.slot             = 0;
-    vbd.pitch            = sizeof(_GpuVertex);
-    vbd.input_rate       = SDL_GPU_VERTEXINPUTRATE_VERTEX;
-    vbd.instance_step_rate = 0;
+    const Mat4 vp = _render_view_proj(r);
+    _LightRect* rects = (_LightRect*)r->light_rects;
+    for (int i = 0; i < r->num_lights; i++) rects[i] = _light_rect(r, &vp, &r->lights[i]);
+    r->light_words   = words;
+    r->light_tiles_x = tiles_x;
+    r->light_tiles_y = tiles_y;
+    _RenderLightCtx ctx = { r, rects };
+    jobParallelFor(tiles_y, _render_light_row, &ctx);
+    r->light_count = r->num_lights;
+    return true;
+}
 
-    SDL_GPUVertexAttribute attrs[3] = {};
-    attrs[0].location   = 0; attrs[0].buffer_slot = 0;
-    attrs[0].format     = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT3;
-    attrs[0].offset     = offsetof(_GpuVertex, px);
-    attrs[1].location   = 1; attrs[1].buffer_slot = 0;
-    attrs[1].format     = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT3;
-    attrs[1].offset     = offsetof(_GpuVertex, nx);
-    attrs[2].location   = 2; attrs[2].buffer_slot = 0;
-    attrs[2].format     = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT3;
-    attrs[2].offset     = offsetof(_GpuVertex, r);
+inline Vec3 renderLightsAt(const Renderer* r, const int x, const int y, const Vec3 p, const Vec3 n)
+{
+    if (!r->lights || r->num_lights <= 0) return vec3(0, 0, 0);
+    if (x < 0 || y < 0 || x >= r->window->bWidth || y >= r->window->bHeight || !_render_lights_ready(r))
+        return _light_accumulate(r->lights, r->num_lights, NULL, 0, p, n);
+    const size_t tile = (size_t)(y >> RENDER_LIGHT_TILE_SHIFT) * r->light_tiles_x + (x >> RENDER_LIGHT_TILE_SHIFT);
+    return _light_accumulate(r->lights, r->num_lights, r->light_masks + tile * r->light_words, r->light_words, p, n);
+}
 
-    SDL_GPUColorTargetDescription ctd = {};
-    ctd.format = SDL_GetGPUSwapchainTextureFormat(gpu->device, gpu->window->window);
+inline void renderComposite(Renderer* r)
+{
+#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
+    if (r->gpu) return;
+#endif
+    if (!r->oit.pending) return;
+    r->oit.pending = false;
+    if (!r->depth.valid || !r->window->buffer_valid || _render_msaa_samples(r) > 1) {
+        memset(r->oit.count, 0, r->oit.capacity);
+        return;
+    }
+    _RenderOitCtx ctx = { r, (r->depth.width + _RENDER_OIT_TILE - 1) / _RENDER_OIT_TILE };
+    jobParallelFor(ctx.tiles_x * ((r->depth.height + _RENDER_OIT_TILE - 1) / _RENDER_OIT_TILE), _render_oit_tile, &ctx);
+}
 
-    SDL_GPUTextureFormat depth_fmt = SDL_GPU_TEXTUREFORMAT_D32_FLOAT;
+inline void renderGetStats(const Renderer* r, RenderStats* s)
+{
+    *s = r->stats;
+    s->visible = 0;
+    if (r->depth.valid) {
+        const size_t n = (size_t)r->depth.width * r->depth.height;
+        const DepthBuffer* db = &r->depth;
+        for (size_t i = 0; i < n; i++)
+            s->visible += db->format == DEPTH_FORMAT_U16 ? db->depth16[i] != _DEPTH_U16_MAX :
+                          db->format == DEPTH_FORMAT_U24_REVERSED ? db->depth24[i] != 0 : db->depths[i] != FLT_MAX;
+    }
+    s->overdraw = s->visible ? (float)((double)s->shaded / (double)s->visible) : 0.0f;
+}
 
-    SDL_GPUGraphicsPipelineCreateInfo pci = {};
-    pci.vertex_shader   = vert;
-    pci.fragment_shader = frag;
-    pci.primitive_type  = SDL_GPU_PRIMITIVETYPE_TRIANGLELIST;
-    pci.vertex_input_state.vertex_buffer_descriptions  = &vbd;
-    pci.vertex_input_state.num_vertex_buffers          = 1;
-    pci.vertex_input_state.vertex_attributes           = attrs;
-    pci.vertex_input_state.num_vertex_attributes       = 3;
-    pci.target_info.num_color_targets                  = 1;
-    pci.target_info.color_target_descriptions          = &ctd;
-    pci.target_info.has_depth_stencil_target           = true;
-    pci.target_info.depth_stencil_format               = depth_fmt;
-    pci.rasterizer_state.fill_mode                     = SDL_GPU_FILLMODE_FILL;
-    pci.rasterizer_state.cull_mode                     = SDL_GPU_CULLMODE_BACK;
-    pci.rasterizer_state.front_face                    = SDL_GPU_FRONTFACE_COUNTER_CLOCKWISE;
-    pci.rasterizer_state.enable_depth_clip             = true;
-    pci.depth_stencil_state.enable_depth_test          = true;
-    pci.depth_stencil_state.enable_depth_write         = true;
-    pci.depth_stencil_state.compare_op                 = SDL_GPU_COMPAREOP_LESS;
+#endif // RENDER3D_IMPLEMENTATION
+#endif // WRAPPER_RENDER3D_H
 
-    SDL_GPUGraphicsPipeline *pl = SDL_CreateGPUGraphicsPipeline(gpu->device, &pci);
-    SDL_ReleaseGPUShader(gpu->device, vert);
-    SDL_ReleaseGPUShader(gpu->device, frag);
-    return pl;
+// ============================================================================
+// Dynamic resolution: scale the render buffer to hit a frame-time budget
+// ============================================================================
+#ifndef WRAPPER_DYNRES_H
+#define WRAPPER_DYNRES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    double target_ms;       // Budget for renderScene
+    float  min_scale;       // Bounds for Window_t::render_scale
+    float  max_scale;
+    float  max_step;        // Largest scale change per adjustment
+    float  quantum;         // Scales are rounded to multiples of this (avoids 1-pixel churn)
+    float  headroom;        // Hysteresis: grow only below target * (1 - headroom)
+    float  smoothing;       // Weight of the newest sample in the moving average (0..1]
+    int    cooldown;        // Frames to wait after a change before measuring again
+
+    float  scale;           // Current scale
+    float  pending;         // Scale applied by the next dynresApply (== scale if none)
+    double avg_ms;          // Smoothed renderScene time
+    double last_ms;
+    int    settle;          // Frames left in cooldown
+    int    changes;         // Number of resolution changes so far
+} DynRes;
+
+// Set up a controller; the scale starts at max_scale
+/*  -> Example:
+ *  DynRes dr;
+ *  dynresInit(&dr, 8.0, 0.4f, 1.0f); // 8 ms render budget, 40%..100% resolution
+ */
+void dynresInit(DynRes *d, double target_ms, float min_scale, float max_scale);
+
+// Reserve window and depth buffers for max_scale at the current window size, so changes never reallocate
+/*  -> Example:
+ *  dynresReserve(&dr, &renderer);
+ */
+bool dynresReserve(DynRes *d, Renderer *r);
+
+// Apply a pending resolution change (clears color and depth); call before drawing into the buffer
+/*  -> Example:
+ *  dynresApply(&dr, &renderer);
+ *  renderClear(&renderer);
+ */
+void dynresApply(DynRes *d, Renderer *r);
+
+// Feed one renderScene time and schedule a change for the next frame if needed
+/*  -> Example:
+ *  dynresUpdate(&dr, measured_ms);
+ */
+void dynresUpdate(DynRes *d, double render_ms);
+
+// dynresApply + timed renderScene + dynresUpdate
+/*  -> Example:
+ *  dynresRenderScene(&dr, &renderer, models, count);
+ */
+void dynresRenderScene(DynRes *d, Renderer *r, const Model *models, int count);
+
+#ifdef __cplusplus
 }
+#endif
 
-static inline SDL_GPUTexture* _renderCreateDepthTex(SDL_GPUDevice *dev, Uint32 w, Uint32 h)
+#ifdef DYNRES_IMPLEMENTATION
+
+inline void dynresInit(DynRes *d, const double target_ms, const float min_scale, const float max_scale)
 {
-    SDL_GPUTextureCreateInfo tci = {};
-    tci.type                 = SDL_GPU_TEXTURETYPE_2D;
-    tci.format               = SDL_GPU_TEXTUREFORMAT_D32_FLOAT;
-    tci.usage                = SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET;
-    tci.width                = w;
-    tci.height               = h;
-    tci.layer_count_or_depth = 1;
-    tci.num_levels           = 1;
-    return SDL_CreateGPUTexture(dev, &tci);
+    d->target_ms = target_ms;
+    d->min_scale = min_scale > 0.05f ? min_scale : 0.05f;
+    d->max_scale = max_scale > d->min_scale ? max_scale : d->min_scale;
+    d->max_step  = 0.1f;
+    d->quantum   = 1.0f / 32.0f;
+    d->headroom  = 0.15f;
+    d->smoothing = 0.2f;
+    d->cooldown  = 8;
+    d->scale     = d->max_scale;
+    d->pending   = d->max_scale;
+    d->avg_ms    = 0.0;
+    d->last_ms   = 0.0;
+    d->settle    = 0;
+    d->changes   = 0;
+}
+
+inline bool dynresReserve(DynRes *d, Renderer *r)
+{
+    const int mw = (int)ceilf((float)r->window->width  * d->max_scale);
+    const int mh = (int)ceilf((float)r->window->height * d->max_scale);
+    return bufferReserve(r->window, mw, mh) && renderReserve(r, mw, mh);
+}
+
+inline void dynresApply(DynRes *d, Renderer *r)
+{
+    Window_t *w = r->window;
+    if (d->pending != d->scale || w->render_scale != d->scale) {
+        d->scale = d->pending;
+        setRenderScale(w, d->scale);
+        if (!w->buffer_valid) resizeBuffer(w);
+    }
+    // Depth follows the new buffer size on the next renderClear/renderModel
+}
+
+inline void dynresUpdate(DynRes *d, const double render_ms)
+{
+    d->last_ms = render_ms;
+    if (d->settle > 0) {
+        // Frames right after a change still carry the old cost (caches, first-touch pages)
+        d->settle--;
+        d->avg_ms = render_ms;
+        return;
+    }
+    d->avg_ms = d->avg_ms > 0.0 ? d->avg_ms + (render_ms - d->avg_ms) * d->smoothing : render_ms;
+    if (d->avg_ms <= 0.0 || d->target_ms <= 0.0) return;
+
+    const bool over  = d->avg_ms > d->target_ms;
+    const bool under = d->avg_ms < d->target_ms * (1.0 - d->headroom);
+    if (!over && !under) return;
+
+    // Cost scales with pixel count, i.e. with scale^2
+    float want = d->scale * sqrtf((float)(d->target_ms / d->avg_ms));
+    if (want > d->scale + d->max_step) want = d->scale + d->max_step;
+    if (want < d->scale - d->max_step) want = d->scale - d->max_step;
+    want = d->quantum > 0.0f ? (over ? floorf(want / d->quantum) : ceilf(want / d->quantum)) * d->quantum : want;
+    if (want < d->min_scale) want = d->min_scale;
+    if (want > d->max_scale) want = d->max_scale;
+    if (want == d->scale) return;
+
+    d->pending = want;
+    d->settle  = d->cooldown;
+    d->changes++;
 }
 
+inline void dynresRenderScene(DynRes *d, Renderer *r, const Model *models, const int count)
+{
+    dynresApply(d, r);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    renderScene(r, models, count);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    dynresUpdate(d, (double)(t1.tv_sec - t0.tv_sec) * 1000.0 + (double)(t1.tv_nsec - t0.tv_nsec) / 1e6);
+}
+
+#endif // DYNRES_IMPLEMENTATION
+#endif // WRAPPER_DYNRES_H
+
+// ============================================================================
+// Temporal upsampling: render part of the pixels each frame, reproject the rest
+// ============================================================================
+#ifndef WRAPPER_TEMPORAL_H
+#define WRAPPER_TEMPORAL_H
+
+#ifdef __cplusplus
+extern "C" {
 #endif
-#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
-inline void renderInit(Renderer* r, Window_t* win, Camera* cam, Gpu* gpu)
-#else
-inline void renderInit(Renderer* r, Window_t* win, Camera* cam)
+
+typedef enum {
+    TEMPORAL_CHECKERBOARD = 0,  // Half the pixels per frame, the two checkerboards alternating
+    TEMPORAL_QUARTER            // One pixel of every 2x2 quad per frame, cycling through all four
+} TemporalPattern;
+
+// Pixels outside a frame's subset take the previous frame's color at the same world point, found through the
+// rendered neighbors' distances and the camera delta and clamped to those neighbors' color range. Disoccluded
+// pixels (no neighbor distance lands on matching history) get the neighbors' average instead.
+typedef struct {
+    TemporalPattern pattern;
+    float depth_tolerance;      // Relative distance mismatch above which history is rejected. Default 0.05
+    PixelSubset subset;         // Pixels this frame renders; off (all of them) while there is no history
+    unsigned frame;
+    int width, height;          // Buffer size of the frame in flight and of the history
+    Camera camera, prev;        // This frame's camera and the one the history was rendered with
+    bool history_valid;
+    uint32_t* history;          // Previous resolved frame
+    float* history_distance;
+    float* distance;            // This frame: eye distance along each pixel's ray, 0 for a miss (background)
+    int* band_counts;           // temporalResolve scratch: reused and interpolated pixels per band
+    size_t capacity;            // Pixels allocated
+    int reused;                 // Last temporalResolve: pixels taken from history
+    int interpolated;           // Last temporalResolve: pixels filled from their neighbors
+} Temporal;
+
+// Set up reprojection state; buffers are allocated by the first temporalBegin
+/*  -> Example:
+ *  Temporal tr;
+ *  temporalInit(&tr, TEMPORAL_CHECKERBOARD);
+ */
+void temporalInit(Temporal *t, TemporalPattern pattern);
+
+// Release the history buffers
+/*  -> Example:
+ *  temporalFree(&tr);
+ */
+void temporalFree(Temporal *t);
+
+// Drop the history (camera cuts, scene changes): the next frame renders every pixel
+/*  -> Example:
+ *  if (teleported) temporalReset(&tr);
+ */
+void temporalReset(Temporal *t);
+
+// Start a frame for the window buffer seen from cam: picks the pixel subset and clears the distances
+/*  -> Example:
+ *  if (!temporalBegin(&tr, &win, &camera)) return;
+ */
+bool temporalBegin(Temporal *t, const Window_t *w, const Camera *cam);
+
+// Whether pixel (x, y) is rendered this frame
+/*  -> Example:
+ *  if (!temporalPixel(&tr, x, y)) continue;
+ */
+bool temporalPixel(const Temporal *t, int x, int y);
+
+// Primary ray through the center of pixel (x, y), matching the rasterizer's projection
+/*  -> Example:
+ *  const Ray ray = temporalRay(&tr, x, y);
+ */
+Ray temporalRay(const Temporal *t, int x, int y);
+
+// Record the hit distance along temporalRay for a rendered pixel (leave it unset for a miss)
+/*  -> Example:
+ *  if (hit) temporalSetDistance(&tr, x, y, hit_t);
+ */
+void temporalSetDistance(Temporal *t, int x, int y, float distance);
+
+// Fill the pixels outside the subset in w->buffer, then keep the frame as history
+/*  -> Example:
+ *  temporalBegin(&tr, &win, &camera);
+ *  for (int y = 0; y < win.bHeight; y++)
+ *      for (int x = 0; x < win.bWidth; x++) {
+ *          if (!temporalPixel(&tr, x, y)) continue;
+ *          float hit_t;
+ *          win.buffer[y * win.bWidth + x] = trace(temporalRay(&tr, x, y), &hit_t);
+ *          if (hit_t > 0.0f) temporalSetDistance(&tr, x, y, hit_t);
+ *      }
+ *  temporalResolve(&tr, &win);
+ */
+void temporalResolve(Temporal *t, Window_t *w);
+
+// renderScene + renderComposite into the frame's subset, then temporalResolve (CPU renderer; msaa renders
+// every pixel and drops the history)
+/*  -> Example:
+ *  renderClear(&renderer);
+ *  temporalRenderScene(&tr, &renderer, models, count);
+ */
+void temporalRenderScene(Temporal *t, Renderer *r, const Model *models, int count);
+
+#ifdef __cplusplus
+}
 #endif
+
+#ifdef TEMPORAL_IMPLEMENTATION
+
+#define _TEMPORAL_BAND 16
+
+inline void temporalInit(Temporal *t, const TemporalPattern pattern)
+{
+    memset(t, 0, sizeof(*t));
+    t->pattern = pattern;
+    t->depth_tolerance = 0.05f;
+}
+
+inline void temporalFree(Temporal *t)
+{
+    free(t->history);
+    free(t->history_distance);
+    free(t->distance);
+    free(t->band_counts);
+    temporalInit(t, t->pattern);
+}
+
+inline void temporalReset(Temporal *t)
+{
+    t->history_valid = false;
+}
+
+inline bool temporalBegin(Temporal *t, const Window_t *w, const Camera *cam)
+{
+    if (!w->buffer_valid || w->bWidth <= 0 || w->bHeight <= 0) return false;
+    const size_t n = (size_t)w->bWidth * w->bHeight;
+    if (n > t->capacity) {
+        free(t->history);
+        free(t->history_distance);
+        free(t->distance);
+        free(t->band_counts);
+        t->history          = (uint32_t*)malloc(n * sizeof(uint32_t));
+        t->history_distance = (float*)malloc(n * sizeof(float));
+        t->distance         = (float*)malloc(n * sizeof(float));
+        t->band_counts      = (int*)malloc((n / _TEMPORAL_BAND + 1) * 2 * sizeof(int));
+        t->history_valid    = false;
+        t->capacity = t->history && t->history_distance && t->distance && t->band_counts ? n : 0;
+        if (!t->capacity) return false;
+    }
+    if (w->bWidth != t->width || w->bHeight != t->height) t->history_valid = false;
+    t->width  = w->bWidth;
+    t->height = w->bHeight;
+    t->camera = *cam;
+    memset(t->distance, 0, n * sizeof(float));
+
+    // Without history every pixel is rendered
+    memset(&t->subset, 0, sizeof(t->subset));
+    if (!t->history_valid) return true;
+    t->subset.on = true;
+    if (t->pattern == TEMPORAL_QUARTER) {
+        // Diagonal quad corners first, so any two consecutive frames cover both checkerboards
+        static const int phase[4][2] = { {0, 0}, {1, 1}, {0, 1}, {1, 0} };
+        t->subset.row_mask  = 1;
+        t->subset.row_phase = phase[t->frame & 3][0];
+        t->subset.col_phase = phase[t->frame & 3][1];
+    } else {
+        t->subset.shear     = 1;
+        t->subset.col_phase = (int)(t->frame & 1);
+    }
+    return true;
+}
+
+inline bool temporalPixel(const Temporal *t, const int x, const int y)
+{
+    const PixelSubset* s = &t->subset;
+    return !s->on || ((y & s->row_mask) == s->row_phase && (x & 1) == ((s->col_phase + y * s->shear) & 1));
+}
+
+// Unnormalized view direction through a pixel center: front + right * ndc_x * tan_x + up * ndc_y * tan_y
+static inline Vec3 _temporal_dir(const Camera* c, const int width, const int height, const float x, const float y)
+{
+    const float tan_y = tanf(c->fov * 0.5f * (float)M_PI / 180.0f);
+    const float tan_x = tan_y * (float)width / (float)height;
+    const float nx = (2.0f * (x + 0.5f) / (float)width - 1.0f) * tan_x;
+    const float ny = (1.0f - 2.0f * (y + 0.5f) / (float)height) * tan_y;
+    return add(c->front, add(mul(c->right, nx), mul(c->up, ny)));
+}
+
+inline Ray temporalRay(const Temporal *t, const int x, const int y)
+{
+    return (Ray){ t->camera.position, norm(_temporal_dir(&t->camera, t->width, t->height, (float)x, (float)y)) };
+}
+
+inline void temporalSetDistance(Temporal *t, const int x, const int y, const float distance)
+{
+    if (x < 0 || y < 0 || x >= t->width || y >= t->height) return;
+    t->distance[(size_t)y * t->width + x] = distance > 0.0f ? distance : 0.0f;
+}
+
+typedef struct {
+    Temporal* t;
+    uint32_t* buffer;
+    float tan_x, tan_y;         // Previous camera
+} _TemporalCtx;
+
+// History pixel showing the point at distance d along the unit ray dir (d == 0: the background in that
+// direction), or -1 when it is off screen or holds something else. err gets the relative distance mismatch.
+static inline int _temporal_reproject(const _TemporalCtx* ctx, const Vec3 dir, const float d, float* err)
 {
-    r->window           = win;
-    r->camera           = cam;
-    r->wireframe        = false;
-    r->backface_culling = true;
-    r->light_dir        = norm(vec3(0.3f, -1.0f, 0.5f));
-    r->light            = true;
+    const Temporal* t = ctx->t;
+    const Vec3 v = d > 0.0f ? sub(add(t->camera.position, mul(dir, d)), t->prev.position) : dir;
+    const float vz = dot(v, t->prev.front);
+    if (vz <= 1e-6f) return -1;
+    const float sx = dot(v, t->prev.right) / (vz * ctx->tan_x);
+    const float sy = dot(v, t->prev.up) / (vz * ctx->tan_y);
+    const float fx = (sx + 1.0f) * 0.5f * (float)t->width, fy = (1.0f - sy) * 0.5f * (float)t->height;
+    if (!(fx >= 0.0f && fy >= 0.0f && fx < (float)t->width && fy < (float)t->height)) return -1;
+    const int i = (int)fy * t->width + (int)fx;
+    const float hd = t->history_distance[i];
+    if (d <= 0.0f) {
+        *err = 0.0f;
+        return hd == 0.0f ? i : -1;
+    }
+    const float pd = len(v);
+    *err = fabsf(hd - pd) / pd;
+    return hd > 0.0f && *err <= t->depth_tolerance ? i : -1;
+}
 
-#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
-    r->gpu       = gpu;
-    r->gpu_ready = false;
-    r->pipeline  = NULL;
-    r->depth_tex = NULL;
-    r->depth_tex_w = 0;
-    r->depth_tex_h = 0;
+static void _temporal_band(void* user, const int band)
+{
+    const _TemporalCtx* ctx = (const _TemporalCtx*)user;
+    Temporal* t = ctx->t;
+    const int W = t->width, H = t->height;
+    const int y1 = (band + 1) * _TEMPORAL_BAND < H ? (band + 1) * _TEMPORAL_BAND : H;
+    int reused = 0, interpolated = 0;
+    for (int y = band * _TEMPORAL_BAND; y < y1; y++) {
+        for (int x = 0; x < W; x++) {
+            if (temporalPixel(t, x, y)) continue;
+
+            // Rendered 3x3 neighbors: color range and average, candidate distances
+            int n = 0, lo[4] = {255, 255, 255, 255}, hi[4] = {0, 0, 0, 0}, sum[4] = {0, 0, 0, 0};
+            float cand[8];
+            for (int dy = -1; dy <= 1; dy++) {
+                const int ny = y + dy;
+                if (ny < 0 || ny >= H) continue;
+                for (int dx = -1; dx <= 1; dx++) {
+                    const int nx = x + dx;
+                    if (nx < 0 || nx >= W || !temporalPixel(t, nx, ny)) continue;
+                    const uint32_t c = ctx->buffer[(size_t)ny * W + nx];
+                    for (int k = 0; k < 4; k++) {
+                        const int v = (int)(c >> (8 * k)) & 0xFF;
+                        lo[k] = v < lo[k] ? v : lo[k];
+                        hi[k] = v > hi[k] ? v : hi[k];
+                        sum[k] += v;
+                    }
+                    cand[n++] = t->distance[(size_t)ny * W + nx];
+                }
+            }
+            if (!n) continue;
+
+            // The candidate whose world point best matches the history wins; the nearest one stands in otherwise
+            const size_t i = (size_t)y * W + x;
+            const Vec3 dir = norm(_temporal_dir(&t->camera, W, H, (float)x, (float)y));
+            int best = -1;
+            float best_err = 0.0f, nearest = cand[0];
+            for (int k = 0; k < n; k++) {
+                if (cand[k] > 0.0f && (nearest == 0.0f || cand[k] < nearest)) nearest = cand[k];
+                float err;
+                const int h = t->history_valid ? _temporal_reproject(ctx, dir, cand[k], &err) : -1;
+                if (h >= 0 && (best < 0 || err < best_err)) { best = h; best_err = err; t->distance[i] = cand[k]; }
+            }
 
-    if (gpu) {
-        r->depth.depths = NULL;
-        r->depth.valid  = false;
-        r->pipeline     = _renderCreateModelPipeline(gpu);
-        if (!r->pipeline) return;
-        int sw, sh;
-        gpuGetDrawableSize(gpu, &sw, &sh);
-        r->depth_tex   = _renderCreateDepthTex(gpu->device, (Uint32)sw, (Uint32)sh);
-        r->depth_tex_w = (Uint32)sw;
-        r->depth_tex_h = (Uint32)sh;
-        r->gpu_ready   = (r->depth_tex != NULL);
+            uint32_t out = 0;
+            if (best >= 0) {
+                const uint32_t c = t->history[best];
+                for (int k = 0; k < 4; k++) {
+                    int v = (int)(c >> (8 * k)) & 0xFF;
+                    v = v < lo[k] ? lo[k] : v > hi[k] ? hi[k] : v;
+                    out |= (uint32_t)v << (8 * k);
+                }
+                reused++;
+            } else {
+                for (int k = 0; k < 4; k++) out |= (uint32_t)((sum[k] + n / 2) / n) << (8 * k);
+                t->distance[i] = nearest;
+                interpolated++;
+            }
+            ctx->buffer[i] = out;
+        }
+    }
+    t->band_counts[2 * band]     = reused;
+    t->band_counts[2 * band + 1] = interpolated;
+}
+
+inline void temporalResolve(Temporal *t, Window_t *w)
+{
+    if (!w->buffer_valid || w->bWidth != t->width || w->bHeight != t->height || !t->capacity) {
+        t->history_valid = false;
         return;
     }
-#endif
+    const size_t n = (size_t)t->width * t->height;
+    t->reused = t->interpolated = 0;
+    if (t->subset.on) {
+        const float tan_y = tanf(t->prev.fov * 0.5f * (float)M_PI / 180.0f);
+        _TemporalCtx ctx = { t, w->buffer, tan_y * (float)t->width / (float)t->height, tan_y };
+        const int bands = (t->height + _TEMPORAL_BAND - 1) / _TEMPORAL_BAND;
+        jobParallelFor(bands, _temporal_band, &ctx);
+        for (int b = 0; b < bands; b++) {
+            t->reused       += t->band_counts[2 * b];
+            t->interpolated += t->band_counts[2 * b + 1];
+        }
+    }
+    memcpy(t->history, w->buffer, n * sizeof(uint32_t));
+    memcpy(t->history_distance, t->distance, n * sizeof(float));
+    t->prev = t->camera;
+    t->history_valid = true;
+    t->frame++;
+}
+
+typedef struct {
+    Temporal* t;
+    const Renderer* r;
+    float a, b;                 // NDC z -> clip w: w = b / (a - z)
+} _TemporalDepthCtx;
 
-    r->depth.width  = win->bWidth;
-    r->depth.height = win->bHeight;
-    r->depth.depths = (float*)malloc(win->bWidth * win->bHeight * sizeof(float));
-    r->depth.valid  = (r->depth.depths != NULL);
-    if (r->depth.valid) renderClear(r);
+static void _temporal_depth_band(void* user, const int band)
+{
+    const _TemporalDepthCtx* ctx = (const _TemporalDepthCtx*)user;
+    Temporal* t = ctx->t;
+    const int y1 = (band + 1) * _TEMPORAL_BAND < t->height ? (band + 1) * _TEMPORAL_BAND : t->height;
+    for (int y = band * _TEMPORAL_BAND; y < y1; y++)
+        for (int x = 0; x < t->width; x++) {
+            if (!temporalPixel(t, x, y)) continue;
+            const float z = renderGetDepth(ctx->r, x, y);
+            if (z == FLT_MAX) continue;
+            // w is the distance along the view axis, and the pixel's direction has a unit front component
+            const Vec3 dir = _temporal_dir(&t->camera, t->width, t->height, (float)x, (float)y);
+            t->distance[(size_t)y * t->width + x] = ctx->b / (ctx->a - z) * len(dir);
+        }
 }
 
-inline void renderFree(Renderer* r)
+inline void temporalRenderScene(Temporal *t, Renderer *r, const Model *models, const int count)
 {
 #if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
     if (r->gpu) {
-        gpuReleasePipeline(r->gpu, &r->pipeline);
-        if (r->depth_tex) { SDL_ReleaseGPUTexture(r->gpu->device, r->depth_tex); r->depth_tex = NULL; }
-        r->gpu_ready = false;
+        renderScene(r, models, count);
+        return;
     }
 #endif
-    if (r->depth.depths) { free(r->depth.depths); r->depth.depths = NULL; }
-    r->depth.valid = false;
+    if (_render_msaa_samples(r) > 1 || !temporalBegin(t, r->window, r->camera)) {
+        renderScene(r, models, count);
+        t->history_valid = false;
+        return;
+    }
+    r->depth.subset = t->subset;
+    renderScene(r, models, count);
+    renderComposite(r);
+    memset(&r->depth.subset, 0, sizeof(r->depth.subset));
+    if (r->depth.width != t->width || r->depth.height != t->height) {
+        t->history_valid = false;
+        return;
+    }
+
+    _TemporalDepthCtx ctx = { t, r, (_RENDER_FAR + _RENDER_NEAR) / (_RENDER_FAR - _RENDER_NEAR),
+                              2.0f * _RENDER_FAR * _RENDER_NEAR / (_RENDER_FAR - _RENDER_NEAR) };
+    jobParallelFor((t->height + _TEMPORAL_BAND - 1) / _TEMPORAL_BAND, _temporal_depth_band, &ctx);
+    temporalResolve(t, r->window);
 }
 
-inline void renderClear(Renderer* r)
-{
-#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
-    if (r->gpu) return;
+#endif // TEMPORAL_IMPLEMENTATION
+#endif // WRAPPER_TEMPORAL_H
+
+// ============================================================================
+// Golden-image regression checks for the CPU renderer
+// ============================================================================
+#ifndef WRAPPER_GOLDEN_H
+#define WRAPPER_GOLDEN_H
+
+#ifdef __cplusplus
+extern "C" {
 #endif
-    if (!r->depth.valid) return;
-    const int size = r->depth.width * r->depth.height;
-    for (int i = 0; i < size; i++) {
-        r->depth.depths[i] = FLT_MAX;
-        r->window->buffer[i] = 0x000000;
-    }
+
+// Per-pixel tolerances for comparing a render against its reference
+typedef struct {
+    int   color_tolerance;   // Max per-channel difference (0-255)
+    float depth_tolerance;   // Max absolute depth difference
+    int   max_bad_pixels;    // Pixels allowed outside tolerance before the check fails
+    bool  write_diff;        // Write <ref>.<variant>.diff.ppm on failure
+} GoldenOptions;
+
+// Result of a single comparison
+typedef struct {
+    int   bad_color;         // Pixels outside color_tolerance
+    int   bad_depth;         // Pixels outside depth_tolerance
+    int   max_color_diff;
+    float max_depth_diff;
+    bool  passed;
+} GoldenResult;
+
+// Built-in canonical scenes (procedural geometry, no asset files needed)
+typedef enum {
+    GOLDEN_SCENE_BOXES = 0,  // Rotated lit boxes at different depths
+    GOLDEN_SCENE_INTERSECT,  // Interpenetrating quads (depth test)
+    GOLDEN_SCENE_SPHERE,     // Dense sphere of small triangles in front of a box
+    GOLDEN_SCENE_COUNT
+} GoldenScene;
+
+// Default tolerances (exact color, small depth epsilon)
+/*  -> Example:
+ *  GoldenOptions opt;
+ *  goldenOptionsInit(&opt);
+ *  opt.color_tolerance = 2;
+ */
+void goldenOptionsInit(GoldenOptions *o);
+
+// Create a window with a framebuffer but without a display (headless rendering)
+/*  -> Example:
+ *  Window_t win;
+ *  ASSERT(goldenHeadlessInit(&win, 320, 240));
+ *  ...
+ *  destroyWindow(&win);
+ */
+bool goldenHeadlessInit(Window_t *w, int width, int height);
+
+// Build a canonical scene into model storage and place the camera (returns model count)
+/*  -> Example:
+ *  Model models[8];
+ *  const int n = goldenBuildScene(GOLDEN_SCENE_BOXES, models, 8, &cam);
+ */
+int goldenBuildScene(GoldenScene scene, Model *storage, int max, Camera *cam);
+
+// Compare color (and optionally depth) against a reference; fills diff if given
+/*  -> Example:
+ *  GoldenResult res = goldenCompare(&img, depth, &ref, ref_depth, &opt, &diff);
+ */
+GoldenResult goldenCompare(const Image *color, const float *depth,
+                           const Image *ref_color, const float *ref_depth,
+                           const GoldenOptions *o, Image *diff);
+
+// Render models through renderScene once per CPU variant (scalar, SSE, AVX2, multi-threaded)
+// and compare w->buffer and depth against <ref_base>.ppm / <ref_base>.pfm.
+// References are recorded from the scalar path only when both files are absent; a missing half, an unreadable
+// file or a size other than the buffer's fails. Returns true if all variants pass.
+/*  -> Example:
+ *  ASSERT(goldenCheck(&renderer, models, n, "tests/golden/boxes", &opt));
+ */
+bool goldenCheck(Renderer *r, const Model *models, int count, const char *ref_base, const GoldenOptions *o);
+
+#ifdef __cplusplus
 }
+#endif
 
-inline void renderModel(Renderer* r, const Model* m)
+#ifdef GOLDEN_IMPLEMENTATION
+
+typedef struct {
+    const char  *name;
+    CpuSimdLevel simd;
+    int          threads;
+} _GoldenVariant;
+
+static const _GoldenVariant _golden_variants[] = {
+    { "scalar", CPU_SIMD_SCALAR, 1 },
+    { "sse",    CPU_SIMD_SSE,    1 },
+    { "avx2",   CPU_SIMD_AVX2,   1 },
+    { "mt",     CPU_SIMD_AVX2,   4 },
+};
+
+inline void goldenOptionsInit(GoldenOptions *o)
 {
-#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
-    if (r->gpu) { (void)m; return; }
-#endif
+    o->color_tolerance = 0;
+    o->depth_tolerance = 1e-5f;
+    o->max_bad_pixels  = 0;
+    o->write_diff      = true;
+}
 
-    if (!r->depth.valid || !m || m->num_triangles == 0) return;
+inline bool goldenHeadlessInit(Window_t *w, const int width, const int height)
+{
+    windowInit(w);
+    w->width   = width;
+    w->height  = height;
+    w->bWidth  = width;
+    w->bHeight = height;
+    return resizeBuffer(w);
+}
 
-    Mat4 view = {0};
-    view.m[0] = r->camera->right.x;   view.m[4] = r->camera->right.y;   view.m[8]  = r->camera->right.z;  view.m[12] = -dot(r->camera->right, r->camera->position);
-    view.m[1] = r->camera->up.x;      view.m[5] = r->camera->up.y;      view.m[9]  = r->camera->up.z;     view.m[13] = -dot(r->camera->up,    r->camera->position);
-    view.m[2] = -r->camera->front.x;  view.m[6] = -r->camera->front.y;  view.m[10] = -r->camera->front.z; view.m[14] =  dot(r->camera->front,  r->camera->position);
-    view.m[15] = 1.0f;
+static inline void _golden_alloc(Model *m, const int n)
+{
+    m->triangles             = (Triangle*)malloc(n * sizeof(Triangle));
+    m->transformed_triangles = (Triangle*)malloc(n * sizeof(Triangle));
+    assert(m->triangles && m->transformed_triangles && "Failed to allocate golden scene triangles");
+    m->num_triangles = 0;
+    m->capacity      = n;
+}
 
-    const float aspect = (float)r->window->bWidth / (float)r->window->bHeight;
-    const Mat4 proj = _perspective(r->camera->fov, aspect, 0.1f, 1000.0f);
-    const Mat4 vp   = _mat4_mul(&proj, &view);
+static inline Triangle *_golden_tri(Model *m, const Vec3 a, const Vec3 b, const Vec3 c)
+{
+    if (m->num_triangles >= m->capacity) return NULL;
+    Triangle *t = &m->triangles[m->num_triangles++];
+    memset(t, 0, sizeof(*t));
+    t->v0 = a; t->v1 = b; t->v2 = c;
+    t->color = m->mat.color;
+    return t;
+}
 
-    for (int i = 0; i < m->num_triangles; i++) {
-        const Triangle* tri = &m->transformed_triangles[i];
-        float w0, w1, w2;
-        Vec3 c0 = _mat4_mul_vec3(&vp, tri->v0, &w0);
-        Vec3 c1 = _mat4_mul_vec3(&vp, tri->v1, &w1);
-        Vec3 c2 = _mat4_mul_vec3(&vp, tri->v2, &w2);
-        if (w0 <= 0.0f || w1 <= 0.0f || w2 <= 0.0f) continue;
-        c0 = vdiv(c0, w0); c1 = vdiv(c1, w1); c2 = vdiv(c2, w2);
-        if (r->backface_culling) if (sub(c1,c0).x*sub(c2,c0).y - sub(c1,c0).y*sub(c2,c0).x <= 0.0f) continue;
-        const float z0=c0.z, z1=c1.z, z2=c2.z;
-        _to_screen(&c0, r->window->bWidth, r->window->bHeight);
-        _to_screen(&c1, r->window->bWidth, r->window->bHeight);
-        _to_screen(&c2, r->window->bWidth, r->window->bHeight);
-        const Vec3 normal = norm(cross(sub(tri->v1, tri->v0), sub(tri->v2, tri->v0)));
-        float brightness = 1.0f;
-        if (r->light) brightness = fmaxf(0.0f, -dot(normal, r->light_dir));
-        const uint32_t color = _vec3_to_color(mul(tri->color, brightness), 1.0f);
-        _fill_triangle(r->window, &r->depth, c0, c1, c2, z0, z1, z2, color);
+// Axis-aligned box centered at origin, outward CCW winding
+static inline void _golden_box(Model *m, const Vec3 h)
+{
+    _golden_alloc(m, 12);
+    const Vec3 axes[3] = { vec3(1,0,0), vec3(0,1,0), vec3(0,0,1) };
+    for (int a = 0; a < 3; a++) {
+        for (int s = -1; s <= 1; s += 2) {
+            const Vec3 n = mul(axes[a], (float)s);
+            const Vec3 u = mul(axes[(a + 1) % 3], (float)s);
+            const Vec3 v = axes[(a + 2) % 3];
+            const Vec3 c = vmul(n, h);
+            const Vec3 hu = vmul(u, h), hv = vmul(v, h);
+            const Vec3 p0 = sub(sub(c, hu), hv), p1 = sub(add(c, hu), hv);
+            const Vec3 p2 = add(add(c, hu), hv), p3 = add(sub(c, hu), hv);
+            _golden_tri(m, p0, p1, p2);
+            _golden_tri(m, p0, p2, p3);
+        }
     }
 }
 
-inline void renderScene(Renderer* r, const Model* models, int count)
+// Single quad in the XY plane facing -Z (towards the golden camera)
+static inline void _golden_quad(Model *m, const float hw, const float hh)
 {
-#if defined(GPU_IMPLEMENTATION) && defined(SDL_IMPLEMENTATION)
-    if (r->gpu && r->gpu_ready) {
+    _golden_alloc(m, 2);
+    _golden_tri(m, vec3(-hw, -hh, 0), vec3(-hw, hh, 0), vec3(hw, hh, 0));
+    _golden_tri(m, vec3(-hw, -hh, 0), vec3(hw, hh, 0), vec3(hw, -hh, 0));
+}
 
-        int sw, sh;
-        gpuGetDrawableSize(r->gpu, &sw, &sh);
-        if ((Uint32)sw != r->depth_tex_w || (Uint32)sh != r->depth_tex_h) {
-            if (r->depth_tex) SDL_ReleaseGPUTexture(r->gpu->device, r->depth_tex);
-            r->depth_tex   = _renderCreateDepthTex(r->gpu->device, (Uint32)sw, (Uint32)sh);
-            r->depth_tex_w = (Uint32)sw;
-            r->depth_tex_h = (Uint32)sh;
-            if (!r->depth_tex) return;
+// UV sphere, outward CCW winding
+static inline void _golden_sphere(Model *m, const float radius, const int rings, const int segments)
+{
+    _golden_alloc(m, rings * segments * 2);
+    for (int i = 0; i < rings; i++) {
+        const float t0 = PI * (float)i / (float)rings, t1 = PI * (float)(i + 1) / (float)rings;
+        for (int j = 0; j < segments; j++) {
+            const float f0 = 2.0f * PI * (float)j / (float)segments, f1 = 2.0f * PI * (float)(j + 1) / (float)segments;
+            const Vec3 p00 = mul(vec3(sinf(t0)*cosf(f0), cosf(t0), sinf(t0)*sinf(f0)), radius);
+            const Vec3 p01 = mul(vec3(sinf(t0)*cosf(f1), cosf(t0), sinf(t0)*sinf(f1)), radius);
+            const Vec3 p10 = mul(vec3(sinf(t1)*cosf(f0), cosf(t1), sinf(t1)*sinf(f0)), radius);
+            const Vec3 p11 = mul(vec3(sinf(t1)*cosf(f1), cosf(t1), sinf(t1)*sinf(f1)), radius);
+            Triangle *t;
+            // Radial vertex normals so smooth shading can be checked against the analytic surface
+            if (i != 0 && (t = _golden_tri(m, p00, p01, p11)))
+                { t->n0 = norm(p00); t->n1 = norm(p01); t->n2 = norm(p11); }
+            if (i != rings - 1 && (t = _golden_tri(m, p00, p11, p10)))
+                { t->n0 = norm(p00); t->n1 = norm(p11); t->n2 = norm(p10); }
         }
+    }
+}
 
-        int total_tris = 0;
-        for (int i = 0; i < count; i++) total_tris += models[i].num_triangles;
-        if (total_tris == 0) return;
+inline int goldenBuildScene(const GoldenScene scene, Model *storage, const int max, Camera *cam)
+{
+    int n = 0;
+    Model *m;
+
+    cameraInit(cam);
+    // Looking down +Z so camera-facing surfaces are lit by the default light_dir
+    cam->position = vec3(0.0f, 2.0f, -6.0f);
+    cam->yaw      = 90.0f;
+    cam->pitch    = -15.0f;
+    cameraUpdate(cam);
 
-        const Uint32 vtx_count = (Uint32)(total_tris * 3);
-        const Uint32 vtx_bytes = vtx_count * sizeof(_GpuVertex);
+    switch (scene) {
+        case GOLDEN_SCENE_BOXES:
+            if ((m = modelCreate(storage, &n, max, vec3(0.9f, 0.2f, 0.2f), 0.0f, 0.0f))) {
+                _golden_box(m, vec3(1.0f, 1.0f, 1.0f));
+                modelTransform(m, vec3(-1.8f, 0.0f, -1.0f), vec3(0.4f, 0.6f, 0.0f), vec3(1, 1, 1));
+            }
+            if ((m = modelCreate(storage, &n, max, vec3(0.2f, 0.9f, 0.2f), 0.0f, 0.0f))) {
+                _golden_box(m, vec3(0.8f, 1.4f, 0.8f));
+                modelTransform(m, vec3(0.3f, -0.2f, 0.5f), vec3(-0.3f, 0.9f, 0.2f), vec3(1, 1, 1));
+            }
+            if ((m = modelCreate(storage, &n, max, vec3(0.2f, 0.4f, 0.9f), 0.0f, 0.0f))) {
+                _golden_box(m, vec3(3.0f, 0.2f, 3.0f));
+                modelTransform(m, vec3(0.0f, -1.6f, -1.0f), vec3(0.1f, 0.0f, 0.0f), vec3(1, 1, 1));
+            }
+            break;
 
-        SDL_GPUTransferBufferCreateInfo tbci = {};
-        tbci.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
-        tbci.size  = vtx_bytes;
-        SDL_GPUTransferBuffer *tb = SDL_CreateGPUTransferBuffer(r->gpu->device, &tbci);
-        if (!tb) return;
+        case GOLDEN_SCENE_INTERSECT:
+            if ((m = modelCreate(storage, &n, max, vec3(1.0f, 0.8f, 0.1f), 0.0f, 0.0f))) {
+                _golden_quad(m, 2.0f, 1.5f);
+                modelTransform(m, vec3(0, 0, 0), vec3(0.0f, 0.5f, 0.0f), vec3(1, 1, 1));
+            }
+            if ((m = modelCreate(storage, &n, max, vec3(0.1f, 0.8f, 1.0f), 0.0f, 0.0f))) {
+                _golden_quad(m, 2.0f, 1.5f);
+                modelTransform(m, vec3(0, 0, 0), vec3(0.0f, -0.5f, 0.0f), vec3(1, 1, 1));
+            }
+            if ((m = modelCreate(storage, &n, max, vec3(0.8f, 0.3f, 0.8f), 0.0f, 0.0f))) {
+                _golden_quad(m, 1.0f, 2.0f);
+                modelTransform(m, vec3(0.5f, 0, 0), vec3(0.6f, 0.0f, 0.3f), vec3(1, 1, 1));
+            }
+            break;
 
-        _GpuVertex *vtx = (_GpuVertex*)SDL_MapGPUTransferBuffer(r->gpu->device, tb, false);
-        if (!vtx) { SDL_ReleaseGPUTransferBuffer(r->gpu->device, tb); return; }
+        case GOLDEN_SCENE_SPHERE:
+            if ((m = modelCreate(storage, &n, max, vec3(0.9f, 0.9f, 0.9f), 0.0f, 0.0f))) {
+                _golden_sphere(m, 1.5f, 32, 64);
+                modelTransform(m, vec3(0.0f, 0.0f, 0.0f), vec3(0.3f, 0.0f, 0.0f), vec3(1, 1, 1));
+            }
+            if ((m = modelCreate(storage, &n, max, vec3(0.9f, 0.5f, 0.1f), 0.0f, 0.0f))) {
+                _golden_box(m, vec3(2.5f, 2.5f, 0.5f));
+                modelTransform(m, vec3(0.0f, 0.0f, 2.5f), vec3(0.0f, 0.3f, 0.0f), vec3(1, 1, 1));
+            }
+            break;
 
-        int vi = 0;
-        for (int mi = 0; mi < count; mi++) {
-            const Model *m = &models[mi];
-            for (int ti = 0; ti < m->num_triangles; ti++) {
-                const Triangle *t = &m->transformed_triangles[ti];
-                const Vec3 n = norm(cross(sub(t->v1, t->v0), sub(t->v2, t->v0)));
+        default:
+            break;
+    }
 
-                vtx[vi].px=t->v0.x; vtx[vi].py=t->v0.y; vtx[vi].pz=t->v0.z;
-                vtx[vi].nx=n.x;     vtx[vi].ny=n.y;     vtx[vi].nz=n.z;
-                vtx[vi].r=t->color.x; vtx[vi].g=t->color.y; vtx[vi].b=t->color.z; vi++;
+    modelUpdate(storage, n);
+    return n;
+}
 
-                vtx[vi].px=t->v1.x; vtx[vi].py=t->v1.y; vtx[vi].pz=t->v1.z;
-                vtx[vi].nx=n.x;     vtx[vi].ny=n.y;     vtx[vi].nz=n.z;
-                vtx[vi].r=t->color.x; vtx[vi].g=t->color.y; vtx[vi].b=t->color.z; vi++;
+inline GoldenResult goldenCompare(const Image *color, const float *depth,
+                                  const Image *ref_color, const float *ref_depth,
+                                  const GoldenOptions *o, Image *diff)
+{
+    GoldenResult res = {0, 0, 0, 0.0f, false};
+    if (color->width != ref_color->width || color->height != ref_color->height) {
+        fprintf(stderr, "[golden] size mismatch: %dx%d vs reference %dx%d\n",
+                color->width, color->height, ref_color->width, ref_color->height);
+        return res;
+    }
 
-                vtx[vi].px=t->v2.x; vtx[vi].py=t->v2.y; vtx[vi].pz=t->v2.z;
-                vtx[vi].nx=n.x;     vtx[vi].ny=n.y;     vtx[vi].nz=n.z;
-                vtx[vi].r=t->color.x; vtx[vi].g=t->color.y; vtx[vi].b=t->color.z; vi++;
+    const int w = color->width, h = color->height;
+    for (int y = 0; y < h; y++) {
+        const uint32_t *a = color->pixels     + (size_t)y * color->pitch;
+        const uint32_t *b = ref_color->pixels + (size_t)y * ref_color->pitch;
+        uint32_t *d = diff ? diff->pixels + (size_t)y * diff->pitch : NULL;
+
+        for (int x = 0; x < w; x++) {
+            int cd = 0;
+            for (int s = 0; s < 24; s += 8) {
+                const int ca = (int)((a[x] >> s) & 0xFF), cb = (int)((b[x] >> s) & 0xFF);
+                const int dd = ca > cb ? ca - cb : cb - ca;
+                if (dd > cd) cd = dd;
+            }
+            if (cd > res.max_color_diff) res.max_color_diff = cd;
+            const bool bad_c = cd > o->color_tolerance;
+
+            bool bad_d = false;
+            if (depth && ref_depth) {
+                const float za = depth[y * w + x], zb = ref_depth[y * w + x];
+                const float dz = fabsf(za - zb);
+                if (dz > res.max_depth_diff) res.max_depth_diff = dz;
+                bad_d = dz > o->depth_tolerance;
             }
-        }
-        SDL_UnmapGPUTransferBuffer(r->gpu->device, tb);
 
-        SDL_GPUBufferCreateInfo bci = {};
-        bci.usage = SDL_GPU_BUFFERUSAGE_VERTEX;
-        bci.size  = vtx_bytes;
-        SDL_GPUBuffer *vbuf = SDL_CreateGPUBuffer(r->gpu->device, &bci);
-        if (!vbuf) { SDL_ReleaseGPUTransferBuffer(r->gpu->device, tb); return; }
+            res.bad_color += bad_c;
+            res.bad_depth += bad_d;
 
-        Mat4 view = {0};
-        view.m[0] = r->camera->right.x;  view.m[4] = r->camera->right.y;  view.m[8]  = r->camera->right.z;  view.m[12] = -dot(r->camera->right, r->camera->position);
-        view.m[1] = r->camera->up.x;     view.m[5] = r->camera->up.y;     view.m[9]  = r->camera->up.z;     view.m[13] = -dot(r->camera->up,    r->camera->position);
-        view.m[2] =-r->camera->front.x;  view.m[6] =-r->camera->front.y;  view.m[10] =-r->camera->front.z;  view.m[14] =  dot(r->camera->front,  r->camera->position);
-        view.m[15]= 1.0f;
+            if (d) {
+                // red = color mismatch, green = depth-only mismatch, dimmed reference otherwise
+                if (bad_c)      d[x] = 0xFF000000u | ((uint32_t)(128 + cd / 2) << 16);
+                else if (bad_d) d[x] = 0xFF00C000u;
+                else            d[x] = 0xFF000000u | ((b[x] >> 2) & 0x003F3F3Fu);
+            }
+        }
+    }
 
-        const float aspect = sw > 0 && sh > 0 ? (float)sw / (float)sh : 1.0f;
-        const Mat4 proj   = _perspective(r->camera->fov, aspect, 0.1f, 1000.0f);
-        const Mat4 vp_mat = _mat4_mul(&proj, &view);
+    res.passed = res.bad_color <= o->max_bad_pixels && res.bad_depth <= o->max_bad_pixels;
+    return res;
+}
 
-        _GpuModelUniforms u = {};
-        memcpy(u.vp, vp_mat.m, sizeof(u.vp));
-        u.light_dir[0] = r->light_dir.x;
-        u.light_dir[1] = r->light_dir.y;
-        u.light_dir[2] = r->light_dir.z;
-        u.light_dir[3] = 0.0f;
-        u.use_light    = r->light ? 1.0f : 0.0f;
+// Portable float map, single channel, little endian, rows stored bottom-up
+static inline bool _golden_write_pfm(const char *path, const float *data, const int w, const int h)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    fprintf(f, "Pf\n%d %d\n-1.0\n", w, h);
+    bool ok = true;
+    for (int y = h - 1; y >= 0 && ok; y--)
+        ok = fwrite(data + (size_t)y * w, sizeof(float), (size_t)w, f) == (size_t)w;
+    fclose(f);
+    return ok;
+}
 
-        GpuRenderPass frame;
-        if (!gpuBeginRender(r->gpu, &frame)) {
-            SDL_ReleaseGPUBuffer(r->gpu->device, vbuf);
-            SDL_ReleaseGPUTransferBuffer(r->gpu->device, tb);
-            return;
-        }
-        if (!frame.swapchain) {
-            SDL_ReleaseGPUBuffer(r->gpu->device, vbuf);
-            SDL_ReleaseGPUTransferBuffer(r->gpu->device, tb);
-            return;
-        }
+static inline float *_golden_read_pfm(const char *path, const int w, const int h)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
 
-        SDL_GPUCopyPass *cp = SDL_BeginGPUCopyPass(frame.cmd);
-        SDL_GPUTransferBufferLocation src_loc = {};
-        src_loc.transfer_buffer = tb;
-        SDL_GPUBufferRegion dst_reg = {};
-        dst_reg.buffer = vbuf;
-        dst_reg.size   = vtx_bytes;
-        SDL_UploadToGPUBuffer(cp, &src_loc, &dst_reg, false);
-        SDL_EndGPUCopyPass(cp);
-        SDL_ReleaseGPUTransferBuffer(r->gpu->device, tb);
+    int fw = 0, fh = 0;
+    float scale = 0.0f;
+    if (fscanf(f, "Pf %d %d %f", &fw, &fh, &scale) != 3 || fw != w || fh != h || scale >= 0.0f || fgetc(f) == EOF) {
+        fclose(f);
+        return NULL;
+    }
 
-        imguiPrepareDrawData(frame.cmd);
+    float *data = (float*)malloc((size_t)w * h * sizeof(float));
+    assert(data && "Failed to allocate golden depth buffer");
+    bool ok = true;
+    for (int y = h - 1; y >= 0 && ok; y--)
+        ok = fread(data + (size_t)y * w, sizeof(float), (size_t)w, f) == (size_t)w;
+    fclose(f);
 
-        SDL_GPUColorTargetInfo color_tgt = {};
-        color_tgt.texture     = frame.swapchain;
-        color_tgt.load_op     = SDL_GPU_LOADOP_CLEAR;
-        color_tgt.store_op    = SDL_GPU_STOREOP_STORE;
-        color_tgt.clear_color = {r->gpu->clear_r, r->gpu->clear_g, r->gpu->clear_b, r->gpu->clear_a};
+    if (!ok) { free(data); return NULL; }
+    return data;
+}
 
-        SDL_GPUDepthStencilTargetInfo depth_tgt = {};
-        depth_tgt.texture     = r->depth_tex;
-        depth_tgt.load_op     = SDL_GPU_LOADOP_CLEAR;
-        depth_tgt.store_op    = SDL_GPU_STOREOP_DONT_CARE;
-        depth_tgt.clear_depth = 1.0f;
+static inline bool _golden_exists(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    fclose(f);
+    return true;
+}
 
-        SDL_GPURenderPass *scene_pass = SDL_BeginGPURenderPass(frame.cmd, &color_tgt, 1, &depth_tgt);
-        SDL_BindGPUGraphicsPipeline(scene_pass, r->pipeline);
-        SDL_PushGPUVertexUniformData(frame.cmd, 0, &u, sizeof(u));
-        SDL_GPUBufferBinding vbind = { .buffer = vbuf, .offset = 0 };
-        SDL_BindGPUVertexBuffers(scene_pass, 0, &vbind, 1);
-        SDL_DrawGPUPrimitives(scene_pass, vtx_count, 1, 0, 0);
-        SDL_EndGPURenderPass(scene_pass);
+static inline void _golden_render(Renderer *r, const Model *models, const int count)
+{
+    renderClear(r);
+    renderScene(r, models, count);
+}
 
-        SDL_GPUColorTargetInfo imgui_tgt = {};
-        imgui_tgt.texture  = frame.swapchain;
-        imgui_tgt.load_op  = SDL_GPU_LOADOP_LOAD;
-        imgui_tgt.store_op = SDL_GPU_STOREOP_STORE;
-        SDL_GPURenderPass *imgui_pass = SDL_BeginGPURenderPass(frame.cmd, &imgui_tgt, 1, NULL);
-        imguiRenderDrawData(frame.cmd, imgui_pass);
-        SDL_EndGPURenderPass(imgui_pass);
+inline bool goldenCheck(Renderer *r, const Model *models, const int count, const char *ref_base, const GoldenOptions *o)
+{
+    Window_t *w = r->window;
+    if (!w->buffer_valid || !r->depth.valid) return false;
+    if (r->depth.format != DEPTH_FORMAT_F32) return false; // References store float depth
+
+    char color_path[1024], depth_path[1024], diff_path[1024];
+    snprintf(color_path, sizeof(color_path), "%s.ppm", ref_base);
+    snprintf(depth_path, sizeof(depth_path), "%s.pfm", ref_base);
+
+    const CpuSimdLevel saved_simd    = cpuGetSimdLevel();
+    const int          saved_threads = _cpu_thread_count;
+
+    Image fb;
+    imageWrap(&fb, w->buffer, w->bWidth, w->bHeight, w->bWidth);
+
+    const bool have_color = _golden_exists(color_path), have_depth = _golden_exists(depth_path);
+    if (!have_color && !have_depth) {
+        // No reference yet: record one from the scalar path
+        cpuSetSimdLevel(CPU_SIMD_SCALAR);
+        cpuSetThreadCount(1);
+        _golden_render(r, models, count);
+        cpuSetSimdLevel(saved_simd);
+        cpuSetThreadCount(saved_threads);
+
+        const bool ok = imageSavePPM(&fb, color_path) && _golden_write_pfm(depth_path, r->depth.depths, w->bWidth, w->bHeight);
+        fprintf(stderr, "[golden] %s: %s reference\n", ref_base, ok ? "recorded" : "FAILED to record");
+        return ok;
+    }
 
-        gpuEndRender(r->gpu, &frame);
-        SDL_ReleaseGPUBuffer(r->gpu->device, vbuf);
-        return;
+    // Anything short of a complete, readable pair at the current size fails and leaves the files alone
+    Image ref;
+    memset(&ref, 0, sizeof(ref));
+    float *ref_depth = NULL;
+    if (!have_color || !have_depth) {
+        fprintf(stderr, "[golden] %s: FAILED (%s missing)\n", ref_base, have_color ? depth_path : color_path);
+        return false;
     }
-#endif
-    for (int i = 0; i < count; i++) renderModel(r, &models[i]);
+    if (!imageLoadPPM(&ref, color_path) || ref.width != w->bWidth || ref.height != w->bHeight ||
+        !(ref_depth = _golden_read_pfm(depth_path, w->bWidth, w->bHeight))) {
+        fprintf(stderr, "[golden] %s: FAILED (reference unreadable or not %dx%d)\n", ref_base, w->bWidth, w->bHeight);
+        imageFree(&ref);
+        return false;
+    }
+
+    Image diff;
+    const bool have_diff = o->write_diff && imageCreate(&diff, w->bWidth, w->bHeight);
+
+    bool all_passed = true;
+    const int nvariants = (int)(sizeof(_golden_variants) / sizeof(_golden_variants[0]));
+    for (int i = 0; i < nvariants; i++) {
+        const _GoldenVariant *v = &_golden_variants[i];
+        cpuSetSimdLevel(v->simd);
+        if (v->threads == 1 && cpuGetSimdLevel() != v->simd) continue; // not compiled in
+        cpuSetThreadCount(v->threads);
+
+        _golden_render(r, models, count);
+        const GoldenResult res = goldenCompare(&fb, r->depth.depths, &ref, ref_depth, o, have_diff ? &diff : NULL);
+
+        fprintf(stderr, "[golden] %s/%s: %s (color %d bad, max %d | depth %d bad, max %g)\n",
+                ref_base, v->name, res.passed ? "ok" : "FAILED",
+                res.bad_color, res.max_color_diff, res.bad_depth, (double)res.max_depth_diff);
+
+        if (!res.passed) {
+            all_passed = false;
+            if (have_diff) {
+                snprintf(diff_path, sizeof(diff_path), "%s.%s.diff.ppm", ref_base, v->name);
+                imageSavePPM(&diff, diff_path);
+            }
+        }
+    }
+
+    cpuSetSimdLevel(saved_simd);
+    cpuSetThreadCount(saved_threads);
+    if (have_diff) imageFree(&diff);
+    imageFree(&ref);
+    free(ref_depth);
+    return all_passed;
 }
 
-#endif // RENDER3D_IMPLEMENTATION
-#endif // WRAPPER_RENDER3D_H
+#endif // GOLDEN_IMPLEMENTATION
+#endif // WRAPPER_GOLDEN_H
 #endif // WRAPPER_CORE_H
\ No newline at end of file
@@ -0,0 +1,96 @@
+// Golden-image regression test for the CPU renderer.
+// Build and run from the repository root:
+//   c++ -std=c++17 -O2 -mavx2 -I. tests/golden.cpp -o golden_test -lX11 -lpthread && ./golden_test
+// References live in tests/golden/; delete both files of a scene to re-record it.
+#define CORE_IMPLEMENTATION
+#define KEYS_IMPLEMENTATION
+#define MATH_IMPLEMENTATION
+#define CAMERA_IMPLEMENTATION
+#define MODEL_IMPLEMENTATION
+#define RENDER3D_IMPLEMENTATION
+#define IMAGE_IMPLEMENTATION
+#define GOLDEN_IMPLEMENTATION
+#include "core.h"
+
+#define WIDTH  160
+#define HEIGHT 120
+
+static int failures = 0;
+
+#define EXPECT(cond) do { if (!(cond)) { fprintf(stderr, "%s:%d: expected %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+static bool check_scene(Window_t *win, const GoldenScene scene, const char *ref_base)
+{
+    Camera cam;
+    Renderer r;
+    Model models[8];
+    GoldenOptions opt;
+    goldenOptionsInit(&opt);
+
+    const int n = goldenBuildScene(scene, models, 8, &cam);
+    renderInit(&r, win, &cam);
+    const bool ok = goldenCheck(&r, models, n, ref_base, &opt);
+    renderFree(&r);
+    for (int i = 0; i < n; i++) modelFree(&models[i]);
+    return ok;
+}
+
+static long file_size(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END);
+    const long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+int main(void)
+{
+    Window_t win;
+    ASSERT(goldenHeadlessInit(&win, WIDTH, HEIGHT));
+
+    // Stored references
+    EXPECT(check_scene(&win, GOLDEN_SCENE_BOXES,     "tests/golden/boxes"));
+    EXPECT(check_scene(&win, GOLDEN_SCENE_INTERSECT, "tests/golden/intersect"));
+    EXPECT(check_scene(&win, GOLDEN_SCENE_SPHERE,    "tests/golden/sphere"));
+
+    // Recording happens only when both files are absent
+    char base[256], ppm[300], pfm[300];
+    snprintf(base, sizeof(base), "/tmp/golden_test_%d", (int)getpid());
+    snprintf(ppm, sizeof(ppm), "%s.ppm", base);
+    snprintf(pfm, sizeof(pfm), "%s.pfm", base);
+    remove(ppm);
+    remove(pfm);
+    EXPECT(check_scene(&win, GOLDEN_SCENE_BOXES, base));
+    EXPECT(file_size(ppm) > 0 && file_size(pfm) > 0);
+    EXPECT(check_scene(&win, GOLDEN_SCENE_BOXES, base));
+
+    // A different scene against them fails
+    EXPECT(!check_scene(&win, GOLDEN_SCENE_SPHERE, base));
+
+    // A resolution change fails and keeps the references
+    const long ppm_size = file_size(ppm), pfm_size = file_size(pfm);
+    Window_t small;
+    ASSERT(goldenHeadlessInit(&small, WIDTH / 2, HEIGHT / 2));
+    EXPECT(!check_scene(&small, GOLDEN_SCENE_BOXES, base));
+    EXPECT(file_size(ppm) == ppm_size && file_size(pfm) == pfm_size);
+    destroyWindow(&small);
+
+    // So do a corrupt file and a missing half
+    FILE *f = fopen(pfm, "wb");
+    ASSERT(f);
+    fputs("Pf\n", f);
+    fclose(f);
+    EXPECT(!check_scene(&win, GOLDEN_SCENE_BOXES, base));
+    EXPECT(file_size(pfm) == 3);
+    remove(pfm);
+    EXPECT(!check_scene(&win, GOLDEN_SCENE_BOXES, base));
+    EXPECT(file_size(pfm) < 0);
+
+    remove(ppm);
+    destroyWindow(&win);
+    if (failures) fprintf(stderr, "%d check(s) failed\n", failures);
+    else printf("golden: all checks passed\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,66 @@
+// Bitmap font test: builds a font from a grid atlas and draws with it.
+// Build and run from the repository root:
+//   c++ -std=c++17 -O2 -mavx2 -I. tests/text.cpp -o text_test -lX11 -lpthread && ./text_test
+#define CORE_IMPLEMENTATION
+#define KEYS_IMPLEMENTATION
+#define MATH_IMPLEMENTATION
+#define IMAGE_IMPLEMENTATION
+#define DRAW2D_IMPLEMENTATION
+#define TEXT_IMPLEMENTATION
+#include "core.h"
+
+static int failures = 0;
+
+#define EXPECT(cond) do { if (!(cond)) { fprintf(stderr, "%s:%d: expected %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+int main(void)
+{
+    // 64x64 atlas of 8x8 cells starting at ' ': 'A' (cell 33) is a solid block, '!' (cell 1) a half-bright column
+    Image atlas;
+    ASSERT(imageCreate(&atlas, 64, 64));
+    for (int y = 0; y < 64; y++)
+        for (int x = 0; x < 64; x++) atlas.pixels[y * atlas.pitch + x] = 0;
+    for (int y = 0; y < 8; y++)
+        for (int x = 0; x < 8; x++) atlas.pixels[(4 * 8 + y) * atlas.pitch + 8 + x] = 0xFFFFFFFF;
+    for (int y = 0; y < 8; y++) atlas.pixels[y * atlas.pitch + 8 + 3] = 0xFF808080;
+
+    BitmapFont font;
+    EXPECT(fontFromAtlas(&font, &atlas, 8, 8, 32));
+    EXPECT(font.coverage != NULL);
+    EXPECT(font.coverage_size == (size_t)64 * 8 * 8);
+    EXPECT(font.line_height == 8 && font.ascent == 8);
+
+    const Glyph *a = &font.glyphs['A'];
+    EXPECT(a->width == 8 && a->height == 8 && a->advance == 8);
+    EXPECT(font.coverage[a->offset] == 255 && font.coverage[a->offset + 63] == 255);
+    const Glyph *bang = &font.glyphs['!'];
+    EXPECT(font.coverage[bang->offset + 3] == 128 && font.coverage[bang->offset + 2] == 0);
+
+    int tw = 0, th = 0;
+    fontMeasure(&font, "A!A", &tw, &th);
+    EXPECT(tw == 24 && th == 8);
+
+    Window_t win;
+    windowInit(&win);
+    win.width = win.bWidth = 32;
+    win.height = win.bHeight = 16;
+    ASSERT(resizeBuffer(&win));
+    memset(win.buffer, 0, (size_t)win.bWidth * win.bHeight * sizeof(uint32_t));
+    drawText(&win, &font, 2, 4, "A!", 0xFF00FF00);
+    EXPECT((win.buffer[4 * win.bWidth + 2] & 0x00FFFFFF) == 0x0000FF00);
+    EXPECT((win.buffer[11 * win.bWidth + 9] & 0x00FFFFFF) == 0x0000FF00);
+    EXPECT(win.buffer[3 * win.bWidth + 2] == 0 && win.buffer[4 * win.bWidth + 10] == 0);
+    EXPECT(((win.buffer[4 * win.bWidth + 13] >> 8) & 0xFF) >= 127 && ((win.buffer[4 * win.bWidth + 13] >> 8) & 0xFF) <= 129);
+
+    // A second load reuses nothing from the first
+    fontFree(&font);
+    EXPECT(fontFromAtlas(&font, &atlas, 16, 16, 0));
+    EXPECT(font.coverage_size == (size_t)16 * 16 * 16);
+    fontFree(&font);
+
+    imageFree(&atlas);
+    destroyWindow(&win);
+    if (failures) fprintf(stderr, "%d check(s) failed\n", failures);
+    else printf("text: all checks passed\n");
+    return failures ? 1 : 0;
+}